@@ -1613,6 +1613,89 @@ static void test_reg_unload_key(void)
     DeleteFileA("saved_key.LOG");
 }
 
+/* Wine saves registry changes to a journal appended to the hive file, check that
+ * the entries replace the previous values and that an entry that was only partly
+ * written when the server went down is ignored. */
+static void test_reg_load_journal(void)
+{
+    static const char journal[] =
+        "WINE REGISTRY Version 2\n"
+        "#base=0:0:0:0.0\n"
+        "\n[Replay] 0\n"
+        "\"a\"=dword:00000001\n"
+        "\"b\"=dword:00000002\n"
+        ";; commit\n"
+        "\n[Replay] 0\n"
+        "#replace\n"
+        "\"b\"=dword:00000003\n"
+        "\"c\"=\"new\"\n"
+        "\n[Replay\\\\Sub] 0\n"
+        "\"d\"=dword:00000004\n"
+        ";; commit\n"
+        "\n[Replay] 0\n"
+        "#replace\n"
+        "\"b\"=dword:00000005\n"
+        "\n[Torn] 0\n"
+        "\"e\"=dword:0000";
+    char path[MAX_PATH], buffer[16];
+    DWORD ret, size, written, value;
+    HANDLE file;
+    HKEY key;
+
+    if (strcmp(winetest_platform, "wine"))
+    {
+        skip("registry journals are specific to Wine\n");
+        return;
+    }
+
+    GetTempPathA(sizeof(path), path);
+    GetTempFileNameA(path, "reg", 0, path);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile failed, error %lu\n", GetLastError());
+    WriteFile(file, journal, sizeof(journal) - 1, &written, NULL);
+    CloseHandle(file);
+
+    if (!set_privileges(SE_RESTORE_NAME, TRUE) ||
+        !set_privileges(SE_BACKUP_NAME, FALSE))
+    {
+        win_skip("Failed to set SE_RESTORE_NAME privileges, skipping tests\n");
+        DeleteFileA(path);
+        return;
+    }
+
+    ret = RegLoadKeyA(HKEY_LOCAL_MACHINE, "JournalTest", path);
+    ok(ret == ERROR_SUCCESS, "RegLoadKey failed, got %ld\n", ret);
+
+    ret = RegOpenKeyExA(HKEY_LOCAL_MACHINE, "JournalTest\\Replay", 0, KEY_READ, &key);
+    ok(ret == ERROR_SUCCESS, "RegOpenKeyEx failed, got %ld\n", ret);
+
+    ret = RegQueryValueExA(key, "a", NULL, NULL, NULL, NULL);
+    ok(ret == ERROR_FILE_NOT_FOUND, "replaced value still present, got %ld\n", ret);
+    size = sizeof(value);
+    ret = RegQueryValueExA(key, "b", NULL, NULL, (BYTE *)&value, &size);
+    ok(ret == ERROR_SUCCESS, "RegQueryValueEx failed, got %ld\n", ret);
+    ok(value == 3, "got %lu, partly written entry was applied\n", value);
+    size = sizeof(buffer);
+    ret = RegQueryValueExA(key, "c", NULL, NULL, (BYTE *)buffer, &size);
+    ok(ret == ERROR_SUCCESS, "RegQueryValueEx failed, got %ld\n", ret);
+    ok(!strcmp(buffer, "new"), "got %s\n", debugstr_a(buffer));
+    size = sizeof(value);
+    ret = RegGetValueA(key, "Sub", "d", RRF_RT_REG_DWORD, NULL, &value, &size);
+    ok(ret == ERROR_SUCCESS, "RegGetValue failed, got %ld\n", ret);
+    ok(value == 4, "got %lu\n", value);
+    RegCloseKey(key);
+
+    ret = RegOpenKeyExA(HKEY_LOCAL_MACHINE, "JournalTest\\Torn", 0, KEY_READ, &key);
+    ok(ret == ERROR_FILE_NOT_FOUND, "partly written key was created, got %ld\n", ret);
+    if (!ret) RegCloseKey(key);
+
+    ret = RegUnLoadKeyA(HKEY_LOCAL_MACHINE, "JournalTest");
+    ok(ret == ERROR_SUCCESS, "RegUnLoadKey failed, got %ld\n", ret);
+
+    set_privileges(SE_RESTORE_NAME, FALSE);
+    DeleteFileA(path);
+}
+
 /* Helper function to wait for a file blocked by the registry to be available */
 static void wait_file_available(char *path)
 {
@@ -5053,6 +5136,7 @@ START_TEST(registry)
     test_reg_save_key();
     test_reg_load_key();
     test_reg_unload_key();
+    test_reg_load_journal();
     test_reg_load_app_key();
     test_reg_copy_tree();
     test_reg_delete_tree();
@@ -3529,11 +3529,417 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+static const struct
+{
+    const char *name;
+    WORD bpp;
+    DWORD compression;
+    DWORD masks[3];
+} primitive_formats[] =
+{
+    { "8888",      32, BI_RGB },
+    { "r10g10b10", 32, BI_BITFIELDS, { 0x3ff00000, 0x000ffc00, 0x000003ff } },
+    { "24",        24, BI_RGB },
+    { "555",       16, BI_RGB },
+    { "565",       16, BI_BITFIELDS, { 0xf800, 0x07e0, 0x001f } },
+    { "8",          8, BI_RGB },
+    { "4",          4, BI_RGB },
+    { "1",          1, BI_RGB },
+};
+
+static HBITMAP create_primitive_dib( int format, int width, int height, BYTE **bits )
+{
+    char bmibuf[sizeof(BITMAPINFO) + 256 * sizeof(RGBQUAD)];
+    BITMAPINFO *bmi = (BITMAPINFO *)bmibuf;
+    HBITMAP dib;
+    int i;
+
+    memset( bmibuf, 0, sizeof(bmibuf) );
+    bmi->bmiHeader.biSize        = sizeof(bmi->bmiHeader);
+    bmi->bmiHeader.biWidth       = width;
+    bmi->bmiHeader.biHeight      = height;
+    bmi->bmiHeader.biPlanes      = 1;
+    bmi->bmiHeader.biBitCount    = primitive_formats[format].bpp;
+    bmi->bmiHeader.biCompression = primitive_formats[format].compression;
+    if (bmi->bmiHeader.biCompression == BI_BITFIELDS)
+        memcpy( bmi->bmiColors, primitive_formats[format].masks, sizeof(primitive_formats[format].masks) );
+    else if (bmi->bmiHeader.biBitCount <= 8)
+    {
+        for (i = 0; i < 1 << bmi->bmiHeader.biBitCount; i++)
+        {
+            bmi->bmiColors[i].rgbRed   = i * 37;
+            bmi->bmiColors[i].rgbGreen = i * 101;
+            bmi->bmiColors[i].rgbBlue  = i * 59;
+        }
+    }
+
+    dib = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)bits, NULL, 0 );
+    ok( dib != NULL, "CreateDIBSection failed\n" );
+    return dib;
+}
+
+static void fill_random( BYTE *bits, DWORD size, DWORD seed, BOOL premultiply )
+{
+    DWORD i, a;
+
+    for (i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bits[i] = seed >> 16;
+    }
+    if (!premultiply) return;
+    /* mostly premultiplied, with a few invalid pixels */
+    for (i = 0; i + 4 <= size; i += 4)
+    {
+        if (!(i % 68)) continue;
+        a = bits[i + 3];
+        bits[i]     = bits[i] * a / 255;
+        bits[i + 1] = bits[i + 1] * a / 255;
+        bits[i + 2] = bits[i + 2] * a / 255;
+    }
+}
+
+enum primitive_op
+{
+    OP_SOLID, OP_COPY, OP_CONVERT, OP_BLEND, OP_BLEND_CONST, OP_STRETCH, OP_SHRINK, OP_HALFTONE, OP_COUNT
+};
+
+static const char *primitive_op_names[OP_COUNT] =
+{
+    "solid", "copy", "convert", "blend", "blend const", "stretch", "shrink", "halftone"
+};
+
+static void do_primitive_op( enum primitive_op op, HDC dst_dc, HDC src_dc, HDC argb_dc,
+                             int x, int width, int size )
+{
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+
+    switch (op)
+    {
+    case OP_SOLID:
+        PatBlt( dst_dc, x, 0, width, size, PATCOPY );
+        break;
+    case OP_COPY:
+        BitBlt( dst_dc, x, 0, width, size, src_dc, x, 0, SRCCOPY );
+        break;
+    case OP_CONVERT:
+        BitBlt( dst_dc, x, 0, width, size, argb_dc, x, 0, SRCCOPY );
+        break;
+    case OP_BLEND:
+        GdiAlphaBlend( dst_dc, x, 0, width, size, argb_dc, x, 0, width, size, blend );
+        break;
+    case OP_BLEND_CONST:
+        blend.SourceConstantAlpha = 100;
+        blend.AlphaFormat = 0;
+        GdiAlphaBlend( dst_dc, x, 0, width, size, argb_dc, x, 0, width, size, blend );
+        break;
+    case OP_STRETCH:
+        SetStretchBltMode( dst_dc, COLORONCOLOR );
+        StretchBlt( dst_dc, 0, 0, size, size, src_dc, 0, 0, size / 2, size / 2, SRCCOPY );
+        break;
+    case OP_SHRINK:
+        SetStretchBltMode( dst_dc, COLORONCOLOR );
+        StretchBlt( dst_dc, 0, 0, size / 2, size / 2, src_dc, 0, 0, size, size, SRCCOPY );
+        break;
+    case OP_HALFTONE:
+        SetStretchBltMode( dst_dc, HALFTONE );
+        StretchBlt( dst_dc, 0, 0, size / 2, size / 2, src_dc, 0, 0, size, size, SRCCOPY );
+        break;
+    default:
+        break;
+    }
+}
+
+/* Times the drawing primitives for each format and size, the timings are
+ * only traced. Operations that work per pixel are also checked to give the
+ * same result when done in narrow strips, which exercises the row tails. */
+static void test_primitives(void)
+{
+    static const int sizes[] = { 64, 256, 1024 };
+    int format, size_idx, size, iterations = winetest_debug > 1 ? 20 : 1;
+    HDC dst_dc, src_dc, argb_dc;
+    HBITMAP dst_dib, src_dib, argb_dib, orig_dst, orig_src, orig_argb;
+    BYTE *dst_bits, *src_bits, *argb_bits, *copy;
+    LARGE_INTEGER freq, start, end;
+    enum primitive_op op;
+    DWORD dst_size;
+    HBRUSH brush;
+    int i, x;
+
+    QueryPerformanceFrequency( &freq );
+    dst_dc  = CreateCompatibleDC( NULL );
+    src_dc  = CreateCompatibleDC( NULL );
+    argb_dc = CreateCompatibleDC( NULL );
+    brush = CreateSolidBrush( RGB(0x12, 0x9a, 0x5e) );
+    SelectObject( dst_dc, brush );
+
+    for (format = 0; format < ARRAY_SIZE(primitive_formats); format++)
+    {
+        for (size_idx = 0; size_idx < ARRAY_SIZE(sizes); size_idx++)
+        {
+            size = sizes[size_idx];
+            if (size > 64 && winetest_debug <= 1) break;
+
+            dst_dib  = create_primitive_dib( format, size, size, &dst_bits );
+            src_dib  = create_primitive_dib( format, size, size, &src_bits );
+            argb_dib = create_primitive_dib( 0, size, size, &argb_bits );
+            orig_dst  = SelectObject( dst_dc, dst_dib );
+            orig_src  = SelectObject( src_dc, src_dib );
+            orig_argb = SelectObject( argb_dc, argb_dib );
+
+            dst_size = size * size * primitive_formats[format].bpp / 8;
+            fill_random( src_bits, dst_size, 1, FALSE );
+            copy = HeapAlloc( GetProcessHeap(), 0, dst_size );
+
+            for (op = 0; op < OP_COUNT; op++)
+            {
+                fill_random( argb_bits, size * size * 4, 2, TRUE );
+
+                if (op == OP_CONVERT || op == OP_BLEND || op == OP_BLEND_CONST)
+                {
+                    fill_random( dst_bits, dst_size, 3, FALSE );
+                    do_primitive_op( op, dst_dc, src_dc, argb_dc, 0, size, size );
+                    memcpy( copy, dst_bits, dst_size );
+
+                    fill_random( dst_bits, dst_size, 3, FALSE );
+                    for (x = 0; x < size; x += 3)
+                        do_primitive_op( op, dst_dc, src_dc, argb_dc, x, min( 3, size - x ), size );
+                    ok( !memcmp( copy, dst_bits, dst_size ), "%s %d: %s differs when done in strips\n",
+                        primitive_formats[format].name, size, primitive_op_names[op] );
+                }
+
+                QueryPerformanceCounter( &start );
+                for (i = 0; i < iterations; i++)
+                    do_primitive_op( op, dst_dc, src_dc, argb_dc, 0, size, size );
+                GdiFlush();
+                QueryPerformanceCounter( &end );
+
+                if (winetest_debug > 1)
+                    trace( "%s %dx%d %s: %.1f us\n", primitive_formats[format].name, size, size,
+                           primitive_op_names[op],
+                           (end.QuadPart - start.QuadPart) * 1000000.0 / freq.QuadPart / iterations );
+            }
+
+            HeapFree( GetProcessHeap(), 0, copy );
+            SelectObject( dst_dc, orig_dst );
+            SelectObject( src_dc, orig_src );
+            SelectObject( argb_dc, orig_argb );
+            DeleteObject( dst_dib );
+            DeleteObject( src_dib );
+            DeleteObject( argb_dib );
+        }
+    }
+
+    DeleteDC( dst_dc );
+    DeleteDC( src_dc );
+    DeleteDC( argb_dc );
+    DeleteObject( brush );
+}
+
+enum banded_op
+{
+    BANDED_SOLID, BANDED_HATCH, BANDED_BLEND, BANDED_GRADIENT, BANDED_STRETCH, BANDED_SHRINK, BANDED_COUNT
+};
+
+static const char *banded_op_names[BANDED_COUNT] =
+{
+    "solid", "hatch", "blend", "gradient", "stretch", "shrink"
+};
+
+static void do_banded_op( enum banded_op op, HDC dst_dc, HDC src_dc, int y, int height, int size )
+{
+    BLENDFUNCTION blend = { AC_SRC_OVER, 0, 0x80, 0 };
+    TRIVERTEX vert[2] = { { 0, 0, 0xff00, 0x8000, 0x1000, 0 }, { size, size, 0x0800, 0xf000, 0xc000, 0xff00 } };
+    GRADIENT_RECT rect = { 0, 1 };
+    HRGN rgn;
+
+    switch (op)
+    {
+    case BANDED_SOLID:
+    case BANDED_HATCH:
+        PatBlt( dst_dc, 0, y, size, height, PATINVERT );
+        break;
+    case BANDED_BLEND:
+        GdiAlphaBlend( dst_dc, 0, y, size, height, src_dc, 0, y, size, height, blend );
+        break;
+    case BANDED_GRADIENT:
+        rgn = CreateRectRgn( 0, y, size, y + height );
+        SelectClipRgn( dst_dc, rgn );
+        GdiGradientFill( dst_dc, vert, 2, &rect, 1, GRADIENT_FILL_RECT_V );
+        SelectClipRgn( dst_dc, NULL );
+        DeleteObject( rgn );
+        break;
+    case BANDED_STRETCH:
+    case BANDED_SHRINK:
+        /* stretching in strips would round differently, clip the whole blit instead */
+        SaveDC( dst_dc );
+        IntersectClipRect( dst_dc, 0, y, size, y + height );
+        if (op == BANDED_STRETCH)
+            StretchBlt( dst_dc, 0, 0, size, size, src_dc, 0, 0, size / 3, size / 3, SRCCOPY );
+        else
+            StretchBlt( dst_dc, 0, 0, size / 3, size / 3, src_dc, 0, 0, size, size, SRCCOPY );
+        RestoreDC( dst_dc, -1 );
+        break;
+    default:
+        break;
+    }
+}
+
+/* Large operations on bitmaps that the application can't access directly
+ * may be split into bands drawn by several threads. Check that the result
+ * matches drawing in strips too small to be split, and trace the throughput
+ * of both. */
+static void test_banded_blits(void)
+{
+    static const int size = 1024, strip = 16;
+    HDC dst_dc, src_dc, screen_dc;
+    HBITMAP dst_bmp, src_dib, orig_dst, orig_src;
+    BYTE *src_bits, *init, *copy, *bits;
+    LARGE_INTEGER freq, start, mid, start2, end;
+    enum banded_op op;
+    HBRUSH brush;
+    BITMAP bm;
+    DWORD dst_size;
+    int mono, y;
+
+    QueryPerformanceFrequency( &freq );
+    screen_dc = GetDC( 0 );
+    dst_dc = CreateCompatibleDC( NULL );
+    src_dc = CreateCompatibleDC( NULL );
+    /* a source in another format is converted first, and the copy can be split */
+    src_dib = create_primitive_dib( 2, size, size, &src_bits );
+    orig_src = SelectObject( src_dc, src_dib );
+    fill_random( src_bits, size * size * 3, 4, FALSE );
+
+    for (mono = 0; mono < 2; mono++)
+    {
+        if (mono) dst_bmp = CreateBitmap( size, size, 1, 1, NULL );
+        else dst_bmp = CreateCompatibleBitmap( screen_dc, size, size );
+        ok( dst_bmp != NULL, "failed to create bitmap\n" );
+        GetObjectW( dst_bmp, sizeof(bm), &bm );
+        dst_size = bm.bmWidthBytes * bm.bmHeight;
+        orig_dst = SelectObject( dst_dc, dst_bmp );
+
+        init = HeapAlloc( GetProcessHeap(), 0, dst_size );
+        copy = HeapAlloc( GetProcessHeap(), 0, dst_size );
+        bits = HeapAlloc( GetProcessHeap(), 0, dst_size );
+        fill_random( init, dst_size, 5, FALSE );
+
+        for (op = 0; op < BANDED_COUNT; op++)
+        {
+            if (op == BANDED_HATCH) brush = CreateHatchBrush( HS_DIAGCROSS, RGB(0x40, 0xc0, 0x80) );
+            else brush = CreateSolidBrush( RGB(0x40, 0xc0, 0x80) );
+            SelectObject( dst_dc, brush );
+
+            SetBitmapBits( dst_bmp, dst_size, init );
+            QueryPerformanceCounter( &start );
+            for (y = 0; y < size; y += strip) do_banded_op( op, dst_dc, src_dc, y, strip, size );
+            GdiFlush();
+            QueryPerformanceCounter( &mid );
+            GetBitmapBits( dst_bmp, dst_size, copy );
+
+            SetBitmapBits( dst_bmp, dst_size, init );
+            QueryPerformanceCounter( &start2 );
+            do_banded_op( op, dst_dc, src_dc, 0, size, size );
+            GdiFlush();
+            QueryPerformanceCounter( &end );
+            GetBitmapBits( dst_bmp, dst_size, bits );
+            ok( !memcmp( copy, bits, dst_size ), "%u bpp %s: result differs\n",
+                bm.bmBitsPixel, banded_op_names[op] );
+
+            if (winetest_debug > 1)
+                trace( "%u bpp %s: %.2f ms in strips, %.2f ms at once\n",
+                       bm.bmBitsPixel, banded_op_names[op],
+                       (mid.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart,
+                       (end.QuadPart - start2.QuadPart) * 1000.0 / freq.QuadPart );
+
+            SelectObject( dst_dc, GetStockObject( WHITE_BRUSH ) );
+            DeleteObject( brush );
+        }
+
+        HeapFree( GetProcessHeap(), 0, init );
+        HeapFree( GetProcessHeap(), 0, copy );
+        HeapFree( GetProcessHeap(), 0, bits );
+        SelectObject( dst_dc, orig_dst );
+        DeleteObject( dst_bmp );
+    }
+
+    SelectObject( src_dc, orig_src );
+    DeleteObject( src_dib );
+    DeleteDC( dst_dc );
+    DeleteDC( src_dc );
+    ReleaseDC( 0, screen_dc );
+}
+
+static void draw_font_cache_text( HDC hdc, int height, BOOL aa )
+{
+    WCHAR str[0x180 - 0x21];
+    LOGFONTA lf;
+    HFONT font;
+    RECT rect;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(str); i++) str[i] = 0x21 + i;
+
+    memset( &lf, 0, sizeof(lf) );
+    strcpy( lf.lfFaceName, "Tahoma" );
+    lf.lfHeight = height;
+    lf.lfQuality = aa ? ANTIALIASED_QUALITY : NONANTIALIASED_QUALITY;
+    font = SelectObject( hdc, CreateFontIndirectA( &lf ));
+
+    SetRect( &rect, 0, 0, 512, 512 );
+    FillRect( hdc, &rect, GetStockObject( WHITE_BRUSH ));
+    SetRect( &rect, 0, 0, 512, 0 );
+    DrawTextW( hdc, str, ARRAY_SIZE(str), &rect, DT_WORDBREAK | DT_NOPREFIX );
+    GdiFlush();
+
+    DeleteObject( SelectObject( hdc, font ));
+}
+
+static void test_font_cache(void)
+{
+    static const int size = 512;
+    BYTE *bits, *copy;
+    HBITMAP dib, orig;
+    int aa, height;
+    HDC hdc;
+
+    hdc = CreateCompatibleDC( NULL );
+    dib = create_primitive_dib( 0, size, size, &bits );
+    orig = SelectObject( hdc, dib );
+    copy = HeapAlloc( GetProcessHeap(), 0, size * size * 4 );
+    SetTextColor( hdc, RGB(0x20, 0x40, 0x80) );
+    SetBkMode( hdc, TRANSPARENT );
+
+    for (aa = 0; aa < 2; aa++)
+    {
+        draw_font_cache_text( hdc, 17, aa );
+        memcpy( copy, bits, size * size * 4 );
+
+        /* cached glyphs */
+        draw_font_cache_text( hdc, 17, aa );
+        ok( !memcmp( copy, bits, size * size * 4 ), "aa %d: cached text differs\n", aa );
+
+        /* enough fonts to push the first one out of the cache */
+        for (height = 8; height < 108; height++) draw_font_cache_text( hdc, height, aa );
+        draw_font_cache_text( hdc, 17, aa );
+        ok( !memcmp( copy, bits, size * size * 4 ), "aa %d: text differs after eviction\n", aa );
+    }
+
+    HeapFree( GetProcessHeap(), 0, copy );
+    SelectObject( hdc, orig );
+    DeleteObject( dib );
+    DeleteDC( hdc );
+}
+
 START_TEST(dib)
 {
     CryptAcquireContextW(&crypt_prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 
     test_simple_graphics();
+    test_primitives();
+    test_banded_blits();
+    test_font_cache();
 
     CryptReleaseContext(crypt_prov, 0);
 }
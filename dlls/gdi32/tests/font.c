@@ -7964,6 +7964,62 @@ done:
     DeleteDC(hdc);
 }
 
+static INT CALLBACK font_list_hash_proc( const LOGFONTA *lf, const TEXTMETRICA *tm, DWORD type, LPARAM lparam )
+{
+    const ENUMLOGFONTEXA *elf = (const ENUMLOGFONTEXA *)lf;
+    DWORD *hash = (DWORD *)lparam, face_hash = lf->lfCharSet ^ (tm->tmWeight << 8) ^ (type << 24);
+    const BYTE *ptr;
+
+    for (ptr = elf->elfFullName; *ptr; ptr++) face_hash = face_hash * 31 + *ptr;
+    for (ptr = (const BYTE *)elf->elfStyle; *ptr; ptr++) face_hash = face_hash * 31 + *ptr;
+    hash[0]++;
+    hash[1] += face_hash;  /* independent of the enumeration order */
+    return 1;
+}
+
+static void get_font_list_hash( DWORD hash[2] )
+{
+    LOGFONTA lf;
+    HDC hdc;
+
+    memset( &lf, 0, sizeof(lf) );
+    lf.lfCharSet = DEFAULT_CHARSET;
+    hash[0] = hash[1] = 0;
+    hdc = GetDC( 0 );
+    EnumFontFamiliesExA( hdc, &lf, font_list_hash_proc, (LPARAM)hash, 0 );
+    ReleaseDC( 0, hdc );
+}
+
+/* the font list is loaded from cached data in later processes, it must not change */
+static void test_font_list_in_child( char **argv )
+{
+    char cmdline[MAX_PATH + 64];
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    DWORD hash[2];
+
+    get_font_list_hash( hash );
+    ok( hash[0] > 0, "no fonts enumerated\n" );
+
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    sprintf( cmdline, "%s font font_list %lu %lu", argv[0], hash[0], hash[1] );
+    ok( CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info ),
+        "CreateProcess failed.\n" );
+    wait_child_process( info.hProcess );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+}
+
+static void test_font_list_child( char **argv )
+{
+    DWORD hash[2];
+
+    get_font_list_hash( hash );
+    ok( hash[0] == strtoul( argv[3], NULL, 10 ), "got %lu fonts, expected %s\n", hash[0], argv[3] );
+    ok( hash[1] == strtoul( argv[4], NULL, 10 ), "got hash %lu, expected %s\n", hash[1], argv[4] );
+}
+
 START_TEST(font)
 {
     static const char *test_names[] =
@@ -7982,9 +8038,12 @@ START_TEST(font)
     {
         if (!strcmp(argv[2], "AddFontMemResource"))
             test_AddFontMemResource();
+        else if (!strcmp(argv[2], "font_list") && argc >= 5)
+            test_font_list_child(argv);
         return;
     }
 
+    test_font_list_in_child(argv);
     test_stock_fonts();
     test_logfont();
     test_bitmap_font();
@@ -3727,6 +3727,188 @@ static void test_heap_sizes(void)
     test_heap_size( 0x150000 );
 }
 
+#define CROSS_THREAD_SLOTS 64
+#define CROSS_THREAD_SHARED 256
+
+struct cross_thread_params
+{
+    HANDLE heap;
+    HANDLE start;
+    UINT seed;
+    UINT iterations;
+    void *volatile *shared;
+    BOOL failed;
+};
+
+static UINT next_random( UINT *seed )
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static DWORD WINAPI cross_thread_proc( void *arg )
+{
+    struct cross_thread_params *params = arg;
+    void *blocks[CROSS_THREAD_SLOTS] = {0}, *old;
+    UINT i, j, seed = params->seed;
+
+    WaitForSingleObject( params->start, INFINITE );
+
+    for (i = 0; i < params->iterations; i++)
+    {
+        j = next_random( &seed ) % CROSS_THREAD_SLOTS;
+        if (!blocks[j])
+        {
+            if (!(blocks[j] = HeapAlloc( params->heap, 0, 8 + next_random( &seed ) % 512 ))) params->failed = TRUE;
+            else *(UINT *)blocks[j] = j;
+            continue;
+        }
+
+        if (*(UINT *)blocks[j] != j) params->failed = TRUE;
+        if (next_random( &seed ) % 8)
+        {
+            if (!HeapFree( params->heap, 0, blocks[j] )) params->failed = TRUE;
+        }
+        else
+        {
+            /* let another thread free it */
+            old = InterlockedExchangePointer( (void **)&params->shared[next_random( &seed ) % CROSS_THREAD_SHARED],
+                                              blocks[j] );
+            if (old && !HeapFree( params->heap, 0, old )) params->failed = TRUE;
+        }
+        blocks[j] = NULL;
+    }
+
+    for (j = 0; j < CROSS_THREAD_SLOTS; j++)
+        if (blocks[j] && !HeapFree( params->heap, 0, blocks[j] )) params->failed = TRUE;
+
+    return 0;
+}
+
+/* returns the number of alloc/free operations per second */
+static double test_cross_thread_frees( HANDLE heap, UINT thread_count, UINT iterations )
+{
+    static void *volatile shared[CROSS_THREAD_SHARED];
+    struct cross_thread_params params[16];
+    LARGE_INTEGER start, end, freq;
+    HANDLE threads[16], event;
+    UINT i;
+
+    event = CreateEventW( NULL, TRUE, FALSE, NULL );
+    for (i = 0; i < thread_count; i++)
+    {
+        params[i].heap = heap;
+        params[i].start = event;
+        params[i].seed = i * 7919 + 1;
+        params[i].iterations = iterations;
+        params[i].shared = shared;
+        params[i].failed = FALSE;
+        threads[i] = CreateThread( NULL, 0, cross_thread_proc, &params[i], 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+    }
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    SetEvent( event );
+    WaitForMultipleObjects( thread_count, threads, TRUE, INFINITE );
+    QueryPerformanceCounter( &end );
+
+    for (i = 0; i < thread_count; i++)
+    {
+        ok( !params[i].failed, "thread %u failed\n", i );
+        CloseHandle( threads[i] );
+    }
+    for (i = 0; i < CROSS_THREAD_SHARED; i++)
+    {
+        if (!shared[i]) continue;
+        ok( HeapFree( heap, 0, shared[i] ), "HeapFree failed, error %lu\n", GetLastError() );
+        shared[i] = NULL;
+    }
+    CloseHandle( event );
+
+    ok( HeapValidate( heap, 0, NULL ), "heap is corrupted\n" );
+    return thread_count * iterations * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+}
+
+static void test_heap_threads(void)
+{
+    ULONG compat_info = 2; /* LFH */
+    void *ptrs[64];
+    HANDLE heap;
+    BOOL ret;
+    UINT i;
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( !!heap, "HeapCreate failed, error %lu\n", GetLastError() );
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &compat_info, sizeof(compat_info) );
+    ok( ret, "HeapSetInformation failed, error %lu\n", GetLastError() );
+    test_cross_thread_frees( heap, 4, 10000 );
+
+    /* blocks freed by this thread may stay cached, the heap must still validate */
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) ptrs[i] = HeapAlloc( heap, 0, 24 );
+    for (i = 0; i < ARRAY_SIZE(ptrs); i += 2) ok( HeapFree( heap, 0, ptrs[i] ), "HeapFree failed\n" );
+    ok( HeapValidate( heap, 0, NULL ), "heap is corrupted\n" );
+    for (i = 1; i < ARRAY_SIZE(ptrs); i += 2) ok( HeapFree( heap, 0, ptrs[i] ), "HeapFree failed\n" );
+    ok( HeapValidate( heap, 0, NULL ), "heap is corrupted\n" );
+
+    /* destroy the heap while the threads may still cache some of its blocks */
+    ret = HeapDestroy( heap );
+    ok( ret, "HeapDestroy failed, error %lu\n", GetLastError() );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( !!heap, "HeapCreate failed, error %lu\n", GetLastError() );
+    test_cross_thread_frees( heap, 4, 10000 );
+    ret = HeapDestroy( heap );
+    ok( ret, "HeapDestroy failed, error %lu\n", GetLastError() );
+
+    test_cross_thread_frees( GetProcessHeap(), 4, 10000 );
+}
+
+/* alloc/free throughput with cross-thread frees, only run interactively */
+static void test_heap_threads_perf(void)
+{
+    static const UINT counts[] = {1, 2, 4, 8, 16};
+    ULONG compat_info = 2; /* LFH */
+    char buffer[16];
+    double rate;
+    HANDLE heap;
+    UINT i;
+
+    if (!winetest_interactive) return;
+
+    if (winetest_debug > 1 && GetEnvironmentVariableA( "WINE_HEAP_THREAD_CACHE", buffer, sizeof(buffer) ))
+        trace( "running with WINE_HEAP_THREAD_CACHE=%s\n", buffer );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( !!heap, "HeapCreate failed, error %lu\n", GetLastError() );
+    HeapSetInformation( heap, HeapCompatibilityInformation, &compat_info, sizeof(compat_info) );
+    for (i = 0; i < ARRAY_SIZE(counts); i++)
+    {
+        rate = test_cross_thread_frees( heap, counts[i], 4000000 );
+        if (winetest_debug > 1)
+            trace( "%2u threads: %.0f alloc/free per second, %.0f per thread\n", counts[i], rate, rate / counts[i] );
+    }
+    HeapDestroy( heap );
+}
+
+static void test_heap_threads_child( const char *argv0, const char *name, const char *value )
+{
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup = {.cb = sizeof(startup)};
+    char buffer[MAX_PATH];
+    BOOL ret;
+
+    sprintf( buffer, "%s heap.c threads", argv0 );
+    SetEnvironmentVariableA( name, value );
+    ret = CreateProcessA( NULL, buffer, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    SetEnvironmentVariableA( name, NULL );
+    ok( ret, "failed to create child process error %lu\n", GetLastError() );
+    if (!ret) return;
+
+    wait_child_process( info.hProcess );
+    CloseHandle( info.hThread );
+    CloseHandle( info.hProcess );
+}
+
 START_TEST(heap)
 {
     int argc;
@@ -3737,7 +3919,12 @@ START_TEST(heap)
     argc = winetest_get_mainargs( &argv );
     if (argc >= 3)
     {
-        test_child_heap( argv[2] );
+        if (!strcmp( argv[2], "threads" ))
+        {
+            test_heap_threads();
+            test_heap_threads_perf();
+        }
+        else test_child_heap( argv[2] );
         return;
     }
 
@@ -3764,4 +3951,8 @@ START_TEST(heap)
     }
     else win_skip( "RtlGetNtGlobalFlags not found, skipping heap debug tests\n" );
     test_heap_sizes();
+    test_heap_threads();
+    test_heap_threads_perf();
+    if (!strcmp( winetest_platform, "wine" ))
+        test_heap_threads_child( argv[0], "WINE_HEAP_THREAD_CACHE", "1" );
 }
@@ -4289,6 +4289,237 @@ static void test_HashLinks(void)
     ok(found, "Could not find kernel32\n");
 }
 
+/* runs in a child process, so that the dlls it loads are loaded for the first time */
+static void test_export_lookup(void)
+{
+    static const char *dlls[] = { "ntdll.dll", "kernel32.dll", "kernelbase.dll", "user32.dll", "gdi32.dll",
+                                  "advapi32.dll", "ole32.dll", "oleaut32.dll", "shell32.dll", "shlwapi.dll" };
+    static const char *importers[] = { "comdlg32.dll", "comctl32.dll", "setupapi.dll", "wininet.dll", "msi.dll",
+                                       "mshtml.dll", "urlmon.dll", "propsys.dll" };
+    LARGE_INTEGER start, end, freq;
+    HMODULE modules[ARRAY_SIZE(dlls)];
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names, *functions;
+    const WORD *ordinals;
+    ULONG size, i, j, count = 0;
+    double load_time, lookup_time = 0;
+    const char *name;
+    void *proc;
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < ARRAY_SIZE(dlls); i++)
+    {
+        modules[i] = LoadLibraryA( dlls[i] );
+        ok( modules[i] != NULL, "failed to load %s, error %lu\n", dlls[i], GetLastError() );
+    }
+    QueryPerformanceCounter( &end );
+    load_time = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+    for (i = 0; i < ARRAY_SIZE(dlls); i++)
+    {
+        if (!modules[i]) continue;
+        exports = pRtlImageDirectoryEntryToData( modules[i], TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+        ok( exports != NULL, "%s: no exports\n", dlls[i] );
+        if (!exports) continue;
+
+        names = (const DWORD *)((char *)modules[i] + exports->AddressOfNames);
+        ordinals = (const WORD *)((char *)modules[i] + exports->AddressOfNameOrdinals);
+        functions = (const DWORD *)((char *)modules[i] + exports->AddressOfFunctions);
+
+        QueryPerformanceCounter( &start );
+        for (j = 0; j < exports->NumberOfNames; j++)
+        {
+            name = (const char *)modules[i] + names[j];
+            proc = GetProcAddress( modules[i], name );
+            /* forwarded exports resolve to another module */
+            if (functions[ordinals[j]] >= (char *)exports - (char *)modules[i] &&
+                functions[ordinals[j]] < (char *)exports - (char *)modules[i] + size)
+                continue;
+            if (!strncmp( name, "wine_", 5 )) continue;  /* may be hidden */
+            ok( proc == (char *)modules[i] + functions[ordinals[j]], "%s: got %p for %s\n", dlls[i], proc, name );
+        }
+        proc = GetProcAddress( modules[i], "nonexistent_export" );
+        ok( !proc, "%s: got %p\n", dlls[i], proc );
+        QueryPerformanceCounter( &end );
+
+        lookup_time += (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+        count += exports->NumberOfNames;
+    }
+
+    if (winetest_debug > 1)
+        trace( "loaded %u dlls in %.3f ms, %lu exports resolved in %.3f ms\n", (UINT)ARRAY_SIZE(dlls),
+               load_time * 1000, count, lookup_time * 1000 );
+
+    /* time the import fixups of dlls whose dependencies are already loaded */
+    count = 0;
+    load_time = 0;
+    for (i = 0; i < ARRAY_SIZE(importers); i++)
+    {
+        const IMAGE_IMPORT_DESCRIPTOR *imports;
+        const IMAGE_THUNK_DATA *thunk;
+        HMODULE module;
+
+        if (GetModuleHandleA( importers[i] )) continue;  /* already loaded, no fixups to time */
+
+        QueryPerformanceCounter( &start );
+        module = LoadLibraryA( importers[i] );
+        QueryPerformanceCounter( &end );
+        ok( module != NULL, "failed to load %s, error %lu\n", importers[i], GetLastError() );
+        if (!module) continue;
+        load_time += (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+
+        imports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size );
+        for ( ; imports && imports->Name; imports++)
+        {
+            thunk = (const IMAGE_THUNK_DATA *)((char *)module + imports->FirstThunk);
+            while (thunk++->u1.Function) count++;
+        }
+        FreeLibrary( module );
+    }
+
+    if (winetest_debug > 1)
+        trace( "resolved %lu imports while loading in %.3f ms\n", count, load_time * 1000 );
+
+    for (i = 0; i < ARRAY_SIZE(dlls); i++) if (modules[i]) FreeLibrary( modules[i] );
+}
+
+static void run_export_lookup_child(void)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH + 64];
+    char **argv;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader export_lookup", argv[0] );
+    ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess(%s) error %ld\n", cmdline, GetLastError() );
+    if (!ret) return;
+    wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+}
+
+static void child_loader_cache( const char *dll_name )
+{
+    char path[MAX_PATH];
+    HMODULE module;
+
+    if (!(module = LoadLibraryA( dll_name ))) ExitProcess( 0 );
+    GetModuleFileNameA( module, path, ARRAY_SIZE(path) );
+    if (strstr( path, "ldrcache_a" )) ExitProcess( 1 );
+    if (strstr( path, "ldrcache_b" )) ExitProcess( 2 );
+    ExitProcess( 3 );
+}
+
+static DWORD run_loader_cache_child(void)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    char cmdline[MAX_PATH + 64];
+    char **argv;
+    DWORD ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader loader_cache wldrcache.dll", argv[0] );
+    ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    ok( ret, "CreateProcess(%s) error %ld\n", cmdline, GetLastError() );
+    if (!ret) return 0;
+    ret = WaitForSingleObject( pi.hProcess, 10000 );
+    ok( ret == WAIT_OBJECT_0, "child process failed to terminate\n" );
+    if (ret != WAIT_OBJECT_0) TerminateProcess( pi.hProcess, 0 );
+    GetExitCodeProcess( pi.hProcess, &ret );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+    return ret;
+}
+
+static void test_loader_cache(void)
+{
+    char temp_path[MAX_PATH], dir_a[MAX_PATH], dir_b[MAX_PATH], dll_a[MAX_PATH], dll_b[MAX_PATH];
+    char dll_name[MAX_PATH], *old_path, *path;
+    IMAGE_NT_HEADERS nt_header = nt_header_template;
+    FILETIME dir_time;
+    HANDLE dir;
+    DWORD ret, len;
+    int i;
+
+    nt_header.OptionalHeader.SectionAlignment = page_size;
+    nt_header.OptionalHeader.DllCharacteristics = IMAGE_DLLCHARACTERISTICS_NX_COMPAT;
+    nt_header.OptionalHeader.FileAlignment = page_size;
+    nt_header.OptionalHeader.SizeOfHeaders = sizeof(dos_header) + sizeof(nt_header) + sizeof(IMAGE_SECTION_HEADER);
+    nt_header.OptionalHeader.SizeOfImage = sizeof(dos_header) + sizeof(nt_header) + sizeof(IMAGE_SECTION_HEADER) + page_size;
+    section.SizeOfRawData = sizeof(section_data);
+    section.PointerToRawData = page_size;
+    section.VirtualAddress = page_size;
+    section.Misc.VirtualSize = page_size;
+    create_test_dll_sections( &dos_header, &nt_header, &section, section_data, dll_name );
+
+    GetTempPathA( MAX_PATH, temp_path );
+    sprintf( dir_a, "%sldrcache_a", temp_path );
+    sprintf( dir_b, "%sldrcache_b", temp_path );
+    sprintf( dll_a, "%s\\wldrcache.dll", dir_a );
+    sprintf( dll_b, "%s\\wldrcache.dll", dir_b );
+    CreateDirectoryA( dir_a, NULL );
+    CreateDirectoryA( dir_b, NULL );
+    ret = CopyFileA( dll_name, dll_b, FALSE );
+    ok( ret, "CopyFile failed, error %lu\n", GetLastError() );
+
+    dir = CreateFileA( dir_a, FILE_READ_ATTRIBUTES | FILE_WRITE_ATTRIBUTES,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                       FILE_FLAG_BACKUP_SEMANTICS, 0 );
+    ok( dir != INVALID_HANDLE_VALUE, "failed to open %s, error %lu\n", dir_a, GetLastError() );
+    ret = GetFileTime( dir, NULL, NULL, &dir_time );
+    ok( ret, "GetFileTime failed, error %lu\n", GetLastError() );
+
+    /* search the first directory before the second one */
+    len = GetEnvironmentVariableA( "PATH", NULL, 0 );
+    old_path = HeapAlloc( GetProcessHeap(), 0, len + 1 );
+    path = HeapAlloc( GetProcessHeap(), 0, len + 2 * MAX_PATH + 2 );
+    if (!GetEnvironmentVariableA( "PATH", old_path, len + 1 )) old_path[0] = 0;
+    sprintf( path, "%s;%s;%s", dir_a, dir_b, old_path );
+    SetEnvironmentVariableA( "PATH", path );
+
+    /* the first run records the location, the second one makes sure that
+     * creating the cache itself didn't invalidate it */
+    for (i = 0; i < 2; i++)
+    {
+        ret = run_loader_cache_child();
+        ok( ret == 2, "%d: got %lu\n", i, ret );
+    }
+
+    /* restoring the directory time after adding a new copy doesn't hide it */
+    ret = CopyFileA( dll_name, dll_a, FALSE );
+    ok( ret, "CopyFile failed, error %lu\n", GetLastError() );
+    ret = SetFileTime( dir, NULL, NULL, &dir_time );
+    ok( ret, "SetFileTime failed, error %lu\n", GetLastError() );
+    ret = run_loader_cache_child();
+    ok( ret == 1, "got %lu\n", ret );
+
+    /* and the search result is recorded again */
+    ret = run_loader_cache_child();
+    ok( ret == 1, "got %lu\n", ret );
+
+    /* removing it is noticed as well */
+    DeleteFileA( dll_a );
+    ret = SetFileTime( dir, NULL, NULL, &dir_time );
+    ok( ret, "SetFileTime failed, error %lu\n", GetLastError() );
+    ret = run_loader_cache_child();
+    ok( ret == 2, "got %lu\n", ret );
+
+    SetEnvironmentVariableA( "PATH", old_path );
+    HeapFree( GetProcessHeap(), 0, old_path );
+    HeapFree( GetProcessHeap(), 0, path );
+    CloseHandle( dir );
+    DeleteFileA( dll_a );
+    DeleteFileA( dll_b );
+    DeleteFileA( dll_name );
+    RemoveDirectoryA( dir_a );
+    RemoveDirectoryA( dir_b );
+}
+
 START_TEST(loader)
 {
     int argc;
@@ -4347,6 +4578,16 @@ START_TEST(loader)
         *child_failures = -1;
 
     argc = winetest_get_mainargs(&argv);
+    if (argc > 2 && !strcmp( argv[2], "export_lookup" ))
+    {
+        test_export_lookup();
+        return;
+    }
+    if (argc > 3 && !strcmp( argv[2], "loader_cache" ))
+    {
+        child_loader_cache( argv[3] );
+        return;
+    }
     if (argc > 4)
     {
         test_dll_phase = atoi(argv[4]);
@@ -4372,6 +4613,8 @@ START_TEST(loader)
     test_LoadPackagedLibrary();
     test_wow64_redirection();
     test_HashLinks();
+    run_export_lookup_child();
+    test_loader_cache();
     test_dll_file( "ntdll.dll" );
     test_dll_file( "kernel32.dll" );
     test_dll_file( "advapi32.dll" );
@@ -230,6 +230,7 @@ static Scheduler* (__cdecl *p_Scheduler_Create)(SchedulerPolicy*);
 static Scheduler* (__cdecl *p_CurrentScheduler_Get)(void);
 static void (__cdecl *p_CurrentScheduler_Detach)(void);
 static unsigned int (__cdecl *p_CurrentScheduler_Id)(void);
+static void (__cdecl *p_CurrentScheduler_ScheduleTask)(void (__cdecl*)(void*), void*);
 
 static int (__cdecl *p__memicmp)(const char*, const char*, size_t);
 static int (__cdecl *p__memicmp_l)(const char*, const char*, size_t,_locale_t);
@@ -324,6 +325,7 @@ static BOOL init(void)
         SET(p_SchedulerPolicy_dtor, "??1SchedulerPolicy@Concurrency@@QEAA@XZ");
         SET(p_Scheduler_Create, "?Create@Scheduler@Concurrency@@SAPEAV12@AEBVSchedulerPolicy@2@@Z");
         SET(p_CurrentScheduler_Get, "?Get@CurrentScheduler@Concurrency@@SAPEAVScheduler@2@XZ");
+        SET(p_CurrentScheduler_ScheduleTask, "?ScheduleTask@CurrentScheduler@Concurrency@@SAXP6AXPEAX@Z0@Z");
     } else {
         SET(pSpinWait_ctor_yield, "??0?$_SpinWait@$00@details@Concurrency@@QAE@P6AXXZ@Z");
         SET(pSpinWait_dtor, "??_F?$_SpinWait@$00@details@Concurrency@@QAEXXZ");
@@ -365,6 +367,7 @@ static BOOL init(void)
         SET(p_SchedulerPolicy_dtor, "??1SchedulerPolicy@Concurrency@@QAE@XZ");
         SET(p_Scheduler_Create, "?Create@Scheduler@Concurrency@@SAPAV12@ABVSchedulerPolicy@2@@Z");
         SET(p_CurrentScheduler_Get, "?Get@CurrentScheduler@Concurrency@@SAPAVScheduler@2@XZ");
+        SET(p_CurrentScheduler_ScheduleTask, "?ScheduleTask@CurrentScheduler@Concurrency@@SAXP6AXPAX@Z0@Z");
     }
 
     init_thiscall_thunk();
@@ -995,6 +998,68 @@ static void test_Scheduler(void)
     call_func1(p_SchedulerPolicy_dtor, &policy);
 }
 
+struct blocking_tasks
+{
+    event evt;
+    LONG to_start;
+    LONG running;
+    LONG timeouts;
+    HANDLE done;
+};
+
+/* all tasks but the last one wait for the event, the last one sets it */
+static void __cdecl blocking_task_proc(void *arg)
+{
+    struct blocking_tasks *tasks = arg;
+
+    if (InterlockedDecrement(&tasks->to_start))
+    {
+        if (call_func2(p_event_wait, &tasks->evt, 5000))
+            InterlockedIncrement(&tasks->timeouts);
+    }
+    else
+    {
+        call_func1(p_event_set, &tasks->evt);
+    }
+
+    if (!InterlockedDecrement(&tasks->running))
+        SetEvent(tasks->done);
+}
+
+static void test_ScheduleTask(void)
+{
+    struct blocking_tasks tasks;
+    SchedulerPolicy policy;
+    Scheduler *scheduler;
+    unsigned int i, count;
+    DWORD ret;
+
+    call_func1(p_SchedulerPolicy_ctor, &policy);
+    call_func3(p_SchedulerPolicy_SetConcurrencyLimits, &policy, 1, 2);
+    scheduler = p_Scheduler_Create(&policy);
+    ok(scheduler != NULL, "Scheduler::Create() = NULL\n");
+    call_func1(scheduler->vtable->Attach, scheduler);
+
+    /* one more task than virtual processors, blocked tasks must not keep the last one from running */
+    count = call_func1(scheduler->vtable->GetNumberOfVirtualProcessors, scheduler) + 1;
+    call_func1(p_event_ctor, &tasks.evt);
+    tasks.to_start = tasks.running = count;
+    tasks.timeouts = 0;
+    tasks.done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    for (i = 0; i < count; i++)
+        p_CurrentScheduler_ScheduleTask(blocking_task_proc, &tasks);
+
+    ret = WaitForSingleObject(tasks.done, 20000);
+    ok(ret == WAIT_OBJECT_0, "WaitForSingleObject returned %lu\n", ret);
+    ok(!tasks.timeouts, "%ld tasks timed out waiting for the event\n", tasks.timeouts);
+
+    CloseHandle(tasks.done);
+    call_func1(p_event_dtor, &tasks.evt);
+    p_CurrentScheduler_Detach();
+    call_func1(scheduler->vtable->Release, scheduler);
+    call_func1(p_SchedulerPolicy_dtor, &policy);
+}
+
 static void test__memicmp(void)
 {
     static const char *s1 = "abc";
@@ -1159,6 +1224,7 @@ START_TEST(msvcr100)
 
     test_ExternalContextBase();
     test_Scheduler();
+    test_ScheduleTask();
     test_wmemcpy_s();
     test_wmemmove_s();
     test_fread_s();
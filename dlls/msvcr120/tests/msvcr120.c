@@ -1665,6 +1665,81 @@ static void test_StructuredTaskCollection(void)
     CloseHandle(chore_evt2);
 }
 
+struct range_chore
+{
+    _UnrealizedChore chore;
+    unsigned int start, end;
+    LONG *sum;
+};
+
+/* splits the range like parallel_for does, so most chores are scheduled
+ * from worker threads and have to be stolen to run in parallel */
+static void __cdecl range_chore_proc(_UnrealizedChore *_this)
+{
+    struct range_chore *chore = CONTAINING_RECORD(_this, struct range_chore, chore);
+    _StructuredTaskCollection task_coll;
+    struct range_chore left, right;
+    unsigned int i, mid;
+    LONG sum = 0;
+    int status;
+
+    if (chore->end - chore->start <= 64)
+    {
+        for (i = chore->start; i < chore->end; i++)
+            sum += i % 7;
+        InterlockedAdd(chore->sum, sum);
+        return;
+    }
+
+    mid = chore->start + (chore->end - chore->start) / 2;
+    _UnrealizedChore_ctor(&left.chore, range_chore_proc);
+    left.start = chore->start;
+    left.end = mid;
+    left.sum = chore->sum;
+    _UnrealizedChore_ctor(&right.chore, range_chore_proc);
+    right.start = mid;
+    right.end = chore->end;
+    right.sum = chore->sum;
+
+    call_func2(p__StructuredTaskCollection_ctor, &task_coll, NULL);
+    call_func2(p__StructuredTaskCollection__Schedule, &task_coll, &left.chore);
+    status = p__StructuredTaskCollection__RunAndWait(&task_coll, &right.chore);
+    ok(status == 1, "_StructuredTaskCollection::_RunAndWait failed: %d\n", status);
+    call_func1(p__StructuredTaskCollection_dtor, &task_coll);
+}
+
+static void test_parallel_for(void)
+{
+    static const unsigned int sizes[] = { 1000, 100000, 1000000 };
+    LARGE_INTEGER freq, start, end;
+    struct range_chore chore;
+    LONG sum, expected;
+    unsigned int i, j;
+
+    QueryPerformanceFrequency(&freq);
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        expected = 0;
+        for (j = 0; j < sizes[i]; j++)
+            expected += j % 7;
+
+        sum = 0;
+        _UnrealizedChore_ctor(&chore.chore, range_chore_proc);
+        chore.start = 0;
+        chore.end = sizes[i];
+        chore.sum = &sum;
+
+        QueryPerformanceCounter(&start);
+        range_chore_proc(&chore.chore);
+        QueryPerformanceCounter(&end);
+        ok(sum == expected, "%u: got %ld, expected %ld\n", sizes[i], sum, expected);
+
+        if (winetest_debug > 1)
+            trace("%u iterations: %.3f ms\n", sizes[i],
+                    (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+    }
+}
+
 static void test_strcmp(void)
 {
     int ret = p_strcmp( "abc", "abcd" );
@@ -1719,5 +1794,6 @@ START_TEST(msvcr120)
     test_towctrans();
     test_CurrentContext();
     test_StructuredTaskCollection();
+    test_parallel_for();
     test_strcmp();
 }
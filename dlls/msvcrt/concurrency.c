@@ -95,6 +95,7 @@ union allocator_cache_entry {
 struct scheduler_list {
     struct Scheduler *scheduler;
     struct scheduler_list *next;
+    struct work_queue *queue;
 };
 
 struct beacon {
@@ -112,6 +113,7 @@ typedef struct {
     struct _StructuredTaskCollection *task_collection;
     CRITICAL_SECTION beacons_cs;
     struct list beacons;
+    struct Scheduler *vproc; /* scheduler whose virtual processor runs the context */
 } ExternalContextBase;
 extern const vtable_ptr ExternalContextBase_vtable;
 static void ExternalContextBase_ctor(ExternalContextBase*);
@@ -143,6 +145,22 @@ typedef struct Scheduler {
         void, (Scheduler*,void (__cdecl*)(void*),void*), (this,proc,data))
 #endif
 
+struct work_item {
+    void (__cdecl *proc)(void*);
+    void *data;
+};
+
+/* Ring buffer of work items. Contexts push their chores and pop them in
+ * LIFO order, virtual processors steal the oldest ones from the tail. */
+struct work_queue {
+    struct list entry;
+    SRWLOCK lock;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int size;
+    struct work_item *items;
+};
+
 typedef struct {
     Scheduler scheduler;
     LONG ref;
@@ -153,7 +171,10 @@ typedef struct {
     int shutdown_size;
     HANDLE *shutdown_events;
     CRITICAL_SECTION cs;
-    struct list scheduled_chores;
+    struct list queues;
+    struct work_queue tasks;
+    TP_WORK *work;
+    LONG active_vprocs;
 } ThreadScheduler;
 extern const vtable_ptr ThreadScheduler_vtable;
 
@@ -219,11 +240,6 @@ typedef struct _UnrealizedChore
     void *unk[6];
 } _UnrealizedChore;
 
-struct scheduled_chore {
-    struct list entry;
-    _UnrealizedChore *chore;
-};
-
 /* keep in sync with msvcp90/msvcp90.h */
 typedef struct cs_queue
 {
@@ -957,19 +973,31 @@ bool __thiscall ExternalContextBase_IsSynchronouslyBlocked(const ExternalContext
     return this->blocked >= 1;
 }
 
+static void release_vproc(struct Scheduler *scheduler);
+static void reclaim_vproc(struct Scheduler *scheduler);
+
 DEFINE_THISCALL_WRAPPER(ExternalContextBase_Block, 4)
 void __thiscall ExternalContextBase_Block(ExternalContextBase *this)
 {
+    struct Scheduler *vproc = this->vproc;
     LONG blocked;
 
     TRACE("(%p)->()\n", this);
 
     blocked = InterlockedIncrement(&this->blocked);
+    if (blocked < 1)
+        return;
+
+    /* let another virtual processor run the scheduler's work while we wait */
+    if (vproc)
+        release_vproc(vproc);
     while (blocked >= 1)
     {
         RtlWaitOnAddress(&this->blocked, &blocked, sizeof(LONG), NULL);
         blocked = this->blocked;
     }
+    if (vproc)
+        reclaim_vproc(vproc);
 }
 
 DEFINE_THISCALL_WRAPPER(ExternalContextBase_Yield, 4)
@@ -1046,24 +1074,7 @@ int __thiscall ExternalContextBase_GetContextKind(const ExternalContextBase *thi
     return 0;
 }
 
-static void remove_scheduled_chores(Scheduler *scheduler, const ExternalContextBase *context)
-{
-    ThreadScheduler *tscheduler = (ThreadScheduler*)scheduler;
-    struct scheduled_chore *sc, *next;
-
-    if (tscheduler->scheduler.vtable != &ThreadScheduler_vtable)
-        return;
-
-    EnterCriticalSection(&tscheduler->cs);
-    LIST_FOR_EACH_ENTRY_SAFE(sc, next, &tscheduler->scheduled_chores,
-                             struct scheduled_chore, entry) {
-        if (sc->chore->task_collection->context == &context->context) {
-            list_remove(&sc->entry);
-            operator_delete(sc);
-        }
-    }
-    LeaveCriticalSection(&tscheduler->cs);
-}
+static void release_context_queue(struct scheduler_list *entry, BOOL keep_chores);
 
 static void ExternalContextBase_dtor(ExternalContextBase *this)
 {
@@ -1080,12 +1091,12 @@ static void ExternalContextBase_dtor(ExternalContextBase *this)
     }
 
     if (this->scheduler.scheduler) {
-        remove_scheduled_chores(this->scheduler.scheduler, this);
+        release_context_queue(&this->scheduler, FALSE);
         call_Scheduler_Release(this->scheduler.scheduler);
 
         for(scheduler_cur=this->scheduler.next; scheduler_cur; scheduler_cur=scheduler_next) {
             scheduler_next = scheduler_cur->next;
-            remove_scheduled_chores(scheduler_cur->scheduler, this);
+            release_context_queue(scheduler_cur, FALSE);
             call_Scheduler_Release(scheduler_cur->scheduler);
             operator_delete(scheduler_cur);
         }
@@ -1391,7 +1402,6 @@ void __thiscall SchedulerPolicy_dtor(SchedulerPolicy *this)
 static void ThreadScheduler_dtor(ThreadScheduler *this)
 {
     int i;
-    struct scheduled_chore *sc, *next;
 
     if(this->ref != 0) WARN("ref = %ld\n", this->ref);
     SchedulerPolicy_dtor(&this->policy);
@@ -1403,11 +1413,13 @@ static void ThreadScheduler_dtor(ThreadScheduler *this)
     this->cs.DebugInfo->Spare[0] = 0;
     DeleteCriticalSection(&this->cs);
 
-    if (!list_empty(&this->scheduled_chores))
-        ERR("scheduled chore list is not empty\n");
-    LIST_FOR_EACH_ENTRY_SAFE(sc, next, &this->scheduled_chores,
-            struct scheduled_chore, entry)
-        operator_delete(sc);
+    if (this->work)
+        CloseThreadpoolWork(this->work);
+    if (!list_empty(&this->queues))
+        ERR("context queue list is not empty\n");
+    if (this->tasks.head != this->tasks.tail)
+        ERR("scheduled task list is not empty\n");
+    free(this->tasks.items);
 }
 
 DEFINE_THISCALL_WRAPPER(ThreadScheduler_Id, 4)
@@ -1499,6 +1511,7 @@ void __thiscall ThreadScheduler_Attach(ThreadScheduler *this)
         context->scheduler.next = l;
     }
     context->scheduler.scheduler = &this->scheduler;
+    context->scheduler.queue = NULL;
     ThreadScheduler_Reference(this);
 }
 
@@ -1517,69 +1530,308 @@ DEFINE_THISCALL_WRAPPER(ThreadScheduler_CreateScheduleGroup, 4)
     return NULL;
 }
 
-typedef struct
+static void work_queue_init(struct work_queue *queue)
 {
-    void (__cdecl *proc)(void*);
-    void *data;
-    ThreadScheduler *scheduler;
-} schedule_task_arg;
+    memset(queue, 0, sizeof(*queue));
+    InitializeSRWLock(&queue->lock);
+}
+
+static BOOL work_queue_push(struct work_queue *queue, void (__cdecl *proc)(void*), void *data)
+{
+    struct work_item *items;
+    unsigned int i, size;
+
+    AcquireSRWLockExclusive(&queue->lock);
+    if (queue->head - queue->tail == queue->size)
+    {
+        size = queue->size ? queue->size * 2 : 32;
+        if (!(items = malloc(size * sizeof(*items))))
+        {
+            ReleaseSRWLockExclusive(&queue->lock);
+            return FALSE;
+        }
+        for (i = queue->tail; i != queue->head; i++)
+            items[i & (size - 1)] = queue->items[i & (queue->size - 1)];
+        free(queue->items);
+        queue->items = items;
+        queue->size = size;
+    }
+    queue->items[queue->head & (queue->size - 1)].proc = proc;
+    queue->items[queue->head & (queue->size - 1)].data = data;
+    queue->head++;
+    ReleaseSRWLockExclusive(&queue->lock);
+    return TRUE;
+}
+
+static void __cdecl run_chore(void *data)
+{
+    _UnrealizedChore *chore = data;
+    chore->chore_wrapper(chore);
+}
+
+/* Pops the newest (lifo) or oldest item. If task_collection is set, only
+ * chores belonging to it are returned. Canceled items are skipped. */
+static BOOL work_queue_pop(struct work_queue *queue, BOOL lifo,
+        const _StructuredTaskCollection *task_collection, struct work_item *ret)
+{
+    struct work_item *item;
+    BOOL found = FALSE;
+
+    if (queue->head == queue->tail)
+        return FALSE;
+
+    AcquireSRWLockExclusive(&queue->lock);
+    while (queue->head != queue->tail)
+    {
+        item = &queue->items[(lifo ? queue->head - 1 : queue->tail) & (queue->size - 1)];
+        if (item->proc && task_collection && (item->proc != run_chore ||
+                ((_UnrealizedChore*)item->data)->task_collection != task_collection))
+            break;
+
+        if (lifo) queue->head--;
+        else queue->tail++;
+        if (item->proc)
+        {
+            *ret = *item;
+            found = TRUE;
+            break;
+        }
+    }
+    ReleaseSRWLockExclusive(&queue->lock);
+    return found;
+}
+
+static LONG work_queue_cancel(struct work_queue *queue, const _StructuredTaskCollection *task_collection)
+{
+    struct work_item *item;
+    _UnrealizedChore *chore;
+    LONG removed = 0;
+    unsigned int i;
+
+    AcquireSRWLockExclusive(&queue->lock);
+    for (i = queue->tail; i != queue->head; i++)
+    {
+        item = &queue->items[i & (queue->size - 1)];
+        if (item->proc != run_chore)
+            continue;
+        chore = item->data;
+        if (chore->task_collection != task_collection)
+            continue;
+        chore->task_collection = NULL;
+        item->proc = NULL;
+        removed++;
+    }
+    ReleaseSRWLockExclusive(&queue->lock);
+    return removed;
+}
+
+static void throw_allocation_error(HRESULT hr)
+{
+    scheduler_resource_allocation_error e;
+    scheduler_resource_allocation_error_ctor_name(&e, NULL, hr);
+    _CxxThrowException(&e, &scheduler_resource_allocation_error_exception_type);
+}
 
 void __cdecl CurrentScheduler_Detach(void);
 
-static void WINAPI schedule_task_proc(PTP_CALLBACK_INSTANCE instance, void *context, PTP_WORK work)
+static BOOL ThreadScheduler_get_work(ThreadScheduler *this, struct work_item *item)
 {
-    schedule_task_arg arg;
-    BOOL detach = FALSE;
+    ExternalContextBase *context = (ExternalContextBase*)get_current_context();
+    struct work_queue *queue;
+    BOOL ret = FALSE;
 
-    arg = *(schedule_task_arg*)context;
-    operator_delete(context);
+    if (context->scheduler.scheduler == &this->scheduler && context->scheduler.queue &&
+            work_queue_pop(context->scheduler.queue, TRUE, NULL, item))
+        return TRUE;
+    if (work_queue_pop(&this->tasks, FALSE, NULL, item))
+        return TRUE;
 
-    if(&arg.scheduler->scheduler != get_current_scheduler()) {
-        ThreadScheduler_Attach(arg.scheduler);
+    EnterCriticalSection(&this->cs);
+    LIST_FOR_EACH_ENTRY(queue, &this->queues, struct work_queue, entry)
+    {
+        if ((ret = work_queue_pop(queue, FALSE, NULL, item)))
+        {
+            /* rotate the list so the next steal starts with another context */
+            list_remove(&this->queues);
+            list_add_after(&queue->entry, &this->queues);
+            break;
+        }
+    }
+    LeaveCriticalSection(&this->cs);
+    return ret;
+}
+
+static BOOL ThreadScheduler_has_work(ThreadScheduler *this)
+{
+    struct work_queue *queue;
+    BOOL ret = this->tasks.head != this->tasks.tail;
+
+    EnterCriticalSection(&this->cs);
+    LIST_FOR_EACH_ENTRY(queue, &this->queues, struct work_queue, entry)
+    {
+        if (ret) break;
+        ret = queue->head != queue->tail;
+    }
+    LeaveCriticalSection(&this->cs);
+    return ret;
+}
+
+static BOOL ThreadScheduler_claim_vproc(ThreadScheduler *this)
+{
+    LONG active, prev = this->active_vprocs;
+
+    do
+    {
+        active = prev;
+        if (active >= this->virt_proc_no)
+            return FALSE;
+    } while ((prev = InterlockedCompareExchange(&this->active_vprocs, active + 1, active)) != active);
+    return TRUE;
+}
+
+static void WINAPI vproc_proc(PTP_CALLBACK_INSTANCE instance, void *context, PTP_WORK work)
+{
+    ThreadScheduler *scheduler = context;
+    ExternalContextBase *ctx;
+    struct work_item item;
+    BOOL detach = FALSE;
+
+    if(&scheduler->scheduler != get_current_scheduler()) {
+        ThreadScheduler_Attach(scheduler);
         detach = TRUE;
     }
-    ThreadScheduler_Release(arg.scheduler);
+    ctx = (ExternalContextBase*)get_current_context();
 
-    arg.proc(arg.data);
+    /* if all virtual processors are busy the task is left in the queue,
+     * they recheck for work before going idle */
+    while (ThreadScheduler_claim_vproc(scheduler))
+    {
+        ctx->vproc = &scheduler->scheduler;
+        while (scheduler->active_vprocs <= scheduler->virt_proc_no &&
+                ThreadScheduler_get_work(scheduler, &item))
+            item.proc(item.data);
+        ctx->vproc = NULL;
+
+        /* recheck after releasing the virtual processor, work queued
+         * while we were leaving may not have submitted a new one */
+        InterlockedDecrement(&scheduler->active_vprocs);
+        if (!ThreadScheduler_has_work(scheduler))
+            break;
+    }
 
     if(detach)
         CurrentScheduler_Detach();
+    ThreadScheduler_Release(scheduler);
 }
 
-DEFINE_THISCALL_WRAPPER(ThreadScheduler_ScheduleTask_loc, 16)
-void __thiscall ThreadScheduler_ScheduleTask_loc(ThreadScheduler *this,
-        void (__cdecl *proc)(void*), void* data, /*location*/void *placement)
+static void ThreadScheduler_submit(ThreadScheduler *this)
 {
-    schedule_task_arg *arg;
-    TP_WORK *work;
+    TP_WORK *work = this->work;
 
-    FIXME("(%p %p %p %p) stub\n", this, proc, data, placement);
+    if (!work)
+    {
+        EnterCriticalSection(&this->cs);
+        if (!(work = this->work))
+            work = this->work = CreateThreadpoolWork(vproc_proc, this, NULL);
+        LeaveCriticalSection(&this->cs);
+        if (!work)
+            throw_allocation_error(HRESULT_FROM_WIN32(GetLastError()));
+    }
 
-    arg = operator_new(sizeof(*arg));
-    arg->proc = proc;
-    arg->data = data;
-    arg->scheduler = this;
     ThreadScheduler_Reference(this);
+    SubmitThreadpoolWork(work);
+}
 
-    work = CreateThreadpoolWork(schedule_task_proc, arg, NULL);
-    if(!work) {
-        scheduler_resource_allocation_error e;
+static void ThreadScheduler_wake_vproc(ThreadScheduler *this)
+{
+    if (InterlockedCompareExchange(&this->active_vprocs, 0, 0) < this->virt_proc_no)
+        ThreadScheduler_submit(this);
+}
 
-        ThreadScheduler_Release(this);
-        operator_delete(arg);
-        scheduler_resource_allocation_error_ctor_name(&e, NULL,
-                HRESULT_FROM_WIN32(GetLastError()));
-        _CxxThrowException(&e, &scheduler_resource_allocation_error_exception_type);
-    }
-    SubmitThreadpoolWork(work);
-    CloseThreadpoolWork(work);
+/* called when a context running on a virtual processor blocks */
+static void release_vproc(struct Scheduler *scheduler)
+{
+    ThreadScheduler *this = (ThreadScheduler*)scheduler;
+
+    InterlockedDecrement(&this->active_vprocs);
+    if (ThreadScheduler_has_work(this))
+        ThreadScheduler_wake_vproc(this);
+}
+
+/* called when the blocked context resumes, the scheduler may be oversubscribed
+ * until one of its virtual processors runs out of work */
+static void reclaim_vproc(struct Scheduler *scheduler)
+{
+    ThreadScheduler *this = (ThreadScheduler*)scheduler;
+
+    InterlockedIncrement(&this->active_vprocs);
+}
+
+static struct work_queue *get_context_queue(ExternalContextBase *context, ThreadScheduler *scheduler)
+{
+    struct work_queue *queue = context->scheduler.queue;
+
+    if (queue)
+        return queue;
+
+    if (!(queue = malloc(sizeof(*queue))))
+        throw_allocation_error(E_OUTOFMEMORY);
+    work_queue_init(queue);
+
+    EnterCriticalSection(&scheduler->cs);
+    list_add_tail(&scheduler->queues, &queue->entry);
+    context->scheduler.queue = queue;
+    LeaveCriticalSection(&scheduler->cs);
+    return queue;
+}
+
+static void release_context_queue(struct scheduler_list *entry, BOOL keep_chores)
+{
+    ThreadScheduler *scheduler = (ThreadScheduler*)entry->scheduler;
+    struct work_queue *queue = entry->queue;
+    struct work_item item;
+    BOOL moved = FALSE;
+
+    if (!queue)
+        return;
+
+    /* the queue may be used by _StructuredTaskCollection__Cancel while the
+     * scheduler lock is held */
+    EnterCriticalSection(&scheduler->cs);
+    entry->queue = NULL;
+    list_remove(&queue->entry);
+    LeaveCriticalSection(&scheduler->cs);
+
+    /* hand pending chores over to the scheduler, they are dropped if the
+     * context is destroyed */
+    while (keep_chores && work_queue_pop(queue, FALSE, NULL, &item))
+        moved |= work_queue_push(&scheduler->tasks, item.proc, item.data);
+
+    free(queue->items);
+    free(queue);
+    if (moved)
+        ThreadScheduler_wake_vproc(scheduler);
+}
+
+DEFINE_THISCALL_WRAPPER(ThreadScheduler_ScheduleTask_loc, 16)
+void __thiscall ThreadScheduler_ScheduleTask_loc(ThreadScheduler *this,
+        void (__cdecl *proc)(void*), void* data, /*location*/void *placement)
+{
+    TRACE("(%p %p %p %p)\n", this, proc, data, placement);
+
+    if (placement)
+        FIXME("placement not supported\n");
+
+    if (!work_queue_push(&this->tasks, proc, data))
+        throw_allocation_error(E_OUTOFMEMORY);
+    ThreadScheduler_submit(this);
 }
 
 DEFINE_THISCALL_WRAPPER(ThreadScheduler_ScheduleTask, 12)
 void __thiscall ThreadScheduler_ScheduleTask(ThreadScheduler *this,
         void (__cdecl *proc)(void*), void* data)
 {
-    FIXME("(%p %p %p) stub\n", this, proc, data);
+    TRACE("(%p %p %p)\n", this, proc, data);
     ThreadScheduler_ScheduleTask_loc(this, proc, data, NULL);
 }
 
@@ -1634,7 +1886,10 @@ static ThreadScheduler* ThreadScheduler_ctor(ThreadScheduler *this,
     InitializeCriticalSection(&this->cs);
     this->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": ThreadScheduler");
 
-    list_init(&this->scheduled_chores);
+    list_init(&this->queues);
+    work_queue_init(&this->tasks);
+    this->work = NULL;
+    this->active_vprocs = 0;
     return this;
 }
 
@@ -1712,6 +1967,7 @@ void __cdecl CurrentScheduler_Detach(void)
         _CxxThrowException(&e, &improper_scheduler_detach_exception_type);
     }
 
+    release_context_queue(&context->scheduler, TRUE);
     call_Scheduler_Release(context->scheduler.scheduler);
     if(!context->scheduler.next) {
         context->scheduler.scheduler = NULL;
@@ -1719,6 +1975,7 @@ void __cdecl CurrentScheduler_Detach(void)
         struct scheduler_list *entry = context->scheduler.next;
         context->scheduler.scheduler = entry->scheduler;
         context->scheduler.next = entry->next;
+        context->scheduler.queue = entry->queue;
         operator_delete(entry);
     }
 }
@@ -2117,8 +2374,8 @@ void __thiscall _StructuredTaskCollection__Cancel(
 {
     ThreadScheduler *scheduler;
     void *prev_exception, *new_exception;
-    struct scheduled_chore *sc, *next;
     LONG removed = 0, finished = 1;
+    struct work_queue *queue;
     struct beacon *beacon;
 
     TRACE("(%p)\n", this);
@@ -2147,17 +2404,13 @@ void __thiscall _StructuredTaskCollection__Cancel(
     }
     LeaveCriticalSection(&((ExternalContextBase*)this->context)->beacons_cs);
 
+    /* the context queue is freed by release_context_queue under the scheduler lock */
     EnterCriticalSection(&scheduler->cs);
-    LIST_FOR_EACH_ENTRY_SAFE(sc, next, &scheduler->scheduled_chores,
-                             struct scheduled_chore, entry) {
-        if (sc->chore->task_collection != this)
-            continue;
-        sc->chore->task_collection = NULL;
-        list_remove(&sc->entry);
-        removed++;
-        operator_delete(sc);
-    }
+    if (((ExternalContextBase*)this->context)->scheduler.scheduler == &scheduler->scheduler &&
+            (queue = ((ExternalContextBase*)this->context)->scheduler.queue))
+        removed += work_queue_cancel(queue, this);
     LeaveCriticalSection(&scheduler->cs);
+    removed += work_queue_cancel(&scheduler->tasks, this);
     if (!removed)
         return;
 
@@ -2265,46 +2518,11 @@ static void __cdecl chore_wrapper(_UnrealizedChore *chore)
     __FINALLY_CTX(chore_wrapper_finally, chore)
 }
 
-static BOOL pick_and_execute_chore(ThreadScheduler *scheduler)
-{
-    struct list *entry;
-    struct scheduled_chore *sc;
-    _UnrealizedChore *chore;
-
-    TRACE("(%p)\n", scheduler);
-
-    if (scheduler->scheduler.vtable != &ThreadScheduler_vtable)
-    {
-        ERR("unknown scheduler set\n");
-        return FALSE;
-    }
-
-    EnterCriticalSection(&scheduler->cs);
-    entry = list_head(&scheduler->scheduled_chores);
-    if (entry)
-        list_remove(entry);
-    LeaveCriticalSection(&scheduler->cs);
-    if (!entry)
-        return FALSE;
-
-    sc = LIST_ENTRY(entry, struct scheduled_chore, entry);
-    chore = sc->chore;
-    operator_delete(sc);
-
-    chore->chore_wrapper(chore);
-    return TRUE;
-}
-
-static void __cdecl _StructuredTaskCollection_scheduler_cb(void *data)
-{
-    pick_and_execute_chore((ThreadScheduler*)get_current_scheduler());
-}
-
 static bool schedule_chore(_StructuredTaskCollection *this,
-        _UnrealizedChore *chore, Scheduler **pscheduler)
+        _UnrealizedChore *chore, ThreadScheduler **pscheduler)
 {
-    struct scheduled_chore *sc;
     ThreadScheduler *scheduler;
+    struct work_queue *queue;
 
     if (chore->task_collection) {
         invalid_multiple_scheduling e;
@@ -2321,17 +2539,17 @@ static bool schedule_chore(_StructuredTaskCollection *this,
         return FALSE;
     }
 
-    sc = operator_new(sizeof(*sc));
-    sc->chore = chore;
+    queue = get_context_queue((ExternalContextBase*)this->context, scheduler);
 
     chore->task_collection = this;
     chore->chore_wrapper = chore_wrapper;
+    if (!work_queue_push(queue, run_chore, chore)) {
+        chore->task_collection = NULL;
+        throw_allocation_error(E_OUTOFMEMORY);
+    }
     InterlockedIncrement(&this->count);
 
-    EnterCriticalSection(&scheduler->cs);
-    list_add_head(&scheduler->scheduled_chores, &sc->entry);
-    LeaveCriticalSection(&scheduler->cs);
-    *pscheduler = &scheduler->scheduler;
+    *pscheduler = scheduler;
     return TRUE;
 }
 
@@ -2345,15 +2563,12 @@ void __thiscall _StructuredTaskCollection__Schedule_loc(
         _StructuredTaskCollection *this, _UnrealizedChore *chore,
         /*location*/void *placement)
 {
-    Scheduler *scheduler;
+    ThreadScheduler *scheduler;
 
     TRACE("(%p %p %p)\n", this, chore, placement);
 
     if (schedule_chore(this, chore, &scheduler))
-    {
-        call_Scheduler_ScheduleTask_loc(scheduler,
-                _StructuredTaskCollection_scheduler_cb, NULL, placement);
-    }
+        ThreadScheduler_wake_vproc(scheduler);
 }
 
 #endif /* _MSVCR_VER >= 110 */
@@ -2365,15 +2580,12 @@ DEFINE_THISCALL_WRAPPER(_StructuredTaskCollection__Schedule, 8)
 void __thiscall _StructuredTaskCollection__Schedule(
         _StructuredTaskCollection *this, _UnrealizedChore *chore)
 {
-    Scheduler *scheduler;
+    ThreadScheduler *scheduler;
 
     TRACE("(%p %p)\n", this, chore);
 
     if (schedule_chore(this, chore, &scheduler))
-    {
-        call_Scheduler_ScheduleTask(scheduler,
-                _StructuredTaskCollection_scheduler_cb, NULL);
-    }
+        ThreadScheduler_wake_vproc(scheduler);
 }
 
 static void CALLBACK exception_ptr_rethrow_finally(BOOL normal, void *data)
@@ -2407,11 +2619,13 @@ _TaskCollectionStatus __stdcall _StructuredTaskCollection__RunAndWait(
         execute_chore(chore, this);
     }
 
-    if (this->context) {
-        ThreadScheduler *scheduler = get_thread_scheduler_from_context(this->context);
-        if (scheduler) {
-            while (pick_and_execute_chore(scheduler)) ;
-        }
+    /* run the chores that were not stolen yet on the calling thread */
+    if (this->context && get_thread_scheduler_from_context(this->context)) {
+        struct work_queue *queue = ((ExternalContextBase*)this->context)->scheduler.queue;
+        struct work_item item;
+
+        while (queue && work_queue_pop(queue, TRUE, this, &item))
+            item.proc(item.data);
     }
 
     this->event = get_current_context();
@@ -49,6 +49,7 @@
 
 #include "wine/asm.h"
 #include "wine/debug.h"
+#include "wine/simdstr.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
 
@@ -65,6 +66,7 @@ typedef int (CDECL *MSVCRT_matherr_func)(struct _exception *);
 static MSVCRT_matherr_func MSVCRT_default_matherr_func = NULL;
 
 BOOL sse2_supported;
+BOOL avx2_supported;
 static BOOL sse2_enabled;
 
 void msvcrt_init_math( void *module )
@@ -85,6 +87,9 @@ void msvcrt_init_math( void *module )
 #else
     sse2_enabled = sse2_supported;
 #endif
+#ifdef WINE_SIMD_STRINGS
+    avx2_supported = sse2_supported && __wine_cpu_has_avx2();
+#endif
 }
 
 #if defined(__i386__) || defined(__x86_64__)
@@ -33,6 +33,7 @@
 #include "winnls.h"
 #include "wine/asm.h"
 #include "wine/debug.h"
+#include "wine/simdstr.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
 
@@ -1565,6 +1566,12 @@ int CDECL _atoldbl(_LDOUBLE *value, char *str)
 size_t __cdecl strlen(const char *str)
 {
     const char *s = str;
+
+#ifdef WINE_SIMD_STRINGS
+    if (avx2_supported) return __wine_avx2_strlen(str);
+    if (sse2_supported) return __wine_sse2_strlen(str);
+#endif
+
     while (*s) s++;
     return s - str;
 }
@@ -1576,6 +1583,10 @@ size_t CDECL strnlen(const char *s, size_t maxlen)
 {
     size_t i;
 
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_supported) return __wine_sse2_strnlen(s, maxlen);
+#endif
+
     for(i=0; i<maxlen; i++)
         if(!s[i]) break;
 
@@ -2773,6 +2784,11 @@ int __cdecl memcmp(const void *ptr1, const void *ptr2, size_t n)
     if (n < sizeof(uint64_t))
         return memcmp_bytes(p1, p2, n);
 
+#ifdef WINE_SIMD_STRINGS
+    if (avx2_supported) return __wine_avx2_memcmp(p1, p2, n);
+    if (sse2_supported) return __wine_sse2_memcmp(p1, p2, n);
+#endif
+
     align = -(size_t)p1 & (sizeof(uint64_t) - 1);
 
     if ((result = memcmp_bytes(p1, p2, align)))
@@ -3248,6 +3264,9 @@ void *__cdecl memset(void *dst, int c, size_t n)
  */
 char* __cdecl strchr(const char *str, int c)
 {
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_supported) return (char *)__wine_sse2_strchr(str, c);
+#endif
     do
     {
         if (*str == (char)c) return (char*)str;
@@ -3272,6 +3291,11 @@ void* __cdecl memchr(const void *ptr, int c, size_t n)
 {
     const unsigned char *p = ptr;
 
+#ifdef WINE_SIMD_STRINGS
+    if (avx2_supported) return (void *)__wine_avx2_memchr(ptr, c, n);
+    if (sse2_supported) return (void *)__wine_sse2_memchr(ptr, c, n);
+#endif
+
     for (p = ptr; n; n--, p++) if (*p == (unsigned char)c) return (void *)(ULONG_PTR)p;
     return NULL;
 }
@@ -4692,6 +4692,118 @@ static void test_mbsrev(void)
     _setmbcp(cp);
 }
 
+static void test_string_scan(void)
+{
+    size_t (__cdecl *p_strlen)(const char *);
+    char * (__cdecl *p_strchr)(const char *, int);
+    void * (__cdecl *p_memchr)(const void *, int, size_t);
+    int (__cdecl *p_memcmp)(const void *, const void *, size_t);
+    size_t (__cdecl *p_wcslen)(const wchar_t *);
+    wchar_t * (__cdecl *p_wcschr)(const wchar_t *, wchar_t);
+    size_t (__cdecl *p_wcsnlen)(const wchar_t *, size_t);
+    static const size_t sizes[] = { 7, 64, 4000 };
+    LARGE_INTEGER freq, start, end;
+    unsigned char *page, *end_ptr, *cmp;
+    DWORD old_prot;
+    size_t i, len, pad, n, res, sum;
+    wchar_t *w;
+    char *str;
+
+    p_strlen = (void *)GetProcAddress(hMsvcrt, "strlen");
+    p_strchr = (void *)GetProcAddress(hMsvcrt, "strchr");
+    p_memchr = (void *)GetProcAddress(hMsvcrt, "memchr");
+    p_memcmp = (void *)GetProcAddress(hMsvcrt, "memcmp");
+    p_wcslen = (void *)GetProcAddress(hMsvcrt, "wcslen");
+    p_wcschr = (void *)GetProcAddress(hMsvcrt, "wcschr");
+    p_wcsnlen = (void *)GetProcAddress(hMsvcrt, "wcsnlen");
+
+    /* strings ending right before an inaccessible page */
+    page = VirtualAlloc(NULL, 0x2000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(page != NULL, "VirtualAlloc failed\n");
+    VirtualProtect(page + 0x1000, 0x1000, PAGE_NOACCESS, &old_prot);
+    end_ptr = page + 0x1000;
+    cmp = malloc(0x1000);
+
+    for (len = 0; len < 100; len++)
+    {
+        for (pad = 0; pad < 40; pad++)
+        {
+            str = (char *)end_ptr - pad - len - 1;
+            memset(page, 'x', 0x1000);
+            for (i = 0; i < len; i++) str[i] = 'a' + i % 26;
+            str[len] = 0;
+
+            res = p_strlen(str);
+            ok(res == len, "%Iu/%Iu: strlen returned %Iu\n", len, pad, res);
+            ok(p_strchr(str, 0) == str + len, "%Iu/%Iu: wrong strchr result\n", len, pad);
+            ok(p_strchr(str, 'x') == NULL, "%Iu/%Iu: wrong strchr result\n", len, pad);
+            if (len)
+            {
+                ok(p_strchr(str, str[len - 1]) == str + (len - 1) % 26,
+                   "%Iu/%Iu: wrong strchr result\n", len, pad);
+                ok(p_memchr(str, str[len - 1], len) == p_strchr(str, str[len - 1]),
+                   "%Iu/%Iu: wrong memchr result\n", len, pad);
+            }
+            ok(p_memchr(str, 'x', len + 1 + pad) == (pad ? str + len + 1 : NULL),
+               "%Iu/%Iu: wrong memchr result\n", len, pad);
+            ok(p_memchr(str, 'x', len + 1) == NULL, "%Iu/%Iu: wrong memchr result\n", len, pad);
+            for (n = 0; p_strnlen && n <= len + 1; n++)
+            {
+                res = p_strnlen(str, n);
+                ok(res == min(n, len), "%Iu/%Iu: strnlen(%Iu) returned %Iu\n", len, pad, n, res);
+            }
+
+            memcpy(cmp, str, len + 1);
+            ok(!p_memcmp(cmp, str, len + 1), "%Iu/%Iu: memcmp failed\n", len, pad);
+            if (len)
+            {
+                cmp[len / 2]++;
+                ok(p_memcmp(cmp, str, len + 1) > 0, "%Iu/%Iu: memcmp failed\n", len, pad);
+                ok(p_memcmp(str, cmp, len + 1) < 0, "%Iu/%Iu: memcmp failed\n", len, pad);
+            }
+
+            w = (wchar_t *)(end_ptr - (pad + len + 1) * sizeof(wchar_t));
+            for (i = 0; i < len; i++) w[i] = 0x100 + i;
+            w[len] = 0;
+            res = p_wcslen(w);
+            ok(res == len, "%Iu/%Iu: wcslen returned %Iu\n", len, pad, res);
+            ok(p_wcschr(w, 0) == w + len, "%Iu/%Iu: wrong wcschr result\n", len, pad);
+            if (len) ok(p_wcschr(w, 0x100 + len - 1) == w + len - 1, "%Iu/%Iu: wrong wcschr result\n", len, pad);
+            res = p_wcsnlen(w, len / 2);
+            ok(res == len / 2, "%Iu/%Iu: wcsnlen returned %Iu\n", len, pad, res);
+            res = p_wcsnlen(w, len + 1 + pad);
+            ok(res == len, "%Iu/%Iu: wcsnlen returned %Iu\n", len, pad, res);
+        }
+    }
+
+    VirtualFree(page, 0, MEM_RELEASE);
+    free(cmp);
+
+    if (winetest_debug <= 1) return;
+
+    QueryPerformanceFrequency(&freq);
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        len = sizes[i];
+        str = malloc(len + 2);
+        memset(str, 'a', len + 1);
+        str[len + 1] = 0;
+
+        sum = 0;
+        QueryPerformanceCounter(&start);
+        for (n = 0; n < 0x100000 / len; n++)
+        {
+            sum += p_strlen(str + (n & 1));
+            sum += (char *)p_memchr(str + (n & 1), 0, len + 2) - str;
+            sum += p_memcmp(str, str + 1, len);
+        }
+        QueryPerformanceCounter(&end);
+        trace("%Iu bytes: %.3f ns per call (%Iu)\n", len,
+              (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / (3 * n), sum);
+        free(str);
+    }
+}
+
 START_TEST(string)
 {
     char mem[100];
@@ -4853,4 +4965,5 @@ START_TEST(string)
     test__mbbtype();
     test_wcsncpy();
     test_mbsrev();
+    test_string_scan();
 }
@@ -30,6 +30,7 @@
 #include "winnls.h"
 #include "wtypes.h"
 #include "wine/debug.h"
+#include "wine/simdstr.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
 
@@ -2907,6 +2908,10 @@ size_t CDECL wcsnlen(const wchar_t *s, size_t maxlen)
 {
     size_t i;
 
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_supported && !((ULONG_PTR)s & 1)) return __wine_sse2_wcsnlen(s, maxlen);
+#endif
+
     for (i = 0; i < maxlen; i++)
         if (!s[i]) break;
     return i;
@@ -2949,6 +2954,9 @@ wint_t CDECL towupper(wint_t c)
  */
 wchar_t* CDECL wcschr(const wchar_t *str, wchar_t ch)
 {
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_supported && !((ULONG_PTR)str & 1)) return (WCHAR *)__wine_sse2_wcschr(str, ch);
+#endif
     do { if (*str == ch) return (WCHAR *)(ULONG_PTR)str; } while (*str++);
     return NULL;
 }
@@ -2969,6 +2977,15 @@ wchar_t* CDECL wcsrchr(const wchar_t *str, wchar_t ch)
 size_t CDECL wcslen(const wchar_t *str)
 {
     const wchar_t *s = str;
+
+#ifdef WINE_SIMD_STRINGS
+    if (!((ULONG_PTR)str & 1))
+    {
+        if (avx2_supported) return __wine_avx2_wcslen(str);
+        if (sse2_supported) return __wine_sse2_wcslen(str);
+    }
+#endif
+
     while (*s) s++;
     return s - str;
 }
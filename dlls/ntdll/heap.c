@@ -251,6 +251,7 @@ C_ASSERT( BIN_SIZE_STEP_7 + 3 * BLOCK_ALIGN <= FIELD_MAX( struct block, tail_siz
 
 static BYTE affinity_mapping[] = {20,6,31,15,14,29,27,4,18,24,26,13,0,9,2,30,17,7,23,25,10,19,12,3,22,21,5,16,1,28,11,8};
 static LONG next_thread_affinity;
+static LONG next_heap_id;
 
 /* a bin, tracking heap blocks of a certain size */
 struct bin
@@ -276,6 +277,34 @@ static inline struct group **bin_get_affinity_group( struct bin *bin, BYTE affin
     return bin->affinity_group_base + affinity * BLOCK_SIZE_BIN_COUNT;
 }
 
+/* optional heap statistics, see WINE_HEAP_STATS */
+
+#define HEAP_STATS_SITE_COUNT 1024
+#define HEAP_STATS_SKIP_FRAMES 3  /* heap_stats_sample, heap_stats_alloc, RtlAllocateHeap */
+
+struct bin_stats
+{
+    LONG64 allocs;
+    LONG64 frees;
+    LONG64 live_blocks;
+    LONG64 live_bytes;
+};
+
+struct alloc_site
+{
+    ULONG  hash;
+    ULONG64 samples;
+    ULONG64 bytes;
+    void  *frames[HEAP_WINE_SITE_FRAMES];
+};
+
+struct heap_stats
+{
+    struct bin_stats  bins[BLOCK_SIZE_BIN_COUNT];
+    ULONG64           dropped;
+    struct alloc_site sites[HEAP_STATS_SITE_COUNT];
+};
+
 struct heap
 {                                  /* win32/win64 */
     DWORD_PTR        unknown1[2];   /* 0000/0000 */
@@ -295,6 +324,8 @@ struct heap
     SIZE_T           grow_size;     /* Size of next subheap for growing heap */
     SIZE_T           min_size;      /* Minimum committed size */
     DWORD            magic;         /* Magic number */
+    LONG             id;            /* Unique id, to detect stale thread caches */
+    struct heap_stats *stats;       /* Optional statistics, see WINE_HEAP_STATS */
     DWORD            pending_pos;   /* Position in pending free requests ring */
     struct block   **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION cs;
@@ -330,10 +361,14 @@ C_ASSERT( HEAP_MIN_LARGE_BLOCK_SIZE <= HEAP_INITIAL_GROW_SIZE );
 
 BOOL delay_heap_free = FALSE;
 BOOL heap_zero_hack = FALSE;
+BOOL heap_thread_cache = FALSE;
+UINT heap_stats_sample_rate = 0;
 
 static struct heap *process_heap;  /* main process heap */
 
 static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct block *block );
+static NTSTATUS heap_size( const struct heap *heap, struct block *block, SIZE_T *size );
+static BOOL validate_group( const struct heap *heap, const SUBHEAP *subheap, const struct block *block );
 
 /* check if memory range a contains memory range b */
 static inline BOOL contains( const void *a, SIZE_T a_size, const void *b, SIZE_T b_size )
@@ -1324,6 +1359,8 @@ static BOOL heap_validate( const struct heap *heap )
             else
             {
                 if (!validate_used_block( heap, subheap, block, 0 )) return FALSE;
+                if ((block_get_flags( block ) & BLOCK_FLAG_LFH) && !validate_group( heap, subheap, block ))
+                    return FALSE;
             }
         }
     }
@@ -1355,7 +1392,12 @@ static BOOL heap_validate( const struct heap *heap )
     }
 
     LIST_FOR_EACH_ENTRY( large_arena, &heap->large_list, ARENA_LARGE, entry )
+    {
         if (!validate_large_block( heap, &large_arena->block )) return FALSE;
+        if ((block_get_flags( &large_arena->block ) & BLOCK_FLAG_LFH) &&
+            !validate_group( heap, NULL, &large_arena->block ))
+            return FALSE;
+    }
 
     return TRUE;
 }
@@ -1541,6 +1583,7 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, void *addr, SIZE_T total_size, SIZE_T
     heap->flags         = (flags & ~HEAP_SHARED);
     heap->compat_info   = HEAP_STD;
     heap->magic         = HEAP_MAGIC;
+    heap->id            = InterlockedIncrement( &next_heap_id );
     heap->grow_size     = HEAP_INITIAL_GROW_SIZE;
     heap->min_size      = commit_size;
     list_init( &heap->subheap_list );
@@ -1597,6 +1640,12 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, void *addr, SIZE_T total_size, SIZE_T
         }
     }
 
+    if (heap_stats_sample_rate)
+    {
+        SIZE_T size = sizeof(*heap->stats);
+        NtAllocateVirtualMemory( NtCurrentProcess(), (void *)&heap->stats, 0, &size, MEM_COMMIT, PAGE_READWRITE );
+    }
+
     /* link it into the per-process heap list */
     if (process_heap)
     {
@@ -1690,6 +1739,11 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE handle )
         size = 0;
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
     }
+    if ((addr = heap->stats))
+    {
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
     size = 0;
     addr = heap;
     NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -1788,14 +1842,60 @@ static inline struct block *group_get_block( struct group *group, SIZE_T block_s
     return (struct block *)(first_block + index * block_size);
 }
 
-/* lookup a free block using the group free_bits, the current thread must own the group */
-static inline struct block *group_find_free_block( struct group *group, SIZE_T block_size )
+/* lookup up to count free blocks using the group free_bits, the current thread must own the group */
+static inline UINT group_find_free_blocks( struct group *group, SIZE_T block_size, struct block **blocks, UINT count )
 {
-    ULONG i, free_bits = ReadNoFence( &group->free_bits );
+    ULONG i, mask = 0, free_bits = ReadNoFence( &group->free_bits );
+    UINT n = 0;
+
     /* free_bits will never be 0 as the group is unlinked when it's fully used */
-    BitScanForward( &i, free_bits );
-    InterlockedAnd( &group->free_bits, ~(1 << i) );
-    return group_get_block( group, block_size, i );
+    while (n < count && free_bits)
+    {
+        BitScanForward( &i, free_bits );
+        free_bits &= ~(1 << i);
+        mask |= 1 << i;
+        blocks[n++] = group_get_block( group, block_size, i );
+    }
+    InterlockedAnd( &group->free_bits, ~mask );
+    return n;
+}
+
+/* validate the blocks of a group, block is the heap block holding the group */
+static BOOL validate_group( const struct heap *heap, const SUBHEAP *subheap, const struct block *block )
+{
+    struct group *group = (struct group *)(block + 1);
+    SIZE_T block_size = block_get_size( &group->first_block );
+    LONG free_bits = ReadNoFence( &group->free_bits );
+    const struct block *entry;
+    const char *err = NULL;
+    UINT i;
+
+    for (i = 0; !err && i < GROUP_BLOCK_COUNT; i++)
+    {
+        entry = group_get_block( group, block_size, i );
+        if (block_get_size( entry ) != block_size || block_get_group_index( entry ) != i ||
+            !(block_get_flags( entry ) & BLOCK_FLAG_LFH))
+            err = "invalid group block header";
+        else if (free_bits & (1 << i))
+        {
+            if (block_get_type( entry ) != BLOCK_TYPE_FREE || !(block_get_flags( entry ) & BLOCK_FLAG_FREE))
+                err = "free group block in use";
+        }
+        /* blocks still allocated from the group may be free in a thread cache, or being allocated */
+        else if (block_get_flags( entry ) & BLOCK_FLAG_FREE)
+        {
+            if (block_get_type( entry ) != BLOCK_TYPE_FREE) err = "invalid cached group block";
+        }
+        else if (!validate_used_block( heap, subheap, entry, 0 )) return FALSE;
+    }
+
+    if (err)
+    {
+        ERR( "heap %p, group %p, block %u: %s\n", heap, group, i - 1, err );
+        if (TRACE_ON(heap)) heap_dump( heap );
+    }
+
+    return !err;
 }
 
 /* allocate a new group block using non-LFH allocation, returns a group owned by current thread */
@@ -1819,7 +1919,6 @@ static struct group *group_allocate( struct heap *heap, ULONG flags, SIZE_T bloc
 
     if (status) return NULL;
 
-    block_set_flags( (struct block *)group - 1, 0, BLOCK_FLAG_LFH );
     group->free_bits = ~GROUP_FLAG_FREE;
 
     for (i = 0; i < GROUP_BLOCK_COUNT; ++i)
@@ -1833,6 +1932,9 @@ static struct group *group_allocate( struct heap *heap, ULONG flags, SIZE_T bloc
         mark_block_free( block + 1, (char *)block + block_size - (char *)(block + 1), flags );
     }
 
+    /* only validate the group blocks once they are initialized */
+    block_set_flags( (struct block *)group - 1, 0, BLOCK_FLAG_LFH );
+
     return group;
 }
 
@@ -1907,19 +2009,32 @@ static NTSTATUS heap_release_bin_group( struct heap *heap, ULONG flags, struct b
     return group_release( heap, flags, bin, group );
 }
 
-static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin )
+/* set the free bits of some blocks of a group, releasing the group if it is now fully freed */
+static NTSTATUS group_free_blocks( struct heap *heap, ULONG flags, struct bin *bin, struct group *group, LONG mask )
+{
+    /* if these were the last used blocks in a group and GROUP_FLAG_FREE was set */
+    if (InterlockedOr( &group->free_bits, mask ) != ~mask) return STATUS_SUCCESS;
+
+    /* thread now owns the group, and can release it to its bin */
+    group->free_bits = ~GROUP_FLAG_FREE;
+    return heap_release_bin_group( heap, flags, bin, group );
+}
+
+/* find up to count free blocks, all from the same group */
+static UINT find_free_bin_blocks( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin,
+                                  struct block **blocks, UINT count )
 {
     ULONG affinity = heap_current_thread_affinity();
-    struct block *block;
     struct group *group;
+    UINT n;
 
     /* acquire a group, the thread will own it and no other thread can clear free bits.
      * some other thread might still set the free bits if they are freeing blocks.
      */
-    if (!(group = heap_acquire_bin_group( heap, flags, block_size, bin ))) return NULL;
+    if (!(group = heap_acquire_bin_group( heap, flags, block_size, bin ))) return 0;
     group->affinity = affinity;
 
-    block = group_find_free_block( group, block_size );
+    n = group_find_free_blocks( group, block_size, blocks, count );
 
     /* serialize with heap_free_block_lfh: atomically set GROUP_FLAG_FREE when the free bits are all 0. */
     if (ReadNoFence( &group->free_bits ) || InterlockedCompareExchange( &group->free_bits, GROUP_FLAG_FREE, 0 ))
@@ -1929,9 +2044,212 @@ static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T
             RtlInterlockedPushEntrySList( &bin->groups, &group->entry );
     }
 
+    return n;
+}
+
+static struct block *find_free_bin_block( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin )
+{
+    struct block *block;
+
+    if (!find_free_bin_blocks( heap, flags, block_size, bin, &block, 1 )) return NULL;
     return block;
 }
 
+/* return free blocks of a bin to their groups, with a single free bits update per group */
+static void bin_release_blocks( struct heap *heap, ULONG flags, struct bin *bin, struct block **blocks, UINT count )
+{
+    struct group *group;
+    UINT i, j;
+    LONG mask;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!blocks[i]) continue;
+        group = block_get_group( blocks[i] );
+        mask = 1 << block_get_group_index( blocks[i] );
+
+        for (j = i + 1; j < count; j++)
+        {
+            if (!blocks[j] || block_get_group( blocks[j] ) != group) continue;
+            mask |= 1 << block_get_group_index( blocks[j] );
+            blocks[j] = NULL;
+        }
+
+        group_free_blocks( heap, flags, bin, group, mask );
+    }
+}
+
+/* Per-thread caches in front of the LFH
+ *
+ * Each thread keeps a small magazine of free blocks for each of the smaller
+ * bins, so that most allocations and frees don't need any atomic operation.
+ * Magazines are refilled with several blocks from a single group, and half of
+ * a full magazine is returned to the groups at once.
+ */
+
+#define THREAD_CACHE_BIN_COUNT  0x30  /* only cache blocks up to 1KiB */
+#define THREAD_CACHE_DEPTH      16
+#define THREAD_CACHE_BATCH      (THREAD_CACHE_DEPTH / 2)
+#define THREAD_CACHE_HEAPS      4
+
+struct thread_cache
+{
+    struct heap  *heap;
+    LONG          heap_id;
+    BYTE          count[THREAD_CACHE_BIN_COUNT];
+    struct block *blocks[THREAD_CACHE_BIN_COUNT][THREAD_CACHE_DEPTH];
+};
+
+struct thread_caches
+{
+    UINT                 next_victim;
+    struct thread_cache *caches[THREAD_CACHE_HEAPS];
+};
+
+static inline struct thread_caches *get_thread_caches(void)
+{
+    return NtCurrentTeb()->ReservedForPerf;
+}
+
+/* allocate thread cache memory from the process heap, bypassing the LFH */
+static void *thread_cache_alloc_mem( SIZE_T size )
+{
+    ULONG flags = heap_get_flags( process_heap, HEAP_ZERO_MEMORY );
+    SIZE_T block_size = heap_get_block_size( process_heap, flags, size );
+    NTSTATUS status;
+    void *ptr;
+
+    heap_lock( process_heap, flags );
+    status = heap_allocate_block( process_heap, flags, block_size, size, &ptr );
+    heap_unlock( process_heap, flags );
+
+    return status ? NULL : ptr;
+}
+
+/* free thread cache memory, bypassing the LFH and the heap statistics like the allocation */
+static void thread_cache_free_mem( void *ptr )
+{
+    ULONG flags = heap_get_flags( process_heap, 0 );
+
+    heap_lock( process_heap, flags );
+    heap_free_block( process_heap, flags, (struct block *)ptr - 1 );
+    heap_unlock( process_heap, flags );
+}
+
+/* check that a heap hasn't been destroyed, process heap lock must be held */
+static BOOL heap_is_alive( struct heap *heap, LONG id )
+{
+    struct heap *entry;
+
+    if (heap == process_heap) return id == process_heap->id;
+    LIST_FOR_EACH_ENTRY( entry, &process_heap->entry, struct heap, entry )
+        if (entry == heap) return id == heap->id;
+    return FALSE;
+}
+
+static void thread_cache_flush( struct thread_cache *cache )
+{
+    struct heap *heap = cache->heap;
+    UINT i;
+
+    for (i = 0; i < THREAD_CACHE_BIN_COUNT; i++)
+    {
+        if (!cache->count[i]) continue;
+        bin_release_blocks( heap, heap->flags, heap->bins + i, cache->blocks[i], cache->count[i] );
+        cache->count[i] = 0;
+    }
+}
+
+static struct thread_cache *heap_create_thread_cache( struct heap *heap )
+{
+    struct thread_caches *caches;
+    struct thread_cache *cache;
+    UINT i;
+
+    if (!(caches = get_thread_caches()))
+    {
+        if (!(caches = thread_cache_alloc_mem( sizeof(*caches) ))) return NULL;
+        NtCurrentTeb()->ReservedForPerf = caches;
+    }
+
+    for (i = 0; i < THREAD_CACHE_HEAPS; i++) if (!caches->caches[i]) break;
+    if (i < THREAD_CACHE_HEAPS)
+    {
+        if (!(cache = thread_cache_alloc_mem( sizeof(*cache) ))) return NULL;
+        caches->caches[i] = cache;
+    }
+    else
+    {
+        /* evict the cache of another heap, it might have been destroyed already */
+        cache = caches->caches[caches->next_victim++ % THREAD_CACHE_HEAPS];
+        RtlEnterCriticalSection( &process_heap->cs );
+        if (heap_is_alive( cache->heap, cache->heap_id )) thread_cache_flush( cache );
+        RtlLeaveCriticalSection( &process_heap->cs );
+        memset( cache->count, 0, sizeof(cache->count) );
+    }
+
+    cache->heap = heap;
+    cache->heap_id = heap->id;
+    return cache;
+}
+
+static inline struct thread_cache *heap_get_thread_cache( struct heap *heap )
+{
+    struct thread_caches *caches = get_thread_caches();
+    struct thread_cache *cache;
+    UINT i;
+
+    for (i = 0; caches && i < THREAD_CACHE_HEAPS; i++)
+    {
+        if (!(cache = caches->caches[i]) || cache->heap != heap) continue;
+        if (cache->heap_id != heap->id)
+        {
+            /* the heap was destroyed and a new one created at the same address */
+            memset( cache->count, 0, sizeof(cache->count) );
+            cache->heap_id = heap->id;
+        }
+        return cache;
+    }
+
+    return heap_create_thread_cache( heap );
+}
+
+static struct block *thread_cache_get_block( struct heap *heap, ULONG flags, SIZE_T block_size, struct bin *bin )
+{
+    UINT count, index = bin - heap->bins;
+    struct thread_cache *cache;
+
+    if (!(cache = heap_get_thread_cache( heap ))) return find_free_bin_block( heap, flags, block_size, bin );
+
+    if (!(count = cache->count[index]))
+        count = find_free_bin_blocks( heap, flags, block_size, bin, cache->blocks[index], THREAD_CACHE_BATCH );
+    if (!count) return NULL;
+
+    cache->count[index] = --count;
+    return cache->blocks[index][count];
+}
+
+static BOOL thread_cache_put_block( struct heap *heap, ULONG flags, struct bin *bin, struct block *block )
+{
+    UINT count, index = bin - heap->bins;
+    struct thread_cache *cache;
+
+    if (!(cache = heap_get_thread_cache( heap ))) return FALSE;
+
+    if ((count = cache->count[index]) == THREAD_CACHE_DEPTH)
+    {
+        /* return the least recently freed half of the blocks */
+        struct block **blocks = cache->blocks[index];
+        bin_release_blocks( heap, flags, bin, blocks, THREAD_CACHE_BATCH );
+        memmove( blocks, blocks + THREAD_CACHE_BATCH, (count - THREAD_CACHE_BATCH) * sizeof(*blocks) );
+        count -= THREAD_CACHE_BATCH;
+    }
+
+    cache->blocks[index][count++] = block;
+    cache->count[index] = count;
+    return TRUE;
+}
+
 static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T block_size,
                                          SIZE_T size, void **ret )
 {
@@ -1946,7 +2264,12 @@ static NTSTATUS heap_allocate_block_lfh( struct heap *heap, ULONG flags, SIZE_T
 
     block_size = BLOCK_BIN_SIZE( BLOCK_SIZE_BIN( block_size ) );
 
-    if ((block = find_free_bin_block( heap, flags, block_size, bin )))
+    if (heap_thread_cache && bin - heap->bins < THREAD_CACHE_BIN_COUNT)
+        block = thread_cache_get_block( heap, flags, block_size, bin );
+    else
+        block = find_free_bin_block( heap, flags, block_size, bin );
+
+    if (block)
     {
         block_set_type( block, BLOCK_TYPE_USED );
         block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_USER_FLAGS( flags ) );
@@ -1964,7 +2287,6 @@ static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct bloc
     struct bin *bin, *last = heap->bins + BLOCK_SIZE_BIN_COUNT - 1;
     SIZE_T i, block_size = block_get_size( block );
     struct group *group = block_get_group( block );
-    NTSTATUS status = STATUS_SUCCESS;
 
     if (!(block_get_flags( block ) & BLOCK_FLAG_LFH)) return STATUS_UNSUCCESSFUL;
 
@@ -1977,15 +2299,11 @@ static NTSTATUS heap_free_block_lfh( struct heap *heap, ULONG flags, struct bloc
     block_set_flags( block, (BYTE)~BLOCK_FLAG_LFH, BLOCK_FLAG_FREE );
     mark_block_free( block + 1, (char *)block + block_size - (char *)(block + 1), flags );
 
-    /* if this was the last used block in a group and GROUP_FLAG_FREE was set */
-    if (InterlockedOr( &group->free_bits, 1 << i ) == ~(1 << i))
-    {
-        /* thread now owns the group, and can release it to its bin */
-        group->free_bits = ~GROUP_FLAG_FREE;
-        status = heap_release_bin_group( heap, flags, bin, group );
-    }
+    if (heap_thread_cache && bin - heap->bins < THREAD_CACHE_BIN_COUNT &&
+        thread_cache_put_block( heap, flags, bin, block ))
+        return STATUS_SUCCESS;
 
-    return status;
+    return group_free_blocks( heap, flags, bin, group, 1 << i );
 }
 
 static void bin_try_enable( struct heap *heap, struct bin *bin )
@@ -2032,12 +2350,33 @@ static void heap_thread_detach_bin_groups( struct heap *heap )
     }
 }
 
+static void heap_thread_detach_caches(void)
+{
+    struct thread_caches *caches;
+    struct thread_cache *cache;
+    UINT i;
+
+    if (!(caches = get_thread_caches())) return;
+    NtCurrentTeb()->ReservedForPerf = NULL;
+
+    for (i = 0; i < THREAD_CACHE_HEAPS; i++)
+    {
+        if (!(cache = caches->caches[i])) continue;
+        if (heap_is_alive( cache->heap, cache->heap_id )) thread_cache_flush( cache );
+        thread_cache_free_mem( cache );
+    }
+    thread_cache_free_mem( caches );
+}
+
 void heap_thread_detach(void)
 {
     struct heap *heap;
 
     RtlEnterCriticalSection( &process_heap->cs );
 
+    /* flush the caches first, as it may give back groups to the thread */
+    heap_thread_detach_caches();
+
     LIST_FOR_EACH_ENTRY( heap, &process_heap->entry, struct heap, entry )
         heap_thread_detach_bin_groups( heap );
 
@@ -2046,6 +2385,79 @@ void heap_thread_detach(void)
     RtlLeaveCriticalSection( &process_heap->cs );
 }
 
+/* Optional heap statistics
+ *
+ * With WINE_HEAP_STATS=<n>, every heap counts allocations, frees and live
+ * blocks per bin. If n is larger than 1, the call stack of one allocation out
+ * of n in each bin is also recorded. The statistics can be queried with the
+ * HeapWineStatistics and HeapWineAllocationSites classes, and are dumped when
+ * the process exits.
+ */
+
+static inline UINT heap_stats_bin( const struct block *block )
+{
+    if (block_get_flags( block ) & BLOCK_FLAG_LARGE) return BLOCK_SIZE_BIN_COUNT - 1;
+    return BLOCK_SIZE_BIN( block_get_size( block ) );
+}
+
+static void heap_stats_account( struct heap *heap, struct block *block, LONG64 count )
+{
+    struct bin_stats *stats = heap->stats->bins + heap_stats_bin( block );
+    SIZE_T size;
+
+    heap_size( heap, block, &size );
+    InterlockedAdd64( &stats->live_blocks, count );
+    InterlockedAdd64( &stats->live_bytes, count * (LONG64)size );
+}
+
+static void DECLSPEC_NOINLINE heap_stats_sample( struct heap *heap, ULONG flags, SIZE_T size )
+{
+    struct heap_stats *stats = heap->stats;
+    void *frames[HEAP_WINE_SITE_FRAMES] = {0};
+    struct alloc_site *site;
+    ULONG hash, i, n;
+
+    RtlCaptureStackBackTrace( HEAP_STATS_SKIP_FRAMES, ARRAY_SIZE(frames), frames, &hash );
+
+    heap_lock( heap, flags );
+    for (i = hash % HEAP_STATS_SITE_COUNT, n = 0; n < HEAP_STATS_SITE_COUNT; i = (i + 1) % HEAP_STATS_SITE_COUNT, n++)
+    {
+        site = stats->sites + i;
+        if (!site->samples)
+        {
+            site->hash = hash;
+            memcpy( site->frames, frames, sizeof(frames) );
+            break;
+        }
+        if (site->hash == hash && !memcmp( site->frames, frames, sizeof(frames) )) break;
+    }
+    if (n == HEAP_STATS_SITE_COUNT) stats->dropped++;
+    else
+    {
+        site->samples++;
+        site->bytes += size;
+    }
+    heap_unlock( heap, flags );
+}
+
+static void DECLSPEC_NOINLINE heap_stats_alloc( struct heap *heap, ULONG flags, void *ptr, SIZE_T size )
+{
+    struct block *block = (struct block *)ptr - 1;
+    LONG64 count = InterlockedIncrement64( &heap->stats->bins[heap_stats_bin( block )].allocs );
+
+    heap_stats_account( heap, block, 1 );
+    if (heap_stats_sample_rate > 1 && !(count % heap_stats_sample_rate)) heap_stats_sample( heap, flags, size );
+}
+
+static void heap_stats_free( struct heap *heap, UINT bin, SIZE_T size )
+{
+    struct bin_stats *stats = heap->stats->bins + bin;
+
+    InterlockedIncrement64( &stats->frees );
+    InterlockedDecrement64( &stats->live_blocks );
+    InterlockedAdd64( &stats->live_bytes, -(LONG64)size );
+}
+
 /***********************************************************************
  *           RtlAllocateHeap   (NTDLL.@)
  */
@@ -2079,6 +2491,7 @@ void *WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE handle, ULONG flags, SIZE
     }
 
     if (!status) valgrind_notify_alloc( ptr, size, flags & HEAP_ZERO_MEMORY );
+    if (!status && heap->stats) heap_stats_alloc( heap, heap_flags, ptr, size );
 
     TRACE( "handle %p, flags %#lx, size %#Ix, return %p, status %#lx.\n", handle, flags, size, ptr, status );
     heap_set_status( heap, flags, status );
@@ -2091,8 +2504,10 @@ void *WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE handle, ULONG flags, SIZE
  */
 BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE handle, ULONG flags, void *ptr )
 {
+    SIZE_T stats_size = 0;
     struct block *block;
     struct heap *heap;
+    UINT stats_bin = 0;
     ULONG heap_flags;
     NTSTATUS status;
 
@@ -2104,21 +2519,33 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE handle, ULONG flags, void *
         status = STATUS_INVALID_PARAMETER;
     else if (!(block = unsafe_block_from_ptr( heap, heap_flags, ptr )))
         status = STATUS_INVALID_PARAMETER;
-    else if (block_get_flags( block ) & BLOCK_FLAG_LARGE)
-        status = heap_free_large( heap, heap_flags, block );
-    else if (!(block = heap_delay_free( heap, heap_flags, block )))
-        status = STATUS_SUCCESS;
-    else if (!heap_free_block_lfh( heap, heap_flags, block ))
-        status = STATUS_SUCCESS;
     else
     {
-        SIZE_T block_size = block_get_size( block ), bin = BLOCK_SIZE_BIN( block_size );
+        /* the block can't be looked at anymore once it has been freed */
+        if (heap->stats)
+        {
+            stats_bin = heap_stats_bin( block );
+            heap_size( heap, block, &stats_size );
+        }
 
-        heap_lock( heap, heap_flags );
-        status = heap_free_block( heap, heap_flags, block );
-        heap_unlock( heap, heap_flags );
+        if (block_get_flags( block ) & BLOCK_FLAG_LARGE)
+            status = heap_free_large( heap, heap_flags, block );
+        else if (!(block = heap_delay_free( heap, heap_flags, block )))
+            status = STATUS_SUCCESS;
+        else if (!heap_free_block_lfh( heap, heap_flags, block ))
+            status = STATUS_SUCCESS;
+        else
+        {
+            SIZE_T block_size = block_get_size( block ), bin = BLOCK_SIZE_BIN( block_size );
 
-        if (!status && heap->bins) InterlockedIncrement( &heap->bins[bin].count_freed );
+            heap_lock( heap, heap_flags );
+            status = heap_free_block( heap, heap_flags, block );
+            heap_unlock( heap, heap_flags );
+
+            if (!status && heap->bins) InterlockedIncrement( &heap->bins[bin].count_freed );
+        }
+
+        if (!status && heap->stats) heap_stats_free( heap, stats_bin, stats_size );
     }
 
     TRACE( "handle %p, flags %#lx, ptr %p, return %u, status %#lx.\n", handle, flags, ptr, !status, status );
@@ -2236,6 +2663,20 @@ static NTSTATUS heap_resize_in_place( struct heap *heap, ULONG flags, struct blo
     return status;
 }
 
+static NTSTATUS heap_resize_in_place_stats( struct heap *heap, ULONG flags, struct block *block, SIZE_T block_size,
+                                            SIZE_T size, SIZE_T *old_size, void **ret )
+{
+    NTSTATUS status;
+
+    if (!heap->stats) return heap_resize_in_place( heap, flags, block, block_size, size, old_size, ret );
+
+    /* the block is resized in place or left untouched, account for its new size */
+    heap_stats_account( heap, block, -1 );
+    status = heap_resize_in_place( heap, flags, block, block_size, size, old_size, ret );
+    heap_stats_account( heap, block, 1 );
+    return status;
+}
+
 /***********************************************************************
  *           RtlReAllocateHeap   (NTDLL.@)
  */
@@ -2256,8 +2697,8 @@ void *WINAPI RtlReAllocateHeap( HANDLE handle, ULONG flags, void *ptr, SIZE_T si
         status = STATUS_NO_MEMORY;
     else if (!(block = unsafe_block_from_ptr( heap, heap_flags, ptr )))
         status = STATUS_INVALID_PARAMETER;
-    else if ((status = heap_resize_in_place( heap, heap_flags, block, block_size, size,
-                                        &old_size, &ret )))
+    else if ((status = heap_resize_in_place_stats( heap, heap_flags, block, block_size, size,
+                                                   &old_size, &ret )))
     {
         if (flags & HEAP_REALLOC_IN_PLACE_ONLY)
             status = STATUS_NO_MEMORY;
@@ -2566,6 +3007,171 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
     return total;
 }
 
+static NTSTATUS heap_query_statistics( struct heap *heap, HEAP_WINE_STATISTICS *info, SIZE_T size_in, SIZE_T *size_out )
+{
+    SIZE_T size = offsetof( HEAP_WINE_STATISTICS, Bins[BLOCK_SIZE_BIN_COUNT] );
+    const ARENA_LARGE *large;
+    const struct block *block;
+    const SUBHEAP *subheap;
+    unsigned int i;
+
+    if (size_out) *size_out = size;
+    if (size_in < size) return STATUS_BUFFER_TOO_SMALL;
+
+    memset( info, 0, size );
+    info->Instrumented = !!heap->stats;
+    info->BinCount = BLOCK_SIZE_BIN_COUNT;
+
+    heap_lock( heap, 0 );
+
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+    {
+        const char *commit_end = subheap_commit_end( subheap );
+
+        info->SubheapCount++;
+        info->ReservedSize += subheap_size( subheap );
+        info->CommittedSize += commit_end - (char *)subheap_base( subheap );
+
+        for (block = first_block( subheap ); block; block = next_block( subheap, block ))
+        {
+            if (!(block_get_flags( block ) & BLOCK_FLAG_FREE)) continue;
+            /* the last free block may extend over the uncommitted range */
+            size = min( block_get_size( block ), commit_end - (char *)block );
+            info->FreeBlocks++;
+            info->FreeSize += size;
+            info->LargestFreeBlock = max( info->LargestFreeBlock, size );
+        }
+    }
+
+    LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+    {
+        info->LargeBlocks++;
+        info->LargeSize += large->data_size;
+        info->ReservedSize += large->block_size;
+        info->CommittedSize += large->block_size;
+    }
+
+    heap_unlock( heap, 0 );
+
+    for (i = 0; i < BLOCK_SIZE_BIN_COUNT; i++)
+    {
+        HEAP_WINE_BIN_STATISTICS *bin = info->Bins + i;
+
+        bin->BlockSize = BLOCK_BIN_SIZE( i );
+        if (heap->bins) bin->LowFragmentation = !!ReadNoFence( &heap->bins[i].enabled );
+        if (!heap->stats) continue;
+        bin->Allocations = heap->stats->bins[i].allocs;
+        bin->Frees = heap->stats->bins[i].frees;
+        bin->LiveBlocks = heap->stats->bins[i].live_blocks;
+        bin->LiveBytes = heap->stats->bins[i].live_bytes;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS heap_query_allocation_sites( struct heap *heap, HEAP_WINE_ALLOCATION_SITES *info, SIZE_T size_in,
+                                             SIZE_T *size_out )
+{
+    struct heap_stats *stats = heap->stats;
+    unsigned int i, count = 0;
+    SIZE_T size;
+
+    heap_lock( heap, 0 );
+
+    for (i = 0; stats && i < HEAP_STATS_SITE_COUNT; i++) if (stats->sites[i].samples) count++;
+    size = offsetof( HEAP_WINE_ALLOCATION_SITES, Sites[count] );
+    if (size_out) *size_out = size;
+
+    if (size_in >= size)
+    {
+        info->SampleRate = heap_stats_sample_rate;
+        info->Count = count;
+        info->Dropped = stats ? stats->dropped : 0;
+        for (i = 0, count = 0; stats && i < HEAP_STATS_SITE_COUNT; i++)
+        {
+            const struct alloc_site *site = stats->sites + i;
+            if (!site->samples) continue;
+            info->Sites[count].Samples = site->samples;
+            info->Sites[count].Bytes = site->bytes;
+            memcpy( info->Sites[count].Frames, site->frames, sizeof(site->frames) );
+            count++;
+        }
+    }
+
+    heap_unlock( heap, 0 );
+
+    return size_in >= size ? STATUS_SUCCESS : STATUS_BUFFER_TOO_SMALL;
+}
+
+static void dump_heap_frame( void *frame )
+{
+    LDR_DATA_TABLE_ENTRY *mod;
+
+    if (!LdrFindEntryForAddress( frame, &mod ))
+        MESSAGE( "        %p %s+%#Ix\n", frame, debugstr_us( &mod->BaseDllName ),
+                 (char *)frame - (char *)mod->DllBase );
+    else
+        MESSAGE( "        %p\n", frame );
+}
+
+static void dump_heap_statistics( struct heap *heap )
+{
+    HEAP_WINE_STATISTICS *info;
+    struct alloc_site *top[10] = {0};
+    SIZE_T size;
+    unsigned int i, j, k;
+
+    size = offsetof( HEAP_WINE_STATISTICS, Bins[BLOCK_SIZE_BIN_COUNT] );
+    if (!(info = RtlAllocateHeap( process_heap, 0, size ))) return;
+    heap_query_statistics( heap, info, size, NULL );
+
+    MESSAGE( "heap %p: %lu subheaps, reserved %#Ix, committed %#Ix, free %#Ix in %Iu blocks (largest %#Ix), "
+             "%Iu large blocks of %#Ix bytes\n", heap, info->SubheapCount, info->ReservedSize, info->CommittedSize,
+             info->FreeSize, info->FreeBlocks, info->LargestFreeBlock, info->LargeBlocks, info->LargeSize );
+    for (i = 0; i < info->BinCount; i++)
+    {
+        HEAP_WINE_BIN_STATISTICS *bin = info->Bins + i;
+        if (!bin->Allocations) continue;
+        MESSAGE( "    bin %#5Ix: %10I64u allocs, %10I64u frees, %8Iu live blocks, %#10Ix live bytes%s\n",
+                 bin->BlockSize, bin->Allocations, bin->Frees, bin->LiveBlocks, bin->LiveBytes,
+                 bin->LowFragmentation ? ", LFH" : "" );
+    }
+    RtlFreeHeap( process_heap, 0, info );
+
+    /* the top allocation sites, by sampled bytes */
+    for (i = 0; i < HEAP_STATS_SITE_COUNT; i++)
+    {
+        struct alloc_site *site = heap->stats->sites + i;
+        if (!site->samples) continue;
+        for (j = 0; j < ARRAY_SIZE(top); j++) if (!top[j] || top[j]->bytes < site->bytes) break;
+        if (j == ARRAY_SIZE(top)) continue;
+        memmove( top + j + 1, top + j, (ARRAY_SIZE(top) - j - 1) * sizeof(*top) );
+        top[j] = site;
+    }
+    for (j = 0; j < ARRAY_SIZE(top) && top[j]; j++)
+    {
+        MESSAGE( "    site %u: %I64u samples, %#I64x bytes\n", j, top[j]->samples, top[j]->bytes );
+        for (k = 0; k < HEAP_WINE_SITE_FRAMES && top[j]->frames[k]; k++) dump_heap_frame( top[j]->frames[k] );
+    }
+}
+
+/* dump the statistics of all the heaps when the process exits */
+void heap_dump_statistics(void)
+{
+    struct heap *heap;
+
+    if (!heap_stats_sample_rate) return;
+
+    RtlEnterCriticalSection( &process_heap->cs );
+
+    LIST_FOR_EACH_ENTRY( heap, &process_heap->entry, struct heap, entry )
+        if (heap->stats) dump_heap_statistics( heap );
+
+    if (process_heap->stats) dump_heap_statistics( process_heap );
+
+    RtlLeaveCriticalSection( &process_heap->cs );
+}
+
 /***********************************************************************
  *           RtlQueryHeapInformation    (NTDLL.@)
  */
@@ -2586,6 +3192,14 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE handle, HEAP_INFORMATION_CLASS i
         *(ULONG *)info = ReadNoFence( &heap->compat_info );
         return STATUS_SUCCESS;
 
+    case HeapWineStatistics:
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
+        return heap_query_statistics( heap, info, size_in, size_out );
+
+    case HeapWineAllocationSites:
+        if (!(heap = unsafe_heap_from_handle( handle, 0, &flags ))) return STATUS_ACCESS_VIOLATION;
+        return heap_query_allocation_sites( heap, info, size_in, size_out );
+
     default:
         FIXME( "HEAP_INFORMATION_CLASS %u not implemented!\n", info_class );
         return STATUS_INVALID_INFO_CLASS;
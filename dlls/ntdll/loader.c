@@ -106,6 +106,35 @@ static UNICODE_STRING system_dll_path; /* path to search for system dependency d
 static DWORD default_search_flags;  /* default flags set by LdrSetDefaultDllDirectories */
 static WCHAR *default_load_path;    /* default dll search path */
 
+/* optional startup time accounting, see WINE_LOADER_STATS */
+enum loader_phase
+{
+    LOADER_PHASE_INIT,
+    LOADER_PHASE_SEARCH,
+    LOADER_PHASE_MAP,
+    LOADER_PHASE_IMPORTS,
+    LOADER_PHASE_ATTACH,
+    LOADER_PHASE_COUNT
+};
+
+static const char * const loader_phase_names[LOADER_PHASE_COUNT] =
+{
+    "init",
+    "search",
+    "map",
+    "imports",
+    "attach",
+};
+
+static BOOL loader_stats;
+static enum loader_phase current_loader_phase = LOADER_PHASE_INIT;
+static LONGLONG loader_phase_start;
+static struct
+{
+    LONGLONG ticks;
+    ULONG    count;
+} loader_phases[LOADER_PHASE_COUNT];
+
 struct dll_dir_entry
 {
     struct list entry;
@@ -133,6 +162,41 @@ static const char * const reason_names[] =
     "THREAD_DETACH",
 };
 
+/***********************************************************************
+ *	enter_loader_phase
+ *
+ * Account the time spent so far to the current phase, and switch to a new one.
+ * The loader_section must be locked while calling this function.
+ */
+static enum loader_phase enter_loader_phase( enum loader_phase phase )
+{
+    enum loader_phase prev = current_loader_phase;
+    LARGE_INTEGER now;
+
+    if (!loader_stats) return prev;
+    RtlQueryPerformanceCounter( &now );
+    loader_phases[prev].ticks += now.QuadPart - loader_phase_start;
+    loader_phases[phase].count++;
+    loader_phase_start = now.QuadPart;
+    current_loader_phase = phase;
+    return prev;
+}
+
+
+/***********************************************************************
+ *	leave_loader_phase
+ */
+static void leave_loader_phase( enum loader_phase prev )
+{
+    LARGE_INTEGER now;
+
+    if (!loader_stats) return;
+    RtlQueryPerformanceCounter( &now );
+    loader_phases[current_loader_phase].ticks += now.QuadPart - loader_phase_start;
+    loader_phase_start = now.QuadPart;
+    current_loader_phase = prev;
+}
+
 struct file_id
 {
     BYTE ObjectId[16];
@@ -150,6 +214,26 @@ typedef struct _wine_modref
     BOOL                  system;
 } WINE_MODREF;
 
+/* hash index of the export names, built on the first lookup that misses the hint */
+struct export_index
+{
+    struct export_index *next;  /* next index in the same bucket */
+    HMODULE module;             /* module whose exports are indexed */
+    ULONG mask;                 /* size of the table - 1 */
+    struct
+    {
+        ULONG hash;
+        ULONG pos;              /* position in the name table + 1, 0 if empty */
+    } entries[1];
+};
+
+#define EXPORT_INDEX_MIN_NAMES 32  /* smaller tables are searched directly */
+#define EXPORT_INDEX_BUCKETS   64
+
+/* the indexes have their own lock, so that lookups don't need the loader lock */
+static struct export_index *export_indexes[EXPORT_INDEX_BUCKETS];
+static RTL_SRWLOCK export_index_lock = RTL_SRWLOCK_INIT;
+
 static UINT tls_module_count = 32;     /* number of modules with TLS directory */
 static IMAGE_TLS_DIRECTORY *tls_dirs;  /* array of TLS directories */
 static ULONG tls_thread_count;         /* number of threads for which ThreadLocalStoragePointer is allocated in TEB. */
@@ -1106,16 +1190,130 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static ULONG hash_export_name( const char *name )
+{
+    ULONG hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		lookup_export_index
+ *
+ * The export_index_lock must be held while calling this function.
+ */
+static struct export_index *lookup_export_index( HMODULE module )
+{
+    struct export_index *index = export_indexes[((ULONG_PTR)module >> 16) % EXPORT_INDEX_BUCKETS];
+
+    while (index && index->module != module) index = index->next;
+    return index;
+}
+
+
+/*************************************************************************
+ *		get_export_index
+ *
+ * Get the export name index of a module, building it if needed and if
+ * the module is known to be loaded.
+ */
+static struct export_index *get_export_index( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+                                              BOOL loaded )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_index *index, *existing;
+    ULONG i, pos, hash, size = 64;
+
+    RtlAcquireSRWLockShared( &export_index_lock );
+    index = lookup_export_index( module );
+    RtlReleaseSRWLockShared( &export_index_lock );
+    if (index || !loaded) return index;
+
+    while (size < exports->NumberOfNames * 2) size *= 2;
+    if (!(index = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   offsetof( struct export_index, entries[size] ) )))
+        return NULL;
+    index->module = module;
+    index->mask = size - 1;
+
+    for (pos = 0; pos < exports->NumberOfNames; pos++)
+    {
+        hash = hash_export_name( get_rva( module, names[pos] ));
+        for (i = hash & index->mask; index->entries[i].pos; i = (i + 1) & index->mask) /* nothing */;
+        index->entries[i].hash = hash;
+        index->entries[i].pos = pos + 1;
+    }
+
+    RtlAcquireSRWLockExclusive( &export_index_lock );
+    if (!(existing = lookup_export_index( module )))
+    {
+        index->next = export_indexes[((ULONG_PTR)module >> 16) % EXPORT_INDEX_BUCKETS];
+        export_indexes[((ULONG_PTR)module >> 16) % EXPORT_INDEX_BUCKETS] = index;
+    }
+    RtlReleaseSRWLockExclusive( &export_index_lock );
+
+    if (existing)  /* built by another thread in the meantime */
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, index );
+        return existing;
+    }
+    TRACE( "built export index of %p, %lu names\n", module, exports->NumberOfNames );
+    return index;
+}
+
+
+/*************************************************************************
+ *		free_export_index
+ */
+static void free_export_index( HMODULE module )
+{
+    struct export_index **index, *found = NULL;
+
+    RtlAcquireSRWLockExclusive( &export_index_lock );
+    for (index = &export_indexes[((ULONG_PTR)module >> 16) % EXPORT_INDEX_BUCKETS]; *index; index = &(*index)->next)
+    {
+        if ((*index)->module != module) continue;
+        found = *index;
+        *index = found->next;
+        break;
+    }
+    RtlReleaseSRWLockExclusive( &export_index_lock );
+    RtlFreeHeap( GetProcessHeap(), 0, found );
+}
+
+
 /*************************************************************************
  *		find_name_in_exports
  *
  * Helper for find_named_export.
+ * The index is only built for modules known to be loaded, since it is
+ * freed when the module is unloaded.
  */
-static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports, const char *name )
+static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports, const char *name,
+                                 BOOL loaded )
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int min = 0, max = exports->NumberOfNames - 1;
+    struct export_index *index;
+
+    if (exports->NumberOfNames >= EXPORT_INDEX_MIN_NAMES &&
+        (index = get_export_index( module, exports, loaded )))
+    {
+        ULONG i, pos, hash = hash_export_name( name );
+
+        for (i = hash & index->mask; (pos = index->entries[i].pos); i = (i + 1) & index->mask)
+        {
+            if (index->entries[i].hash != hash) continue;
+            if (!strcmp( get_rva( module, names[pos - 1] ), name )) return ordinals[pos - 1];
+        }
+        return -1;
+    }
 
     while (min <= max)
     {
@@ -1151,7 +1349,8 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
     }
 
     /* then do a binary search */
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
+    if ((ordinal = find_name_in_exports( module, exports, name, get_modref( module ) != NULL )) == -1)
+        return NULL;
     return find_ordinal_export( module, exports, exp_size, ordinal, load_path );
 
 }
@@ -1171,7 +1370,8 @@ void * WINAPI RtlFindExportedRoutineByName( HMODULE module, const char *name )
     exports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size );
     if (!exports || exp_size < sizeof(*exports)) return NULL;
 
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
+    /* without the loader lock, only an index built by the loader can be used */
+    if ((ordinal = find_name_in_exports( module, exports, name, FALSE )) == -1) return NULL;
     if (ordinal >= exports->NumberOfFunctions) return NULL;
     functions = get_rva( module, exports->AddressOfFunctions );
     if (!functions[ordinal]) return NULL;
@@ -1579,6 +1779,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     const IMAGE_IMPORT_DESCRIPTOR *imports;
     SINGLE_LIST_ENTRY *dep_after;
     WINE_MODREF *prev, *imp;
+    enum loader_phase phase;
     int i, nb_imports;
     DWORD size;
     NTSTATUS status;
@@ -1607,6 +1808,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     prev = current_modref;
     current_modref = wm;
     status = STATUS_SUCCESS;
+    phase = enter_loader_phase( LOADER_PHASE_IMPORTS );
     for (i = 0; i < nb_imports; i++)
     {
         dep_after = wm->ldr.DdagNode->Dependencies.Tail;
@@ -1615,6 +1817,7 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
         else if (imp && imp->ldr.DdagNode != node_ntdll && imp->ldr.DdagNode != node_kernel32)
             add_module_dependency_after( wm->ldr.DdagNode, imp->ldr.DdagNode, dep_after );
     }
+    leave_loader_phase( phase );
     current_modref = prev;
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
@@ -1893,10 +2096,14 @@ static NTSTATUS process_attach( LDR_DDAG_NODE *node, LPVOID lpReserved )
     if (status == STATUS_SUCCESS)
     {
         WINE_MODREF *prev = current_modref;
+        enum loader_phase phase;
+
         current_modref = wm;
 
         call_ldr_notifications( LDR_DLL_NOTIFICATION_REASON_LOADED, &wm->ldr );
+        phase = enter_loader_phase( LOADER_PHASE_ATTACH );
         status = MODULE_InitDLL( wm, DLL_PROCESS_ATTACH, lpReserved );
+        leave_loader_phase( phase );
         if (status == STATUS_SUCCESS)
         {
             wm->ldr.Flags |= LDR_PROCESS_ATTACHED;
@@ -3375,6 +3582,380 @@ done:
 }
 
 
+/* Persistent cache of dll search results.
+ *
+ * For each search path, the cache records the directory in which a given dll
+ * was found, so that the directories before it don't need to be probed again.
+ * The entries are only trusted as long as none of these directories has been
+ * modified since the search, which is much cheaper to check than opening the
+ * files. Both the last write and the change times are checked, since the
+ * former can be restored after modifying the directory. The cache is stored in a subdirectory of the system directory, so
+ * that writing it doesn't change the system directory itself, and can be
+ * disabled with WINE_LOADER_CACHE=0.
+ */
+#define LOADER_CACHE_MAGIC       0x43444c57  /* WLDC */
+#define LOADER_CACHE_VERSION     2
+#define LOADER_CACHE_MAX_PATHS   16
+#define LOADER_CACHE_MAX_DIRS    32
+#define LOADER_CACHE_MAX_ENTRIES 512
+#define LOADER_CACHE_MAX_NAME    40
+
+struct loader_cache_dir
+{
+    ULONG         hash;                  /* hash of the directory NT name */
+    ULONG         pad;
+    LARGE_INTEGER time;                  /* last write time, 0 if the directory doesn't exist */
+    LARGE_INTEGER change;                /* change time, 0 if the directory doesn't exist */
+};
+
+struct loader_cache_path
+{
+    ULONG                   hash;        /* hash of the search path */
+    ULONG                   count;       /* number of recorded directories */
+    struct loader_cache_dir dirs[LOADER_CACHE_MAX_DIRS];
+};
+
+struct loader_cache_entry
+{
+    ULONG hash;                          /* hash of the dll name */
+    WORD  path;                          /* index of the search path */
+    WORD  dir;                           /* index of the directory the dll was found in */
+    WCHAR name[LOADER_CACHE_MAX_NAME];
+};
+
+struct loader_cache
+{
+    ULONG                     magic;
+    ULONG                     version;
+    ULONG                     path_count;
+    ULONG                     entry_count;
+    struct loader_cache_path  paths[LOADER_CACHE_MAX_PATHS];
+    struct loader_cache_entry entries[LOADER_CACHE_MAX_ENTRIES];
+};
+
+static const WCHAR loader_cache_dir_name[] = L"\\??\\C:\\windows\\system32\\wineloader";
+static const WCHAR loader_cache_name[] = L"\\??\\C:\\windows\\system32\\wineloader\\wineloader.cache";
+static struct loader_cache *loader_cache;
+static BOOL loader_cache_dirty;
+static ULONG loader_cache_checked[LOADER_CACHE_MAX_PATHS];  /* directories validated in this process */
+static BOOL loader_cache_stale[LOADER_CACHE_MAX_PATHS];
+static ULONG loader_cache_hits, loader_cache_misses;
+
+
+/***********************************************************************
+ *	hash_loader_string
+ */
+static ULONG hash_loader_string( const WCHAR *str, ULONG len )
+{
+    ULONG hash = 2166136261u;
+
+    while (len--)
+    {
+        WCHAR ch = *str++;
+        if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+        hash = (hash ^ ch) * 16777619;
+    }
+    return hash;
+}
+
+
+/***********************************************************************
+ *	get_search_path_dir
+ *
+ * Get the directory at the given index in a search path.
+ */
+static const WCHAR *get_search_path_dir( const WCHAR *paths, ULONG index, ULONG *len )
+{
+    const WCHAR *ptr;
+
+    for (;;)
+    {
+        if (!*paths) return NULL;
+        for (ptr = paths; *ptr && *ptr != ';'; ptr++) /* nothing */;
+        if (!index--) break;
+        paths = *ptr ? ptr + 1 : ptr;
+    }
+    *len = ptr - paths;
+    return paths;
+}
+
+
+/***********************************************************************
+ *	get_loader_cache_dir
+ */
+static void get_loader_cache_dir( const WCHAR *dir, ULONG len, struct loader_cache_dir *info )
+{
+    FILE_NETWORK_OPEN_INFORMATION attrs;
+    UNICODE_STRING nt_name;
+    OBJECT_ATTRIBUTES attr;
+    WCHAR *name;
+
+    memset( info, 0, sizeof(*info) );
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR) ))) return;
+    memcpy( name, dir, len * sizeof(WCHAR) );
+    name[len] = 0;
+    if (!RtlDosPathNameToNtPathName_U_WithStatus( name, &nt_name, NULL, NULL ))
+    {
+        InitializeObjectAttributes( &attr, &nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+        info->hash = hash_loader_string( nt_name.Buffer, nt_name.Length / sizeof(WCHAR) );
+        if (!NtQueryFullAttributesFile( &attr, &attrs ))
+        {
+            info->time = attrs.LastWriteTime;
+            info->change = attrs.ChangeTime;
+        }
+        RtlFreeUnicodeString( &nt_name );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+}
+
+
+/***********************************************************************
+ *	find_loader_cache_path
+ */
+static int find_loader_cache_path( const WCHAR *paths )
+{
+    ULONG i, hash = hash_loader_string( paths, wcslen(paths) );
+
+    for (i = 0; i < loader_cache->path_count; i++)
+        if (loader_cache->paths[i].hash == hash) return i;
+    return -1;
+}
+
+
+/***********************************************************************
+ *	validate_loader_cache_path
+ *
+ * Check that the directories up to the given index haven't changed.
+ */
+static BOOL validate_loader_cache_path( const WCHAR *paths, int path, ULONG dir )
+{
+    struct loader_cache_path *cache_path = &loader_cache->paths[path];
+    struct loader_cache_dir info;
+    const WCHAR *ptr;
+    ULONG len;
+
+    if (loader_cache_stale[path]) return FALSE;
+    if (dir >= cache_path->count) return FALSE;
+
+    for (; loader_cache_checked[path] <= dir; loader_cache_checked[path]++)
+    {
+        if (!(ptr = get_search_path_dir( paths, loader_cache_checked[path], &len ))) break;
+        get_loader_cache_dir( ptr, len, &info );
+        if (info.hash != cache_path->dirs[loader_cache_checked[path]].hash ||
+            info.time.QuadPart != cache_path->dirs[loader_cache_checked[path]].time.QuadPart ||
+            info.change.QuadPart != cache_path->dirs[loader_cache_checked[path]].change.QuadPart)
+            break;
+    }
+    if (loader_cache_checked[path] > dir) return TRUE;
+
+    TRACE( "search path %s changed at directory %lu\n", debugstr_w(paths), loader_cache_checked[path] );
+    loader_cache_stale[path] = TRUE;
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *	find_loader_cache_entry
+ */
+static struct loader_cache_entry *find_loader_cache_entry( int path, const WCHAR *search )
+{
+    ULONG i, hash = hash_loader_string( search, wcslen(search) );
+
+    for (i = 0; i < loader_cache->entry_count; i++)
+    {
+        struct loader_cache_entry *entry = &loader_cache->entries[i];
+        if (entry->hash == hash && entry->path == path && !wcsicmp( entry->name, search )) return entry;
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *	loader_cache_lookup
+ *
+ * Find the directory index where a dll was found the last time.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL loader_cache_lookup( const WCHAR *paths, const WCHAR *search, ULONG *dir )
+{
+    struct loader_cache_entry *entry;
+    int path;
+
+    if (!loader_cache) return FALSE;
+    if ((path = find_loader_cache_path( paths )) != -1 &&
+        (entry = find_loader_cache_entry( path, search )) &&
+        validate_loader_cache_path( paths, path, entry->dir ))
+    {
+        loader_cache_hits++;
+        *dir = entry->dir;
+        return TRUE;
+    }
+    loader_cache_misses++;
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *	loader_cache_add
+ *
+ * Record the directory index where a dll was found.
+ * The loader_section must be locked while calling this function.
+ */
+static void loader_cache_add( const WCHAR *paths, const WCHAR *search, ULONG dir )
+{
+    struct loader_cache_path *cache_path;
+    struct loader_cache_entry *entry;
+    const WCHAR *ptr;
+    ULONG i, j, len;
+    int path;
+
+    if (!loader_cache) return;
+    if (dir >= LOADER_CACHE_MAX_DIRS || wcslen( search ) >= LOADER_CACHE_MAX_NAME) return;
+
+    if ((path = find_loader_cache_path( paths )) == -1 || !validate_loader_cache_path( paths, path, dir ))
+    {
+        if (path == -1)
+        {
+            if (loader_cache->path_count == LOADER_CACHE_MAX_PATHS)
+                loader_cache->path_count = loader_cache->entry_count = 0;
+            path = loader_cache->path_count++;
+        }
+
+        /* drop the entries that were validated against the old directories */
+        for (i = j = 0; i < loader_cache->entry_count; i++)
+            if (loader_cache->entries[i].path != path) loader_cache->entries[j++] = loader_cache->entries[i];
+        loader_cache->entry_count = j;
+
+        cache_path = &loader_cache->paths[path];
+        cache_path->hash = hash_loader_string( paths, wcslen(paths) );
+        for (i = 0; i < LOADER_CACHE_MAX_DIRS && (ptr = get_search_path_dir( paths, i, &len )); i++)
+            get_loader_cache_dir( ptr, len, &cache_path->dirs[i] );
+        cache_path->count = i;
+        loader_cache_checked[path] = i;
+        loader_cache_stale[path] = FALSE;
+        if (dir >= cache_path->count) return;
+    }
+
+    if (!(entry = find_loader_cache_entry( path, search )))
+    {
+        if (loader_cache->entry_count == LOADER_CACHE_MAX_ENTRIES) return;
+        entry = &loader_cache->entries[loader_cache->entry_count++];
+        entry->hash = hash_loader_string( search, wcslen(search) );
+        entry->path = path;
+        wcscpy( entry->name, search );
+    }
+    else if (entry->dir == dir) return;
+
+    entry->dir = dir;
+    loader_cache_dirty = TRUE;
+}
+
+
+/***********************************************************************
+ *	load_loader_cache
+ */
+static void load_loader_cache(void)
+{
+    UNICODE_STRING name = RTL_CONSTANT_STRING( loader_cache_name );
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    WCHAR env_str[4];
+    HANDLE file;
+
+    if (get_env( L"WINE_LOADER_CACHE", env_str, sizeof(env_str) ) && env_str[0] == '0') return;
+    if (!(loader_cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*loader_cache) ))) return;
+
+    InitializeObjectAttributes( &attr, &name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (!NtOpenFile( &file, GENERIC_READ | SYNCHRONIZE, &attr, &io, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                     FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE ))
+    {
+        if (NtReadFile( file, 0, NULL, NULL, &io, loader_cache, sizeof(*loader_cache), NULL, NULL ) ||
+            io.Information != sizeof(*loader_cache))
+            loader_cache->magic = 0;
+        NtClose( file );
+    }
+    else loader_cache->magic = 0;
+
+    if (loader_cache->magic != LOADER_CACHE_MAGIC || loader_cache->version != LOADER_CACHE_VERSION ||
+        loader_cache->path_count > LOADER_CACHE_MAX_PATHS || loader_cache->entry_count > LOADER_CACHE_MAX_ENTRIES)
+    {
+        memset( loader_cache, 0, sizeof(*loader_cache) );
+        loader_cache->magic = LOADER_CACHE_MAGIC;
+        loader_cache->version = LOADER_CACHE_VERSION;
+    }
+    TRACE( "loaded %lu cached dll locations\n", loader_cache->entry_count );
+}
+
+
+/***********************************************************************
+ *	save_loader_cache
+ *
+ * Write the cache to a temporary file, and move it in place.
+ */
+static void save_loader_cache(void)
+{
+    FILE_RENAME_INFORMATION *rename_info;
+    FILE_DISPOSITION_INFORMATION disposition = { TRUE };
+    UNICODE_STRING name;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    WCHAR tmp_name[MAX_PATH];
+    NTSTATUS status;
+    HANDLE file;
+    ULONG size;
+
+    if (!loader_cache || !loader_cache_dirty) return;
+    loader_cache_dirty = FALSE;
+
+    RtlInitUnicodeString( &name, loader_cache_dir_name );
+    InitializeObjectAttributes( &attr, &name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (NtCreateFile( &file, SYNCHRONIZE, &attr, &io, NULL, FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      FILE_OPEN_IF, FILE_SYNCHRONOUS_IO_NONALERT | FILE_DIRECTORY_FILE, NULL, 0 ))
+        return;
+    NtClose( file );
+
+    swprintf( tmp_name, ARRAY_SIZE(tmp_name), L"%s.%04lx", loader_cache_name, GetCurrentProcessId() );
+    RtlInitUnicodeString( &name, tmp_name );
+    InitializeObjectAttributes( &attr, &name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (NtCreateFile( &file, GENERIC_WRITE | DELETE | SYNCHRONIZE, &attr, &io, NULL, FILE_ATTRIBUTE_NORMAL,
+                      0, FILE_OVERWRITE_IF, FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE, NULL, 0 ))
+        return;
+
+    size = offsetof( FILE_RENAME_INFORMATION, FileName[ARRAY_SIZE(loader_cache_name)] );
+    if (!(status = NtWriteFile( file, 0, NULL, NULL, &io, loader_cache, sizeof(*loader_cache), NULL, NULL )) &&
+        (rename_info = RtlAllocateHeap( GetProcessHeap(), 0, size )))
+    {
+        rename_info->ReplaceIfExists = TRUE;
+        rename_info->RootDirectory = 0;
+        rename_info->FileNameLength = sizeof(loader_cache_name) - sizeof(WCHAR);
+        memcpy( rename_info->FileName, loader_cache_name, sizeof(loader_cache_name) );
+        status = NtSetInformationFile( file, &io, rename_info, size, FileRenameInformation );
+        RtlFreeHeap( GetProcessHeap(), 0, rename_info );
+    }
+    if (status) NtSetInformationFile( file, &io, &disposition, sizeof(disposition), FileDispositionInformation );
+    NtClose( file );
+}
+
+
+/***********************************************************************
+ *	dump_loader_stats
+ */
+static void dump_loader_stats(void)
+{
+    LARGE_INTEGER freq;
+    unsigned int i;
+
+    if (!loader_stats) return;
+    leave_loader_phase( current_loader_phase );  /* account the current phase */
+    RtlQueryPerformanceFrequency( &freq );
+    for (i = 0; i < LOADER_PHASE_COUNT; i++)
+        MESSAGE( "%04lx: loader %-8s %8I64u us, %5lu calls\n", GetCurrentProcessId(), loader_phase_names[i],
+                 loader_phases[i].ticks * 1000000 / freq.QuadPart, loader_phases[i].count );
+    MESSAGE( "%04lx: loader cache %lu hits, %lu misses\n", GetCurrentProcessId(),
+             loader_cache_hits, loader_cache_misses );
+}
+
+
 /***********************************************************************
  *	search_dll_file
  *
@@ -3387,7 +3968,9 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
     WCHAR *name;
     BOOL found_image = FALSE;
     NTSTATUS status = STATUS_DLL_NOT_FOUND;
-    ULONG len;
+    enum loader_phase phase;
+    const WCHAR *dir;
+    ULONG len, index;
 
     if (!paths) paths = default_load_path;
     len = wcslen( paths );
@@ -3398,14 +3981,27 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
     if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) )))
         return STATUS_NO_MEMORY;
 
-    while (*paths)
+    phase = enter_loader_phase( LOADER_PHASE_SEARCH );
+
+    /* first try the directory where the dll was found last time */
+    if (loader_cache_lookup( paths, search, &index ) && (dir = get_search_path_dir( paths, index, &len )))
     {
-        LPCWSTR ptr = paths;
+        memcpy( name, dir, len * sizeof(WCHAR) );
+        if (len && name[len - 1] != '\\') name[len++] = '\\';
+        wcscpy( name + len, search );
+
+        nt_name->Buffer = NULL;
+        if (!RtlDosPathNameToNtPathName_U_WithStatus( name, nt_name, NULL, NULL ))
+        {
+            if (!(status = open_dll_file( nt_name, pwm, mapping, image_info, id ))) goto done;
+            RtlFreeUnicodeString( nt_name );
+        }
+        status = STATUS_DLL_NOT_FOUND;
+    }
 
-        while (*ptr && *ptr != ';') ptr++;
-        len = ptr - paths;
-        if (*ptr == ';') ptr++;
-        memcpy( name, paths, len * sizeof(WCHAR) );
+    for (index = 0; (dir = get_search_path_dir( paths, index, &len )); index++)
+    {
+        memcpy( name, dir, len * sizeof(WCHAR) );
         if (len && name[len - 1] != '\\') name[len++] = '\\';
         wcscpy( name + len, search );
 
@@ -3414,14 +4010,18 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
 
         status = open_dll_file( nt_name, pwm, mapping, image_info, id );
         if (status == STATUS_NOT_SUPPORTED) found_image = TRUE;
-        else if (status != STATUS_DLL_NOT_FOUND) goto done;
+        else if (status != STATUS_DLL_NOT_FOUND)
+        {
+            if (!status) loader_cache_add( paths, search, index );
+            goto done;
+        }
         RtlFreeUnicodeString( nt_name );
-        paths = ptr;
     }
 
     if (found_image) status = STATUS_NOT_SUPPORTED;
 
 done:
+    leave_loader_phase( phase );
     RtlFreeHeap( GetProcessHeap(), 0, name );
     return status;
 }
@@ -3559,6 +4159,7 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, DWORD fl
     HANDLE mapping = 0;
     SECTION_IMAGE_INFORMATION image_info;
     NTSTATUS nts = STATUS_DLL_NOT_FOUND;
+    enum loader_phase phase;
     ULONG64 prev;
 
     TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
@@ -3598,6 +4199,7 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, DWORD fl
         NtCurrentTeb()->Tib.ArbitraryUserPointer = nt_name.Buffer + 4;
     }
 
+    phase = enter_loader_phase( LOADER_PHASE_MAP );
     switch (nts)
     {
     case STATUS_INVALID_IMAGE_NOT_MZ:  /* not in PE format, maybe it's a .so file */
@@ -3608,6 +4210,7 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, DWORD fl
         nts = load_native_dll( load_path, &nt_name, mapping, &image_info, &id, flags, system, pwm );
         break;
     }
+    leave_loader_phase( phase );
 
     if (NtCurrentTeb64())
         NtCurrentTeb64()->Tib.ArbitraryUserPointer = prev;
@@ -4154,6 +4757,9 @@ void WINAPI LdrShutdownProcess(void)
         RtlProcessFlsData( NtCurrentTeb()->FlsSlots, 1 );
 
     process_detach();
+    save_loader_cache();
+    heap_dump_statistics();
+    crit_section_dump_profile();
 }
 
 
@@ -4277,6 +4883,7 @@ static void free_modref( WINE_MODREF *wm )
 
     free_tls_slot( &wm->ldr );
     RtlReleaseActivationContext( wm->ldr.ActivationContext );
+    free_export_index( wm->ldr.DllBase );
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
@@ -4680,6 +5287,29 @@ void loader_init( CONTEXT *context, void **entry )
             ERR( "Enabling heap zero hack.\n" );
             heap_zero_hack = TRUE;
         }
+        if (get_env( L"WINE_HEAP_THREAD_CACHE", env_str, sizeof(env_str)) && env_str[0] == L'1')
+        {
+            TRACE( "Enabling per-thread heap caches.\n" );
+            heap_thread_cache = TRUE;
+        }
+        if (get_env( L"WINE_HEAP_STATS", env_str, sizeof(env_str)) )
+        {
+            heap_stats_sample_rate = wcstoul( env_str, NULL, 10 );
+            TRACE( "Enabling heap statistics, sample rate %u.\n", heap_stats_sample_rate );
+        }
+        if (get_env( L"WINE_CS_PROFILE", env_str, sizeof(env_str)) && env_str[0] == L'1')
+        {
+            TRACE( "Enabling critical section contention profile.\n" );
+            crit_section_init_profile();
+        }
+        if (get_env( L"WINE_LOADER_STATS", env_str, sizeof(env_str)) && env_str[0] == L'1')
+        {
+            LARGE_INTEGER now;
+
+            RtlQueryPerformanceCounter( &now );
+            loader_phase_start = now.QuadPart;
+            loader_stats = TRUE;
+        }
 
         peb->ProcessHeap        = RtlCreateHeap( heap_flags, NULL, 0, 0, NULL, NULL );
 
@@ -4700,6 +5330,7 @@ void loader_init( CONTEXT *context, void **entry )
         init_user_process_params();
         load_global_options();
         version_init();
+        load_loader_cache();
 
         if (NtCurrentTeb()->WowTebOffset) init_wow64( context );
 
@@ -4769,6 +5400,8 @@ void loader_init( CONTEXT *context, void **entry )
                  debugstr_w(NtCurrentTeb()->Peb->ProcessParameters->ImagePathName.Buffer), status );
             NtTerminateProcess( GetCurrentProcess(), status );
         }
+        save_loader_cache();
+        dump_loader_stats();
         release_address_space();
         if (wm->ldr.TlsIndex == -1) call_tls_callbacks( wm->ldr.DllBase, DLL_PROCESS_ATTACH );
         if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
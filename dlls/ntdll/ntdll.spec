@@ -1718,7 +1718,10 @@
 @ extern -private __wine_syscall_dispatcher
 @ extern -private __wine_unix_call_dispatcher
 @ extern -private __wine_unixlib_handle
+@ stdcall -syscall __wine_futex_wait(ptr long long ptr)
+@ stdcall -syscall __wine_futex_wake(ptr long long ptr)
 @ stdcall -syscall __wine_set_unix_env(ptr ptr)
+@ stdcall -syscall __wine_wait_for_any_object(long ptr long ptr)
 
 # Debugging
 @ stdcall -norelay __wine_dbg_write(ptr long)
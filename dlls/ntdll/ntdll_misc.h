@@ -49,6 +49,8 @@ extern UINT_PTR page_size;
 
 extern BOOL delay_heap_free;
 extern BOOL heap_zero_hack;
+extern BOOL heap_thread_cache;
+extern UINT heap_stats_sample_rate;
 
 /* exceptions */
 extern LONG call_vectored_handlers( EXCEPTION_RECORD *rec, CONTEXT *context );
@@ -96,6 +98,13 @@ extern void (FASTCALL *pBaseThreadInitThunk)(DWORD,LPTHREAD_START_ROUTINE,void *
 
 extern struct _KUSER_SHARED_DATA *user_shared_data;
 
+/* string.c and wcstring.c, requires ddk/wdm.h */
+#ifdef __x86_64__
+#define sse2_strings_supported() TRUE
+#else
+#define sse2_strings_supported() (user_shared_data->ProcessorFeatures[PF_XMMI64_INSTRUCTIONS_AVAILABLE])
+#endif
+
 extern int CDECL NTDLL__vsnprintf( char *str, SIZE_T len, const char *format, va_list args );
 extern int CDECL NTDLL__vsnwprintf( WCHAR *str, SIZE_T len, const WCHAR *format, va_list args );
 
@@ -140,6 +149,11 @@ static inline void ascii_to_unicode( WCHAR *dst, const char *src, size_t len )
 /* FLS data */
 extern TEB_FLS_DATA *fls_alloc_data(void);
 extern void heap_thread_detach(void);
+extern void heap_dump_statistics(void);
+
+/* critical sections */
+extern void crit_section_init_profile(void);
+extern void crit_section_dump_profile(void);
 
 #ifdef __arm64ec__
 
@@ -239,10 +239,13 @@
     SYSCALL_ENTRY( 0x00eb, NtWriteVirtualMemory, 20 ) \
     SYSCALL_ENTRY( 0x00ec, NtYieldExecution, 0 ) \
     SYSCALL_ENTRY( 0x00ed, __wine_dbg_ftrace, 12 ) \
-    SYSCALL_ENTRY( 0x00ee, __wine_needs_override_large_address_aware, 0 ) \
-    SYSCALL_ENTRY( 0x00ef, __wine_set_unix_env, 8 ) \
-    SYSCALL_ENTRY( 0x00f0, wine_nt_to_unix_file_name, 16 ) \
-    SYSCALL_ENTRY( 0x00f1, wine_unix_to_nt_file_name, 12 )
+    SYSCALL_ENTRY( 0x00ee, __wine_futex_wait, 16 ) \
+    SYSCALL_ENTRY( 0x00ef, __wine_futex_wake, 16 ) \
+    SYSCALL_ENTRY( 0x00f0, __wine_needs_override_large_address_aware, 0 ) \
+    SYSCALL_ENTRY( 0x00f1, __wine_set_unix_env, 8 ) \
+    SYSCALL_ENTRY( 0x00f2, __wine_wait_for_any_object, 16 ) \
+    SYSCALL_ENTRY( 0x00f3, wine_nt_to_unix_file_name, 16 ) \
+    SYSCALL_ENTRY( 0x00f4, wine_unix_to_nt_file_name, 12 )
 
 #define ALL_SYSCALLS64 \
     SYSCALL_ENTRY( 0x0000, NtAcceptConnectPort, 48 ) \
@@ -478,7 +481,10 @@
     SYSCALL_ENTRY( 0x00e6, NtWriteVirtualMemory, 40 ) \
     SYSCALL_ENTRY( 0x00e7, NtYieldExecution, 0 ) \
     SYSCALL_ENTRY( 0x00e8, __wine_dbg_ftrace, 24 ) \
-    SYSCALL_ENTRY( 0x00e9, __wine_needs_override_large_address_aware, 0 ) \
-    SYSCALL_ENTRY( 0x00ea, __wine_set_unix_env, 16 ) \
-    SYSCALL_ENTRY( 0x00eb, wine_nt_to_unix_file_name, 32 ) \
-    SYSCALL_ENTRY( 0x00ec, wine_unix_to_nt_file_name, 24 )
+    SYSCALL_ENTRY( 0x00e9, __wine_futex_wait, 32 ) \
+    SYSCALL_ENTRY( 0x00ea, __wine_futex_wake, 32 ) \
+    SYSCALL_ENTRY( 0x00eb, __wine_needs_override_large_address_aware, 0 ) \
+    SYSCALL_ENTRY( 0x00ec, __wine_set_unix_env, 16 ) \
+    SYSCALL_ENTRY( 0x00ed, __wine_wait_for_any_object, 32 ) \
+    SYSCALL_ENTRY( 0x00ee, wine_nt_to_unix_file_name, 32 ) \
+    SYSCALL_ENTRY( 0x00ef, wine_unix_to_nt_file_name, 24 )
@@ -28,11 +28,15 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
 #include "windef.h"
 #include "winbase.h"
 #include "winnls.h"
 #include "winternl.h"
+#include "ddk/wdm.h"
 #include "ntdll_misc.h"
+#include "wine/simdstr.h"
 
 
 /* same as wctypes except for TAB, which doesn't have C1_BLANK for some reason... */
@@ -74,6 +78,9 @@ void * __cdecl memchr( const void *ptr, int c, size_t n )
 {
     const unsigned char *p = ptr;
 
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported()) return (void *)(ULONG_PTR)__wine_sse2_memchr( ptr, c, n );
+#endif
     for (p = ptr; n; n--, p++) if (*p == (unsigned char)c) return (void *)(ULONG_PTR)p;
     return NULL;
 }
@@ -86,6 +93,9 @@ int __cdecl memcmp( const void *ptr1, const void *ptr2, size_t n )
 {
     const unsigned char *p1, *p2;
 
+#ifdef WINE_SIMD_STRINGS
+    if (n >= 16 && sse2_strings_supported()) return __wine_sse2_memcmp( ptr1, ptr2, n );
+#endif
     for (p1 = ptr1, p2 = ptr2; n; n--, p1++, p2++)
     {
         if (*p1 < *p2) return -1;
@@ -285,6 +295,9 @@ errno_t __cdecl strcat_s( char *dst, size_t len, const char *src )
  */
 char * __cdecl strchr( const char *str, int c )
 {
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported()) return (char *)(ULONG_PTR)__wine_sse2_strchr( str, c );
+#endif
     do { if (*str == (char)c) return (char *)(ULONG_PTR)str; } while (*str++);
     return NULL;
 }
@@ -350,6 +363,10 @@ size_t __cdecl strcspn( const char *str, const char *reject )
 size_t __cdecl strlen( const char *str )
 {
     const char *s = str;
+
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported()) return __wine_sse2_strlen( str );
+#endif
     while (*s) s++;
     return s - str;
 }
@@ -481,6 +498,10 @@ errno_t __cdecl strncpy_s( char *dst, size_t len, const char *src, size_t count
 size_t __cdecl strnlen( const char *str, size_t len )
 {
     const char *s;
+
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported()) return __wine_sse2_strnlen( str, len );
+#endif
     for (s = str; len && *s; s++, len--) ;
     return s - str;
 }
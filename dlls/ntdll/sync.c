@@ -142,6 +142,89 @@ DWORD WINAPI RtlRunOnceComplete( RTL_RUN_ONCE *once, ULONG flags, void *context
 }
 
 
+/***********************************************************************
+ * Native futexes
+ ***********************************************************************/
+
+/* When the Unix side supports them, 32-bit aligned waits go directly to
+ * native futexes instead of through the futex queues below. Waiters are
+ * counted per hash bucket, so that wakes don't need a system call when
+ * nobody is waiting. Each waiter removes itself from the count however
+ * its wait ends, since the kernel may also return without a wake. Waiters
+ * on native futexes can't be woken up with NtAlertThreadByThreadId. */
+
+enum native_futex_type
+{
+    FUTEX_ADDRESS,        /* RtlWaitOnAddress */
+    FUTEX_SRW_SHARED,     /* shared SRW lock waiters */
+    FUTEX_SRW_EXCLUSIVE,  /* exclusive SRW lock waiters */
+    FUTEX_TYPE_COUNT
+};
+
+static LONG native_futex_state;  /* 1 if available, -1 if not, 0 if unknown */
+static LONG native_futex_waiters[FUTEX_TYPE_COUNT][256];
+
+static BOOL use_native_futex(void)
+{
+    LONG state = ReadNoFence( &native_futex_state );
+
+    if (!state)
+    {
+        UNICODE_STRING name = RTL_CONSTANT_STRING( L"WINEFUTEX" ), value;
+        static LONG dummy;
+        WCHAR buffer[8];
+
+        value.Length = 0;
+        value.MaximumLength = sizeof(buffer);
+        value.Buffer = buffer;
+
+        /* a waiter preempted before it reaches the kernel makes every wake
+         * a wasted system call, which happens all the time on a single CPU */
+        if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) state = -1;
+        /* WINEFUTEX=0 disables them; this is called from lock waits, so don't
+         * take the PEB lock to read the environment */
+        else if (!RtlQueryEnvironmentVariable_U( NtCurrentTeb()->Peb->ProcessParameters->Environment,
+                                                 &name, &value ) && value.Length && buffer[0] == '0')
+            state = -1;
+        else state = __wine_futex_wake( &dummy, 0, ~0u, NULL ) ? -1 : 1;
+        WriteNoFence( &native_futex_state, state );
+    }
+    return state > 0;
+}
+
+static LONG *get_native_futex_waiters( const void *addr, enum native_futex_type type )
+{
+    ULONG_PTR val = (ULONG_PTR)addr;
+
+    return &native_futex_waiters[type][(val >> 4) % ARRAY_SIZE(native_futex_waiters[0])];
+}
+
+static NTSTATUS native_futex_wait( const LONG *addr, LONG cmp, enum native_futex_type type,
+                                   const LARGE_INTEGER *timeout )
+{
+    LONG *waiters = get_native_futex_waiters( addr, type );
+    NTSTATUS ret;
+
+    /* full barrier, pairs with the one in native_futex_wake() */
+    InterlockedIncrement( waiters );
+    ret = __wine_futex_wait( addr, cmp, 1 << type, timeout );
+    InterlockedDecrement( waiters );
+    return ret == STATUS_RETRY ? STATUS_SUCCESS : ret;
+}
+
+/* returns the number of threads woken up */
+static ULONG native_futex_wake( const LONG *addr, ULONG count, enum native_futex_type type )
+{
+    LONG *waiters = get_native_futex_waiters( addr, type );
+    ULONG woken;
+
+    MemoryBarrier();
+    if (!ReadNoFence( waiters )) return 0;
+    if (__wine_futex_wake( addr, count, 1 << type, &woken )) return 0;
+    return woken;
+}
+
+
 /***********************************************************************
  * Critical sections
  ***********************************************************************/
@@ -200,6 +283,139 @@ static inline NTSTATUS wait_semaphore( RTL_CRITICAL_SECTION *crit, int timeout )
     }
 }
 
+/* explicit spin counts are used as is, sections without one (or created with
+ * RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN) use an estimate of how long the
+ * recent spinning acquisitions took. SpinCount is visible to applications, so
+ * the estimates live in a table indexed by section address instead; sections
+ * sharing a slot simply share their estimate. */
+#define CRIT_SPIN_ADAPTIVE_MAX 1024
+#define CRIT_SPIN_ADAPTIVE_MASK 0x00ffffff
+#define CRIT_SPIN_ESTIMATES 256
+
+static LONG crit_spin_estimates[CRIT_SPIN_ESTIMATES];
+
+static inline BOOL crit_section_spin_adaptive( ULONG_PTR spincount )
+{
+    return !spincount || (spincount & RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN);
+}
+
+static BOOL crit_section_spin( RTL_CRITICAL_SECTION *crit, ULONG_PTR spincount )
+{
+    LONG *slot = &crit_spin_estimates[((ULONG_PTR)crit >> 3) % CRIT_SPIN_ESTIMATES];
+    LONG estimate = ReadNoFence( slot ), prev = estimate;
+    BOOL adaptive = crit_section_spin_adaptive( spincount ), ret = FALSE;
+    ULONG count, max_count;
+
+    if (adaptive) max_count = min( CRIT_SPIN_ADAPTIVE_MAX, estimate * 2 + 16 );
+    else max_count = spincount;
+
+    for (count = 0; count < max_count; count++)
+    {
+        if (crit->LockCount > 0) return FALSE;  /* more than one waiter, don't bother spinning */
+        if (crit->LockCount == -1)              /* try again */
+        {
+            if (InterlockedCompareExchange( &crit->LockCount, 0, -1 ) == -1)
+            {
+                ret = TRUE;
+                break;
+            }
+        }
+        YieldProcessor();
+    }
+
+    if (adaptive)
+    {
+        /* move towards the time the acquisition took, and back off if spinning didn't help */
+        if (ret) estimate += ((LONG)count - estimate) / 8;
+        else estimate -= estimate / 4;
+        if (estimate != prev) WriteNoFence( slot, estimate );
+    }
+    return ret;
+}
+
+/* optional contention profile, see WINE_CS_PROFILE */
+struct crit_section_profile
+{
+    const void *key;       /* section name if any, section address otherwise */
+    const RTL_CRITICAL_SECTION *crit;
+    char        name[64];
+    LONG        waits;
+    LONGLONG    blocked;   /* total blocked time, in performance counter ticks */
+    LONGLONG    max_blocked;
+};
+
+#define CRIT_SECTION_PROFILE_SIZE 1024
+static struct crit_section_profile *crit_section_profiles;
+
+void crit_section_init_profile(void)
+{
+    SIZE_T size = CRIT_SECTION_PROFILE_SIZE * sizeof(*crit_section_profiles);
+    void *addr = NULL;
+
+    if (!NtAllocateVirtualMemory( GetCurrentProcess(), &addr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+        crit_section_profiles = addr;
+}
+
+static void crit_section_record_wait( RTL_CRITICAL_SECTION *crit, LONGLONG ticks )
+{
+    const char *name = crit_section_has_debuginfo( crit ) ? (const char *)crit->DebugInfo->Spare[0] : NULL;
+    const void *key = name ? (const void *)name : crit, *prev;
+    struct crit_section_profile *entry;
+    ULONG i, index = ((ULONG_PTR)key >> 4) % CRIT_SECTION_PROFILE_SIZE;
+    LONGLONG max;
+
+    for (i = 0; i < CRIT_SECTION_PROFILE_SIZE; i++, index = (index + 1) % CRIT_SECTION_PROFILE_SIZE)
+    {
+        entry = crit_section_profiles + index;
+        if (!(prev = InterlockedCompareExchangePointer( (void **)&entry->key, (void *)key, NULL )))
+        {
+            entry->crit = crit;
+            snprintf( entry->name, sizeof(entry->name), "%s", name ? name : "?" );
+        }
+        else if (prev != key) continue;
+
+        InterlockedIncrement( &entry->waits );
+        InterlockedExchangeAdd64( &entry->blocked, ticks );
+        while ((max = entry->max_blocked) < ticks &&
+               InterlockedCompareExchange64( &entry->max_blocked, ticks, max ) != max) /* nothing */;
+        return;
+    }
+}
+
+static int __cdecl compare_crit_section_profiles( const void *a, const void *b )
+{
+    const struct crit_section_profile *pa = *(struct crit_section_profile *const *)a;
+    const struct crit_section_profile *pb = *(struct crit_section_profile *const *)b;
+
+    if (pa->blocked != pb->blocked) return pa->blocked > pb->blocked ? -1 : 1;
+    return pb->waits - pa->waits;
+}
+
+/* dump the most contended sections on process exit */
+void crit_section_dump_profile(void)
+{
+    struct crit_section_profile **sorted;
+    LARGE_INTEGER freq;
+    ULONG i, count = 0;
+
+    if (!crit_section_profiles) return;
+    if (!(sorted = RtlAllocateHeap( GetProcessHeap(), 0, CRIT_SECTION_PROFILE_SIZE * sizeof(*sorted) ))) return;
+
+    for (i = 0; i < CRIT_SECTION_PROFILE_SIZE; i++)
+        if (crit_section_profiles[i].key) sorted[count++] = crit_section_profiles + i;
+    qsort( sorted, count, sizeof(*sorted), compare_crit_section_profiles );
+
+    RtlQueryPerformanceFrequency( &freq );
+    MESSAGE( "%04lx: %lu contended critical sections\n", GetCurrentProcessId(), count );
+    for (i = 0; i < min( count, 32 ); i++)
+        MESSAGE( "    %p %s: %lu waits, %I64u us blocked, max %I64u us\n", sorted[i]->crit,
+                 debugstr_a(sorted[i]->name), sorted[i]->waits,
+                 sorted[i]->blocked * 1000000 / freq.QuadPart,
+                 sorted[i]->max_blocked * 1000000 / freq.QuadPart );
+
+    RtlFreeHeap( GetProcessHeap(), 0, sorted );
+}
+
 /******************************************************************************
  *      RtlInitializeCriticalSection   (NTDLL.@)
  */
@@ -223,7 +439,7 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionAndSpinCount( RTL_CRITICAL_SECTION *
  */
 NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULONG spincount, ULONG flags )
 {
-    if (flags & (RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN|RTL_CRITICAL_SECTION_FLAG_STATIC_INIT))
+    if (flags & RTL_CRITICAL_SECTION_FLAG_STATIC_INIT)
         FIXME("(%p,%lu,0x%08lx) semi-stub\n", crit, spincount, flags);
 
     /* FIXME: if RTL_CRITICAL_SECTION_FLAG_STATIC_INIT is given, we should use
@@ -254,6 +470,8 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULON
     crit->OwningThread   = 0;
     crit->LockSemaphore  = 0;
     if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) spincount = 0;
+    else if (flags & RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN)
+        spincount = RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN | (spincount & CRIT_SPIN_ADAPTIVE_MASK);
     crit->SpinCount = spincount & ~0x80000000;
     return STATUS_SUCCESS;
 }
@@ -304,6 +522,7 @@ NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
 NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
     unsigned int timeout = 5;
+    LARGE_INTEGER start, end;
 
     /* Don't allow blocking on a critical section during process termination */
     if (RtlDllShutdownInProgress())
@@ -313,6 +532,8 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         return STATUS_SUCCESS;
     }
 
+    if (crit_section_profiles) RtlQueryPerformanceCounter( &start );
+
     for (;;)
     {
         NTSTATUS status = wait_semaphore( crit, timeout );
@@ -325,6 +546,11 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
              crit, debugstr_a(crit_section_get_name(crit)), GetCurrentThreadId(), HandleToULong(crit->OwningThread), timeout );
     }
     if (crit_section_has_debuginfo( crit )) crit->DebugInfo->ContentionCount++;
+    if (crit_section_profiles)
+    {
+        RtlQueryPerformanceCounter( &end );
+        crit_section_record_wait( crit, end.QuadPart - start.QuadPart );
+    }
     return STATUS_SUCCESS;
 }
 
@@ -359,20 +585,12 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
  */
 NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
-    if (crit->SpinCount)
-    {
-        ULONG count;
+    ULONG_PTR spincount = crit->SpinCount;
 
+    if (spincount || NtCurrentTeb()->Peb->NumberOfProcessors > 1)
+    {
         if (RtlTryEnterCriticalSection( crit )) return STATUS_SUCCESS;
-        for (count = crit->SpinCount; count > 0; count--)
-        {
-            if (crit->LockCount > 0) break;  /* more than one waiter, don't bother spinning */
-            if (crit->LockCount == -1)       /* try again */
-            {
-                if (InterlockedCompareExchange( &crit->LockCount, 0, -1 ) == -1) goto done;
-            }
-            YieldProcessor();
-        }
+        if (crit_section_spin( crit, spincount )) goto done;
     }
 
     if (InterlockedIncrement( &crit->LockCount ))
@@ -490,6 +708,9 @@ struct srw_lock
      * value of "owners", so the former can wait on the entire structure, and
      * the latter waits only on the "owners" member. Note then that "owners"
      * must not be the first element in the structure.
+     *
+     * Native futexes do have wake masks, so when they are available both
+     * kinds of waiters wait on the entire structure.
      */
     unsigned short owners;
 };
@@ -526,7 +747,7 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 
     for (;;)
     {
-        union { struct srw_lock s; LONG l; } old, new;
+        union { struct srw_lock s; LONG l; } old, new, cur;
         BOOL wait;
 
         do
@@ -549,7 +770,20 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
         if (!wait) return;
-        RtlWaitOnAddress( &u.s->owners, &new.s.owners, sizeof(short), NULL );
+        if (use_native_futex())
+        {
+            cur = new;
+            /* like the owners wait below, don't go back to the lock only
+             * because other exclusive waiters came or went */
+            do
+            {
+                native_futex_wait( u.l, cur.l, FUTEX_SRW_EXCLUSIVE, NULL );
+                cur.l = ReadNoFence( u.l );
+            } while (cur.s.owners == new.s.owners &&
+                     (cur.s.exclusive_waiters & 1) == (new.s.exclusive_waiters & 1));
+        }
+        else
+            RtlWaitOnAddress( &u.s->owners, &new.s.owners, sizeof(short), NULL );
     }
 }
 
@@ -588,7 +822,10 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
         if (!wait) return;
-        RtlWaitOnAddress( u.s, &new.s, sizeof(struct srw_lock), NULL );
+        if (use_native_futex())
+            native_futex_wait( u.l, new.l, FUTEX_SRW_SHARED, NULL );
+        else
+            RtlWaitOnAddress( u.s, &new.s, sizeof(struct srw_lock), NULL );
     }
 }
 
@@ -611,7 +848,14 @@ void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
         new.s.exclusive_waiters &= ~1;
     } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
-    if (new.s.exclusive_waiters)
+    if (use_native_futex())
+    {
+        if (new.s.exclusive_waiters)
+            native_futex_wake( u.l, 1, FUTEX_SRW_EXCLUSIVE );
+        else
+            native_futex_wake( u.l, ~0u, FUTEX_SRW_SHARED );
+    }
+    else if (new.s.exclusive_waiters)
         RtlWakeAddressSingle( &u.s->owners );
     else
         RtlWakeAddressAll( u.s );
@@ -637,7 +881,12 @@ void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
     } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
     if (!new.s.owners)
-        RtlWakeAddressSingle( &u.s->owners );
+    {
+        if (use_native_futex())
+            native_futex_wake( u.l, 1, FUTEX_SRW_EXCLUSIVE );
+        else
+            RtlWakeAddressSingle( &u.s->owners );
+    }
 }
 
 /***********************************************************************
@@ -894,6 +1143,13 @@ NTSTATUS WINAPI RtlWaitOnAddress( const void *addr, const void *cmp, SIZE_T size
     if (size != 1 && size != 2 && size != 4 && size != 8)
         return STATUS_INVALID_PARAMETER;
 
+    if (size == 4 && !((ULONG_PTR)addr & 3) && use_native_futex())
+    {
+        ret = native_futex_wait( addr, *(const LONG *)cmp, FUTEX_ADDRESS, timeout );
+        TRACE("returning %#lx\n", ret);
+        return ret;
+    }
+
     entry.addr = addr;
     entry.tid = GetCurrentThreadId();
 
@@ -944,6 +1200,9 @@ void WINAPI RtlWakeAddressAll( const void *addr )
 
     if (!addr) return;
 
+    if (!((ULONG_PTR)addr & 3) && use_native_futex())
+        native_futex_wake( addr, ~0u, FUTEX_ADDRESS );
+
     spin_lock( &queue->lock );
 
     if (!queue->queue.next)
@@ -983,6 +1242,11 @@ void WINAPI RtlWakeAddressSingle( const void *addr )
 
     if (!addr) return;
 
+    /* waiters with a different size may be queued below, only look there
+     * if no native waiter was woken up */
+    if (!((ULONG_PTR)addr & 3) && use_native_futex() && native_futex_wake( addr, 1, FUTEX_ADDRESS ))
+        return;
+
     spin_lock( &queue->lock );
 
     if (!queue->queue.next)
@@ -872,6 +872,206 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+static int count_dir_entries( const char *dir, const char *name )
+{
+    char path[MAX_PATH];
+    WIN32_FIND_DATAA data;
+    HANDLE handle;
+    int count = 0;
+
+    sprintf( path, "%s\\%s", dir, name );
+    handle = FindFirstFileA( path, &data );
+    if (handle == INVALID_HANDLE_VALUE) return 0;
+    do count++; while (FindNextFileA( handle, &data ));
+    FindClose( handle );
+    return count;
+}
+
+static BOOL is_dir_sorted( const char *dir )
+{
+    char path[MAX_PATH], prev[MAX_PATH] = "";
+    WIN32_FIND_DATAA data;
+    HANDLE handle;
+    BOOL ret = TRUE;
+
+    sprintf( path, "%s\\*", dir );
+    handle = FindFirstFileA( path, &data );
+    if (handle == INVALID_HANDLE_VALUE) return FALSE;
+    do
+    {
+        if (!strcmp( data.cFileName, "." ) || !strcmp( data.cFileName, ".." )) continue;
+        if (lstrcmpiA( prev, data.cFileName ) > 0) ret = FALSE;
+        strcpy( prev, data.cFileName );
+    } while (FindNextFileA( handle, &data ));
+    FindClose( handle );
+    return ret;
+}
+
+static void test_directory_changes(void)
+{
+    char testdir[MAX_PATH], path[MAX_PATH], path2[MAX_PATH];
+    HANDLE handle;
+    int i, count;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "dirchanges.tmp" );
+    ok( CreateDirectoryA( testdir, NULL ), "CreateDirectory failed %lu\n", GetLastError() );
+
+    for (i = 0; i < 20; i++)
+    {
+        sprintf( path, "%s\\File%u.txt", testdir, i );
+        handle = CreateFileA( path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0 );
+        ok( handle != INVALID_HANDLE_VALUE, "%u: CreateFile failed %lu\n", i, GetLastError() );
+        CloseHandle( handle );
+
+        /* directory contents must not be stale after a change */
+        count = count_dir_entries( testdir, "*" );
+        ok( count == i + 3, "%u: got %u entries\n", i, count );
+        count = count_dir_entries( testdir, "file*.TXT" );
+        ok( count == i + 1, "%u: got %u entries\n", i, count );
+
+        sprintf( path, "%s\\FILE%u.TXT", testdir, i );
+        ok( GetFileAttributesA( path ) != INVALID_FILE_ATTRIBUTES, "%u: file not found\n", i );
+    }
+
+    /* renames */
+    sprintf( path, "%s\\File7.txt", testdir );
+    sprintf( path2, "%s\\Moved.txt", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    ok( GetFileAttributesA( path ) == INVALID_FILE_ATTRIBUTES, "old name still found\n" );
+    sprintf( path2, "%s\\MOVED.TXT", testdir );
+    ok( GetFileAttributesA( path2 ) != INVALID_FILE_ATTRIBUTES, "new name not found\n" );
+    count = count_dir_entries( testdir, "*" );
+    ok( count == 22, "got %u entries\n", count );
+    ok( is_dir_sorted( testdir ), "names are not sorted\n" );
+    ok( MoveFileA( path2, path ), "MoveFile failed %lu\n", GetLastError() );
+    ok( is_dir_sorted( testdir ), "names are not sorted\n" );
+
+    for (i = 0; i < 20; i++)
+    {
+        sprintf( path, "%s\\file%u.txt", testdir, i );
+        ok( DeleteFileA( path ), "%u: DeleteFile failed %lu\n", i, GetLastError() );
+
+        count = count_dir_entries( testdir, "*" );
+        ok( count == 21 - i, "%u: got %u entries\n", i, count );
+        ok( GetFileAttributesA( path ) == INVALID_FILE_ATTRIBUTES, "%u: file still found\n", i );
+        ok( GetLastError() == ERROR_FILE_NOT_FOUND, "%u: wrong error %lu\n", i, GetLastError() );
+    }
+
+    ok( RemoveDirectoryA( testdir ), "RemoveDirectory failed %lu\n", GetLastError() );
+}
+
+static void create_numbered_file( const char *path, DWORD number )
+{
+    HANDLE handle;
+    DWORD size;
+
+    handle = CreateFileA( path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0 );
+    ok( handle != INVALID_HANDLE_VALUE, "CreateFile %s failed %lu\n", path, GetLastError() );
+    WriteFile( handle, &number, sizeof(number), &size, NULL );
+    CloseHandle( handle );
+}
+
+static DWORD read_numbered_file( const char *path )
+{
+    DWORD number = ~0u, size;
+    HANDLE handle;
+
+    handle = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    if (handle == INVALID_HANDLE_VALUE) return ~0u;
+    ReadFile( handle, &number, sizeof(number), &size, NULL );
+    CloseHandle( handle );
+    return number;
+}
+
+/* case-insensitive lookups must find the right file after the directory changes */
+static void test_directory_lookup(void)
+{
+    UINT i, count = 500, opens = winetest_interactive ? 100000 : 2000;
+    char testdir[MAX_PATH], path[MAX_PATH], path2[MAX_PATH];
+    LARGE_INTEGER start, end, freq;
+    DWORD number;
+
+    GetTempPathA( MAX_PATH, testdir );
+    strcat( testdir, "dirlookup.tmp" );
+    ok( CreateDirectoryA( testdir, NULL ), "CreateDirectory failed %lu\n", GetLastError() );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( path, "%s\\Entry%u.dat", testdir, i );
+        create_numbered_file( path, i );
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( path, "%s\\eNTRY%u.DAT", testdir, i );
+        number = read_numbered_file( path );
+        ok( number == i, "%u: got %lu\n", i, number );
+    }
+
+    /* rename to a new name, and create a new file with the old one */
+    sprintf( path, "%s\\Entry5.dat", testdir );
+    sprintf( path2, "%s\\Moved5.dat", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    sprintf( path2, "%s\\MOVED5.DAT", testdir );
+    number = read_numbered_file( path2 );
+    ok( number == 5, "got %lu\n", number );
+    sprintf( path, "%s\\ENTRY5.DAT", testdir );
+    number = read_numbered_file( path );
+    ok( number == ~0u, "got %lu\n", number );
+    sprintf( path, "%s\\entry5.dat", testdir );
+    create_numbered_file( path, 1005 );
+    sprintf( path, "%s\\ENTRY5.DAT", testdir );
+    number = read_numbered_file( path );
+    ok( number == 1005, "got %lu\n", number );
+
+    /* swap two names through a temporary one */
+    sprintf( path, "%s\\Entry6.dat", testdir );
+    sprintf( path2, "%s\\swap.tmp", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    sprintf( path, "%s\\Entry7.dat", testdir );
+    sprintf( path2, "%s\\ENTRY6.DAT", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    sprintf( path, "%s\\swap.tmp", testdir );
+    sprintf( path2, "%s\\entry7.DAT", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    sprintf( path, "%s\\entry6.dat", testdir );
+    number = read_numbered_file( path );
+    ok( number == 7, "got %lu\n", number );
+    sprintf( path, "%s\\Entry7.Dat", testdir );
+    number = read_numbered_file( path );
+    ok( number == 6, "got %lu\n", number );
+
+    /* change only the case of a name */
+    sprintf( path, "%s\\Entry8.dat", testdir );
+    sprintf( path2, "%s\\ENTRY8.DAT", testdir );
+    ok( MoveFileA( path, path2 ), "MoveFile failed %lu\n", GetLastError() );
+    number = read_numbered_file( path );
+    ok( number == 8, "got %lu\n", number );
+    ok( count_dir_entries( testdir, "entry8.dat" ) == 1, "wrong number of entries\n" );
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < opens; i++)
+    {
+        sprintf( path, i & 1 ? "%s\\ENTRY%u.dat" : "%s\\entry%u.DAT", testdir, 10 + i % (count - 10) );
+        if (read_numbered_file( path ) != 10 + i % (count - 10)) break;
+    }
+    QueryPerformanceCounter( &end );
+    ok( i == opens, "open %u failed\n", i );
+    trace( "%u mixed-case opens in a %u entries directory: %.0f opens per second\n", opens, count,
+           opens / ((double)(end.QuadPart - start.QuadPart) / freq.QuadPart) );
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf( path, "%s\\entry%u.dat", testdir, i );
+        ok( DeleteFileA( path ), "%u: DeleteFile failed %lu\n", i, GetLastError() );
+    }
+    sprintf( path, "%s\\moved5.dat", testdir );
+    ok( DeleteFileA( path ), "DeleteFile failed %lu\n", GetLastError() );
+    ok( RemoveDirectoryA( testdir ), "RemoveDirectory failed %lu\n", GetLastError() );
+}
+
 static NTSTATUS get_file_id( FILE_INTERNAL_INFORMATION *info, const WCHAR *root, const WCHAR *name )
 {
     OBJECT_ATTRIBUTES attr;
@@ -1065,5 +1265,7 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_directory_changes();
+    test_directory_lookup();
     test_redirection();
 }
@@ -0,0 +1,144 @@
+/*
+ * Unit test suite for ntdll heap functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winbase.h"
+#include "winternl.h"
+#include "wine/test.h"
+
+static void test_heap_statistics(void)
+{
+    HEAP_WINE_ALLOCATION_SITES *sites;
+    HEAP_WINE_STATISTICS *stats;
+    SIZE_T size, live_blocks = 0;
+    void *ptrs[64];
+    NTSTATUS status;
+    HANDLE heap;
+    UINT i;
+
+    heap = RtlCreateHeap( HEAP_GROWABLE, NULL, 0, 0, NULL, NULL );
+    ok( heap != NULL, "RtlCreateHeap failed\n" );
+
+    size = 0xdeadbeef;
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, NULL, 0, &size );
+    if (status == STATUS_INVALID_INFO_CLASS)
+    {
+        win_skip( "HeapWineStatistics not supported\n" );
+        RtlDestroyHeap( heap );
+        return;
+    }
+    ok( status == STATUS_BUFFER_TOO_SMALL, "got status %#lx\n", status );
+    ok( size > sizeof(*stats), "got size %Iu\n", size );
+
+    stats = HeapAlloc( GetProcessHeap(), 0, size );
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, stats, size, &size );
+    ok( !status, "got status %#lx\n", status );
+    ok( stats->SubheapCount == 1, "got %lu subheaps\n", stats->SubheapCount );
+    ok( stats->CommittedSize && stats->CommittedSize <= stats->ReservedSize, "got committed %#Ix, reserved %#Ix\n",
+        stats->CommittedSize, stats->ReservedSize );
+    ok( stats->FreeSize && stats->FreeSize < stats->CommittedSize, "got free size %#Ix\n", stats->FreeSize );
+    ok( stats->LargestFreeBlock <= stats->FreeSize, "got largest free block %#Ix\n", stats->LargestFreeBlock );
+    ok( !stats->LargeBlocks, "got %Iu large blocks\n", stats->LargeBlocks );
+    ok( stats->BinCount > 1, "got %lu bins\n", stats->BinCount );
+    for (i = 0; i < stats->BinCount; i++) live_blocks += stats->Bins[i].LiveBlocks;
+    ok( !live_blocks, "got %Iu live blocks\n", live_blocks );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) ptrs[i] = RtlAllocateHeap( heap, 0, 24 );
+    ptrs[0] = RtlReAllocateHeap( heap, 0, ptrs[0], 0x100000 );
+    ok( ptrs[0] != NULL, "RtlReAllocateHeap failed\n" );
+
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, stats, size, &size );
+    ok( !status, "got status %#lx\n", status );
+    ok( stats->LargeBlocks == 1, "got %Iu large blocks\n", stats->LargeBlocks );
+    ok( stats->LargeSize == 0x100000, "got large size %#Ix\n", stats->LargeSize );
+    if (stats->Instrumented)
+    {
+        HEAP_WINE_BIN_STATISTICS *large = stats->Bins + stats->BinCount - 1;
+
+        ok( large->BlockSize == ~(SIZE_T)0, "got block size %#Ix\n", large->BlockSize );
+        ok( large->LiveBlocks == 1, "got %Iu live large blocks\n", large->LiveBlocks );
+        ok( large->LiveBytes == 0x100000, "got %#Ix live large bytes\n", large->LiveBytes );
+        for (i = 0, live_blocks = 0; i < stats->BinCount; i++) live_blocks += stats->Bins[i].LiveBlocks;
+        ok( live_blocks == ARRAY_SIZE(ptrs), "got %Iu live blocks\n", live_blocks );
+    }
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++) RtlFreeHeap( heap, 0, ptrs[i] );
+
+    status = RtlQueryHeapInformation( heap, HeapWineStatistics, stats, size, &size );
+    ok( !status, "got status %#lx\n", status );
+    for (i = 0, live_blocks = 0; i < stats->BinCount; i++) live_blocks += stats->Bins[i].LiveBlocks;
+    ok( !live_blocks, "got %Iu live blocks\n", live_blocks );
+    HeapFree( GetProcessHeap(), 0, stats );
+
+    status = RtlQueryHeapInformation( heap, HeapWineAllocationSites, NULL, 0, &size );
+    ok( !status || status == STATUS_BUFFER_TOO_SMALL, "got status %#lx\n", status );
+    sites = HeapAlloc( GetProcessHeap(), 0, size );
+    status = RtlQueryHeapInformation( heap, HeapWineAllocationSites, sites, size, &size );
+    ok( !status, "got status %#lx\n", status );
+    if (sites->SampleRate > 1 && sites->SampleRate <= ARRAY_SIZE(ptrs))
+        ok( sites->Count >= 1, "got %lu sites\n", sites->Count );
+    for (i = 0; i < sites->Count; i++) ok( sites->Sites[i].Samples, "got no samples\n" );
+    HeapFree( GetProcessHeap(), 0, sites );
+
+    RtlDestroyHeap( heap );
+}
+
+static void run_child( const char *test, const char *name, const char *value )
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = {0};
+    char cmdline[MAX_PATH + 32];
+    char **argv;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" %s %s", argv[0], argv[1], test );
+
+    si.cb = sizeof(si);
+    SetEnvironmentVariableA( name, value );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    SetEnvironmentVariableA( name, NULL );
+    ok( ret, "CreateProcess failed, error %lu\n", GetLastError() );
+    if (!ret) return;
+
+    wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+}
+
+START_TEST(heap)
+{
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 3)
+    {
+        if (!strcmp( argv[2], "statistics" )) test_heap_statistics();
+        return;
+    }
+
+    test_heap_statistics();
+    if (!strcmp( winetest_platform, "wine" ))
+        run_child( "statistics", "WINE_HEAP_STATS", "16" );
+}
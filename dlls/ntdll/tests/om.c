@@ -3233,6 +3233,97 @@ static void test_zero_access(void)
     ok( status == STATUS_ACCESS_DENIED, "got %#lx.\n", status );
 }
 
+struct request_storm_params
+{
+    HANDLE start;
+    HANDLE object;
+    UINT   iterations;
+    UINT   failures;
+};
+
+static DWORD WINAPI request_storm_thread( void *arg )
+{
+    struct request_storm_params *params = arg;
+    char buffer[sizeof(OBJECT_NAME_INFORMATION) + 256 * sizeof(WCHAR)];
+    NTSTATUS status;
+    ULONG len;
+    UINT i;
+
+    WaitForSingleObject( params->start, INFINITE );
+    for (i = 0; i < params->iterations; i++)
+    {
+        status = pNtQueryObject( params->object, ObjectNameInformation, buffer, sizeof(buffer), &len );
+        if (status) params->failures++;
+    }
+    return 0;
+}
+
+/* run the request storm from the given number of threads, returns the requests per second */
+static double run_request_storm( HANDLE object, UINT count, UINT iterations )
+{
+    struct request_storm_params params[64];
+    LARGE_INTEGER start, end, freq;
+    HANDLE threads[64], event;
+    UINT i;
+
+    event = CreateEventW( NULL, TRUE, FALSE, NULL );
+    for (i = 0; i < count; i++)
+    {
+        params[i].start = event;
+        params[i].object = object;
+        params[i].iterations = iterations;
+        params[i].failures = 0;
+        threads[i] = CreateThread( NULL, 0, request_storm_thread, &params[i], 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+    }
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    SetEvent( event );
+    WaitForMultipleObjects( count, threads, TRUE, INFINITE );
+    QueryPerformanceCounter( &end );
+
+    for (i = 0; i < count; i++)
+    {
+        ok( !params[i].failures, "thread %u: %u requests failed\n", i, params[i].failures );
+        CloseHandle( threads[i] );
+    }
+    CloseHandle( event );
+
+    return count * iterations * (double)freq.QuadPart / (end.QuadPart - start.QuadPart);
+}
+
+/* check concurrent requests from many threads; in interactive mode also measure the
+ * throughput from 1 to 2 * CPU count threads, run with WINESERVER_IO_URING=1 to compare
+ * the main loops */
+static void test_request_storm(void)
+{
+    UINT count, max_count;
+    HANDLE object;
+    SYSTEM_INFO si;
+    double rate;
+
+    object = CreateEventA( NULL, TRUE, FALSE, "test_request_storm" );
+    ok( object != NULL, "CreateEvent failed, error %lu\n", GetLastError() );
+
+    if (!winetest_interactive)
+    {
+        run_request_storm( object, 8, 1000 );
+        CloseHandle( object );
+        return;
+    }
+
+    GetSystemInfo( &si );
+    max_count = min( 64, 2 * si.dwNumberOfProcessors );
+    for (count = 1;; count = min( count * 2, max_count ))
+    {
+        rate = run_request_storm( object, count, 2000000 / count );
+        if (winetest_debug > 1) trace( "%2u threads: %.0f requests per second\n", count, rate );
+        if (count == max_count) break;
+    }
+    CloseHandle( object );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -3298,4 +3389,5 @@ START_TEST(om)
     test_object_identity();
     test_query_directory();
     test_zero_access();
+    test_request_storm();
 }
@@ -927,6 +927,369 @@ static void test_NtQueryValueKey(void)
     pNtClose(key);
 }
 
+static void test_NtQueryValueKey_repeated(void)
+{
+    KEY_VALUE_PARTIAL_INFORMATION *info;
+    UNICODE_STRING name, upper_name;
+    OBJECT_ATTRIBUTES attr;
+    HANDLE key, key2;
+    NTSTATUS status;
+    char buffer[64];
+    DWORD len, data;
+    int i;
+
+    info = (KEY_VALUE_PARTIAL_INFORMATION *)buffer;
+    pRtlCreateUnicodeStringFromAsciiz(&name, "repeatedtest");
+    pRtlCreateUnicodeStringFromAsciiz(&upper_name, "REPEATEDTEST");
+
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&key, KEY_READ, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey Failed: 0x%08lx\n", status);
+    status = pNtOpenKey(&key2, KEY_READ|KEY_SET_VALUE, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey Failed: 0x%08lx\n", status);
+
+    data = 1;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey Failed: 0x%08lx\n", status);
+
+    /* query often enough for the value to be served without a server call */
+    for (i = 0; i < 100; i++)
+    {
+        status = pNtQueryValueKey(key, i & 1 ? &upper_name : &name, KeyValuePartialInformation,
+                                  info, sizeof(buffer), &len);
+        ok(status == STATUS_SUCCESS, "%d: NtQueryValueKey failed: 0x%08lx\n", i, status);
+        ok(*(DWORD *)info->Data == 1, "%d: wrong data %lu\n", i, *(DWORD *)info->Data);
+    }
+
+    data = 2;
+    status = pNtSetValueKey(key2, &name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey Failed: 0x%08lx\n", status);
+    for (i = 0; i < 100; i++)
+    {
+        status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+        ok(status == STATUS_SUCCESS, "%d: NtQueryValueKey failed: 0x%08lx\n", i, status);
+        ok(info->Type == REG_DWORD, "%d: wrong type %lu\n", i, info->Type);
+        ok(*(DWORD *)info->Data == 2, "%d: wrong data %lu\n", i, *(DWORD *)info->Data);
+    }
+
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data), &len);
+    ok(status == STATUS_BUFFER_OVERFLOW, "NtQueryValueKey wrong status 0x%08lx\n", status);
+    ok(len == FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[sizeof(DWORD)]), "NtQueryValueKey wrong len %lu\n", len);
+
+    status = pNtDeleteValueKey(key2, &name);
+    ok(status == STATUS_SUCCESS, "NtDeleteValueKey failed: 0x%08lx\n", status);
+    for (i = 0; i < 100; i++)
+    {
+        status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+        ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "%d: NtQueryValueKey wrong status 0x%08lx\n", i, status);
+    }
+
+    pNtClose(key2);
+    pNtClose(key);
+    pRtlFreeUnicodeString(&upper_name);
+    pRtlFreeUnicodeString(&name);
+}
+
+static void test_many_subkeys(void)
+{
+    KEY_VALUE_BASIC_INFORMATION *value_info;
+    KEY_BASIC_INFORMATION *basic_info;
+    KEY_FULL_INFORMATION full_info;
+    UNICODE_STRING str, subkey_str, ref_str;
+    OBJECT_ATTRIBUTES attr;
+    HANDLE key, subkey, ref_key;
+    WCHAR name[16], buffer[64];
+    NTSTATUS status;
+    DWORD len, data;
+    int i, j, count = 600, ref_count = 100;
+
+    basic_info = (KEY_BASIC_INFORMATION *)buffer;
+    value_info = (KEY_VALUE_BASIC_INFORMATION *)buffer;
+
+    pRtlCreateUnicodeStringFromAsciiz(&str, "manysubkeys");
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&subkey, KEY_ALL_ACCESS, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08lx\n", status);
+    InitializeObjectAttributes(&attr, &str, 0, subkey, 0);
+    status = pNtCreateKey(&key, KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+    ok(status == STATUS_SUCCESS, "NtCreateKey failed: 0x%08lx\n", status);
+    pNtClose(subkey);
+
+    /* create the subkeys and values in reverse order */
+    for (i = count - 1; i >= 0; i--)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+        pRtlInitUnicodeString(&subkey_str, name);
+        InitializeObjectAttributes(&attr, &subkey_str, 0, key, 0);
+        status = pNtCreateKey(&subkey, KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+        ok(status == STATUS_SUCCESS, "%d: NtCreateKey failed: 0x%08lx\n", i, status);
+        pNtClose(subkey);
+
+        data = i;
+        status = pNtSetValueKey(key, &subkey_str, 0, REG_DWORD, &data, sizeof(data));
+        ok(status == STATUS_SUCCESS, "%d: NtSetValueKey failed: 0x%08lx\n", i, status);
+    }
+
+    status = pNtQueryKey(key, KeyFullInformation, &full_info, sizeof(full_info), &len);
+    ok(status == STATUS_SUCCESS || status == STATUS_BUFFER_OVERFLOW, "NtQueryKey failed: 0x%08lx\n", status);
+    ok(full_info.SubKeys == count, "wrong number of subkeys %lu\n", full_info.SubKeys);
+    ok(full_info.Values == count, "wrong number of values %lu\n", full_info.Values);
+
+    /* subkeys are enumerated in sorted order */
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+        status = pNtEnumerateKey(key, i, KeyBasicInformation, basic_info, sizeof(buffer), &len);
+        ok(status == STATUS_SUCCESS, "%d: NtEnumerateKey failed: 0x%08lx\n", i, status);
+        ok(basic_info->NameLength == wcslen(name) * sizeof(WCHAR) &&
+           !memcmp(basic_info->Name, name, basic_info->NameLength),
+           "%d: wrong name %s\n", i, debugstr_wn(basic_info->Name, basic_info->NameLength / sizeof(WCHAR)));
+    }
+    status = pNtEnumerateKey(key, count, KeyBasicInformation, basic_info, sizeof(buffer), &len);
+    ok(status == STATUS_NO_MORE_ENTRIES, "NtEnumerateKey wrong status 0x%08lx\n", status);
+
+    /* values come back in the same order as from a key too small to be indexed */
+    pRtlCreateUnicodeStringFromAsciiz(&ref_str, "fewvalues");
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&subkey, KEY_ALL_ACCESS, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08lx\n", status);
+    InitializeObjectAttributes(&attr, &ref_str, 0, subkey, 0);
+    status = pNtCreateKey(&ref_key, KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+    ok(status == STATUS_SUCCESS, "NtCreateKey failed: 0x%08lx\n", status);
+    pNtClose(subkey);
+
+    for (i = ref_count - 1; i >= 0; i--)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+        pRtlInitUnicodeString(&subkey_str, name);
+        data = i;
+        status = pNtSetValueKey(ref_key, &subkey_str, 0, REG_DWORD, &data, sizeof(data));
+        ok(status == STATUS_SUCCESS, "%d: NtSetValueKey failed: 0x%08lx\n", i, status);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (i < ref_count)
+        {
+            status = pNtEnumerateValueKey(ref_key, i, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+            ok(status == STATUS_SUCCESS, "%d: NtEnumerateValueKey failed: 0x%08lx\n", i, status);
+            memcpy(name, value_info->Name, value_info->NameLength);
+            name[value_info->NameLength / sizeof(WCHAR)] = 0;
+        }
+        else swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+
+        status = pNtEnumerateValueKey(key, i, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+        ok(status == STATUS_SUCCESS, "%d: NtEnumerateValueKey failed: 0x%08lx\n", i, status);
+        ok(value_info->NameLength == wcslen(name) * sizeof(WCHAR) &&
+           !memcmp(value_info->Name, name, value_info->NameLength),
+           "%d: wrong name %s, expected %s\n", i,
+           debugstr_wn(value_info->Name, value_info->NameLength / sizeof(WCHAR)), debugstr_w(name));
+    }
+    status = pNtEnumerateValueKey(key, count, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+    ok(status == STATUS_NO_MORE_ENTRIES, "NtEnumerateValueKey wrong status 0x%08lx\n", status);
+
+    status = pNtDeleteKey(ref_key);
+    ok(status == STATUS_SUCCESS, "NtDeleteKey failed: 0x%08lx\n", status);
+    pNtClose(ref_key);
+    pRtlFreeUnicodeString(&ref_str);
+
+    for (i = 0; i < count; i += 7)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"SUB%04u", i);
+        pRtlInitUnicodeString(&subkey_str, name);
+        InitializeObjectAttributes(&attr, &subkey_str, 0, key, 0);
+        status = pNtOpenKey(&subkey, DELETE, &attr);
+        ok(status == STATUS_SUCCESS, "%d: NtOpenKey failed: 0x%08lx\n", i, status);
+        status = pNtDeleteKey(subkey);
+        ok(status == STATUS_SUCCESS, "%d: NtDeleteKey failed: 0x%08lx\n", i, status);
+        pNtClose(subkey);
+
+        status = pNtDeleteValueKey(key, &subkey_str);
+        ok(status == STATUS_SUCCESS, "%d: NtDeleteValueKey failed: 0x%08lx\n", i, status);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"sub%04u", i);
+        pRtlInitUnicodeString(&subkey_str, name);
+        InitializeObjectAttributes(&attr, &subkey_str, 0, key, 0);
+        status = pNtOpenKey(&subkey, KEY_READ, &attr);
+        if (i % 7)
+        {
+            ok(status == STATUS_SUCCESS, "%d: NtOpenKey failed: 0x%08lx\n", i, status);
+            pNtClose(subkey);
+        }
+        else ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "%d: NtOpenKey wrong status 0x%08lx\n", i, status);
+
+        status = pNtQueryValueKey(key, &subkey_str, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+        if (i % 7) ok(status == STATUS_SUCCESS, "%d: NtQueryValueKey failed: 0x%08lx\n", i, status);
+        else ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "%d: NtQueryValueKey wrong status 0x%08lx\n", i, status);
+    }
+
+    for (i = j = 0; i < count; i++)
+    {
+        if (!(i % 7)) continue;
+        swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+        status = pNtEnumerateValueKey(key, j, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+        ok(status == STATUS_SUCCESS, "%d: NtEnumerateValueKey failed: 0x%08lx\n", j, status);
+        ok(value_info->NameLength == wcslen(name) * sizeof(WCHAR) &&
+           !memcmp(value_info->Name, name, value_info->NameLength),
+           "%d: wrong name %s, expected %s\n", j,
+           debugstr_wn(value_info->Name, value_info->NameLength / sizeof(WCHAR)), debugstr_w(name));
+        j++;
+    }
+    status = pNtEnumerateValueKey(key, j, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+    ok(status == STATUS_NO_MORE_ENTRIES, "NtEnumerateValueKey wrong status 0x%08lx\n", status);
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(i % 7)) continue;
+        swprintf(name, ARRAY_SIZE(name), L"Sub%04u", i);
+        pRtlInitUnicodeString(&subkey_str, name);
+        InitializeObjectAttributes(&attr, &subkey_str, 0, key, 0);
+        status = pNtOpenKey(&subkey, DELETE, &attr);
+        ok(status == STATUS_SUCCESS, "%d: NtOpenKey failed: 0x%08lx\n", i, status);
+        pNtDeleteKey(subkey);
+        pNtClose(subkey);
+    }
+    status = pNtDeleteKey(key);
+    ok(status == STATUS_SUCCESS, "NtDeleteKey failed: 0x%08lx\n", status);
+    pNtClose(key);
+    pRtlFreeUnicodeString(&str);
+}
+
+static double elapsed_seconds( const LARGE_INTEGER *start )
+{
+    LARGE_INTEGER end, freq;
+
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&freq);
+    return (double)(end.QuadPart - start->QuadPart) / freq.QuadPart;
+}
+
+/* import many values and subkeys in random order under one key; the server indexes keys
+ * with many children, run with WINESERVER_REGISTRY_INDEX=0 on a new wineserver to time
+ * the unindexed lookups */
+static void test_many_values_perf(void)
+{
+    KEY_VALUE_BASIC_INFORMATION *value_info;
+    UNICODE_STRING str, value_str;
+    OBJECT_ATTRIBUTES attr;
+    HANDLE root, key, *subkeys;
+    WCHAR name[16], buffer[64];
+    LARGE_INTEGER start;
+    NTSTATUS status;
+    DWORD len, data;
+    int i, j, tmp, count = winetest_interactive ? 100000 : 2000;
+    int *order;
+
+    value_info = (KEY_VALUE_BASIC_INFORMATION *)buffer;
+
+    order = malloc(count * sizeof(*order));
+    subkeys = malloc(count * sizeof(*subkeys));
+    for (i = 0; i < count; i++) order[i] = i;
+    srand(1);
+    for (i = count - 1; i > 0; i--)
+    {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    pRtlCreateUnicodeStringFromAsciiz(&str, "manyvaluesperf");
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&root, KEY_ALL_ACCESS, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08lx\n", status);
+    InitializeObjectAttributes(&attr, &str, 0, root, 0);
+    status = pNtCreateKey(&key, KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+    ok(status == STATUS_SUCCESS, "NtCreateKey failed: 0x%08lx\n", status);
+    pNtClose(root);
+
+    /* insert in random order, then look up and enumerate */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Value%06u", order[i]);
+        pRtlInitUnicodeString(&value_str, name);
+        data = order[i];
+        status = pNtSetValueKey(key, &value_str, 0, REG_DWORD, &data, sizeof(data));
+        if (status) break;
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtSetValueKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d values inserted in %.3f s\n", count, elapsed_seconds(&start));
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Value%06u", i);
+        pRtlInitUnicodeString(&value_str, name);
+        status = pNtQueryValueKey(key, &value_str, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+        if (status) break;
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtQueryValueKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d values looked up in %.3f s\n", count, elapsed_seconds(&start));
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        status = pNtEnumerateValueKey(key, i, KeyValueBasicInformation, value_info, sizeof(buffer), &len);
+        if (status) break;
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtEnumerateValueKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d values enumerated in %.3f s\n", count, elapsed_seconds(&start));
+
+    /* same for subkeys, like a bulk import of class or product keys */
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Key%06u", order[i]);
+        pRtlInitUnicodeString(&value_str, name);
+        InitializeObjectAttributes(&attr, &value_str, 0, key, 0);
+        status = pNtCreateKey(&subkeys[i], KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+        if (status) break;
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtCreateKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d subkeys created in %.3f s\n", count, elapsed_seconds(&start));
+    count = i;
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        swprintf(name, ARRAY_SIZE(name), L"Key%06u", i);
+        pRtlInitUnicodeString(&value_str, name);
+        InitializeObjectAttributes(&attr, &value_str, 0, key, 0);
+        status = pNtOpenKey(&root, KEY_READ, &attr);
+        if (status) break;
+        pNtClose(root);
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtOpenKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d subkeys opened in %.3f s\n", count, elapsed_seconds(&start));
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < count; i++)
+    {
+        status = pNtEnumerateKey(key, i, KeyBasicInformation, buffer, sizeof(buffer), &len);
+        if (status) break;
+    }
+    ok(status == STATUS_SUCCESS, "%d: NtEnumerateKey failed: 0x%08lx\n", i, status);
+    if (winetest_debug > 1) trace("%d subkeys enumerated in %.3f s\n", count, elapsed_seconds(&start));
+
+    for (i = 0; i < count; i++)
+    {
+        status = pNtDeleteKey(subkeys[i]);
+        ok(status == STATUS_SUCCESS, "NtDeleteKey failed: 0x%08lx\n", status);
+        pNtClose(subkeys[i]);
+    }
+
+    status = pNtDeleteKey(key);
+    ok(status == STATUS_SUCCESS, "NtDeleteKey failed: 0x%08lx\n", status);
+    pNtClose(key);
+    pRtlFreeUnicodeString(&str);
+    free(subkeys);
+    free(order);
+}
+
 static void test_NtDeleteKey(void)
 {
     UNICODE_STRING string;
@@ -2680,6 +3043,9 @@ START_TEST(reg)
     test_NtQueryKey();
     test_NtQueryLicenseKey();
     test_NtQueryValueKey();
+    test_NtQueryValueKey_repeated();
+    test_many_subkeys();
+    test_many_values_perf();
     test_long_value_name();
     test_notify();
     test_RtlCreateRegistryKey();
@@ -52,6 +52,7 @@ static void     (WINAPI *pRtlDeleteResource)( RTL_RWLOCK * );
 static void     (WINAPI *pRtlInitializeResource)( RTL_RWLOCK * );
 static void     (WINAPI *pRtlInitUnicodeString)( UNICODE_STRING *, const WCHAR * );
 static void     (WINAPI *pRtlReleaseResource)( RTL_RWLOCK * );
+static NTSTATUS (WINAPI *p__wine_wait_for_any_object)( ULONG, const HANDLE *, BOOLEAN, const LARGE_INTEGER * );
 static NTSTATUS (WINAPI *pRtlWaitOnAddress)( const void *, const void *, SIZE_T, const LARGE_INTEGER * );
 static void     (WINAPI *pRtlWakeAddressAll)( const void * );
 static void     (WINAPI *pRtlWakeAddressSingle)( const void * );
@@ -901,6 +902,357 @@ static void test_close_io_completion(void)
     CloseHandle( thread );
 }
 
+static void test_wait_for_any_object(void)
+{
+    HANDLE events[WINE_MAXIMUM_WAIT_ANY_OBJECTS + 1];
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+    unsigned int i;
+
+    if (!p__wine_wait_for_any_object)
+    {
+        win_skip( "__wine_wait_for_any_object is not available\n" );
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(events); i++)
+    {
+        status = pNtCreateEvent( &events[i], EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE );
+        ok( !status, "NtCreateEvent returned %#lx\n", status );
+    }
+
+    timeout.QuadPart = 0;
+    pNtSetEvent( events[3], NULL );
+    status = p__wine_wait_for_any_object( MAXIMUM_WAIT_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_WAIT_0 + 3, "got %#lx\n", status );
+    status = p__wine_wait_for_any_object( MAXIMUM_WAIT_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_TIMEOUT, "got %#lx\n", status );
+
+    status = p__wine_wait_for_any_object( 0, NULL, FALSE, NULL );
+    if (status == STATUS_NOT_SUPPORTED)
+    {
+        skip( "waits on more than %u objects are not supported\n", MAXIMUM_WAIT_OBJECTS );
+        status = p__wine_wait_for_any_object( MAXIMUM_WAIT_OBJECTS + 1, events, FALSE, &timeout );
+        ok( status == STATUS_NOT_SUPPORTED, "got %#lx\n", status );
+        goto done;
+    }
+    ok( !status, "got %#lx\n", status );
+
+    status = p__wine_wait_for_any_object( ARRAY_SIZE(events), events, FALSE, &timeout );
+    ok( status == STATUS_INVALID_PARAMETER_1, "got %#lx\n", status );
+
+    pNtSetEvent( events[WINE_MAXIMUM_WAIT_ANY_OBJECTS - 1], NULL );
+    pNtSetEvent( events[MAXIMUM_WAIT_OBJECTS + 5], NULL );
+    status = p__wine_wait_for_any_object( WINE_MAXIMUM_WAIT_ANY_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_WAIT_0 + MAXIMUM_WAIT_OBJECTS + 5, "got %#lx\n", status );
+    status = p__wine_wait_for_any_object( WINE_MAXIMUM_WAIT_ANY_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_WAIT_0 + WINE_MAXIMUM_WAIT_ANY_OBJECTS - 1, "got %#lx\n", status );
+    status = p__wine_wait_for_any_object( WINE_MAXIMUM_WAIT_ANY_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_TIMEOUT, "got %#lx\n", status );
+
+    timeout.QuadPart = -10000;
+    status = p__wine_wait_for_any_object( WINE_MAXIMUM_WAIT_ANY_OBJECTS, events, FALSE, &timeout );
+    ok( status == STATUS_TIMEOUT, "got %#lx\n", status );
+
+done:
+    for (i = 0; i < ARRAY_SIZE(events); i++) pNtClose( events[i] );
+}
+
+/* arm many timers at once, then cancel them out of order; every armed timer
+ * is a pending timeout in the server */
+static void test_timer_storm(void)
+{
+    UINT i, count = winetest_interactive ? 100000 : 1000;
+    LARGE_INTEGER start, mid, end, freq, due;
+    NTSTATUS status;
+    BOOLEAN state;
+    HANDLE *timers;
+
+    timers = HeapAlloc( GetProcessHeap(), 0, count * sizeof(*timers) );
+    for (i = 0; i < count; i++)
+    {
+        status = NtCreateTimer( &timers[i], TIMER_ALL_ACCESS, NULL, NotificationTimer );
+        ok( !status, "NtCreateTimer failed %#lx\n", status );
+        if (status) break;
+    }
+    count = i;
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < count; i++)
+    {
+        due.QuadPart = -(LONGLONG)(60 + i % 997) * 10000000;
+        status = NtSetTimer( timers[i], &due, NULL, NULL, FALSE, 0, NULL );
+        ok( !status, "NtSetTimer failed %#lx\n", status );
+    }
+    QueryPerformanceCounter( &mid );
+    for (i = 0; i < count; i++)
+    {
+        state = TRUE;
+        status = NtCancelTimer( timers[(i * 7919) % count], &state );
+        ok( !status, "NtCancelTimer failed %#lx\n", status );
+        ok( !state, "timer %u already signaled\n", (i * 7919) % count );
+    }
+    QueryPerformanceCounter( &end );
+
+    if (winetest_debug > 1)
+        trace( "%u timers: set %.1f ms, cancel %.1f ms\n", count,
+               (mid.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart,
+               (end.QuadPart - mid.QuadPart) * 1000.0 / freq.QuadPart );
+
+    for (i = 0; i < count; i++) pNtClose( timers[i] );
+    HeapFree( GetProcessHeap(), 0, timers );
+}
+
+enum contention_lock
+{
+    CONTENTION_SRW_EXCLUSIVE,
+    CONTENTION_SRW_MIXED,
+    CONTENTION_CRITICAL_SECTION,
+    CONTENTION_CRITICAL_SECTION_SPIN,
+    CONTENTION_CONDITION_VARIABLE,
+};
+
+static const char *contention_names[] =
+{
+    "srw exclusive",
+    "srw mixed",
+    "critical section",
+    "dynamic spin critical section",
+    "condition variable",
+};
+
+struct contention_params
+{
+    enum contention_lock type;
+    HANDLE start;
+    UINT iterations;
+    UINT thread_count;
+};
+
+static RTL_SRWLOCK contention_srw;
+static RTL_CRITICAL_SECTION contention_cs;
+static RTL_CRITICAL_SECTION contention_spin_cs;
+static RTL_CONDITION_VARIABLE contention_cv;
+static volatile LONG contention_counter;
+static volatile LONG contention_turn;
+
+static DWORD WINAPI contention_thread( void *arg )
+{
+    struct contention_params *params = arg;
+    UINT i, index = InterlockedIncrement( &contention_turn ) - 1;
+    LONG value;
+
+    WaitForSingleObject( params->start, INFINITE );
+
+    for (i = 0; i < params->iterations; i++)
+    {
+        switch (params->type)
+        {
+        case CONTENTION_SRW_EXCLUSIVE:
+            RtlAcquireSRWLockExclusive( &contention_srw );
+            contention_counter++;
+            RtlReleaseSRWLockExclusive( &contention_srw );
+            break;
+        case CONTENTION_SRW_MIXED:
+            if (i % 4)
+            {
+                RtlAcquireSRWLockShared( &contention_srw );
+                value = contention_counter;
+                RtlReleaseSRWLockShared( &contention_srw );
+                if (value < 0) return 1;
+                break;
+            }
+            RtlAcquireSRWLockExclusive( &contention_srw );
+            contention_counter++;
+            RtlReleaseSRWLockExclusive( &contention_srw );
+            break;
+        case CONTENTION_CRITICAL_SECTION:
+            RtlEnterCriticalSection( &contention_cs );
+            contention_counter++;
+            RtlLeaveCriticalSection( &contention_cs );
+            break;
+        case CONTENTION_CRITICAL_SECTION_SPIN:
+            /* short hold times, where spinning should usually get the lock */
+            RtlEnterCriticalSection( &contention_spin_cs );
+            value = ++contention_counter;
+            while (value-- % 64) YieldProcessor();
+            RtlLeaveCriticalSection( &contention_spin_cs );
+            break;
+        case CONTENTION_CONDITION_VARIABLE:
+            /* the threads take turns incrementing the counter */
+            RtlAcquireSRWLockExclusive( &contention_srw );
+            while (contention_counter % params->thread_count != index)
+                RtlSleepConditionVariableSRW( &contention_cv, &contention_srw, NULL, 0 );
+            contention_counter++;
+            RtlReleaseSRWLockExclusive( &contention_srw );
+            RtlWakeAllConditionVariable( &contention_cv );
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void test_contention_threads( enum contention_lock type, UINT thread_count, UINT iterations )
+{
+    struct contention_params params;
+    LARGE_INTEGER start, end, freq;
+    HANDLE threads[16], event;
+    double seconds;
+    DWORD code;
+    UINT i;
+
+    RtlInitializeSRWLock( &contention_srw );
+    RtlInitializeConditionVariable( &contention_cv );
+    contention_counter = 0;
+    contention_turn = 0;
+
+    event = CreateEventW( NULL, TRUE, FALSE, NULL );
+    params.type = type;
+    params.start = event;
+    params.iterations = iterations;
+    params.thread_count = thread_count;
+    for (i = 0; i < thread_count; i++)
+    {
+        threads[i] = CreateThread( NULL, 0, contention_thread, &params, 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+    }
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    SetEvent( event );
+    WaitForMultipleObjects( thread_count, threads, TRUE, INFINITE );
+    QueryPerformanceCounter( &end );
+
+    for (i = 0; i < thread_count; i++)
+    {
+        GetExitCodeThread( threads[i], &code );
+        ok( !code, "thread %u failed\n", i );
+        CloseHandle( threads[i] );
+    }
+    CloseHandle( event );
+
+    if (type == CONTENTION_SRW_MIXED) iterations = (iterations + 3) / 4;
+    ok( contention_counter == thread_count * iterations, "%s: got counter %ld, expected %u\n",
+        contention_names[type], contention_counter, thread_count * iterations );
+
+    seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+    if (winetest_debug > 1)
+        trace( "%s, %2u threads: %.0f operations per second\n", contention_names[type], thread_count,
+               thread_count * params.iterations / seconds );
+}
+
+static void test_lock_contention( UINT iterations )
+{
+    static const UINT counts[] = {1, 2, 4, 8};
+    enum contention_lock type;
+    UINT i;
+
+    RtlInitializeCriticalSection( &contention_cs );
+    RtlInitializeCriticalSectionEx( &contention_spin_cs, 0, RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN );
+    for (type = CONTENTION_SRW_EXCLUSIVE; type <= CONTENTION_CONDITION_VARIABLE; type++)
+    {
+        for (i = 0; i < ARRAY_SIZE(counts); i++)
+        {
+            if (type == CONTENTION_CONDITION_VARIABLE && counts[i] == 1) continue;
+            test_contention_threads( type, counts[i],
+                                     type == CONTENTION_CONDITION_VARIABLE ? iterations / 10 : iterations );
+        }
+    }
+    RtlDeleteCriticalSection( &contention_cs );
+    RtlDeleteCriticalSection( &contention_spin_cs );
+}
+
+/* run the contention benchmark with and without native futexes */
+static void run_contention_child( char **argv, const char *futex )
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = {0};
+    char cmdline[MAX_PATH + 32];
+    BOOL ret;
+
+    if (winetest_debug > 1) trace( "running with WINEFUTEX=%s\n", futex );
+    sprintf( cmdline, "\"%s\" %s contention", argv[0], argv[1] );
+    si.cb = sizeof(si);
+    SetEnvironmentVariableA( "WINEFUTEX", futex );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+    SetEnvironmentVariableA( "WINEFUTEX", NULL );
+    ok( ret, "CreateProcess failed, error %lu\n", GetLastError() );
+    if (!ret) return;
+
+    wait_child_process( pi.hProcess );
+    CloseHandle( pi.hThread );
+    CloseHandle( pi.hProcess );
+}
+
+static volatile LONG spin_block_released;
+
+static DWORD WINAPI spin_block_thread( void *arg )
+{
+    RtlEnterCriticalSection( &contention_spin_cs );
+    ok( spin_block_released, "entered the section before it was released\n" );
+    contention_counter++;
+    RtlLeaveCriticalSection( &contention_spin_cs );
+    return 0;
+}
+
+/* short holds train the waiters to spin, a long hold must still make them block */
+static void test_crit_section_spin_block(void)
+{
+    FILETIME creation, exit, kernel, user;
+    ULONG_PTR spincount;
+    ULONGLONG cpu;
+    HANDLE thread;
+    DWORD ret;
+    UINT i;
+
+    RtlInitializeCriticalSectionEx( &contention_spin_cs, 0, RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN );
+    spincount = contention_spin_cs.SpinCount;
+    contention_counter = 0;
+
+    for (i = 0; i < 20; i++)
+    {
+        RtlEnterCriticalSection( &contention_spin_cs );
+        spin_block_released = 0;
+        thread = CreateThread( NULL, 0, spin_block_thread, NULL, 0, NULL );
+        ok( thread != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+
+        if (i == 19)
+        {
+            /* long enough for any spinning to give up */
+            ret = WaitForSingleObject( thread, 200 );
+            ok( ret == WAIT_TIMEOUT, "got %lu\n", ret );
+            /* a thread still spinning would have used most of that time */
+            ret = GetThreadTimes( thread, &creation, &exit, &kernel, &user );
+            ok( ret, "GetThreadTimes failed, error %lu\n", GetLastError() );
+            cpu = ((ULONGLONG)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+                  ((ULONGLONG)user.dwHighDateTime << 32 | user.dwLowDateTime);
+            ok( cpu < 1000000, "waiter used %I64u us of CPU time\n", cpu / 10 );
+        }
+        else Sleep( 0 );
+
+        spin_block_released = 1;
+        RtlLeaveCriticalSection( &contention_spin_cs );
+
+        ret = WaitForSingleObject( thread, 5000 );
+        ok( !ret, "got %lu\n", ret );
+        CloseHandle( thread );
+    }
+
+    ok( contention_counter == 20, "got counter %ld\n", contention_counter );
+    ok( contention_spin_cs.SpinCount == spincount, "got spin count %#Ix, expected %#Ix\n",
+        contention_spin_cs.SpinCount, spincount );
+
+    /* the section is still usable by its owner without contention */
+    RtlEnterCriticalSection( &contention_spin_cs );
+    RtlEnterCriticalSection( &contention_spin_cs );
+    ok( contention_spin_cs.RecursionCount == 2, "got recursion count %ld\n", contention_spin_cs.RecursionCount );
+    RtlLeaveCriticalSection( &contention_spin_cs );
+    RtlLeaveCriticalSection( &contention_spin_cs );
+    RtlDeleteCriticalSection( &contention_spin_cs );
+}
+
 START_TEST(sync)
 {
     HMODULE module = GetModuleHandleA("ntdll.dll");
@@ -909,7 +1261,11 @@ START_TEST(sync)
 
     argc = winetest_get_mainargs( &argv );
 
-    if (argc > 2) return;
+    if (argc > 2)
+    {
+        if (!strcmp( argv[2], "contention" )) test_lock_contention( 1000000 );
+        return;
+    }
 
     pNtAlertThreadByThreadId        = (void *)GetProcAddress(module, "NtAlertThreadByThreadId");
     pNtClose                        = (void *)GetProcAddress(module, "NtClose");
@@ -938,6 +1294,7 @@ START_TEST(sync)
     pRtlInitUnicodeString           = (void *)GetProcAddress(module, "RtlInitUnicodeString");
     pRtlReleaseResource             = (void *)GetProcAddress(module, "RtlReleaseResource");
     pRtlWaitOnAddress               = (void *)GetProcAddress(module, "RtlWaitOnAddress");
+    p__wine_wait_for_any_object     = (void *)GetProcAddress(module, "__wine_wait_for_any_object");
     pRtlWakeAddressAll              = (void *)GetProcAddress(module, "RtlWakeAddressAll");
     pRtlWakeAddressSingle           = (void *)GetProcAddress(module, "RtlWakeAddressSingle");
 
@@ -949,4 +1306,14 @@ START_TEST(sync)
     test_resource();
     test_tid_alert( argv );
     test_close_io_completion();
+    test_wait_for_any_object();
+    test_timer_storm();
+    test_lock_contention( 20000 );
+    test_crit_section_spin_block();
+
+    if (winetest_interactive && !strcmp( winetest_platform, "wine" ))
+    {
+        run_contention_child( argv, "1" );
+        run_contention_child( argv, "0" );
+    }
 }
@@ -838,6 +838,103 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK work_count_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+struct work_nested_ctx
+{
+    TP_CALLBACK_ENVIRON *environment;
+    LONG count;
+};
+
+static void CALLBACK work_nested_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct work_nested_ctx *ctx = userdata;
+
+    /* each callback posts two more callbacks from the worker thread */
+    if (InterlockedIncrement(&ctx->count) < 0x1000)
+    {
+        pTpSimpleTryPost(work_nested_cb, ctx, ctx->environment);
+        pTpSimpleTryPost(work_nested_cb, ctx, ctx->environment);
+    }
+}
+
+static void test_tp_work_nested(void)
+{
+    TP_CALLBACK_ENVIRON environment;
+    struct work_nested_ctx nested;
+    TP_CLEANUP_GROUP *group;
+    NTSTATUS status;
+    TP_POOL *pool;
+    DWORD i;
+
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %lx\n", status);
+    pTpSetPoolMaxThreads(pool, 4);
+    status = pTpAllocCleanupGroup(&group);
+    ok(!status, "TpAllocCleanupGroup failed with status %lx\n", status);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+    environment.CleanupGroup = group;
+    nested.environment = &environment;
+    nested.count = 0;
+    status = pTpSimpleTryPost(work_nested_cb, &nested, &environment);
+    ok(!status, "TpSimpleTryPost failed with status %lx\n", status);
+    for (i = 0; i < 500 && nested.count < 0x1fff; i++) Sleep(10);
+    pTpReleaseCleanupGroupMembers(group, FALSE, NULL);
+    ok(nested.count == 0x1fff, "got %lu callbacks\n", nested.count);
+    pTpReleaseCleanupGroup(group);
+    pTpReleasePool(pool);
+}
+
+/* callback throughput depending on the number of pool threads, only run interactively */
+static void test_tp_work_throughput(void)
+{
+    static const DWORD counts[] = {1, 2, 4, 8, 16, 32, 64};
+    TP_CALLBACK_ENVIRON environment;
+    LARGE_INTEGER start, end, freq;
+    DWORD i, j, total = 1000000;
+    NTSTATUS status;
+    TP_WORK *work;
+    TP_POOL *pool;
+    LONG userdata;
+
+    if (!winetest_interactive) return;
+
+    QueryPerformanceFrequency(&freq);
+    for (i = 0; i < ARRAY_SIZE(counts); i++)
+    {
+        status = pTpAllocPool(&pool, NULL);
+        ok(!status, "TpAllocPool failed with status %lx\n", status);
+        pTpSetPoolMaxThreads(pool, counts[i]);
+
+        memset(&environment, 0, sizeof(environment));
+        environment.Version = 1;
+        environment.Pool = pool;
+        userdata = 0;
+        status = pTpAllocWork(&work, work_count_cb, &userdata, &environment);
+        ok(!status, "TpAllocWork failed with status %lx\n", status);
+
+        QueryPerformanceCounter(&start);
+        for (j = 0; j < total; j++)
+            pTpPostWork(work);
+        pTpWaitForWork(work, FALSE);
+        QueryPerformanceCounter(&end);
+
+        ok(userdata == total, "got %lu callbacks\n", userdata);
+        if (winetest_debug > 1)
+            trace("%2lu threads: %.0f callbacks per second\n", counts[i],
+                  userdata / ((double)(end.QuadPart - start.QuadPart) / freq.QuadPart));
+
+        pTpReleaseWork(work);
+        pTpReleasePool(pool);
+    }
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -2398,6 +2495,8 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_nested();
+    test_tp_work_throughput();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -97,8 +97,48 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_WORKER_SPIN    200
+#define THREADPOOL_MAX_QUEUES     64     /* number of workers owning a local queue */
+#define THREADPOOL_QUEUE_SIZE     256    /* must be a power of two */
+#define THREADPOOL_SHARED_SIZE    1024   /* must be a power of two */
+#define THREADPOOL_SHARED_POLL    32     /* poll the shared queue first every n dequeues */
+#define THREADPOOL_SPLIT_RETRY    100    /* retry splitting an oversized wait bucket every n ms */
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+struct threadpool_object;
+
+/* Work queue owned by a worker thread. Only the owner pushes objects, any
+ * worker may pop them from the head, which keeps the queue in FIFO order. */
+struct threadpool_queue
+{
+    LONG                    head;
+    LONG                    tail;
+    struct threadpool_object *volatile objects[THREADPOOL_QUEUE_SIZE];
+};
+
+/* Bounded multi-producer multi-consumer queue, used for objects submitted
+ * from threads which do not own a local queue. */
+struct threadpool_shared_queue
+{
+    LONG                    enqueue_pos;
+    LONG                    dequeue_pos;
+    struct
+    {
+        LONG                seq;
+        struct threadpool_object *volatile object;
+    } cells[THREADPOOL_SHARED_SIZE];
+};
+
+/* per worker state, slots are reused by new workers and only freed with the pool */
+struct threadpool_worker
+{
+    struct threadpool      *pool;
+    unsigned int            index;
+    BOOL                    active;     /* locked via .pool->cs */
+    unsigned int            dequeue_count;
+    struct threadpool_queue queues[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -108,12 +148,19 @@ struct threadpool
     CRITICAL_SECTION        cs;
     /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
     struct list             pools[3];
+    /* Lock-free queues for work and simple objects, in the same order. Objects
+     * overflow to .pools when they are full. */
+    struct threadpool_shared_queue queues[3];
+    struct threadpool_worker *workers[THREADPOOL_MAX_QUEUES];
+    LONG                    num_worker_slots;
     RTL_CONDITION_VARIABLE  update_event;
-    /* information about worker threads, locked via .cs */
-    int                     max_workers;
-    int                     min_workers;
-    int                     num_workers;
-    int                     num_busy_workers;
+    /* information about worker threads, locked via .cs, counters
+     * used outside of the lock are updated with interlocked functions */
+    LONG                    max_workers;
+    LONG                    min_workers;
+    LONG                    num_workers;
+    LONG                    num_busy_workers;
+    LONG                    num_idle_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -152,11 +199,13 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* information about the pool, locked via .pool->cs, callback counters of
+     * work and simple objects are updated with interlocked functions instead */
     struct list             pool_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
     HANDLE                  completed_event;
+    LONG                    queued;
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
@@ -270,12 +319,14 @@ static struct
 {
     CRITICAL_SECTION        cs;
     LONG                    num_buckets;
+    LONG                    capacity;
     struct list             buckets;
 }
 waitqueue =
 {
     { &waitqueue_debug, -1, 0, 0, 0, 0 },       /* cs */
     0,                                          /* num_buckets */
+    0,                                          /* capacity */
     LIST_INIT( waitqueue.buckets )              /* buckets */
 };
 
@@ -363,6 +414,7 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 }
 
 static void CALLBACK threadpool_worker_proc( void *param );
+static void CALLBACK waitqueue_thread_proc( void *param );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
@@ -1239,18 +1291,111 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
     RtlLeaveCriticalSection( &timerqueue.cs );
 }
 
+/***********************************************************************
+ *           waitqueue_create_bucket    (internal)
+ *
+ * Creates a new bucket and the corresponding wait thread. Must be called
+ * with waitqueue.cs held.
+ */
+static NTSTATUS waitqueue_create_bucket( BOOL alertable, struct waitqueue_bucket **ret )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    HANDLE thread;
+
+    bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
+    if (!bucket)
+        return STATUS_NO_MEMORY;
+
+    bucket->objcount = 0;
+    bucket->alertable = alertable;
+    list_init( &bucket->reserved );
+    list_init( &bucket->waiting );
+
+    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
+                            NULL, SynchronizationEvent, FALSE );
+    if (status)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return status;
+    }
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
+                                  waitqueue_thread_proc, bucket, &thread, NULL );
+    if (status)
+    {
+        NtClose( bucket->update_event );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return status;
+    }
+
+    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+    waitqueue.num_buckets++;
+    NtClose( thread );
+
+    *ret = bucket;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           waitqueue_split_bucket    (internal)
+ *
+ * Moves the wait objects exceeding waitqueue.capacity to new buckets.
+ * Returns FALSE if the bucket is still too large.
+ */
+static BOOL waitqueue_split_bucket( struct waitqueue_bucket *bucket )
+{
+    struct list *lists[2] = { &bucket->reserved, &bucket->waiting };
+    struct waitqueue_bucket *other_bucket = NULL;
+    struct threadpool_object *wait, *next;
+    LONG count = 0;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(lists); i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, lists[i], struct threadpool_object, u.wait.wait_entry )
+        {
+            assert( wait->type == TP_OBJECT_TYPE_WAIT );
+            if (++count <= waitqueue.capacity) continue;
+
+            if (!other_bucket || other_bucket->objcount >= waitqueue.capacity)
+            {
+                if (other_bucket) NtSetEvent( other_bucket->update_event, NULL );
+                if (waitqueue_create_bucket( bucket->alertable, &other_bucket )) return FALSE;
+            }
+
+            list_remove( &wait->u.wait.wait_entry );
+            list_add_tail( i ? &other_bucket->waiting : &other_bucket->reserved, &wait->u.wait.wait_entry );
+            wait->u.wait.bucket = other_bucket;
+            other_bucket->objcount++;
+            bucket->objcount--;
+        }
+    }
+
+    if (other_bucket) NtSetEvent( other_bucket->update_event, NULL );
+    return TRUE;
+}
+
 /***********************************************************************
  *           waitqueue_thread_proc    (internal)
+ *
+ * The handle array is kept across waits and only rebuilt when the bucket
+ * changes, a wait object times out or an object is removed after it was
+ * signaled. handles[0] is the update event, so that a bucket that could
+ * not be split can still wait on a prefix of its objects; the split is then
+ * retried every THREADPOOL_SPLIT_RETRY ms until the remaining objects can be
+ * waited on as well.
  */
 static void CALLBACK waitqueue_thread_proc( void *param )
 {
-    struct threadpool_object *objects[MAXIMUM_WAITQUEUE_OBJECTS];
-    LONG update_serials[MAXIMUM_WAITQUEUE_OBJECTS];
-    HANDLE handles[MAXIMUM_WAITQUEUE_OBJECTS + 1];
+    struct threadpool_object *objects[WINE_MAXIMUM_WAIT_ANY_OBJECTS - 1];
+    LONG update_serials[WINE_MAXIMUM_WAIT_ANY_OBJECTS - 1];
+    HANDLE handles[WINE_MAXIMUM_WAIT_ANY_OBJECTS];
     struct waitqueue_bucket *bucket = param;
     struct threadpool_object *wait, *next;
     LARGE_INTEGER now, timeout;
-    DWORD num_handles;
+    DWORD num_handles = 0, index;
+    BOOL rebuild = TRUE, narrow = FALSE;
     NTSTATUS status;
 
     TRACE( "starting wait queue thread\n" );
@@ -1258,49 +1403,66 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
+    handles[0] = bucket->update_event;
+
     for (;;)
     {
-        NtQuerySystemTime( &now );
-        timeout.QuadPart = MAXLONGLONG;
-        num_handles = 0;
-
-        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object,
-                                  u.wait.wait_entry )
+        if (rebuild || !bucket->objcount)
         {
-            assert( wait->type == TP_OBJECT_TYPE_WAIT );
-            assert( wait->u.wait.wait_pending );
-            if (wait->u.wait.timeout <= now.QuadPart)
+            /* Release temporary references to wait objects. */
+            while (num_handles)
+            {
+                wait = objects[--num_handles];
+                assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                tp_object_release( wait );
+            }
+
+            if (narrow) narrow = !waitqueue_split_bucket( bucket );
+
+            NtQuerySystemTime( &now );
+            timeout.QuadPart = MAXLONGLONG;
+
+            LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object,
+                                      u.wait.wait_entry )
             {
-                /* Wait object timed out. */
-                if ((wait->u.wait.flags & WT_EXECUTEONLYONCE))
+                assert( wait->type == TP_OBJECT_TYPE_WAIT );
+                assert( wait->u.wait.wait_pending );
+                if (wait->u.wait.timeout <= now.QuadPart)
                 {
-                    list_remove( &wait->u.wait.wait_entry );
-                    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-                    wait->u.wait.wait_pending = FALSE;
+                    /* Wait object timed out. */
+                    if ((wait->u.wait.flags & WT_EXECUTEONLYONCE))
+                    {
+                        list_remove( &wait->u.wait.wait_entry );
+                        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+                        wait->u.wait.wait_pending = FALSE;
+                    }
+                    if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
+                    {
+                        InterlockedIncrement( &wait->refcount );
+                        wait->num_pending_callbacks++;
+                        RtlEnterCriticalSection( &wait->pool->cs );
+                        tp_object_execute( wait, TRUE );
+                        RtlLeaveCriticalSection( &wait->pool->cs );
+                        tp_object_release( wait );
+                    }
+                    else tp_object_submit( wait, FALSE );
                 }
-                if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
+                else
                 {
+                    if (wait->u.wait.timeout < timeout.QuadPart)
+                        timeout.QuadPart = wait->u.wait.timeout;
+
+                    assert( num_handles < ARRAY_SIZE(objects) );
                     InterlockedIncrement( &wait->refcount );
-                    wait->num_pending_callbacks++;
-                    RtlEnterCriticalSection( &wait->pool->cs );
-                    tp_object_execute( wait, TRUE );
-                    RtlLeaveCriticalSection( &wait->pool->cs );
-                    tp_object_release( wait );
+                    objects[num_handles] = wait;
+                    handles[num_handles + 1] = wait->u.wait.handle;
+                    update_serials[num_handles] = wait->update_serial;
+                    num_handles++;
                 }
-                else tp_object_submit( wait, FALSE );
-            }
-            else
-            {
-                if (wait->u.wait.timeout < timeout.QuadPart)
-                    timeout.QuadPart = wait->u.wait.timeout;
-
-                assert( num_handles < MAXIMUM_WAITQUEUE_OBJECTS );
-                InterlockedIncrement( &wait->refcount );
-                objects[num_handles] = wait;
-                handles[num_handles] = wait->u.wait.handle;
-                update_serials[num_handles] = wait->update_serial;
-                num_handles++;
             }
+            if (narrow && timeout.QuadPart - now.QuadPart > THREADPOOL_SPLIT_RETRY * 10000)
+                timeout.QuadPart = now.QuadPart + THREADPOOL_SPLIT_RETRY * 10000;
+            rebuild = FALSE;
         }
 
         if (!bucket->objcount)
@@ -1318,16 +1480,18 @@ static void CALLBACK waitqueue_thread_proc( void *param )
         }
         else
         {
-            handles[num_handles] = bucket->update_event;
+            DWORD count = narrow ? min( num_handles, MAXIMUM_WAITQUEUE_OBJECTS ) : num_handles;
+
             RtlLeaveCriticalSection( &waitqueue.cs );
-            status = NtWaitForMultipleObjects( num_handles + 1, handles, TRUE, bucket->alertable, &timeout );
+            status = __wine_wait_for_any_object( count + 1, handles, bucket->alertable, &timeout );
             RtlEnterCriticalSection( &waitqueue.cs );
 
-            if (status >= STATUS_WAIT_0 && status < STATUS_WAIT_0 + num_handles)
+            index = status - STATUS_WAIT_0 - 1;
+            if (status > STATUS_WAIT_0 && index < count)
             {
-                wait = objects[status - STATUS_WAIT_0];
+                wait = objects[index];
                 assert( wait->type == TP_OBJECT_TYPE_WAIT );
-                if (wait->u.wait.bucket && wait->update_serial == update_serials[status - STATUS_WAIT_0])
+                if (wait->u.wait.bucket && wait->update_serial == update_serials[index])
                 {
                     /* Wait object signaled. */
                     assert( wait->u.wait.bucket == bucket );
@@ -1336,6 +1500,7 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                         list_remove( &wait->u.wait.wait_entry );
                         list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
                         wait->u.wait.wait_pending = FALSE;
+                        rebuild = TRUE;
                     }
                     if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                     {
@@ -1351,27 +1516,31 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 {
                     WARN("wait object %p triggered while object was %s.\n",
                             wait, wait->u.wait.bucket ? "updated" : "destroyed");
+                    rebuild = TRUE;
                 }
             }
-
-            /* Release temporary references to wait objects. */
-            while (num_handles)
+            else if (status == STATUS_NOT_SUPPORTED)
             {
-                wait = objects[--num_handles];
-                assert( wait->type == TP_OBJECT_TYPE_WAIT );
-                tp_object_release( wait );
+                /* Some objects can only be waited on by the server, fall
+                 * back to buckets which fit into a single server wait. */
+                TRACE( "limiting wait queue buckets to %u objects\n", MAXIMUM_WAITQUEUE_OBJECTS );
+                waitqueue.capacity = MAXIMUM_WAITQUEUE_OBJECTS;
+                if ((narrow = !waitqueue_split_bucket( bucket )))
+                    WARN( "failed to split wait queue bucket %p, retrying\n", bucket );
+                rebuild = TRUE;
             }
+            else rebuild = TRUE;
         }
 
         /* Try to merge bucket with other threads. */
         if (waitqueue.num_buckets > 1 && bucket->objcount &&
-            bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 1 / 3)
+            bucket->objcount <= waitqueue.capacity * 1 / 3)
         {
             struct waitqueue_bucket *other_bucket;
             LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
             {
                 if (other_bucket != bucket && other_bucket->objcount && other_bucket->alertable == bucket->alertable &&
-                    other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
+                    other_bucket->objcount + bucket->objcount <= waitqueue.capacity * 2 / 3)
                 {
                     other_bucket->objcount += bucket->objcount;
                     bucket->objcount = 0;
@@ -1429,7 +1598,6 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
 {
     struct waitqueue_bucket *bucket;
     NTSTATUS status;
-    HANDLE thread;
     BOOL alertable = (wait->u.wait.flags & WT_EXECUTEINIOTHREAD) != 0;
     assert( wait->type == TP_OBJECT_TYPE_WAIT );
 
@@ -1441,59 +1609,31 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
 
     RtlEnterCriticalSection( &waitqueue.cs );
 
-    /* Try to assign to existing bucket if possible. */
-    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
+    /* Buckets can hold more objects when the wait doesn't go through the server. */
+    if (!waitqueue.capacity)
     {
-        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS && bucket->alertable == alertable)
-        {
-            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-            wait->u.wait.bucket = bucket;
-            bucket->objcount++;
-
-            status = STATUS_SUCCESS;
-            goto out;
-        }
+        if (__wine_wait_for_any_object( 0, NULL, FALSE, NULL ))
+            waitqueue.capacity = MAXIMUM_WAITQUEUE_OBJECTS;
+        else
+            waitqueue.capacity = WINE_MAXIMUM_WAIT_ANY_OBJECTS - 1;
     }
 
-    /* Create a new bucket and corresponding worker thread. */
-    bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
-    if (!bucket)
+    /* Try to assign to existing bucket if possible. */
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
     {
-        status = STATUS_NO_MEMORY;
-        goto out;
+        if (bucket->objcount < waitqueue.capacity && bucket->alertable == alertable)
+            goto done;
     }
 
-    bucket->objcount = 0;
-    bucket->alertable = alertable;
-    list_init( &bucket->reserved );
-    list_init( &bucket->waiting );
-
-    status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS,
-                            NULL, SynchronizationEvent, FALSE );
-    if (status)
-    {
-        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    /* Create a new bucket and corresponding worker thread. */
+    if ((status = waitqueue_create_bucket( alertable, &bucket )))
         goto out;
-    }
-
-    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
-                                  waitqueue_thread_proc, bucket, &thread, NULL );
-    if (status == STATUS_SUCCESS)
-    {
-        list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
-        waitqueue.num_buckets++;
 
-        list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-        wait->u.wait.bucket = bucket;
-        bucket->objcount++;
-
-        NtClose( thread );
-    }
-    else
-    {
-        NtClose( bucket->update_event );
-        RtlFreeHeap( GetProcessHeap(), 0, bucket );
-    }
+done:
+    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+    wait->u.wait.bucket = bucket;
+    bucket->objcount++;
+    status = STATUS_SUCCESS;
 
 out:
     RtlLeaveCriticalSection( &waitqueue.cs );
@@ -1675,7 +1815,7 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
     struct threadpool *pool;
-    unsigned int i;
+    unsigned int i, j;
 
     pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
     if (!pool)
@@ -1690,12 +1830,22 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         list_init( &pool->pools[i] );
+    for (i = 0; i < ARRAY_SIZE(pool->queues); ++i)
+    {
+        pool->queues[i].enqueue_pos = 0;
+        pool->queues[i].dequeue_pos = 0;
+        for (j = 0; j < THREADPOOL_SHARED_SIZE; ++j)
+            pool->queues[i].cells[j].seq = j;
+    }
+    memset( pool->workers, 0, sizeof(pool->workers) );
+    pool->num_worker_slots = 0;
     RtlInitializeConditionVariable( &pool->update_event );
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
@@ -1737,7 +1887,15 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
     assert( pool->shutdown );
     assert( !pool->objcount );
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
         assert( list_empty( &pool->pools[i] ) );
+        assert( pool->queues[i].enqueue_pos == pool->queues[i].dequeue_pos );
+    }
+    for (i = 0; i < pool->num_worker_slots; ++i)
+    {
+        assert( !pool->workers[i]->active );
+        RtlFreeHeap( GetProcessHeap(), 0, pool->workers[i] );
+    }
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -1921,6 +2079,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
     object->completed_event         = NULL;
+    object->queued                  = FALSE;
     object->num_pending_callbacks   = 0;
     object->num_running_callbacks   = 0;
     object->num_associated_callbacks = 0;
@@ -1980,10 +2139,145 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
 
 static void tp_object_prio_queue( struct threadpool_object *object )
 {
-    ++object->pool->num_busy_workers;
+    InterlockedIncrement( &object->pool->num_busy_workers );
     list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
 }
 
+/* Work and simple objects are scheduled through the lock-free work queues,
+ * other objects keep per-callback state which is protected by the pool lock. */
+static inline BOOL object_uses_work_queues( const struct threadpool_object *object )
+{
+    return object->type == TP_OBJECT_TYPE_SIMPLE || object->type == TP_OBJECT_TYPE_WORK;
+}
+
+static BOOL tp_queue_push( struct threadpool_queue *queue, struct threadpool_object *object )
+{
+    ULONG tail = queue->tail;
+
+    if (tail - (ULONG)ReadAcquire( &queue->head ) >= THREADPOOL_QUEUE_SIZE) return FALSE;
+    queue->objects[tail % THREADPOOL_QUEUE_SIZE] = object;
+    WriteRelease( &queue->tail, tail + 1 );
+    return TRUE;
+}
+
+static struct threadpool_object *tp_queue_pop( struct threadpool_queue *queue )
+{
+    struct threadpool_object *object;
+    LONG head = ReadAcquire( &queue->head ), prev;
+
+    while (head != ReadAcquire( &queue->tail ))
+    {
+        /* the slot may be reused as soon as the head moves, in which case the exchange fails */
+        object = queue->objects[(ULONG)head % THREADPOOL_QUEUE_SIZE];
+        if ((prev = InterlockedCompareExchange( &queue->head, (ULONG)head + 1, head )) == head)
+            return object;
+        head = prev;
+    }
+
+    return NULL;
+}
+
+static BOOL tp_shared_queue_push( struct threadpool_shared_queue *queue, struct threadpool_object *object )
+{
+    ULONG pos = ReadNoFence( &queue->enqueue_pos ), prev;
+    LONG diff;
+
+    for (;;)
+    {
+        diff = ReadAcquire( &queue->cells[pos % THREADPOOL_SHARED_SIZE].seq ) - pos;
+        if (diff < 0) return FALSE;
+        if (diff > 0)
+        {
+            pos = ReadNoFence( &queue->enqueue_pos );
+            continue;
+        }
+        if ((prev = InterlockedCompareExchange( &queue->enqueue_pos, pos + 1, pos )) == pos) break;
+        pos = prev;
+    }
+
+    queue->cells[pos % THREADPOOL_SHARED_SIZE].object = object;
+    WriteRelease( &queue->cells[pos % THREADPOOL_SHARED_SIZE].seq, pos + 1 );
+    return TRUE;
+}
+
+static struct threadpool_object *tp_shared_queue_pop( struct threadpool_shared_queue *queue )
+{
+    ULONG pos = ReadNoFence( &queue->dequeue_pos ), prev;
+    struct threadpool_object *object;
+    LONG diff;
+
+    for (;;)
+    {
+        diff = ReadAcquire( &queue->cells[pos % THREADPOOL_SHARED_SIZE].seq ) - (pos + 1);
+        if (diff < 0) return NULL;
+        if (diff > 0)
+        {
+            pos = ReadNoFence( &queue->dequeue_pos );
+            continue;
+        }
+        if ((prev = InterlockedCompareExchange( &queue->dequeue_pos, pos + 1, pos )) == pos) break;
+        pos = prev;
+    }
+
+    object = queue->cells[pos % THREADPOOL_SHARED_SIZE].object;
+    WriteRelease( &queue->cells[pos % THREADPOOL_SHARED_SIZE].seq, pos + THREADPOOL_SHARED_SIZE );
+    return object;
+}
+
+/***********************************************************************
+ *           tp_object_enqueue    (internal)
+ *
+ * Queues a work or simple object, which has to hold a queue reference.
+ * Objects submitted from a worker thread of the same pool go to its local
+ * queue, others to the shared queue of the pool.
+ */
+static void tp_object_enqueue( struct threadpool_object *object, BOOL local )
+{
+    struct threadpool_worker *worker = NtCurrentTeb()->ThreadPoolData;
+    struct threadpool *pool = object->pool;
+
+    InterlockedIncrement( &pool->num_busy_workers );
+
+    if (local && worker && worker->pool == pool &&
+        tp_queue_push( &worker->queues[object->priority], object ))
+        return;
+    if (tp_shared_queue_push( &pool->queues[object->priority], object ))
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    list_add_tail( &pool->pools[object->priority], &object->pool_entry );
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_threadpool_signal    (internal)
+ *
+ * Wakes up an idle worker thread, or starts a new one if all workers are
+ * busy, after work has been queued outside of the pool lock.
+ */
+static void tp_threadpool_signal( struct threadpool *pool, BOOL new_work )
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* pairs with the idle worker accounting in threadpool_worker_proc */
+    MemoryBarrier();
+    if (!ReadNoFence( &pool->num_idle_workers ) &&
+        (!new_work || ReadNoFence( &pool->num_busy_workers ) <= ReadNoFence( &pool->num_workers ) ||
+         ReadNoFence( &pool->num_workers ) >= pool->max_workers))
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+
+    if (new_work && !pool->num_idle_workers && pool->num_busy_workers > pool->num_workers &&
+        pool->num_workers < pool->max_workers)
+        status = tp_new_worker_thread( pool );
+
+    if (status != STATUS_SUCCESS && pool->num_idle_workers)
+        RtlWakeConditionVariable( &pool->update_event );
+
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
 /***********************************************************************
  *           tp_object_submit    (internal)
  *
@@ -1998,6 +2292,22 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
+    if (object_uses_work_queues( object ))
+    {
+        /* Increment refcount and queue the object, unless it is already queued. The
+         * queue holds an additional reference, as it may still contain the object
+         * after all pending callbacks have been cancelled. */
+        InterlockedIncrement( &object->refcount );
+        InterlockedIncrement( &object->num_pending_callbacks );
+        if (!InterlockedCompareExchange( &object->queued, TRUE, FALSE ))
+        {
+            InterlockedIncrement( &object->refcount );
+            tp_object_enqueue( object, TRUE );
+        }
+        tp_threadpool_signal( pool, TRUE );
+        return;
+    }
+
     RtlEnterCriticalSection( &pool->cs );
 
     /* Start new worker threads if required. */
@@ -2035,7 +2345,12 @@ static void tp_object_cancel( struct threadpool_object *object )
     LONG pending_callbacks = 0;
 
     RtlEnterCriticalSection( &pool->cs );
-    if (object->num_pending_callbacks)
+    if (object_uses_work_queues( object ))
+    {
+        /* The object stays in its queue, and is dropped when it is dequeued. */
+        pending_callbacks = InterlockedExchange( &object->num_pending_callbacks, 0 );
+    }
+    else if (object->num_pending_callbacks)
     {
         pending_callbacks = object->num_pending_callbacks;
         object->num_pending_callbacks = 0;
@@ -2057,15 +2372,15 @@ static void tp_object_cancel( struct threadpool_object *object )
 
 static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
 {
-    if (object->num_pending_callbacks)
+    if (ReadAcquire( &object->num_pending_callbacks ))
         return FALSE;
     if (object->type == TP_OBJECT_TYPE_IO && object->u.io.pending_count)
         return FALSE;
 
     if (group)
-        return !object->num_running_callbacks;
+        return !ReadAcquire( &object->num_running_callbacks );
     else
-        return !object->num_associated_callbacks;
+        return !ReadAcquire( &object->num_associated_callbacks );
 }
 
 /***********************************************************************
@@ -2163,55 +2478,20 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
-{
-    struct list *ptr;
-    unsigned int i;
-
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-    {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
-    }
-
-    return ptr;
-}
-
 /***********************************************************************
- *           tp_object_execute    (internal)
+ *           tp_object_run_callback    (internal)
  *
- * Executes a threadpool object callback, object->pool->cs has to be
- * held.
+ * Runs the callback of a threadpool object, followed by the finalization
+ * callback and the cleanup tasks requested by the callback. Returns FALSE
+ * if the callback was disassociated from the object.
  */
-static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
+static BOOL tp_object_run_callback( struct threadpool_object *object, TP_WAIT_RESULT wait_result,
+                                    struct io_completion *completion )
 {
     TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
-    struct io_completion completion;
-    struct threadpool *pool = object->pool;
-    TP_WAIT_RESULT wait_result = 0;
     NTSTATUS status;
 
-    object->num_pending_callbacks--;
-
-    /* For wait objects check if they were signaled or have timed out. */
-    if (object->type == TP_OBJECT_TYPE_WAIT)
-    {
-        wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
-        if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
-    }
-    else if (object->type == TP_OBJECT_TYPE_IO)
-    {
-        assert( object->u.io.completion_count );
-        completion = object->u.io.completions[--object->u.io.completion_count];
-    }
-
-    /* Leave critical section and do the actual callback. */
-    object->num_associated_callbacks++;
-    object->num_running_callbacks++;
-    RtlLeaveCriticalSection( &pool->cs );
-    if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
-
     /* Initialize threadpool instance struct. */
     callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
     instance.object                     = object;
@@ -2267,9 +2547,9 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
         {
             TRACE( "executing I/O callback %p(%p, %p, %#Ix, %p, %p)\n",
                     object->u.io.callback, callback_instance, object->userdata,
-                    completion.cvalue, &completion.iosb, (TP_IO *)object );
+                    completion->cvalue, &completion->iosb, (TP_IO *)object );
             object->u.io.callback( callback_instance, object->userdata,
-                    (void *)completion.cvalue, &completion.iosb, (TP_IO *)object );
+                    (void *)completion->cvalue, &completion->iosb, (TP_IO *)object );
             TRACE( "callback %p returned\n", object->u.io.callback );
             break;
         }
@@ -2314,9 +2594,153 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     }
 
 skip_cleanup:
+    return instance.associated;
+}
+
+/***********************************************************************
+ *           tp_object_execute    (internal)
+ *
+ * Executes a threadpool object callback, object->pool->cs has to be
+ * held.
+ */
+static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
+{
+    struct io_completion completion;
+    struct threadpool *pool = object->pool;
+    TP_WAIT_RESULT wait_result = 0;
+    BOOL associated;
+
+    object->num_pending_callbacks--;
+
+    /* For wait objects check if they were signaled or have timed out. */
+    if (object->type == TP_OBJECT_TYPE_WAIT)
+    {
+        wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+        if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+    }
+    else if (object->type == TP_OBJECT_TYPE_IO)
+    {
+        assert( object->u.io.completion_count );
+        completion = object->u.io.completions[--object->u.io.completion_count];
+    }
+
+    /* Leave critical section and do the actual callback. */
+    InterlockedIncrement( &object->num_associated_callbacks );
+    InterlockedIncrement( &object->num_running_callbacks );
+    RtlLeaveCriticalSection( &pool->cs );
+    if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
+
+    associated = tp_object_run_callback( object, wait_result, &completion );
+
     if (wait_thread) RtlEnterCriticalSection( &waitqueue.cs );
     RtlEnterCriticalSection( &pool->cs );
 
+    InterlockedDecrement( &object->num_running_callbacks );
+    if (object_is_finished( object, TRUE ))
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+
+    if (associated)
+    {
+        InterlockedDecrement( &object->num_associated_callbacks );
+        if (object_is_finished( object, FALSE ))
+            RtlWakeAllConditionVariable( &object->finished_event );
+    }
+}
+
+/***********************************************************************
+ *           tp_object_finish_callback    (internal)
+ *
+ * Accounts the end of a callback which was executed without holding the
+ * pool lock, and wakes up threads waiting for the object if needed.
+ */
+static void tp_object_finish_callback( struct threadpool_object *object, BOOL associated )
+{
+    struct threadpool *pool = object->pool;
+    BOOL finished, group_finished;
+
+    InterlockedDecrement( &object->num_running_callbacks );
+    group_finished = object_is_finished( object, TRUE );
+    finished = FALSE;
+    if (associated)
+    {
+        InterlockedDecrement( &object->num_associated_callbacks );
+        finished = object_is_finished( object, FALSE );
+    }
+    if (!finished && !group_finished) return;
+
+    /* waiters check the counters while holding the pool lock */
+    RtlEnterCriticalSection( &pool->cs );
+    if (group_finished)
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+    if (finished)
+        RtlWakeAllConditionVariable( &object->finished_event );
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_object_requeue    (internal)
+ *
+ * Queues a work or simple object again if it still has pending callbacks,
+ * otherwise releases its queue reference.
+ */
+static void tp_object_requeue( struct threadpool_object *object )
+{
+    if (ReadAcquire( &object->num_pending_callbacks ) <= 0)
+    {
+        /* A concurrent tp_object_submit either still sees the object queued,
+         * or we see its pending callback after clearing the flag. */
+        InterlockedExchange( &object->queued, FALSE );
+        if (ReadAcquire( &object->num_pending_callbacks ) <= 0 ||
+            InterlockedCompareExchange( &object->queued, TRUE, FALSE ))
+        {
+            tp_object_release( object );
+            return;
+        }
+    }
+
+    /* Requeue to the shared queue, so that callbacks of other objects are not
+     * delayed by an object with many pending callbacks. */
+    tp_object_enqueue( object, FALSE );
+    tp_threadpool_signal( object->pool, FALSE );
+}
+
+/***********************************************************************
+ *           tp_object_execute_queued    (internal)
+ *
+ * Executes a callback of a work or simple object taken from the work
+ * queues, without holding the pool lock.
+ */
+static void tp_object_execute_queued( struct threadpool_object *object )
+{
+    LONG pending = ReadNoFence( &object->num_pending_callbacks ), prev;
+    BOOL associated;
+
+    /* Account the callback as running before claiming it, waiters must not
+     * see the object without pending and running callbacks in between. */
+    InterlockedIncrement( &object->num_associated_callbacks );
+    InterlockedIncrement( &object->num_running_callbacks );
+
+    while (pending > 0)
+    {
+        if ((prev = InterlockedCompareExchange( &object->num_pending_callbacks, pending - 1, pending )) == pending)
+            break;
+        pending = prev;
+    }
+
+    if (pending <= 0)
+    {
+        /* all pending callbacks have been cancelled */
+        tp_object_finish_callback( object, TRUE );
+        tp_object_requeue( object );
+        return;
+    }
+
+    /* Let other workers pick up further pending callbacks while this one runs,
+     * the reference of the claimed callback keeps the object alive. */
+    tp_object_requeue( object );
+
+    associated = tp_object_run_callback( object, 0, NULL );
+
     /* Simple callbacks are automatically shutdown after execution. */
     if (object->type == TP_OBJECT_TYPE_SIMPLE)
     {
@@ -2324,16 +2748,138 @@ skip_cleanup:
         object->shutdown = TRUE;
     }
 
-    object->num_running_callbacks--;
-    if (object_is_finished( object, TRUE ))
-        RtlWakeAllConditionVariable( &object->group_finished_event );
+    tp_object_finish_callback( object, associated );
+    tp_object_release( object );
+}
+
+/***********************************************************************
+ *           tp_worker_attach    (internal)
+ *
+ * Assigns a work queue slot to the current worker thread, pool->cs has
+ * to be held. Returns NULL if all slots are in use.
+ */
+static struct threadpool_worker *tp_worker_attach( struct threadpool *pool )
+{
+    struct threadpool_worker *worker;
+    unsigned int i;
+
+    for (i = 0; i < pool->num_worker_slots; ++i)
+        if (!pool->workers[i]->active) break;
 
-    if (instance.associated)
+    if (i == pool->num_worker_slots)
     {
-        object->num_associated_callbacks--;
-        if (object_is_finished( object, FALSE ))
-            RtlWakeAllConditionVariable( &object->finished_event );
+        if (i == ARRAY_SIZE(pool->workers)) return NULL;
+        if (!(worker = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*worker) ))) return NULL;
+        worker->pool  = pool;
+        worker->index = i;
+        pool->workers[i] = worker;
+        /* pairs with the stealing loop in tp_threadpool_get_next_object */
+        WriteRelease( &pool->num_worker_slots, i + 1 );
+    }
+
+    worker = pool->workers[i];
+    worker->active = TRUE;
+    NtCurrentTeb()->ThreadPoolData = worker;
+    return worker;
+}
+
+/***********************************************************************
+ *           tp_worker_detach    (internal)
+ *
+ * Releases the work queue slot of the current worker thread, pool->cs
+ * has to be held. Its queues are empty at this point, as only the owner
+ * pushes to them.
+ */
+static void tp_worker_detach( struct threadpool_worker *worker )
+{
+    NtCurrentTeb()->ThreadPoolData = NULL;
+    if (worker) worker->active = FALSE;
+}
+
+static BOOL tp_threadpool_has_work( struct threadpool *pool )
+{
+    unsigned int i, j, count = ReadAcquire( &pool->num_worker_slots );
+
+    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
+        if (!list_empty( &pool->pools[i] )) return TRUE;
+        if (ReadNoFence( &pool->queues[i].enqueue_pos ) != ReadNoFence( &pool->queues[i].dequeue_pos )) return TRUE;
+        for (j = 0; j < count; ++j)
+        {
+            struct threadpool_queue *queue = &pool->workers[j]->queues[i];
+            if (ReadNoFence( &queue->head ) != ReadNoFence( &queue->tail )) return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/***********************************************************************
+ *           tp_threadpool_get_next_object    (internal)
+ *
+ * Dequeues the next object to execute, from the local queue of the
+ * worker, the shared queue and the locked pool list, in that order for
+ * each priority, before trying to steal work from other workers. Returns
+ * with pool->cs held if *locked is set.
+ */
+static struct threadpool_object *tp_threadpool_get_next_object( struct threadpool *pool, struct threadpool_worker *worker,
+                                                                BOOL *locked )
+{
+    struct threadpool_object *object;
+    unsigned int i, j, count;
+    struct list *ptr;
+    BOOL shared_first;
+
+    *locked = FALSE;
+
+    /* make sure that a worker submitting its own work doesn't starve the shared queue */
+    shared_first = !worker || !(++worker->dequeue_count % THREADPOOL_SHARED_POLL);
+
+    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
+        if (shared_first && (object = tp_shared_queue_pop( &pool->queues[i] ))) return object;
+        if (worker && (object = tp_queue_pop( &worker->queues[i] ))) return object;
+        if (!shared_first && (object = tp_shared_queue_pop( &pool->queues[i] ))) return object;
+
+        /* unlocked check first, the list is only used by timers, waits, I/O
+         * and when the lock-free queues are full */
+        if (list_empty( &pool->pools[i] )) continue;
+
+        RtlEnterCriticalSection( &pool->cs );
+        if ((ptr = list_head( &pool->pools[i] )))
+        {
+            object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+            list_remove( &object->pool_entry );
+
+            if (object_uses_work_queues( object ))
+            {
+                RtlLeaveCriticalSection( &pool->cs );
+                return object;
+            }
+
+            /* If further pending callbacks are queued, move the work item to
+             * the end of the pool list. Otherwise remove it from the pool. */
+            assert( object->num_pending_callbacks > 0 );
+            if (object->num_pending_callbacks > 1)
+                tp_object_prio_queue( object );
+
+            *locked = TRUE;
+            return object;
+        }
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+
+    count = ReadAcquire( &pool->num_worker_slots );
+    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
+        for (j = 1; j <= count; ++j)
+        {
+            struct threadpool_worker *victim = pool->workers[((worker ? worker->index : 0) + j) % count];
+            if (victim != worker && (object = tp_queue_pop( &victim->queues[i] ))) return object;
+        }
     }
+
+    return NULL;
 }
 
 /***********************************************************************
@@ -2342,37 +2888,61 @@ skip_cleanup:
 static void CALLBACK threadpool_worker_proc( void *param )
 {
     struct threadpool *pool = param;
+    struct threadpool_object *object;
+    struct threadpool_worker *worker;
     LARGE_INTEGER timeout;
-    struct list *ptr;
+    NTSTATUS status;
+    BOOL locked;
+    int spin, spin_count;
 
     TRACE( "starting worker thread for pool %p\n", pool );
     set_thread_name(L"wine_threadpool_worker");
 
+    /* spinning only delays the threads queuing new work on a single processor */
+    spin_count = NtCurrentTeb()->Peb->NumberOfProcessors > 1 ? THREADPOOL_WORKER_SPIN : 1;
+
     RtlEnterCriticalSection( &pool->cs );
+    worker = tp_worker_attach( pool );
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
-        {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
+        RtlLeaveCriticalSection( &pool->cs );
 
-            /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
-            if (object->num_pending_callbacks > 1)
-                tp_object_prio_queue( object );
+        for (spin = 0; spin < spin_count; ++spin)
+        {
+            while ((object = tp_threadpool_get_next_object( pool, worker, &locked )))
+            {
+                if (locked)
+                {
+                    tp_object_execute( object, FALSE );
+                    RtlLeaveCriticalSection( &pool->cs );
+                    tp_object_release( object );
+                }
+                else tp_object_execute_queued( object );
 
-            tp_object_execute( object, FALSE );
+                assert( pool->num_busy_workers );
+                InterlockedDecrement( &pool->num_busy_workers );
+                spin = 0;
+            }
+            YieldProcessor();
+        }
 
-            assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+        RtlEnterCriticalSection( &pool->cs );
 
-            tp_object_release( object );
+        /* Account the thread as idle before checking for work, tp_threadpool_signal
+         * checks the idle count after queuing an object. */
+        InterlockedIncrement( &pool->num_idle_workers );
+        if (tp_threadpool_has_work( pool ))
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
+            continue;
         }
 
         /* Shutdown worker thread if requested. */
         if (pool->shutdown)
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
             break;
+        }
 
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
@@ -2380,13 +2950,15 @@ static void CALLBACK threadpool_worker_proc( void *param )
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+        status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        InterlockedDecrement( &pool->num_idle_workers );
+        if (status == STATUS_TIMEOUT && !tp_threadpool_has_work( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
     }
+    tp_worker_detach( worker );
     pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
@@ -2734,7 +3306,7 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     pool = object->pool;
     RtlEnterCriticalSection( &pool->cs );
 
-    object->num_associated_callbacks--;
+    InterlockedDecrement( &object->num_associated_callbacks );
     if (object_is_finished( object, FALSE ))
         RtlWakeAllConditionVariable( &object->finished_event );
 
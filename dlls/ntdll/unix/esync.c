@@ -157,6 +157,7 @@ static inline UINT_PTR handle_to_index( HANDLE handle, UINT_PTR *entry )
     return idx % ESYNC_LIST_BLOCK_SIZE;
 }
 
+/* must be called inside the fd cache section, which serializes the updates */
 static struct esync *add_to_list( HANDLE handle, enum esync_type type, int fd, void *shm )
 {
     UINT_PTR entry, idx = handle_to_index( handle, &entry );
@@ -175,14 +176,17 @@ static struct esync *add_to_list( HANDLE handle, enum esync_type type, int fd, v
             void *ptr = anon_mmap_alloc( ESYNC_LIST_BLOCK_SIZE * sizeof(struct esync),
                                          PROT_READ | PROT_WRITE );
             if (ptr == MAP_FAILED) return FALSE;
-            esync_list[entry] = ptr;
+            if (InterlockedCompareExchangePointer( (void **)&esync_list[entry], ptr, NULL ))
+                munmap( ptr, ESYNC_LIST_BLOCK_SIZE * sizeof(struct esync) );
         }
     }
 
-    if (!InterlockedCompareExchange( (LONG *)&esync_list[entry][idx].type, type, 0 ))
+    if (!esync_list[entry][idx].type)
     {
+        /* readers don't take the lock, publish the type last */
         esync_list[entry][idx].fd = fd;
         esync_list[entry][idx].shm = shm;
+        __atomic_store_n( &esync_list[entry][idx].type, type, __ATOMIC_RELEASE );
     }
     return &esync_list[entry][idx];
 }
@@ -192,11 +196,14 @@ static struct esync *get_cached_object( HANDLE handle )
     UINT_PTR entry, idx = handle_to_index( handle, &entry );
 
     if (entry >= ESYNC_LIST_ENTRIES || !esync_list[entry]) return NULL;
-    if (!esync_list[entry][idx].type) return NULL;
+    if (!__atomic_load_n( &esync_list[entry][idx].type, __ATOMIC_ACQUIRE )) return NULL;
 
     return &esync_list[entry][idx];
 }
 
+/* cache statistics, only maintained when tracing */
+static LONG cache_hits, cache_misses;
+
 /* Gets an object. This is either a proper esync object (i.e. an event,
  * semaphore, etc. created using create_esync) or a generic synchronizable
  * server-side object which the server will signal (e.g. a process, thread,
@@ -210,7 +217,11 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
     sigset_t sigset;
     int fd = -1;
 
-    if ((*obj = get_cached_object( handle ))) return STATUS_SUCCESS;
+    if ((*obj = get_cached_object( handle )))
+    {
+        if (TRACE_ON(esync)) InterlockedIncrement( &cache_hits );
+        return STATUS_SUCCESS;
+    }
 
     if ((INT_PTR)handle < 0)
     {
@@ -225,6 +236,10 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
         return STATUS_INVALID_HANDLE;
     }
 
+    if (TRACE_ON(esync))
+        TRACE( "cache miss for %p, %d hits, %d misses.\n", handle, (int)cache_hits,
+               (int)InterlockedIncrement( &cache_misses ));
+
     /* We need to try grabbing it from the server. */
     server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
     if (!(*obj = get_cached_object( handle )))
@@ -241,10 +256,11 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
             }
         }
         SERVER_END_REQ;
+        if (!ret) *obj = add_to_list( handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
     }
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
-    if (*obj)
+    if (*obj && fd == -1)
     {
         /* We managed to grab it while in the CS; return it. */
         return STATUS_SUCCESS;
@@ -258,11 +274,59 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
     }
 
     TRACE("Got fd %d for handle %p.\n", fd, handle);
-
-    *obj = add_to_list( handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
     return ret;
 }
 
+/* Retrieve the fds of all the handles that are not cached yet in a single
+ * server round trip, instead of one get_esync_fd call each. */
+static void prefetch_objects( const HANDLE *handles, DWORD count )
+{
+    struct __server_request_info reqs[MAXIMUM_WAIT_OBJECTS];
+    void *req_ptrs[MAXIMUM_WAIT_OBJECTS];
+    HANDLE missing[MAXIMUM_WAIT_OBJECTS];
+    unsigned int i, nb_missing = 0, nb_reqs = 0;
+    obj_handle_t fd_handle;
+    sigset_t sigset;
+
+    for (i = 0; i < count && i < MAXIMUM_WAIT_OBJECTS; i++)
+        if ((INT_PTR)handles[i] > 0 && !get_cached_object( handles[i] )) missing[nb_missing++] = handles[i];
+    if (nb_missing < 2) return;  /* get_object() does it just as well */
+
+    /* the server sends the fds of the successful requests in request order,
+     * see server_call_batch(); they must be received inside the fd cache
+     * section so that no other thread reads them from the socket */
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    for (i = 0; i < nb_missing; i++)
+    {
+        if (get_cached_object( missing[i] )) continue;
+        memset( &reqs[nb_reqs].u.req, 0, sizeof(reqs[nb_reqs].u.req) );
+        reqs[nb_reqs].name = "get_esync_fd";
+        reqs[nb_reqs].u.req.request_header.req = REQ_get_esync_fd;
+        reqs[nb_reqs].u.req.get_esync_fd_request.handle = wine_server_obj_handle( missing[i] );
+        reqs[nb_reqs].data_count = 0;
+        req_ptrs[nb_reqs] = &reqs[nb_reqs];
+        missing[nb_reqs++] = missing[i];
+    }
+    if (nb_reqs)
+    {
+        /* requests that weren't processed have an error status, even if the batch failed */
+        server_call_batch( req_ptrs, nb_reqs );
+        for (i = 0; i < nb_reqs; i++)
+        {
+            const struct get_esync_fd_reply *reply = &reqs[i].u.reply.get_esync_fd_reply;
+            int fd;
+
+            if (reply->__header.error) continue;
+            fd = receive_fd( &fd_handle );
+            assert( wine_server_ptr_handle(fd_handle) == missing[i] );
+            TRACE( "Got fd %d for handle %p.\n", fd, missing[i] );
+            if (get_cached_object( missing[i] )) close( fd );  /* duplicate handle in the list */
+            else add_to_list( missing[i], reply->type, fd, reply->shm_idx ? get_shm( reply->shm_idx ) : 0 );
+        }
+    }
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+}
+
 NTSTATUS esync_close( HANDLE handle )
 {
     UINT_PTR entry, idx = handle_to_index( handle, &entry );
@@ -315,13 +379,12 @@ static NTSTATUS create_esync( enum esync_type type, HANDLE *handle, ACCESS_MASK
         }
     }
     SERVER_END_REQ;
+    if (!ret || ret == STATUS_OBJECT_NAME_EXISTS)
+        add_to_list( *handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
     if (!ret || ret == STATUS_OBJECT_NAME_EXISTS)
-    {
-        add_to_list( *handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
         TRACE("-> handle %p, fd %d.\n", *handle, fd);
-    }
 
     free( objattr );
     return ret;
@@ -355,14 +418,10 @@ static NTSTATUS open_esync( enum esync_type type, HANDLE *handle,
         }
     }
     SERVER_END_REQ;
+    if (!ret) add_to_list( *handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
     server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
-    if (!ret)
-    {
-        add_to_list( *handle, type, fd, shm_idx ? get_shm( shm_idx ) : 0 );
-
-        TRACE("-> handle %p, fd %d.\n", *handle, fd);
-    }
+    if (!ret) TRACE("-> handle %p, fd %d.\n", *handle, fd);
     return ret;
 }
 
@@ -811,8 +870,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
 {
     static const LARGE_INTEGER zero;
 
-    struct esync *objs[MAXIMUM_WAIT_OBJECTS];
-    struct pollfd fds[MAXIMUM_WAIT_OBJECTS + 1];
+    struct esync *objs[WINE_MAXIMUM_WAIT_ANY_OBJECTS];
+    struct pollfd fds[WINE_MAXIMUM_WAIT_ANY_OBJECTS + 1];
     int has_esync = 0, has_server = 0;
     BOOL msgwait = FALSE;
     LONGLONG timeleft;
@@ -856,6 +915,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
             end = now.QuadPart - timeout->QuadPart;
     }
 
+    prefetch_objects( handles, count );
+
     for (i = 0; i < count; i++)
     {
         ret = get_object( handles[i], &objs[i] );
@@ -871,7 +932,11 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
         msgwait = TRUE;
 
     if (has_esync && has_server)
+    {
+        /* the server can't take more objects, and dropping them would be wrong */
+        if (count > MAXIMUM_WAIT_OBJECTS) return STATUS_NOT_SUPPORTED;
         FIXME("Can't wait on esync and server objects at the same time!\n");
+    }
     else if (has_server)
         return STATUS_NOT_IMPLEMENTED;
 
@@ -1052,7 +1117,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                                 /* We found our object. */
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
                                 if (update_grabbed_object( obj ))
-                                    return STATUS_ABANDONED_WAIT_0 + i;
+                                    /* indices past MAXIMUM_WAIT_OBJECTS can't be reported as abandoned */
+                                    return (i < MAXIMUM_WAIT_OBJECTS ? STATUS_ABANDONED_WAIT_0 : STATUS_WAIT_0) + i;
                                 return i;
                             }
                         }
@@ -106,6 +106,9 @@
 #undef XATTR_ADDITIONAL_OPTIONS
 #include <sys/extattr.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include <time.h>
 #include <unistd.h>
 
@@ -2489,6 +2492,536 @@ done:
 }
 
 
+/* compare file names for directory sorting */
+static int name_compare( const void *a, const void *b )
+{
+    const struct dir_data_names *file_a = (const struct dir_data_names *)a;
+    const struct dir_data_names *file_b = (const struct dir_data_names *)b;
+    int ret = wcsicmp( file_a->long_name, file_b->long_name );
+    if (!ret) ret = wcscmp( file_a->long_name, file_b->long_name );
+    return ret;
+}
+
+
+/* sort file names, but not "." and ".." */
+static void sort_dir_data_names( struct dir_data *data )
+{
+    unsigned int i = 0, j;
+
+    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
+    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
+    for (j = i + 1; j < data->count; j++)
+        if (name_compare( &data->names[j - 1], &data->names[j] ) > 0) break;
+    if (j < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+}
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* process-wide cache of directory listings, kept up to date through inotify */
+struct dir_listing
+{
+    struct list      entry;          /* entry in the LRU list */
+    dev_t            dev;            /* directory device */
+    ino_t            ino;            /* directory inode */
+    int              wd;             /* inotify watch descriptor, -1 if already removed */
+    BOOLEAN          case_sensitive; /* whether lookups in the directory are case sensitive */
+    BOOLEAN          building;       /* the directory is being read without the mutex held */
+    BOOLEAN          invalid;        /* the directory changed while it was being read */
+    BOOLEAN          sorted;         /* the names are in sorted order */
+    struct dir_data *data;           /* directory contents, with generated short names */
+    unsigned int     removed;        /* names removed since reading, their strings are still in data */
+    unsigned int     hash_size;      /* size of the name hash table, a power of 2 */
+    unsigned int     next_size;      /* number of names hash_next has room for */
+    int             *hash;           /* first node in each bucket, -1 if empty */
+    int             *hash_next;      /* next node in the same bucket; node 2 * i is the long name of
+                                        name i, node 2 * i + 1 its short name */
+};
+
+static struct list dir_listings = LIST_INIT( dir_listings );
+static unsigned int dir_listing_count;
+static int dir_listing_fd = -1;
+static BOOL dir_listing_disabled;
+static pthread_mutex_t dir_listing_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const unsigned int dir_listing_max_count = 256;
+
+#define DIR_LISTING_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_UNMOUNT)
+
+static void free_dir_listing( struct dir_listing *listing )
+{
+    if (listing->wd != -1) inotify_rm_watch( dir_listing_fd, listing->wd );
+    list_remove( &listing->entry );
+    dir_listing_count--;
+    free_dir_data( listing->data );
+    free( listing->hash );
+    free( listing->hash_next );
+    free( listing );
+}
+
+/* add a file to a directory listing, always generating the short name */
+static BOOL append_listing_entry( struct dir_data *data, const char *long_name )
+{
+    WCHAR long_nameW[MAX_DIR_ENTRY_LEN + 1];
+    WCHAR short_nameW[13];
+    int long_len, short_len = 0;
+
+    long_len = ntdll_umbstowcs( long_name, strlen(long_name), long_nameW, ARRAY_SIZE(long_nameW) );
+    if (long_len == ARRAY_SIZE(long_nameW)) return TRUE;
+    long_nameW[long_len] = 0;
+
+    if (!is_legal_8dot3_name( long_nameW, long_len ))
+        short_len = hash_short_file_name( long_nameW, long_len, short_nameW );
+    short_nameW[short_len] = 0;
+    wcsupr( short_nameW );
+
+    return add_dir_data_names( data, long_nameW, short_nameW, long_name );
+}
+
+static unsigned int hash_dir_name( const WCHAR *name, int length )
+{
+    unsigned int hash = 0;
+
+    while (length--) hash = hash * 65599 + towupper( *name++ );
+    return hash;
+}
+
+static inline const WCHAR *get_listing_node_name( const struct dir_listing *listing, int node )
+{
+    const struct dir_data_names *names = &listing->data->names[node / 2];
+    return (node & 1) ? names->short_name : names->long_name;
+}
+
+static inline int *get_listing_bucket( const struct dir_listing *listing, int node )
+{
+    const WCHAR *name = get_listing_node_name( listing, node );
+    return &listing->hash[hash_dir_name( name, wcslen( name )) & (listing->hash_size - 1)];
+}
+
+/* add the long and short names of name i to the hash index */
+static void link_listing_name( struct dir_listing *listing, unsigned int i )
+{
+    int *bucket, node;
+
+    for (node = 2 * i; node <= 2 * i + 1; node++)
+    {
+        if (!get_listing_node_name( listing, node )[0]) continue;
+        bucket = get_listing_bucket( listing, node );
+        listing->hash_next[node] = *bucket;
+        *bucket = node;
+    }
+}
+
+/* remove the long and short names of name i from the hash index */
+static void unlink_listing_name( struct dir_listing *listing, unsigned int i )
+{
+    int *ptr, node;
+
+    for (node = 2 * i; node <= 2 * i + 1; node++)
+    {
+        if (!get_listing_node_name( listing, node )[0]) continue;
+        for (ptr = get_listing_bucket( listing, node ); *ptr != node; ptr = &listing->hash_next[*ptr])
+            assert( *ptr != -1 );
+        *ptr = listing->hash_next[node];
+    }
+}
+
+/* build the case-insensitive hash index of the long and short names of a listing */
+static BOOL build_dir_listing_index( struct dir_listing *listing )
+{
+    unsigned int i, count = listing->data->count;
+    int *hash, *next;
+
+    free( listing->hash );
+    free( listing->hash_next );
+    listing->hash = listing->hash_next = NULL;
+
+    for (listing->hash_size = 16; listing->hash_size < count; listing->hash_size *= 2) ;
+    listing->next_size = max( 2 * count, 16 );
+    if (!(hash = malloc( listing->hash_size * sizeof(*hash) ))) return FALSE;
+    if (!(next = malloc( 2 * listing->next_size * sizeof(*next) )))
+    {
+        free( hash );
+        return FALSE;
+    }
+    memset( hash, 0xff, listing->hash_size * sizeof(*hash) );
+    listing->hash = hash;
+    listing->hash_next = next;
+
+    for (i = 0; i < count; i++) link_listing_name( listing, i );
+    return TRUE;
+}
+
+/* find a file by long name, or also by short name if requested, in a directory listing */
+static const struct dir_data_names *find_dir_listing_name( const struct dir_listing *listing, const WCHAR *name,
+                                                           int length, BOOLEAN short_names )
+{
+    const struct dir_data_names *names = listing->data->names, *ret = NULL;
+    BOOL ret_short = FALSE;
+    const WCHAR *str;
+    int node;
+
+    /* long names take precedence over short names, then the first name in sorted order */
+    for (node = listing->hash[hash_dir_name( name, length ) & (listing->hash_size - 1)]; node != -1;
+         node = listing->hash_next[node])
+    {
+        if ((node & 1) && (!short_names || (ret && !ret_short))) continue;
+        str = get_listing_node_name( listing, node );
+        if (wcsnicmp( str, name, length ) || str[length]) continue;
+        if (ret && ret_short == (node & 1) && name_compare( ret, &names[node / 2] ) < 0) continue;
+        ret = &names[node / 2];
+        ret_short = node & 1;
+    }
+    return ret;
+}
+
+/* find a file by its Unix name in a directory listing */
+static int find_dir_listing_unix_name( const struct dir_listing *listing, const char *unix_name )
+{
+    WCHAR nameW[MAX_DIR_ENTRY_LEN + 1];
+    int node, len;
+
+    len = ntdll_umbstowcs( unix_name, strlen( unix_name ), nameW, ARRAY_SIZE(nameW) );
+    if (len == ARRAY_SIZE(nameW)) return -1;
+
+    for (node = listing->hash[hash_dir_name( nameW, len ) & (listing->hash_size - 1)]; node != -1;
+         node = listing->hash_next[node])
+    {
+        if (!(node & 1) && !strcmp( listing->data->names[node / 2].unix_name, unix_name )) return node / 2;
+    }
+    return -1;
+}
+
+/* add a file that was created in the directory */
+static BOOL add_dir_listing_name( struct dir_listing *listing, const char *unix_name )
+{
+    struct dir_data *data = listing->data;
+    int *next;
+
+    if (find_dir_listing_unix_name( listing, unix_name ) != -1) return TRUE;
+    if (!append_listing_entry( data, unix_name )) return FALSE;
+    if (data->count > 2 * listing->hash_size) return build_dir_listing_index( listing );
+    if (data->count > listing->next_size)
+    {
+        if (!(next = realloc( listing->hash_next, 4 * listing->next_size * sizeof(*next) ))) return FALSE;
+        listing->hash_next = next;
+        listing->next_size *= 2;
+    }
+    link_listing_name( listing, data->count - 1 );
+    listing->sorted = FALSE;
+    return TRUE;
+}
+
+/* remove a file that was deleted from the directory */
+static BOOL remove_dir_listing_name( struct dir_listing *listing, const char *unix_name )
+{
+    struct dir_data *data = listing->data;
+    int i = find_dir_listing_unix_name( listing, unix_name ), last = data->count - 1;
+
+    if (i == -1) return TRUE;
+    unlink_listing_name( listing, i );
+    if (i != last)
+    {
+        unlink_listing_name( listing, last );
+        data->names[i] = data->names[last];
+        link_listing_name( listing, i );
+        listing->sorted = FALSE;
+    }
+    data->count--;
+    /* the strings are not freed, read the directory again once half of them are garbage */
+    return ++listing->removed < data->count;
+}
+
+/* apply an event to a listing, returns FALSE if the listing can't be kept */
+static BOOL update_dir_listing( struct dir_listing *listing, const struct inotify_event *event )
+{
+    if (listing->building)
+    {
+        listing->invalid = TRUE;
+        return TRUE;
+    }
+    if (!event->len || (event->mask & IN_Q_OVERFLOW)) return FALSE;
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) return add_dir_listing_name( listing, event->name );
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) return remove_dir_listing_name( listing, event->name );
+    return FALSE;
+}
+
+/* apply the changes to the listings of the directories; dir_listing_mutex must be held */
+static void process_dir_listing_events(void)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct dir_listing *listing, *next;
+    const struct inotify_event *event;
+    ssize_t size;
+    char *ptr;
+
+    while ((size = read( dir_listing_fd, buffer, sizeof(buffer) )) > 0)
+    {
+        for (ptr = buffer; ptr < buffer + size; ptr += sizeof(*event) + event->len)
+        {
+            event = (const struct inotify_event *)ptr;
+            LIST_FOR_EACH_ENTRY_SAFE( listing, next, &dir_listings, struct dir_listing, entry )
+            {
+                if (!(event->mask & IN_Q_OVERFLOW) && listing->wd != event->wd) continue;
+                if (event->mask & IN_IGNORED) listing->wd = -1;
+                if (update_dir_listing( listing, event )) continue;
+                TRACE( "dropping listing for %lx:%lx, event %x\n", (long)listing->dev, (long)listing->ino, event->mask );
+                free_dir_listing( listing );
+            }
+        }
+    }
+}
+
+/* changes made by other hosts on network file systems are not reported through inotify */
+static BOOL is_local_file_system( int fd )
+{
+#ifdef __linux__
+    struct statfs stfs;
+
+    if (fstatfs( fd, &stfs ) == -1) return FALSE;
+    switch ((unsigned int)stfs.f_type)
+    {
+    case 0x6969:      /* NFS_SUPER_MAGIC */
+    case 0x517b:      /* SMB_SUPER_MAGIC */
+    case 0xff534d42:  /* CIFS_MAGIC_NUMBER */
+    case 0xfe534d42:  /* SMB2_MAGIC_NUMBER */
+    case 0x65735546:  /* FUSE_SUPER_MAGIC */
+    case 0x01021997:  /* V9FS_MAGIC */
+    case 0x00c36400:  /* CEPH_SUPER_MAGIC */
+    case 0x5346414f:  /* AFS_FS_MAGIC */
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+/* read the sorted contents of a directory */
+static struct dir_data *read_dir_listing_data( DIR *dirp )
+{
+    struct dir_data *data;
+    struct dirent *de;
+
+    if (!(data = calloc( 1, sizeof(*data) ))) return NULL;
+    if (!append_listing_entry( data, "." ) || !append_listing_entry( data, ".." )) goto failed;
+    while ((de = readdir( dirp )))
+    {
+        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+        if (!append_listing_entry( data, de->d_name )) goto failed;
+    }
+    sort_dir_data_names( data );
+    return data;
+
+failed:
+    free_dir_data( data );
+    return NULL;
+}
+
+/* make room for a new listing by dropping the least recently used one */
+static void evict_dir_listing(void)
+{
+    struct dir_listing *listing;
+
+    LIST_FOR_EACH_ENTRY_REV( listing, &dir_listings, struct dir_listing, entry )
+    {
+        if (listing->building) continue;
+        free_dir_listing( listing );
+        return;
+    }
+}
+
+/***********************************************************************
+ *           create_dir_listing
+ *
+ * Read the contents of a directory into a new listing. Must be called with
+ * dir_listing_mutex held; it is released while the directory is read, so
+ * that other lookups are not blocked behind readdir().
+ */
+static struct dir_listing *create_dir_listing( const char *dir )
+{
+    struct dir_listing *listing;
+    struct dir_data *data;
+    BOOLEAN case_sensitive;
+    struct stat st;
+    DIR *dirp;
+    int fd;
+
+    if ((fd = open( dir, O_RDONLY | O_DIRECTORY )) == -1) return NULL;
+#ifdef VFAT_IOCTL_READDIR_BOTH
+    {
+        KERNEL_DIRENT kde[2];
+
+        /* real short names need to be retrieved from the file system, don't cache them */
+        if (ioctl( fd, VFAT_IOCTL_READDIR_BOTH, (long)kde ) != -1)
+        {
+            close( fd );
+            return NULL;
+        }
+    }
+#endif
+    if (!is_local_file_system( fd ) || fstat( fd, &st ) == -1 || !(dirp = fdopendir( fd )))
+    {
+        close( fd );
+        return NULL;
+    }
+    if (!(listing = calloc( 1, sizeof(*listing) )))
+    {
+        closedir( dirp );
+        return NULL;
+    }
+
+    /* add the watch first so that changes made while reading are not missed */
+    if ((listing->wd = inotify_add_watch( dir_listing_fd, dir, DIR_LISTING_EVENTS | IN_ONLYDIR )) == -1)
+    {
+        free( listing );
+        closedir( dirp );
+        return NULL;
+    }
+    listing->dev = st.st_dev;
+    listing->ino = st.st_ino;
+    listing->building = TRUE;
+    if (dir_listing_count >= dir_listing_max_count) evict_dir_listing();
+    list_add_head( &dir_listings, &listing->entry );
+    dir_listing_count++;
+
+    mutex_unlock( &dir_listing_mutex );
+    data = read_dir_listing_data( dirp );
+    closedir( dirp );
+    case_sensitive = get_dir_case_sensitivity( dir );
+    mutex_lock( &dir_listing_mutex );
+
+    process_dir_listing_events();
+    listing->building = FALSE;
+    listing->data = data;
+    listing->case_sensitive = case_sensitive;
+    listing->sorted = TRUE;
+    if (!data || listing->invalid || !build_dir_listing_index( listing ))
+    {
+        free_dir_listing( listing );
+        return NULL;
+    }
+    data->id.dev = st.st_dev;
+    data->id.ino = st.st_ino;
+    TRACE( "%s: %u files\n", debugstr_a(dir), data->count );
+    return listing;
+}
+
+/***********************************************************************
+ *           get_dir_listing
+ *
+ * Retrieve the cached listing of a directory, reading it if necessary.
+ * dir_listing_mutex must be held while the listing is in use.
+ */
+static struct dir_listing *get_dir_listing( const char *dir )
+{
+    struct dir_listing *listing;
+    struct stat st;
+
+    if (dir_listing_disabled) return NULL;
+    if (dir_listing_fd == -1 && (dir_listing_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC )) == -1)
+    {
+        WARN( "inotify not available, directory listings won't be cached\n" );
+        dir_listing_disabled = TRUE;
+        return NULL;
+    }
+    process_dir_listing_events();
+
+    if (stat( dir, &st ) == -1) return NULL;
+    LIST_FOR_EACH_ENTRY( listing, &dir_listings, struct dir_listing, entry )
+    {
+        if (listing->dev != st.st_dev || listing->ino != st.st_ino) continue;
+        if (listing->building) return NULL;  /* being read by another thread */
+        list_remove( &listing->entry );
+        list_add_head( &dir_listings, &listing->entry );
+        return listing;
+    }
+
+    return create_dir_listing( dir );
+}
+
+/***********************************************************************
+ *           sort_dir_listing
+ *
+ * Restore the sorted order of the names after files were added or removed.
+ */
+static BOOL sort_dir_listing( struct dir_listing *listing )
+{
+    if (listing->sorted) return TRUE;
+    sort_dir_data_names( listing->data );
+    listing->sorted = TRUE;
+    if (build_dir_listing_index( listing )) return TRUE;
+    free_dir_listing( listing );
+    return FALSE;
+}
+
+#else  /* HAVE_SYS_INOTIFY_H */
+
+struct dir_listing
+{
+    BOOLEAN          case_sensitive;
+    struct dir_data *data;
+};
+
+static pthread_mutex_t dir_listing_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct dir_listing *get_dir_listing( const char *dir )
+{
+    return NULL;
+}
+
+static const struct dir_data_names *find_dir_listing_name( const struct dir_listing *listing, const WCHAR *name,
+                                                           int length, BOOLEAN short_names )
+{
+    return NULL;
+}
+
+static BOOL sort_dir_listing( struct dir_listing *listing )
+{
+    return FALSE;
+}
+
+#endif  /* HAVE_SYS_INOTIFY_H */
+
+
+/***********************************************************************
+ *           read_directory_data_cached
+ *
+ * Read a directory from the process-wide listing cache; helper for NtQueryDirectoryFile.
+ * The resulting names are already sorted.
+ */
+static NTSTATUS read_directory_data_cached( struct dir_data *data, const UNICODE_STRING *mask )
+{
+    static const WCHAR emptyW[] = {0};
+    const struct dir_data_names *names;
+    struct dir_listing *listing;
+    NTSTATUS status = STATUS_SUCCESS;
+    const WCHAR *short_name;
+    unsigned int i;
+
+    mutex_lock( &dir_listing_mutex );
+    if (!(listing = get_dir_listing( "." )) || !sort_dir_listing( listing ))
+    {
+        mutex_unlock( &dir_listing_mutex );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    for (i = 0; i < listing->data->count; i++)
+    {
+        names = &listing->data->names[i];
+        short_name = disable_sfn ? emptyW : names->short_name;
+        if (mask && !match_filename( names->long_name, wcslen( names->long_name ), mask ) &&
+            (!short_name[0] || !match_filename( short_name, wcslen( short_name ), mask )))
+            continue;
+        if (!add_dir_data_names( data, names->long_name, short_name, names->unix_name ))
+        {
+            status = STATUS_NO_MEMORY;
+            break;
+        }
+    }
+    mutex_unlock( &dir_listing_mutex );
+    return status;
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
@@ -2518,21 +3051,12 @@ static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICOD
         }
     }
 
+    if (!(status = read_directory_data_cached( data, mask ))) return status;
+    if (status != STATUS_NOT_SUPPORTED) return status;
     return read_directory_data_readdir( data, mask );
 }
 
 
-/* compare file names for directory sorting */
-static int name_compare( const void *a, const void *b )
-{
-    const struct dir_data_names *file_a = (const struct dir_data_names *)a;
-    const struct dir_data_names *file_b = (const struct dir_data_names *)b;
-    int ret = wcsicmp( file_a->long_name, file_b->long_name );
-    if (!ret) ret = wcscmp( file_a->long_name, file_b->long_name );
-    return ret;
-}
-
-
 /***********************************************************************
  *           init_cached_dir_data
  *
@@ -2553,11 +3077,7 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
-    i = 0;
-    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
-    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    sort_dir_data_names( data );
 
     if (data->count)
     {
@@ -2790,6 +3310,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
                                   BOOLEAN check_case )
 {
     WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_listing *listing;
     BOOLEAN is_name_8_dot_3;
     DIR *dir;
     struct dirent *de;
@@ -2817,6 +3338,26 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     is_name_8_dot_3 = is_name_8_dot_3 && length >= 8 && name[4] == '~';
 #endif
 
+    /* look for it in the cached directory listing */
+
+    mutex_lock( &dir_listing_mutex );
+    if ((listing = get_dir_listing( unix_name )))
+    {
+        const struct dir_data_names *names = NULL;
+
+        if (is_name_8_dot_3 || listing->case_sensitive)
+            names = find_dir_listing_name( listing, name, length, is_name_8_dot_3 );
+        if (names)
+        {
+            unix_name[pos - 1] = '/';
+            strcpy( unix_name + pos, names->unix_name );
+        }
+        mutex_unlock( &dir_listing_mutex );
+        if (names) return STATUS_SUCCESS;
+        goto not_found;
+    }
+    mutex_unlock( &dir_listing_mutex );
+
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
     /* now look for it through the directory */
@@ -354,6 +354,19 @@ static void put_object_from_wait( struct fsync *obj )
     put_object( obj );
 }
 
+static BOOL is_object_cached( HANDLE handle )
+{
+    UINT_PTR entry, idx = handle_to_index( handle, &entry );
+    struct fsync_cache cache;
+
+    if (entry >= FSYNC_LIST_ENTRIES || !fsync_list[entry]) return FALSE;
+    *(uint64_t *)&cache = __atomic_load_n( (uint64_t *)&fsync_list[entry][idx], __ATOMIC_SEQ_CST );
+    return cache.type && cache.shm_idx;
+}
+
+/* cache statistics, only maintained when tracing */
+static LONG cache_hits, cache_misses;
+
 static BOOL get_cached_object( HANDLE handle, struct fsync *obj )
 {
     UINT_PTR entry, idx = handle_to_index( handle, &entry );
@@ -393,7 +406,11 @@ static NTSTATUS get_object( HANDLE handle, struct fsync *obj )
     enum fsync_type type;
     sigset_t sigset;
 
-    if (get_cached_object( handle, obj )) return STATUS_SUCCESS;
+    if (get_cached_object( handle, obj ))
+    {
+        if (TRACE_ON(fsync)) InterlockedIncrement( &cache_hits );
+        return STATUS_SUCCESS;
+    }
 
     if ((INT_PTR)handle < 0)
     {
@@ -403,6 +420,10 @@ static NTSTATUS get_object( HANDLE handle, struct fsync *obj )
 
     if (!handle) return STATUS_INVALID_HANDLE;
 
+    if (TRACE_ON(fsync))
+        TRACE( "cache miss for %p, %d hits, %d misses.\n", handle, (int)cache_hits,
+               (int)InterlockedIncrement( &cache_misses ));
+
     /* We need to try grabbing it from the server. Uninterrupted section
      * is needed to avoid race with NtClose() which first calls fsync_close()
      * and then closes handle on server. Without the section we might cache
@@ -440,6 +461,51 @@ static NTSTATUS get_object( HANDLE handle, struct fsync *obj )
     return ret;
 }
 
+/* Retrieve the objects of all the handles that are not cached yet in a
+ * single server round trip, instead of one get_fsync_idx call each. */
+static void prefetch_objects( const HANDLE *handles, DWORD count )
+{
+    struct __server_request_info reqs[MAXIMUM_WAIT_OBJECTS];
+    void *req_ptrs[MAXIMUM_WAIT_OBJECTS];
+    HANDLE missing[MAXIMUM_WAIT_OBJECTS];
+    unsigned int i, nb_missing = 0, nb_reqs = 0;
+    sigset_t sigset;
+
+    for (i = 0; i < count && i < MAXIMUM_WAIT_OBJECTS; i++)
+        if ((INT_PTR)handles[i] > 0 && !is_object_cached( handles[i] )) missing[nb_missing++] = handles[i];
+    if (nb_missing < 2) return;  /* get_object() does it just as well */
+
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    for (i = 0; i < nb_missing; i++)
+    {
+        if (is_object_cached( missing[i] )) continue;
+        memset( &reqs[nb_reqs].u.req, 0, sizeof(reqs[nb_reqs].u.req) );
+        reqs[nb_reqs].name = "get_fsync_idx";
+        reqs[nb_reqs].u.req.request_header.req = REQ_get_fsync_idx;
+        reqs[nb_reqs].u.req.get_fsync_idx_request.handle = wine_server_obj_handle( missing[i] );
+        reqs[nb_reqs].data_count = 0;
+        req_ptrs[nb_reqs] = &reqs[nb_reqs];
+        missing[nb_reqs++] = missing[i];
+    }
+    if (nb_reqs && !server_call_batch( req_ptrs, nb_reqs ))
+    {
+        for (i = 0; i < nb_reqs; i++)
+        {
+            const struct get_fsync_idx_reply *reply = &reqs[i].u.reply.get_fsync_idx_reply;
+            struct fsync obj;
+
+            if (reply->__header.error) continue;
+            TRACE( "Got shm index %d for handle %p.\n", reply->shm_idx, missing[i] );
+            add_to_list( missing[i], reply->type, reply->shm_idx );
+            /* the cache doesn't hold a reference, release the one taken by the server */
+            obj.type = reply->type;
+            obj.shm = get_shm( reply->shm_idx );
+            put_object( &obj );
+        }
+    }
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+}
+
 static NTSTATUS get_object_for_wait( HANDLE handle, struct fsync *obj, int *prev_pid )
 {
     NTSTATUS ret;
@@ -921,10 +987,10 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
     int current_tid = 0;
 #define CURRENT_TID (current_tid ? current_tid : (current_tid = GetCurrentThreadId()))
 
-    struct futex_waitv futexes[MAXIMUM_WAIT_OBJECTS + 1];
-    struct fsync objs[MAXIMUM_WAIT_OBJECTS];
+    struct futex_waitv futexes[WINE_MAXIMUM_WAIT_ANY_OBJECTS + 1];
+    struct fsync objs[WINE_MAXIMUM_WAIT_ANY_OBJECTS];
     BOOL msgwait = FALSE, waited = FALSE;
-    int prev_pids[MAXIMUM_WAIT_OBJECTS];
+    int prev_pids[WINE_MAXIMUM_WAIT_ANY_OBJECTS];
     int has_fsync = 0, has_server = 0;
     clockid_t clock_id = 0;
     struct timespec64 end;
@@ -953,6 +1019,8 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
 
     get_wait_end_time( &timeout, &end, &clock_id );
 
+    prefetch_objects( handles, count );
+
     for (i = 0; i < count; i++)
     {
         ret = get_object_for_wait( handles[i], &objs[i], &prev_pids[i] );
@@ -978,7 +1046,15 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
         msgwait = TRUE;
 
     if (has_fsync && has_server)
+    {
+        /* the server can't take more objects, and dropping them would be wrong */
+        if (count > MAXIMUM_WAIT_OBJECTS)
+        {
+            put_objects( objs, count );
+            return STATUS_NOT_SUPPORTED;
+        }
         FIXME("Can't wait on fsync and server objects at the same time!\n");
+    }
     else if (has_server)
     {
         put_objects( objs, count );
@@ -1080,7 +1156,8 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                             TRACE("Woken up by abandoned mutex %p [%d].\n", handles[i], i);
                             mutex->count = 1;
                             put_objects( objs, count );
-                            return STATUS_ABANDONED_WAIT_0 + i;
+                            /* indices past MAXIMUM_WAIT_OBJECTS can't be reported as abandoned */
+                            return (i < MAXIMUM_WAIT_OBJECTS ? STATUS_ABANDONED_WAIT_0 : STATUS_WAIT_0) + i;
                         }
 
                         futex_vector_set( &futexes[i], &mutex->tid, tid );
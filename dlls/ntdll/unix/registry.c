@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -43,6 +44,16 @@ WINE_DEFAULT_DEBUG_CHANNEL(reg);
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* shared memory cache of frequently queried keys, maintained by the server */
+static registry_cache_slot_t *registry_cache;
+
+/* handle to registry cache slot mapping; each entry stores the cache serial number
+ * in the high 32 bits, the handle index in the next 24 bits and the slot index.
+ * The server gives the slot a new serial whenever a handle to the cached key is
+ * closed, so an entry left behind for a handle value that got reused never matches. */
+#define REGISTRY_CACHE_HANDLES 1024
+static UINT64 registry_cache_handles[REGISTRY_CACHE_HANDLES];
+
 
 NTSTATUS open_hkcu_key( const char *path, HANDLE *key )
 {
@@ -631,6 +642,182 @@ NTSTATUS WINAPI NtSetInformationKey( HANDLE key, int class, void *info, ULONG le
 }
 
 
+/* map the shared registry cache, return NULL if not available */
+static registry_cache_slot_t *get_registry_cache(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+                                  '_','_','w','i','n','e','_','r','e','g','i','s','t','r','y','_','c','a','c','h','e',0};
+    static BOOL failed;
+    UNICODE_STRING name_str = RTL_CONSTANT_STRING( nameW );
+    OBJECT_ATTRIBUTES attr = { sizeof(attr), 0, &name_str };
+    const size_t size = REGISTRY_CACHE_SLOTS * sizeof(*registry_cache);
+    HANDLE section;
+    int fd, needs_close;
+    void *ptr = MAP_FAILED;
+
+    if (registry_cache || failed) return registry_cache;
+
+    if (!NtOpenSection( &section, SECTION_MAP_READ, &attr ))
+    {
+        if (!server_get_unix_fd( section, 0, &fd, &needs_close, NULL, NULL ))
+        {
+            ptr = mmap( NULL, size, PROT_READ, MAP_SHARED, fd, 0 );
+            if (needs_close) close( fd );
+        }
+        NtClose( section );
+    }
+    if (ptr == MAP_FAILED)
+    {
+        WARN( "registry cache not available\n" );
+        failed = TRUE;
+        return NULL;
+    }
+    if (InterlockedCompareExchangePointer( (void **)&registry_cache, ptr, NULL )) munmap( ptr, size );
+    return registry_cache;
+}
+
+/* remember the cache slot returned by the server for a key handle */
+static void set_cached_key( HANDLE handle, int slot, unsigned int serial )
+{
+    unsigned int index = HandleToULong( handle ) >> 2;
+    UINT64 entry = 0;
+
+    if (index >= (1 << 24)) return;
+    if (serial && slot >= 0 && slot < REGISTRY_CACHE_SLOTS && get_registry_cache())
+        entry = ((UINT64)serial << 32) | (index << 8) | slot;
+    __atomic_store_n( &registry_cache_handles[index % REGISTRY_CACHE_HANDLES], entry, __ATOMIC_SEQ_CST );
+}
+
+/* forget the cache slot of a key handle that is being closed */
+void registry_cache_close( HANDLE handle )
+{
+    unsigned int index = HandleToULong( handle ) >> 2;
+    UINT64 *ptr = &registry_cache_handles[index % REGISTRY_CACHE_HANDLES];
+    UINT64 entry = __atomic_load_n( ptr, __ATOMIC_SEQ_CST );
+
+    if (entry && ((entry >> 8) & 0xffffff) == index)
+        __atomic_compare_exchange_n( ptr, &entry, 0, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+}
+
+/* compare a cached value name with the requested one, case-insensitively */
+static BOOL cached_name_equal( const volatile WCHAR *cached, const WCHAR *name, unsigned int len )
+{
+    unsigned int i;
+
+    for (i = 0; i < len / sizeof(WCHAR); i++)
+        if (towupper( cached[i] ) != towupper( name[i] )) return FALSE;
+    return TRUE;
+}
+
+/* find the cache slot of a key handle and start reading it, return NULL if not cached */
+static registry_cache_slot_t *begin_cached_key_read( HANDLE handle, unsigned int *seq )
+{
+    unsigned int index = HandleToULong( handle ) >> 2;
+    registry_cache_slot_t *slot;
+    UINT64 entry;
+
+    if (!registry_cache || index >= (1 << 24)) return NULL;
+    entry = __atomic_load_n( &registry_cache_handles[index % REGISTRY_CACHE_HANDLES], __ATOMIC_SEQ_CST );
+    if (!entry || ((entry >> 8) & 0xffffff) != index) return NULL;
+
+    slot = &registry_cache[entry & 0xff];
+    *seq = __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE );
+    if ((*seq & 1) || slot->serial != (unsigned int)(entry >> 32)) return NULL;
+    return slot;
+}
+
+/* check that the cache slot didn't change while we were reading it */
+static BOOL end_cached_key_read( registry_cache_slot_t *slot, unsigned int seq )
+{
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) == seq;
+}
+
+/* snapshot of a value in a cache slot, with lengths validated against the slot size */
+struct cached_value
+{
+    unsigned int           type;
+    data_size_t            namelen;
+    data_size_t            len;
+    const volatile char   *name;     /* followed by the data */
+};
+
+/* fetch the next value in a cache slot, return FALSE if the data is inconsistent;
+ * the lengths are read only once since the server may be rewriting the slot */
+static BOOL next_cached_value( registry_cache_slot_t *slot, unsigned int *pos, struct cached_value *ret )
+{
+    const volatile struct registry_cache_value *value = (const volatile void *)(slot->data + *pos);
+    data_size_t avail;
+
+    if (*pos + sizeof(*value) > REGISTRY_CACHE_DATA_SIZE) return FALSE;
+    avail = REGISTRY_CACHE_DATA_SIZE - *pos - sizeof(*value);
+    ret->type    = value->type;
+    ret->namelen = value->namelen;
+    ret->len     = value->len;
+    if (ret->namelen > avail || ret->len > avail - ret->namelen) return FALSE;
+    ret->name = (const volatile char *)(value + 1);
+    *pos += (sizeof(*value) + ret->namelen + ret->len + 3) & ~3;
+    return TRUE;
+}
+
+/* look up a value in the shared registry cache without a server round-trip;
+ * return FALSE if the key is not cached or is being modified */
+static BOOL get_cached_key_value( HANDLE handle, const UNICODE_STRING *name, void *data, data_size_t size,
+                                  int *type, data_size_t *total, unsigned int *status )
+{
+    struct cached_value value;
+    registry_cache_slot_t *slot;
+    unsigned int seq, count, i, pos = 0;
+
+    if (!(slot = begin_cached_key_read( handle, &seq ))) return FALSE;
+
+    *status = STATUS_OBJECT_NAME_NOT_FOUND;
+    count = slot->count;
+    for (i = 0; i < count; i++)
+    {
+        if (!next_cached_value( slot, &pos, &value )) return FALSE;
+        if (value.namelen != name->Length) continue;
+        if (!cached_name_equal( (const volatile WCHAR *)value.name, name->Buffer, name->Length )) continue;
+        *type   = value.type;
+        *total  = value.len;
+        *status = STATUS_SUCCESS;
+        memcpy( data, (const char *)value.name + value.namelen, min( size, value.len ));
+        break;
+    }
+    return end_cached_key_read( slot, seq );
+}
+
+/* enumerate a value from the shared registry cache, same semantics as the enum_key_value request */
+static BOOL enum_cached_key_value( HANDLE handle, ULONG index, KEY_VALUE_INFORMATION_CLASS info_class,
+                                   void *data, data_size_t size, int *type, data_size_t *namelen,
+                                   data_size_t *datalen, data_size_t *total, unsigned int *status )
+{
+    struct cached_value value;
+    registry_cache_slot_t *slot;
+    unsigned int seq, i, pos = 0;
+    data_size_t name_size;
+
+    if (!(slot = begin_cached_key_read( handle, &seq ))) return FALSE;
+
+    if (index >= slot->count)
+    {
+        *status = STATUS_NO_MORE_ENTRIES;
+        return end_cached_key_read( slot, seq );
+    }
+    for (i = 0; i <= index; i++) if (!next_cached_value( slot, &pos, &value )) return FALSE;
+
+    *type = value.type;
+    name_size = info_class == KeyValuePartialInformation ? 0 : value.namelen;
+    *total = name_size + (info_class == KeyValueBasicInformation ? 0 : value.len);
+    size = min( size, *total );
+    *namelen = min( size, name_size );
+    *datalen = size - *namelen;
+    memcpy( data, (const char *)value.name + value.namelen - name_size, size );
+    *status = STATUS_SUCCESS;
+    return end_cached_key_read( slot, seq );
+}
+
+
 /* fill the key value info structure for a specific info class */
 static void copy_key_value_info( KEY_VALUE_INFORMATION_CLASS info_class, void *info,
                                  DWORD length, int type, int name_len, int data_len )
@@ -697,6 +884,8 @@ NTSTATUS WINAPI NtEnumerateValueKey( HANDLE handle, ULONG index, KEY_VALUE_INFOR
     unsigned int ret;
     void *ptr;
     size_t fixed_size;
+    data_size_t data_size, namelen, datalen, total;
+    int type;
 
     TRACE( "(%p,%u,%d,%p,%d)\n", handle, (int)index, info_class, info, (int)length );
 
@@ -711,22 +900,32 @@ NTSTATUS WINAPI NtEnumerateValueKey( HANDLE handle, ULONG index, KEY_VALUE_INFOR
         return STATUS_INVALID_PARAMETER;
     }
     fixed_size = (char *)ptr - (char *)info;
+    data_size = length > fixed_size ? length - fixed_size : 0;
 
-    SERVER_START_REQ( enum_key_value )
+    if (!enum_cached_key_value( handle, index, info_class, ptr, data_size,
+                                &type, &namelen, &datalen, &total, &ret ))
     {
-        req->hkey       = wine_server_obj_handle( handle );
-        req->index      = index;
-        req->info_class = info_class;
-        if (length > fixed_size) wine_server_set_reply( req, ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( enum_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type, reply->namelen,
-                                 wine_server_reply_size(reply) - reply->namelen );
-            *result_len = fixed_size + reply->total;
-            if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey       = wine_server_obj_handle( handle );
+            req->index      = index;
+            req->info_class = info_class;
+            if (data_size) wine_server_set_reply( req, ptr, data_size );
+            ret = wine_server_call( req );
+            type    = reply->type;
+            namelen = reply->namelen;
+            datalen = wine_server_reply_size( reply ) - reply->namelen;
+            total   = reply->total;
         }
+        SERVER_END_REQ;
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, type, namelen, datalen );
+        *result_len = fixed_size + total;
+        if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
@@ -741,6 +940,8 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
     unsigned int ret;
     UCHAR *data_ptr;
     unsigned int fixed_size, min_size;
+    data_size_t data_size, total;
+    int type;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, (int)length );
 
@@ -786,21 +987,31 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    data_size = (length > fixed_size && data_ptr) ? length - fixed_size : 0;
+
+    if (!get_cached_key_value( handle, name, data_ptr, data_size, &type, &total, &ret ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (data_size) wine_server_set_reply( req, data_ptr, data_size );
+            ret = wine_server_call( req );
+            type  = reply->type;
+            total = reply->total;
+            if (!ret || ret == STATUS_OBJECT_NAME_NOT_FOUND)
+                set_cached_key( handle, reply->cache_slot, reply->cache_serial );
         }
+        SERVER_END_REQ;
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, type, name->Length, total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
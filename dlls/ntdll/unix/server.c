@@ -127,6 +127,7 @@ sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static int initial_cwd = -1;
 static pid_t server_pid;
+static LONG server_round_trips;  /* number of requests sent, for startup tracing */
 pthread_mutex_t fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* atomically exchange a 64-bit value */
@@ -286,6 +287,7 @@ unsigned int server_call_unlocked( void *req_ptr )
     unsigned int ret;
 
     FTRACE_BLOCK_START("req %s", req->name)
+    if (TRACE_ON(server)) InterlockedIncrement( &server_round_trips );
     TRACE_(client)("%s start\n", req->name); \
     if (!(ret = send_request( req )))
         ret = wait_reply( req );
@@ -312,6 +314,93 @@ unsigned int CDECL wine_server_call( void *req_ptr )
 }
 
 
+/* size of a batched request or reply entry, padded to keep the headers aligned */
+static inline data_size_t batch_entry_size( data_size_t header, data_size_t size )
+{
+    return header + ((size + 7) & ~7);
+}
+
+
+/***********************************************************************
+ *           server_call_batch
+ *
+ * Perform several independent server calls in a single round trip.
+ * Each request receives its own reply and status exactly as with
+ * wine_server_call(); the requests must not depend on each other's
+ * results. Only the requests allowed by the server's batch_requests
+ * handler can be batched; the only one of them returning an fd is
+ * get_esync_fd, whose fds are sent in request order for the requests
+ * that succeeded, and must be received by the caller inside the fd
+ * cache section.
+ */
+unsigned int server_call_batch( void **req_ptrs, unsigned int count )
+{
+    data_size_t req_size = 0, reply_size = 0, pos;
+    unsigned int i, j, ret, done = 0;
+    char *buffer, *replies;
+
+    for (i = 0; i < count; i++)
+    {
+        struct __server_request_info *req = req_ptrs[i];
+        req_size += batch_entry_size( sizeof(req->u.req), req->u.req.request_header.request_size );
+        reply_size += batch_entry_size( sizeof(req->u.reply), req->u.req.request_header.reply_size );
+    }
+    if (!(buffer = calloc( 1, req_size + reply_size )))
+    {
+        ret = STATUS_NO_MEMORY;
+        goto failed;
+    }
+    replies = buffer + req_size;
+
+    for (i = pos = 0; i < count; i++)
+    {
+        struct __server_request_info *req = req_ptrs[i];
+        data_size_t start = pos;
+
+        memcpy( buffer + pos, &req->u.req, sizeof(req->u.req) );
+        pos += sizeof(req->u.req);
+        for (j = 0; j < req->data_count; j++)
+        {
+            memcpy( buffer + pos, req->data[j].ptr, req->data[j].size );
+            pos += req->data[j].size;
+        }
+        pos = start + batch_entry_size( sizeof(req->u.req), req->u.req.request_header.request_size );
+    }
+
+    SERVER_START_REQ( batch_requests )
+    {
+        wine_server_add_data( req, buffer, req_size );
+        wine_server_set_reply( req, replies, reply_size );
+        ret = wine_server_call( req );
+        done = reply->count;
+    }
+    SERVER_END_REQ;
+
+    for (i = pos = 0; i < done; i++)
+    {
+        struct __server_request_info *req = req_ptrs[i];
+
+        memcpy( &req->u.reply, replies + pos, sizeof(req->u.reply) );
+        if (req->u.reply.reply_header.reply_size)
+            memcpy( req->reply_data, replies + pos + sizeof(req->u.reply),
+                    req->u.reply.reply_header.reply_size );
+        pos += batch_entry_size( sizeof(req->u.reply), req->u.reply.reply_header.reply_size );
+    }
+    free( buffer );
+
+failed:
+    for (i = done; i < count; i++)
+    {
+        struct __server_request_info *req = req_ptrs[i];
+
+        memset( &req->u.reply, 0, sizeof(req->u.reply) );
+        req->u.reply.reply_header.error = ret ? ret : STATUS_INTERNAL_ERROR;
+    }
+    TRACE_(client)( "batch of %u requests, %u processed\n", count, done );
+    return ret;
+}
+
+
 /***********************************************************************
  *           unixcall_wine_server_call
  *
@@ -1753,6 +1842,8 @@ void server_init_process_done(void)
     /* always send the native TEB */
     if (!(teb = NtCurrentTeb64())) teb = NtCurrentTeb();
 
+    TRACE( "%d server round trips during process startup\n", server_round_trips + 1 );
+
     /* Signal the parent process to continue */
     SERVER_START_REQ( init_process_done )
     {
@@ -1840,7 +1931,10 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
     /* always remove the cached fd; if the server request fails we'll just
      * retrieve it again */
     if (options & DUPLICATE_CLOSE_SOURCE)
+    {
         fd = remove_fd_from_cache( source );
+        registry_cache_close( source );
+    }
 
     SERVER_START_REQ( dup_handle )
     {
@@ -1901,6 +1995,7 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
     /* always remove the cached fd; if the server request fails we'll just
      * retrieve it again */
     fd = remove_fd_from_cache( handle );
+    registry_cache_close( handle );
 
     if (do_fsync())
         fsync_close( handle );
@@ -110,6 +110,8 @@ static inline ULONGLONG monotonic_counter(void)
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
 
 static int futex_private = 128;
 
@@ -134,6 +136,28 @@ static inline int futex_wake( const LONG *addr, int val )
     return syscall( __NR_futex, addr, FUTEX_WAKE | futex_private, val, NULL, 0, 0 );
 }
 
+/* the timeout is absolute, based on CLOCK_MONOTONIC */
+static inline int futex_wait_bitset( const LONG *addr, int val, struct timespec *end, unsigned int mask )
+{
+#if (defined(__i386__) || defined(__arm__)) && _TIME_BITS==64
+    if (end && sizeof(*end) != 8)
+    {
+        struct {
+            long tv_sec;
+            long tv_nsec;
+        } end32 = { end->tv_sec, end->tv_nsec };
+
+        return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET | futex_private, val, &end32, 0, mask );
+    }
+#endif
+    return syscall( __NR_futex, addr, FUTEX_WAIT_BITSET | futex_private, val, end, 0, mask );
+}
+
+static inline int futex_wake_bitset( const LONG *addr, int val, unsigned int mask )
+{
+    return syscall( __NR_futex, addr, FUTEX_WAKE_BITSET | futex_private, val, NULL, 0, mask );
+}
+
 static inline int use_futexes(void)
 {
     static LONG supported = -1;
@@ -1589,6 +1613,40 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles, BO
 }
 
 
+/******************************************************************
+ *		__wine_wait_for_any_object (ntdll.so)
+ *
+ * Wait-any flavor of NtWaitForMultipleObjects that accepts up to WINE_MAXIMUM_WAIT_ANY_OBJECTS
+ * handles when fsync or esync is in use. A zero count only checks for that support.
+ */
+NTSTATUS WINAPI __wine_wait_for_any_object( ULONG count, const HANDLE *handles, BOOLEAN alertable,
+                                            const LARGE_INTEGER *timeout )
+{
+    NTSTATUS ret;
+
+    if (count && count <= MAXIMUM_WAIT_OBJECTS)
+        return NtWaitForMultipleObjects( count, handles, TRUE, alertable, timeout );
+    if (!do_fsync() && !do_esync()) return STATUS_NOT_SUPPORTED;
+    if (!count) return STATUS_SUCCESS;
+    if (count > WINE_MAXIMUM_WAIT_ANY_OBJECTS) return STATUS_INVALID_PARAMETER_1;
+
+    if (do_fsync())
+    {
+        ret = fsync_wait_objects( count, handles, TRUE, alertable, timeout );
+        if (ret != STATUS_NOT_IMPLEMENTED) return ret;
+    }
+
+    if (do_esync())
+    {
+        ret = esync_wait_objects( count, handles, TRUE, alertable, timeout );
+        if (ret != STATUS_NOT_IMPLEMENTED) return ret;
+    }
+
+    /* server objects are limited to MAXIMUM_WAIT_OBJECTS */
+    return STATUS_NOT_SUPPORTED;
+}
+
+
 /******************************************************************
  *		NtWaitForSingleObject (NTDLL.@)
  */
@@ -2776,6 +2834,70 @@ NTSTATUS WINAPI NtWaitForAlertByThreadId( const void *address, const LARGE_INTEG
 
 #endif
 
+/***********************************************************************
+ *             __wine_futex_wait (ntdll.so)
+ *
+ * Waits on a 32-bit value as long as it equals cmp. Only wakeups whose
+ * mask intersects with the given mask are received. Returns STATUS_SUCCESS
+ * only when woken up by __wine_futex_wake(), and STATUS_RETRY when the
+ * value didn't match or the wait was interrupted.
+ */
+NTSTATUS WINAPI __wine_futex_wait( const LONG *addr, LONG cmp, ULONG mask, const LARGE_INTEGER *timeout )
+{
+#ifdef __linux__
+    if (use_futexes())
+    {
+        struct timespec end;
+        int ret;
+
+        if (!mask) return STATUS_INVALID_PARAMETER;
+        if (timeout && timeout->QuadPart != TIMEOUT_INFINITE)
+        {
+            LONGLONG timeleft = update_timeout( get_absolute_timeout( timeout ) );
+
+            clock_gettime( CLOCK_MONOTONIC, &end );
+            end.tv_sec += timeleft / TICKSPERSEC;
+            end.tv_nsec += (timeleft % TICKSPERSEC) * 100;
+            if (end.tv_nsec >= 1000000000)
+            {
+                end.tv_sec++;
+                end.tv_nsec -= 1000000000;
+            }
+            ret = futex_wait_bitset( addr, cmp, &end, mask );
+        }
+        else ret = futex_wait_bitset( addr, cmp, NULL, mask );
+
+        if (!ret) return STATUS_SUCCESS;
+        if (errno == ETIMEDOUT) return STATUS_TIMEOUT;
+        return STATUS_RETRY;
+    }
+#endif
+    return STATUS_NOT_SUPPORTED;
+}
+
+
+/***********************************************************************
+ *             __wine_futex_wake (ntdll.so)
+ *
+ * Wakes up to count threads waiting on addr with a matching mask, and
+ * returns the number of threads actually woken up.
+ */
+NTSTATUS WINAPI __wine_futex_wake( const LONG *addr, ULONG count, ULONG mask, ULONG *woken )
+{
+#ifdef __linux__
+    if (use_futexes())
+    {
+        int ret;
+
+        if (!mask) return STATUS_INVALID_PARAMETER;
+        ret = futex_wake_bitset( addr, min( count, INT_MAX ), mask );
+        if (woken) *woken = max( ret, 0 );
+        return STATUS_SUCCESS;
+    }
+#endif
+    return STATUS_NOT_SUPPORTED;
+}
+
 /* Notify direct completion of async and close the wait handle if it is no longer needed.
  * This function is a no-op (returns status as-is) if the supplied handle is NULL.
  */
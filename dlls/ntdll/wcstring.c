@@ -28,11 +28,15 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
 #include "windef.h"
 #include "winbase.h"
 #include "winnls.h"
 #include "winternl.h"
+#include "ddk/wdm.h"
 #include "ntdll_misc.h"
+#include "wine/simdstr.h"
 
 static const unsigned short wctypes[256] =
 {
@@ -215,6 +219,10 @@ errno_t __cdecl wcscpy_s( wchar_t *dst, size_t len, const wchar_t *src )
 size_t __cdecl wcslen( LPCWSTR str )
 {
     const WCHAR *s = str;
+
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported() && !((ULONG_PTR)str & 1)) return __wine_sse2_wcslen( str );
+#endif
     while (*s) s++;
     return s - str;
 }
@@ -255,6 +263,9 @@ errno_t __cdecl wcscat_s( wchar_t *dst, size_t len, const wchar_t *src )
  */
 LPWSTR __cdecl wcschr( LPCWSTR str, WCHAR ch )
 {
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported() && !((ULONG_PTR)str & 1)) return (WCHAR *)(ULONG_PTR)__wine_sse2_wcschr( str, ch );
+#endif
     do { if (*str == ch) return (WCHAR *)(ULONG_PTR)str; } while (*str++);
     return NULL;
 }
@@ -407,6 +418,10 @@ errno_t __cdecl wcsncpy_s( wchar_t *dst, size_t len, const wchar_t *src, size_t
 size_t __cdecl wcsnlen( const WCHAR *str, size_t len )
 {
     const WCHAR *s;
+
+#ifdef WINE_SIMD_STRINGS
+    if (sse2_strings_supported() && !((ULONG_PTR)str & 1)) return __wine_sse2_wcsnlen( str, len );
+#endif
     for (s = str; len && *s; s++, len--) ;
     return s - str;
 }
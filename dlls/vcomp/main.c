@@ -23,6 +23,7 @@
 
 #include <stdarg.h>
 #include <assert.h>
+#include <wchar.h>
 
 #include "windef.h"
 #include "winbase.h"
@@ -45,6 +46,13 @@ static int     vcomp_max_threads;
 static int     vcomp_num_threads;
 static int     vcomp_num_procs;
 static BOOL    vcomp_nested_fork = FALSE;
+static unsigned int vcomp_spin_count = 4000;
+static enum
+{
+    PROC_BIND_FALSE,
+    PROC_BIND_CLOSE,   /* consecutive threads on consecutive processors */
+    PROC_BIND_SPREAD,  /* threads evenly spread over the processors */
+} vcomp_proc_bind = PROC_BIND_FALSE;
 
 static RTL_CRITICAL_SECTION vcomp_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -83,13 +91,15 @@ struct vcomp_thread_data
     unsigned int            dynamic_type;
     unsigned int            dynamic_begin;
     unsigned int            dynamic_end;
+
+    /* processor the thread is bound to, -1 if none */
+    int                     bound_proc;
 };
 
 struct vcomp_team_data
 {
-    CONDITION_VARIABLE      cond;
     int                     num_threads;
-    int                     finished_threads;
+    LONG                    finished_threads;
 
     /* callback arguments */
     int                     nargs;
@@ -97,8 +107,9 @@ struct vcomp_team_data
     va_list                 valist;
 
     /* barrier */
-    unsigned int            barrier;
-    int                     barrier_count;
+    LONG                    barrier;
+    LONG                    barrier_count;
+    LONG                    barrier_sleepers;
 };
 
 struct vcomp_task_data
@@ -118,6 +129,8 @@ struct vcomp_task_data
     unsigned int            dynamic_iterations;
     int                     dynamic_step;
     unsigned int            dynamic_chunksize;
+    /* generation in the high part, dispensed iterations in the low part */
+    LONG64                  dynamic_state;
 };
 
 static void **ptr_from_va_list(va_list valist)
@@ -414,6 +427,7 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
     data->task.single           = 0;
     data->task.section          = 0;
     data->task.dynamic          = 0;
+    data->task.dynamic_state    = 0;
 
     thread_data = &data->thread;
     thread_data->team           = NULL;
@@ -425,6 +439,7 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
     thread_data->section        = 1;
     thread_data->dynamic        = 1;
     thread_data->dynamic_type   = 0;
+    thread_data->bound_proc     = -1;
 
     vcomp_set_thread_data(thread_data);
     return thread_data;
@@ -439,6 +454,71 @@ static void vcomp_free_thread_data(void)
     vcomp_set_thread_data(NULL);
 }
 
+static void vcomp_read_env(void)
+{
+    WCHAR buffer[16];
+
+    if (GetEnvironmentVariableW(L"OMP_WAIT_POLICY", buffer, ARRAY_SIZE(buffer)) < ARRAY_SIZE(buffer))
+    {
+        if (!wcsicmp(buffer, L"ACTIVE")) vcomp_spin_count = 200000;
+        else if (!wcsicmp(buffer, L"PASSIVE")) vcomp_spin_count = 0;
+    }
+    if (vcomp_num_procs <= 1) vcomp_spin_count = 0;
+
+    if (GetEnvironmentVariableW(L"OMP_PROC_BIND", buffer, ARRAY_SIZE(buffer)) < ARRAY_SIZE(buffer))
+    {
+        if (!wcsicmp(buffer, L"TRUE") || !wcsicmp(buffer, L"CLOSE")) vcomp_proc_bind = PROC_BIND_CLOSE;
+        else if (!wcsicmp(buffer, L"SPREAD")) vcomp_proc_bind = PROC_BIND_SPREAD;
+        else if (wcsicmp(buffer, L"FALSE")) FIXME("unsupported OMP_PROC_BIND %s\n", debugstr_w(buffer));
+    }
+
+    TRACE("spin count %u, proc bind %d\n", vcomp_spin_count, vcomp_proc_bind);
+}
+
+/* Waits until *addr changes from value. Spin for a while before blocking,
+ * waking up a thread costs far more than the typical imbalance between the
+ * threads of a team. Wakers only have to call RtlWakeAddressAll if sleepers
+ * is nonzero. */
+static void vcomp_wait_while_equal(LONG *addr, LONG value, LONG *sleepers)
+{
+    unsigned int i;
+
+    for (i = 0; i < vcomp_spin_count; i++)
+    {
+        if (ReadAcquire(addr) != value) return;
+        YieldProcessor();
+    }
+
+    if (sleepers) InterlockedIncrement(sleepers);
+    while (ReadAcquire(addr) == value)
+        RtlWaitOnAddress(addr, &value, sizeof(value), NULL);
+    if (sleepers) InterlockedDecrement(sleepers);
+}
+
+static void vcomp_bind_thread(struct vcomp_thread_data *thread_data, int num_threads)
+{
+    int proc, num_procs = min(vcomp_num_procs, (int)sizeof(DWORD_PTR) * 8);
+
+    switch (vcomp_proc_bind)
+    {
+    case PROC_BIND_CLOSE:
+        proc = thread_data->thread_num % num_procs;
+        break;
+    case PROC_BIND_SPREAD:
+        /* consecutive threads share a processor when there are more threads than processors */
+        proc = (LONGLONG)thread_data->thread_num * num_procs / num_threads;
+        break;
+    default:
+        return;
+    }
+    if (proc == thread_data->bound_proc) return;
+
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << proc))
+        thread_data->bound_proc = proc;
+    else
+        WARN("failed to bind thread %d to processor %d\n", thread_data->thread_num, proc);
+}
+
 void CDECL _vcomp_atomic_add_i1(char *dest, char val)
 {
     interlocked_xchg_add8(dest, val);
@@ -1080,26 +1160,22 @@ void CDECL _vcomp_flush(void)
 void CDECL _vcomp_barrier(void)
 {
     struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+    LONG barrier;
 
     TRACE("()\n");
 
-    if (!team_data)
+    if (!team_data || team_data->num_threads == 1)
         return;
 
-    EnterCriticalSection(&vcomp_section);
-    if (++team_data->barrier_count >= team_data->num_threads)
+    barrier = ReadAcquire(&team_data->barrier);
+    if (InterlockedIncrement(&team_data->barrier_count) >= team_data->num_threads)
     {
-        team_data->barrier++;
         team_data->barrier_count = 0;
-        WakeAllConditionVariable(&team_data->cond);
+        InterlockedIncrement(&team_data->barrier);
+        if (ReadAcquire(&team_data->barrier_sleepers))
+            RtlWakeAddressAll(&team_data->barrier);
     }
-    else
-    {
-        unsigned int barrier = team_data->barrier;
-        while (team_data->barrier == barrier)
-            SleepConditionVariableCS(&team_data->cond, &vcomp_section, INFINITE);
-    }
-    LeaveCriticalSection(&vcomp_section);
+    else vcomp_wait_while_equal(&team_data->barrier, barrier, &team_data->barrier_sleepers);
 }
 
 void CDECL _vcomp_set_num_threads(int num_threads)
@@ -1435,6 +1511,16 @@ void CDECL _vcomp_for_static_end(void)
     /* nothing to do here */
 }
 
+/* Starts a new generation of dynamic_state, chunk requests for the previous
+ * loop will fail from now on. */
+static void vcomp_reset_dynamic_state(struct vcomp_task_data *task_data, unsigned int generation)
+{
+    LONG64 state;
+
+    do state = task_data->dynamic_state;
+    while (InterlockedCompareExchange64(&task_data->dynamic_state, (LONG64)generation << 32, state) != state);
+}
+
 void CDECL _vcomp_for_dynamic_init(unsigned int flags, unsigned int first, unsigned int last,
                                    int step, unsigned int chunksize)
 {
@@ -1495,6 +1581,8 @@ void CDECL _vcomp_for_dynamic_init(unsigned int flags, unsigned int first, unsig
         thread_data->dynamic_type = type;
         if ((int)(thread_data->dynamic - task_data->dynamic) > 0)
         {
+            /* invalidate the previous loop before reusing the fields */
+            vcomp_reset_dynamic_state(task_data, thread_data->dynamic);
             task_data->dynamic              = thread_data->dynamic;
             task_data->dynamic_first        = first;
             task_data->dynamic_last         = last;
@@ -1566,6 +1654,8 @@ void CDECL _vcomp_for_dynamic_init_i8(ULONG64 flags, ULONG64 first, ULONG64 last
         thread_data->dynamic_type = type;
         if ((LONG64)(thread_data->dynamic - task_data->dynamic) > 0)
         {
+            /* invalidate the previous loop before reusing the fields */
+            vcomp_reset_dynamic_state(task_data, thread_data->dynamic);
             task_data->dynamic              = thread_data->dynamic;
             task_data->dynamic_first        = first;
             task_data->dynamic_last         = last;
@@ -1577,10 +1667,53 @@ void CDECL _vcomp_for_dynamic_init_i8(ULONG64 flags, ULONG64 first, ULONG64 last
     }
 }
 
+/* Hands out the next chunk of a dynamic or guided loop without taking
+ * vcomp_section. Fails if the loop is finished or was replaced by a newer
+ * one; the loop parameters are only used if the update succeeds, so they
+ * are consistent with the generation. */
+static BOOL vcomp_next_chunk(struct vcomp_thread_data *thread_data, int num_threads,
+                             unsigned int *begin, unsigned int *end)
+{
+    struct vcomp_task_data *task_data = thread_data->task;
+    unsigned int taken, remaining, iterations, first, last, total;
+    LONG64 state, prev;
+    int step;
+
+    state = InterlockedCompareExchange64(&task_data->dynamic_state, 0, 0);
+    for (;;)
+    {
+        if ((unsigned int)(state >> 32) != thread_data->dynamic)
+            return FALSE;
+        taken = (unsigned int)state;
+        first = task_data->dynamic_first;
+        last  = task_data->dynamic_last;
+        step  = task_data->dynamic_step;
+        total = task_data->dynamic_iterations;
+        if (!(remaining = total - taken))
+            return FALSE;
+
+        iterations = min(remaining, task_data->dynamic_chunksize);
+        if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
+            remaining > num_threads * task_data->dynamic_chunksize)
+        {
+            iterations = (remaining + num_threads - 1) / num_threads;
+        }
+
+        prev = InterlockedCompareExchange64(&task_data->dynamic_state, state + iterations, state);
+        if (prev == state) break;
+        state = prev;
+    }
+
+    *begin = first + taken * step;
+    *end   = *begin + (iterations - 1) * step;
+    if (taken + iterations == total)
+        *end = last;
+    return TRUE;
+}
+
 int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
 {
     struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
-    struct vcomp_task_data *task_data = thread_data->task;
     struct vcomp_team_data *team_data = thread_data->team;
     int num_threads = team_data ? team_data->num_threads : 1;
 
@@ -1596,26 +1729,7 @@ int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
     else if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_CHUNKED ||
              thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED)
     {
-        unsigned int iterations = 0;
-        EnterCriticalSection(&vcomp_section);
-        if (thread_data->dynamic == task_data->dynamic &&
-            task_data->dynamic_iterations != 0)
-        {
-            iterations = min(task_data->dynamic_iterations, task_data->dynamic_chunksize);
-            if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
-                task_data->dynamic_iterations > num_threads * task_data->dynamic_chunksize)
-            {
-                iterations = (task_data->dynamic_iterations + num_threads - 1) / num_threads;
-            }
-            *begin = task_data->dynamic_first;
-            *end   = task_data->dynamic_first + (iterations - 1) * task_data->dynamic_step;
-            task_data->dynamic_iterations -= iterations;
-            task_data->dynamic_first      += iterations * task_data->dynamic_step;
-            if (!task_data->dynamic_iterations)
-                *end = task_data->dynamic_last;
-        }
-        LeaveCriticalSection(&vcomp_section);
-        return iterations != 0;
+        return vcomp_next_chunk(thread_data, num_threads, begin, end);
     }
 
     return 0;
@@ -1624,7 +1738,6 @@ int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
 LONG64 CDECL _vcomp_for_dynamic_next_i8(LONG64 *begin, LONG64 *end)
 {
     struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
-    struct vcomp_task_data *task_data = thread_data->task;
     struct vcomp_team_data *team_data = thread_data->team;
     LONG64 num_threads = team_data ? team_data->num_threads : 1;
 
@@ -1640,26 +1753,13 @@ LONG64 CDECL _vcomp_for_dynamic_next_i8(LONG64 *begin, LONG64 *end)
     else if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_CHUNKED ||
              thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED)
     {
-        unsigned int iterations = 0;
-        EnterCriticalSection(&vcomp_section);
-        if (thread_data->dynamic == task_data->dynamic &&
-            task_data->dynamic_iterations != 0)
-        {
-            iterations = min(task_data->dynamic_iterations, task_data->dynamic_chunksize);
-            if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
-                task_data->dynamic_iterations > num_threads * task_data->dynamic_chunksize)
-            {
-                iterations = (task_data->dynamic_iterations + num_threads - 1) / num_threads;
-            }
-            *begin = task_data->dynamic_first;
-            *end   = task_data->dynamic_first + (iterations - 1) * task_data->dynamic_step;
-            task_data->dynamic_iterations -= iterations;
-            task_data->dynamic_first      += iterations * task_data->dynamic_step;
-            if (!task_data->dynamic_iterations)
-                *end = task_data->dynamic_last;
-        }
-        LeaveCriticalSection(&vcomp_section);
-        return iterations != 0;
+        unsigned int chunk_begin, chunk_end;
+
+        if (!vcomp_next_chunk(thread_data, num_threads, &chunk_begin, &chunk_end))
+            return 0;
+        *begin = chunk_begin;
+        *end   = chunk_end;
+        return 1;
     }
 
     return 0;
@@ -1684,15 +1784,35 @@ static DWORD WINAPI _vcomp_fork_worker(void *param)
         struct vcomp_team_data *team = thread_data->team;
         if (team != NULL)
         {
+            int num_threads = team->num_threads;
+            unsigned int spin;
+
             LeaveCriticalSection(&vcomp_section);
+            vcomp_bind_thread(thread_data, num_threads);
             _vcomp_fork_call_wrapper(team->wrapper, team->nargs, ptr_from_va_list(team->valist));
             EnterCriticalSection(&vcomp_section);
 
             thread_data->team = NULL;
             list_remove(&thread_data->entry);
             list_add_tail(&vcomp_idle_threads, &thread_data->entry);
-            if (++team->finished_threads >= team->num_threads)
-                WakeAllConditionVariable(&team->cond);
+
+            /* the team lives on the stack of the master thread, which takes
+             * vcomp_section once all threads have checked in, so don't touch
+             * it after leaving the section */
+            if (InterlockedIncrement(&team->finished_threads) >= num_threads)
+                RtlWakeAddressAll(&team->finished_threads);
+            LeaveCriticalSection(&vcomp_section);
+
+            /* programs often fork in a loop, stay awake for a while so the
+             * next parallel region doesn't have to wait for a wakeup */
+            for (spin = 0; spin < vcomp_spin_count; spin++)
+            {
+                if (*(struct vcomp_team_data * volatile *)&thread_data->team) break;
+                YieldProcessor();
+            }
+
+            EnterCriticalSection(&vcomp_section);
+            continue;
         }
 
         if (!SleepConditionVariableCS(&thread_data->cond, &vcomp_section, 5000) &&
@@ -1732,7 +1852,6 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     else
         num_threads = vcomp_num_threads;
 
-    InitializeConditionVariable(&team_data.cond);
     team_data.num_threads       = 1;
     team_data.finished_threads  = 0;
     team_data.nargs             = nargs;
@@ -1740,10 +1859,12 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     va_start(team_data.valist, wrapper);
     team_data.barrier           = 0;
     team_data.barrier_count     = 0;
+    team_data.barrier_sleepers  = 0;
 
     task_data.single            = 0;
     task_data.section           = 0;
     task_data.dynamic           = 0;
+    task_data.dynamic_state     = 0;
 
     thread_data.team            = &team_data;
     thread_data.task            = &task_data;
@@ -1754,6 +1875,7 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     thread_data.section         = 1;
     thread_data.dynamic         = 1;
     thread_data.dynamic_type    = 0;
+    thread_data.bound_proc      = prev_thread_data->bound_proc;
     list_init(&thread_data.entry);
     InitializeConditionVariable(&thread_data.cond);
 
@@ -1799,6 +1921,7 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
             data->section       = 1;
             data->dynamic       = 1;
             data->dynamic_type  = 0;
+            data->bound_proc    = -1;
             InitializeConditionVariable(&data->cond);
 
             thread = CreateThread(NULL, 0, _vcomp_fork_worker, data, 0, NULL);
@@ -1825,13 +1948,18 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
 
     if (team_data.num_threads > 1)
     {
-        EnterCriticalSection(&vcomp_section);
+        LONG finished = InterlockedIncrement(&team_data.finished_threads);
 
-        team_data.finished_threads++;
-        while (team_data.finished_threads < team_data.num_threads)
-            SleepConditionVariableCS(&team_data.cond, &vcomp_section, INFINITE);
+        while (finished < team_data.num_threads)
+        {
+            vcomp_wait_while_equal(&team_data.finished_threads, finished, NULL);
+            finished = ReadAcquire(&team_data.finished_threads);
+        }
 
+        /* wait for the last thread to be done waking us up */
+        EnterCriticalSection(&vcomp_section);
         LeaveCriticalSection(&vcomp_section);
+
         assert(list_empty(&thread_data.entry));
     }
 
@@ -2108,6 +2236,7 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
             vcomp_max_threads = sysinfo.dwNumberOfProcessors;
             vcomp_num_threads = sysinfo.dwNumberOfProcessors;
             vcomp_num_procs   = sysinfo.dwNumberOfProcessors;
+            vcomp_read_env();
             break;
         }
 
@@ -2612,6 +2612,88 @@ static void test_reduction_float_double(void)
     }
 }
 
+static void CDECL epcc_fork_cb(LONG *count)
+{
+    InterlockedIncrement(count);
+}
+
+static void CDECL epcc_barrier_cb(LONG *count, LONG *errors)
+{
+    int num_threads = pomp_get_num_threads();
+    int i;
+
+    for (i = 0; i < 100; i++)
+    {
+        InterlockedIncrement(count);
+        p_vcomp_barrier();
+        if (*count < (i + 1) * num_threads) InterlockedIncrement(errors);
+    }
+}
+
+static void CDECL epcc_dynamic_cb(unsigned int flags, unsigned int chunksize, LONG *sum)
+{
+    unsigned int begin, end, i;
+    LONG local = 0;
+
+    p_vcomp_for_dynamic_init(flags | VCOMP_DYNAMIC_FLAGS_INCREMENT, 0, 9999, 1, chunksize);
+    while (p_vcomp_for_dynamic_next(&begin, &end))
+        for (i = begin; i <= end; i++) local += i;
+    InterlockedExchangeAdd(sum, local);
+}
+
+/* overhead measurements along the lines of the EPCC OpenMP microbenchmarks,
+ * the timings are only traced */
+static void test_epcc_overheads(void)
+{
+    LARGE_INTEGER freq, start, stop;
+    int max_threads = pomp_get_max_threads();
+    LONG count, errors, sum;
+    int i, num_threads;
+
+    QueryPerformanceFrequency(&freq);
+
+    for (num_threads = 1; num_threads <= 4; num_threads++)
+    {
+        pomp_set_num_threads(num_threads);
+
+        count = 0;
+        QueryPerformanceCounter(&start);
+        for (i = 0; i < 1000; i++)
+            p_vcomp_fork(TRUE, 1, epcc_fork_cb, &count);
+        QueryPerformanceCounter(&stop);
+        ok(count == 1000 * num_threads, "expected count == %d, got %ld\n", 1000 * num_threads, count);
+        if (winetest_debug > 1)
+            trace("%d threads: parallel %.2f us\n", num_threads,
+                  (stop.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+
+        count = errors = 0;
+        QueryPerformanceCounter(&start);
+        p_vcomp_fork(TRUE, 2, epcc_barrier_cb, &count, &errors);
+        QueryPerformanceCounter(&stop);
+        ok(count == 100 * num_threads, "expected count == %d, got %ld\n", 100 * num_threads, count);
+        ok(!errors, "got %ld threads leaving the barrier early\n", errors);
+        if (winetest_debug > 1)
+            trace("%d threads: barrier %.2f us\n", num_threads,
+                  (stop.QuadPart - start.QuadPart) * 10000.0 / freq.QuadPart);
+
+        for (i = 0; i < 2; i++)
+        {
+            unsigned int flags = i ? VCOMP_DYNAMIC_FLAGS_GUIDED : VCOMP_DYNAMIC_FLAGS_CHUNKED;
+
+            sum = 0;
+            QueryPerformanceCounter(&start);
+            p_vcomp_fork(TRUE, 3, epcc_dynamic_cb, flags, 1, &sum);
+            QueryPerformanceCounter(&stop);
+            ok(sum == 49995000, "expected sum == 49995000, got %ld\n", sum);
+            if (winetest_debug > 1)
+                trace("%d threads: %s iteration %.3f us\n", num_threads, i ? "guided" : "dynamic",
+                      (stop.QuadPart - start.QuadPart) * 100.0 / freq.QuadPart);
+        }
+    }
+
+    pomp_set_num_threads(max_threads);
+}
+
 static void test_omp_get_num_procs(void)
 {
     SYSTEM_INFO sysinfo;
@@ -2654,6 +2736,7 @@ START_TEST(vcomp)
     test_reduction_integer32();
     test_reduction_integer64();
     test_reduction_float_double();
+    test_epcc_overheads();
 
     release_vcomp();
 }
@@ -206,7 +206,7 @@ DWORD stretch_bits( const BITMAPINFO *src_info, struct bitblt_coords *src,
     if (!(ptr = malloc( dst_info->bmiHeader.biSizeImage )))
         return ERROR_OUTOFMEMORY;
 
-    err = stretch_bitmapinfo( src_info, bits->ptr, src, dst_info, ptr, dst, mode );
+    err = stretch_bitmapinfo( src_info, bits, src, dst_info, ptr, dst, mode );
     if (bits->free) bits->free( bits );
     bits->ptr = ptr;
     bits->is_copy = TRUE;
@@ -0,0 +1,246 @@
+/*
+ * DIB driver banded rendering
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#if 0
+#pragma makedep unix
+#endif
+
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ntgdi_private.h"
+#include "dibdrv.h"
+
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dib);
+
+/* Large operations are split into horizontal bands that are drawn by a
+ * small pool of worker threads, together with the calling thread. The
+ * primitives only touch the destination rows they are given, so the
+ * result is the same as drawing everything at once.
+ *
+ * The workers are plain host threads, they only ever run the primitives
+ * and never call back into Wine. They can't handle page faults either, so
+ * only bits that the application never sees are drawn in bands: it could
+ * protect its own memory at any time, or have write watches on it, which
+ * rely on Wine's signal handlers. */
+
+#define MIN_BAND_PIXELS  (128 * 1024)  /* don't bother with smaller bands */
+
+struct band_job
+{
+    void (*func)( void *context, int band );
+    void *context;
+    int   count;    /* number of bands */
+    int   next;     /* next band to be picked up */
+    int   pending;  /* bands that haven't been finished yet */
+};
+
+static pthread_mutex_t band_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t band_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t band_done_cond = PTHREAD_COND_INITIALIZER;
+static struct band_job *band_job;
+static int band_threads = -1;
+
+static void *band_thread( void *arg )
+{
+    struct band_job *job;
+    int band;
+
+    pthread_mutex_lock( &band_mutex );
+    for (;;)
+    {
+        while (!(job = band_job) || job->next >= job->count)
+            pthread_cond_wait( &band_work_cond, &band_mutex );
+
+        band = job->next++;
+        pthread_mutex_unlock( &band_mutex );
+        job->func( job->context, band );
+        pthread_mutex_lock( &band_mutex );
+        if (!--job->pending) pthread_cond_signal( &band_done_cond );
+    }
+    return NULL;
+}
+
+static void init_band_threads(void)
+{
+    const char *env = getenv( "WINE_DIB_THREADS" );
+    long count = sysconf( _SC_NPROCESSORS_ONLN ) - 1;
+    sigset_t block, old;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int i;
+
+    if (env) count = atoi( env );
+    count = max( 0, min( count, MAX_DIB_BANDS - 1 ));
+
+    /* keep Wine's signal handlers away from threads it doesn't know about */
+    sigfillset( &block );
+    pthread_sigmask( SIG_BLOCK, &block, &old );
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    for (i = 0; i < count; i++)
+        if (pthread_create( &thread, &attr, band_thread, NULL )) break;
+    pthread_attr_destroy( &attr );
+    pthread_sigmask( SIG_SETMASK, &old, NULL );
+
+    band_threads = i;
+    TRACE( "using %d band threads\n", band_threads );
+}
+
+/* whether the bits can be safely accessed from the band threads */
+static BOOL is_private_dib( const dib_info *dib )
+{
+    return dib->private_bits || dib->bits.is_copy;
+}
+
+/***********************************************************************
+ *           get_band_count
+ *
+ * Number of bands worth splitting an operation touching that many
+ * pixels of dst, and optionally src, into; 1 if it should be done in one go.
+ */
+int get_band_count( const dib_info *dst, const dib_info *src, ULONGLONG pixels )
+{
+    ULONGLONG count;
+
+    if (pixels < 2 * MIN_BAND_PIXELS) return 1;
+    if (!is_private_dib( dst ) || (src && !is_private_dib( src ))) return 1;
+
+    pthread_mutex_lock( &band_mutex );
+    if (band_threads == -1) init_band_threads();
+    count = band_job ? 1 : band_threads + 1;  /* no nesting between threads */
+    pthread_mutex_unlock( &band_mutex );
+
+    return min( count, pixels / MIN_BAND_PIXELS );
+}
+
+/***********************************************************************
+ *           run_in_bands
+ *
+ * Call func once for each band, spread over the band threads. Returns
+ * when all of them are done.
+ */
+void run_in_bands( void (*func)( void *context, int band ), void *context, int count )
+{
+    struct band_job job = { func, context, count, 0, count };
+    BOOL threaded = FALSE;
+    int band;
+
+    if (count > 1)
+    {
+        pthread_mutex_lock( &band_mutex );
+        if (!band_job)  /* otherwise another thread is using them */
+        {
+            band_job = &job;
+            pthread_cond_broadcast( &band_work_cond );
+            threaded = TRUE;
+        }
+        pthread_mutex_unlock( &band_mutex );
+    }
+
+    if (!threaded)
+    {
+        for (band = 0; band < count; band++) func( context, band );
+        return;
+    }
+
+    pthread_mutex_lock( &band_mutex );
+    while (job.next < job.count)
+    {
+        band = job.next++;
+        pthread_mutex_unlock( &band_mutex );
+        func( context, band );
+        pthread_mutex_lock( &band_mutex );
+        job.pending--;
+    }
+    while (job.pending) pthread_cond_wait( &band_done_cond, &band_mutex );
+    band_job = NULL;
+    pthread_mutex_unlock( &band_mutex );
+}
+
+struct rect_bands
+{
+    void       (*func)( void *context, int num, const RECT *rects );
+    void        *context;
+    int          num;
+    const RECT  *rects;
+    RECT        *buffer;  /* num rectangles for each band */
+    int          top;
+    int          height;  /* of each band */
+};
+
+static void draw_rect_band( void *context, int band )
+{
+    struct rect_bands *bands = context;
+    RECT *band_rects = bands->buffer + band * bands->num, limit;
+    int i, count = 0;
+
+    limit.left   = INT_MIN;
+    limit.right  = INT_MAX;
+    limit.top    = bands->top + band * bands->height;
+    limit.bottom = limit.top + bands->height;
+    for (i = 0; i < bands->num; i++)
+        if (intersect_rect( &band_rects[count], &bands->rects[i], &limit )) count++;
+
+    if (count) bands->func( bands->context, count, band_rects );
+}
+
+/***********************************************************************
+ *           draw_rects_in_bands
+ *
+ * Call func for the rectangles of dst, split into horizontal bands if they
+ * are big enough. The rectangles must not overlap.
+ */
+void draw_rects_in_bands( const dib_info *dst, const dib_info *src,
+                          void (*func)( void *context, int num, const RECT *rects ), void *context,
+                          int num, const RECT *rects )
+{
+    struct rect_bands bands;
+    RECT buffer[32];
+    ULONGLONG pixels = 0;
+    int i, top = INT_MAX, bottom = INT_MIN, count;
+
+    for (i = 0; i < num; i++)
+    {
+        pixels += (ULONGLONG)(rects[i].right - rects[i].left) * (rects[i].bottom - rects[i].top);
+        top = min( top, rects[i].top );
+        bottom = max( bottom, rects[i].bottom );
+    }
+
+    bands.buffer = buffer;
+    if ((count = get_band_count( dst, src, pixels )) < 2 ||
+        (num * count > ARRAY_SIZE(buffer) && !(bands.buffer = malloc( num * count * sizeof(RECT) ))))
+    {
+        func( context, num, rects );
+        return;
+    }
+
+    bands.func    = func;
+    bands.context = context;
+    bands.num     = num;
+    bands.rects   = rects;
+    bands.top     = top;
+    bands.height  = (bottom - top + count - 1) / count;
+    run_in_bands( draw_rect_band, &bands, count );
+    if (bands.buffer != buffer) free( bands.buffer );
+}
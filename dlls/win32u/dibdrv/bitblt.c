@@ -585,17 +585,40 @@ static void mask_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src,
     }
 }
 
+struct blend_rects_params
+{
+    const dib_info *dst;
+    const dib_info *src;
+    POINT           offset;
+    BLENDFUNCTION   blend;
+};
+
+static void blend_rects_band( void *context, int num, const RECT *rects )
+{
+    const struct blend_rects_params *params = context;
+
+    params->dst->funcs->blend_rects( params->dst, num, rects, params->src, &params->offset, params->blend );
+}
+
 static DWORD blend_rect( dib_info *dst, const RECT *dst_rect, const dib_info *src, const RECT *src_rect,
                          HRGN clip, BLENDFUNCTION blend )
 {
-    POINT offset;
+    struct blend_rects_params params;
     struct clipped_rects clipped_rects;
 
     if (!get_clipped_rects( dst, dst_rect, clip, &clipped_rects )) return ERROR_SUCCESS;
 
-    offset.x = src_rect->left - dst_rect->left;
-    offset.y = src_rect->top  - dst_rect->top;
-    dst->funcs->blend_rects( dst, clipped_rects.count, clipped_rects.rects, src, &offset, blend );
+    params.dst      = dst;
+    params.src      = src;
+    params.offset.x = src_rect->left - dst_rect->left;
+    params.offset.y = src_rect->top  - dst_rect->top;
+    params.blend    = blend;
+
+    /* bands would read rows that other bands are writing */
+    if (src->bits.ptr == dst->bits.ptr)
+        blend_rects_band( &params, clipped_rects.count, clipped_rects.rects );
+    else
+        draw_rects_in_bands( dst, src, blend_rects_band, &params, clipped_rects.count, clipped_rects.rects );
 
     free_clipped_rects( &clipped_rects );
     return ERROR_SUCCESS;
@@ -680,19 +703,42 @@ static void get_gradient_triangle_vertices( const GRADIENT_TRIANGLE *tri, const
     bounds->bottom = v[2].y;
 }
 
-static BOOL gradient_rect( dib_info *dib, TRIVERTEX *v, int mode, HRGN clip, const RECT *bounds )
+struct gradient_rects_params
+{
+    const dib_info *dib;
+    TRIVERTEX      *v;
+    int             mode;
+    LONG            failed;
+};
+
+static void gradient_rects_band( void *context, int num, const RECT *rects )
 {
+    struct gradient_rects_params *params = context;
     int i;
-    struct clipped_rects clipped_rects;
-    BOOL ret = TRUE;
 
-    if (!get_clipped_rects( dib, bounds, clip, &clipped_rects )) return TRUE;
-    for (i = 0; i < clipped_rects.count; i++)
+    for (i = 0; i < num; i++)
     {
-        if (!(ret = dib->funcs->gradient_rect( dib, &clipped_rects.rects[i], v, mode ))) break;
+        if (params->failed) break;
+        if (!params->dib->funcs->gradient_rect( params->dib, &rects[i], params->v, params->mode ))
+            params->failed = TRUE;
     }
+}
+
+static BOOL gradient_rect( dib_info *dib, TRIVERTEX *v, int mode, HRGN clip, const RECT *bounds )
+{
+    struct gradient_rects_params params;
+    struct clipped_rects clipped_rects;
+
+    if (!get_clipped_rects( dib, bounds, clip, &clipped_rects )) return TRUE;
+
+    params.dib    = dib;
+    params.v      = v;
+    params.mode   = mode;
+    params.failed = FALSE;
+    draw_rects_in_bands( dib, NULL, gradient_rects_band, &params, clipped_rects.count, clipped_rects.rects );
+
     free_clipped_rects( &clipped_rects );
-    return ret;
+    return !params.failed;
 }
 
 static DWORD copy_src_bits( dib_info *src, RECT *src_rect )
@@ -1197,28 +1243,123 @@ static DWORD calc_1d_stretch_params( INT dst_start, INT dst_length, INT dst_vis_
     return ERROR_SUCCESS;
 }
 
+/* position in the vertical stretch loop */
+struct stretch_pos
+{
+    POINT        dst;
+    POINT        src;
+    int          err;
+    unsigned int count;  /* number of rows done */
+};
+
+struct stretch_rows
+{
+    dib_info                    *dst_dib;
+    const dib_info              *src_dib;
+    void                       (*row_fn)( const dib_info *dst_dib, const POINT *dst_start,
+                                          const dib_info *src_dib, const POINT *src_start,
+                                          const struct stretch_params *params, int mode, BOOL keep_dst );
+    const struct stretch_params *h_params;
+    const struct stretch_params *v_params;
+    int                          mode;
+    BOOL                         vstretch;
+    int                          width;  /* of the destination rows */
+    int                          count;
+    struct stretch_pos           bands[MAX_DIB_BANDS + 1];
+};
+
+/* Moves to the next row. Returns TRUE if the next row starts afresh, i.e.
+ * it neither copies the previous destination row nor merges into it. */
+static BOOL stretch_next_row( const struct stretch_rows *rows, struct stretch_pos *pos )
+{
+    const struct stretch_params *v_params = rows->v_params;
+    BOOL ret = FALSE;
+
+    if (pos->err > 0)
+    {
+        if (rows->vstretch) pos->src.y += v_params->src_inc;
+        else pos->dst.y += v_params->dst_inc;
+        pos->err += v_params->err_add_1;
+        ret = TRUE;
+    }
+    else pos->err += v_params->err_add_2;
+
+    if (rows->vstretch) pos->dst.y += v_params->dst_inc;
+    else pos->src.y += v_params->src_inc;
+    pos->count++;
+    return ret;
+}
+
+/* Splits the rows into bands that can be drawn independently, and returns
+ * the number of bands. The end of each band is the start of the next one. */
+static int get_stretch_bands( struct stretch_rows *rows, int count )
+{
+    struct stretch_pos pos = rows->bands[0];
+    unsigned int length = rows->v_params->length;
+    int band = 1;
+
+    while (band < count && pos.count < length)
+    {
+        if (stretch_next_row( rows, &pos ) && pos.count >= (ULONGLONG)length * band / count)
+            rows->bands[band++] = pos;
+    }
+    rows->bands[band].count = length;
+    return band;
+}
+
+static void stretch_rows_band( void *context, int band )
+{
+    const struct stretch_rows *rows = context;
+    const struct stretch_params *v_params = rows->v_params;
+    struct stretch_pos pos = rows->bands[band];
+    unsigned int end = rows->bands[band + 1].count;
+    BOOL fresh = TRUE;
+    RECT last_row, this_row;
+
+    last_row.left = 0;
+    last_row.right = rows->width;
+
+    for ( ; pos.count < end; fresh = stretch_next_row( rows, &pos ))
+    {
+        if (rows->vstretch)
+        {
+            if (fresh)
+                rows->row_fn( rows->dst_dib, &pos.dst, rows->src_dib, &pos.src, rows->h_params, rows->mode, FALSE );
+            else
+            {
+                last_row.top = pos.dst.y - v_params->dst_inc;
+                last_row.bottom = last_row.top + 1;
+                this_row = last_row;
+                OffsetRect( &this_row, 0, v_params->dst_inc );
+                copy_rect( rows->dst_dib, &this_row, rows->dst_dib, &last_row, NULL, R2_COPYPEN );
+            }
+        }
+        else if (rows->mode != STRETCH_DELETESCANS || fresh)
+            rows->row_fn( rows->dst_dib, &pos.dst, rows->src_dib, &pos.src, rows->h_params, rows->mode, !fresh );
+    }
+}
 
-DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bitblt_coords *src,
-                          const BITMAPINFO *dst_info, void *dst_bits, struct bitblt_coords *dst,
-                          INT mode )
+DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, const struct gdi_image_bits *src_bits,
+                          struct bitblt_coords *src, const BITMAPINFO *dst_info, void *dst_bits,
+                          struct bitblt_coords *dst, INT mode )
 {
     dib_info src_dib, dst_dib;
     POINT dst_start, src_start, dst_end, src_end;
     RECT rect;
     BOOL hstretch, vstretch;
     struct stretch_params v_params, h_params;
-    int err;
+    struct stretch_rows rows;
+    int count;
     DWORD ret;
-    void (* row_fn)(const dib_info *dst_dib, const POINT *dst_start,
-                    const dib_info *src_dib, const POINT *src_start,
-                    const struct stretch_params *params, int mode, BOOL keep_dst);
 
     TRACE("dst %d, %d - %d x %d visrect %s src %d, %d - %d x %d visrect %s\n",
           dst->x, dst->y, dst->width, dst->height, wine_dbgstr_rect(&dst->visrect),
           src->x, src->y, src->width, src->height, wine_dbgstr_rect(&src->visrect));
 
-    init_dib_info_from_bitmapinfo( &src_dib, src_info, src_bits );
+    init_dib_info_from_bitmapinfo( &src_dib, src_info, src_bits->ptr );
+    src_dib.bits.is_copy = src_bits->is_copy;
     init_dib_info_from_bitmapinfo( &dst_dib, dst_info, dst_bits );
+    dst_dib.private_bits = TRUE;  /* always a temporary buffer allocated by stretch_bits */
 
     if (mode == HALFTONE)
     {
@@ -1251,64 +1392,23 @@ DWORD stretch_bitmapinfo( const BITMAPINFO *src_info, void *src_bits, struct bit
     dst_start.x -= dst->visrect.left;
     dst_start.y -= dst->visrect.top;
 
-    err = v_params.err_start;
-
-    row_fn = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
-
-    if (vstretch)
-    {
-        BOOL need_row = TRUE;
-        RECT last_row, this_row;
-        if (hstretch) mode = STRETCH_DELETESCANS;
-        last_row.left = 0;
-        last_row.right = dst->visrect.right - dst->visrect.left;
-
-        while (v_params.length--)
-        {
-            if (need_row)
-            {
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, FALSE );
-                need_row = FALSE;
-            }
-            else
-            {
-                last_row.top = dst_start.y - v_params.dst_inc;
-                last_row.bottom = last_row.top + 1;
-                this_row = last_row;
-                OffsetRect( &this_row, 0, v_params.dst_inc );
-                copy_rect( &dst_dib, &this_row, &dst_dib, &last_row, NULL, R2_COPYPEN );
-            }
-
-            if (err > 0)
-            {
-                src_start.y += v_params.src_inc;
-                need_row = TRUE;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            dst_start.y += v_params.dst_inc;
-        }
-    }
-    else
-    {
-        int merged_rows = 0;
-
-        while (v_params.length--)
-        {
-            if (mode != STRETCH_DELETESCANS || !merged_rows)
-                row_fn( &dst_dib, &dst_start, &src_dib, &src_start, &h_params, mode, merged_rows != 0 );
-            merged_rows++;
-
-            if (err > 0)
-            {
-                dst_start.y += v_params.dst_inc;
-                merged_rows = 0;
-                err += v_params.err_add_1;
-            }
-            else err += v_params.err_add_2;
-            src_start.y += v_params.src_inc;
-        }
-    }
+    rows.dst_dib   = &dst_dib;
+    rows.src_dib   = &src_dib;
+    rows.row_fn    = hstretch ? dst_dib.funcs->stretch_row : dst_dib.funcs->shrink_row;
+    rows.h_params  = &h_params;
+    rows.v_params  = &v_params;
+    rows.mode      = (vstretch && hstretch) ? STRETCH_DELETESCANS : mode;
+    rows.vstretch  = vstretch;
+    rows.width     = dst->visrect.right - dst->visrect.left;
+    rows.bands[0].dst   = dst_start;
+    rows.bands[0].src   = src_start;
+    rows.bands[0].err   = v_params.err_start;
+    rows.bands[0].count = 0;
+
+    count = get_band_count( &dst_dib, &src_dib, (ULONGLONG)v_params.length * max( h_params.length, 1 ));
+    count = min( count, MAX_DIB_BANDS );
+    rows.count = get_stretch_bands( &rows, count );
+    run_in_bands( stretch_rows_band, &rows, rows.count );
 
 done:
     /* update coordinates, the destination rectangle is always stored at 0,0 */
@@ -25,6 +25,7 @@ typedef struct
     RECT rect;  /* visible rectangle relative to bitmap origin */
     int stride; /* stride in bytes.  Will be -ve for bottom-up dibs (see bits). */
     struct gdi_image_bits bits; /* bits.ptr points to the top-left corner of the dib. */
+    BOOL private_bits; /* the bits are allocated by win32u and not visible to the application */
 
     DWORD red_mask, green_mask, blue_mask;
     int red_shift, green_shift, blue_shift;
@@ -265,6 +266,14 @@ extern int clip_line(const POINT *start, const POINT *end, const RECT *clip,
 extern void release_cached_font( struct cached_font *font );
 extern BOOL fill_with_pixel( DC *dc, dib_info *dib, DWORD pixel, int num, const RECT *rects, INT rop );
 
+#define MAX_DIB_BANDS 8  /* including the calling thread */
+
+extern int get_band_count( const dib_info *dst, const dib_info *src, ULONGLONG pixels );
+extern void run_in_bands( void (*func)( void *context, int band ), void *context, int count );
+extern void draw_rects_in_bands( const dib_info *dst, const dib_info *src,
+                                 void (*func)( void *context, int num, const RECT *rects ), void *context,
+                                 int num, const RECT *rects );
+
 static inline void init_clipped_rects( struct clipped_rects *clip_rects )
 {
     clip_rects->count = 0;
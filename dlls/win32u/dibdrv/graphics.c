@@ -33,6 +33,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(dib);
 
 struct cached_glyph
 {
+    UINT         key;  /* see glyph_key() */
     GLYPHMETRICS metrics;
     BYTE         bits[1];
 };
@@ -44,24 +45,66 @@ enum glyph_type
     GLYPH_NBTYPES
 };
 
-#define GLYPH_CACHE_PAGE_SIZE  0x100
-#define GLYPH_CACHE_PAGES      (0x10000 / GLYPH_CACHE_PAGE_SIZE)
+/* The glyphs of a font are looked up in an open addressed hash table that is
+ * only ever grown. The previous versions of the table are kept until the font
+ * is freed, so lookups don't need to take the lock. The glyphs themselves are
+ * packed into a few large blocks instead of being allocated one by one. */
+
+#define GLYPH_TABLE_MIN_BITS  6
+#define GLYPH_BLOCK_MIN_SIZE  0x1000
+#define GLYPH_BLOCK_MAX_SIZE  0x10000
+
+struct glyph_table
+{
+    struct glyph_table           *prev;
+    UINT                          bits;
+    UINT                          count;
+    struct cached_glyph *volatile glyphs[1];
+};
+
+struct glyph_block
+{
+    struct glyph_block *next;
+    UINT                size;
+    UINT                used;
+    BYTE                data[1];
+};
 
 struct cached_font
 {
-    struct list           entry;
-    LONG                  ref;
-    DWORD                 hash;
-    LOGFONTW              lf;
-    XFORM                 xform;
-    UINT                  aa_flags;
-    struct cached_glyph **glyphs[GLYPH_NBTYPES][GLYPH_CACHE_PAGES];
+    struct list                  entry;       /* in the font_cache list, most recently used first */
+    struct list                  hash_entry;  /* in the font_cache_hash_table bucket */
+    LONG                         ref;         /* protected by font_cache_lock */
+    DWORD                        hash;
+    LOGFONTW                     lf;
+    XFORM                        xform;
+    UINT                         aa_flags;
+    pthread_mutex_t              glyph_lock;
+    struct glyph_table *volatile glyphs;
+    struct glyph_block          *blocks;
+    SIZE_T                       size;        /* resident bytes */
 };
 
+#define FONT_CACHE_HASH_BITS  6
+#define FONT_CACHE_MIN_FONTS  5                  /* always keep that many fonts around */
+#define FONT_CACHE_MAX_FONTS  64
+#define FONT_CACHE_BUDGET     (8 * 1024 * 1024)  /* bytes of glyphs kept for unused fonts */
+
 static struct list font_cache = LIST_INIT( font_cache );
+static struct list font_cache_hash_table[1 << FONT_CACHE_HASH_BITS];
+static UINT font_cache_count;
+static SIZE_T font_cache_unused_size;  /* resident bytes of the fonts with no references */
 
 static pthread_mutex_t font_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static struct
+{
+    LONG64 hits;
+    LONG64 misses;
+    LONG64 size;
+    LONG64 evicted;
+} font_cache_stats;
+
 
 static BOOL brush_rect( dibdrv_physdev *pdev, dib_brush *brush, const RECT *rect, HRGN clip )
 {
@@ -631,10 +674,57 @@ static int font_cache_cmp( const struct cached_font *p1, const struct cached_fon
     return ret;
 }
 
+static void free_cached_font( struct cached_font *font )
+{
+    struct glyph_block *block, *next_block;
+    struct glyph_table *table, *prev_table;
+
+    TRACE( "%p, %s bytes\n", font, wine_dbgstr_longlong( font->size ));
+
+    for (block = font->blocks; block; block = next_block)
+    {
+        next_block = block->next;
+        free( block );
+    }
+    for (table = font->glyphs; table; table = prev_table)
+    {
+        prev_table = table->prev;
+        free( table );
+    }
+    list_remove( &font->entry );
+    list_remove( &font->hash_entry );
+    pthread_mutex_destroy( &font->glyph_lock );
+    InterlockedExchangeAdd64( &font_cache_stats.size, -(LONG64)font->size );
+    InterlockedIncrement64( &font_cache_stats.evicted );
+    font_cache_unused_size -= font->size;
+    font_cache_count--;
+    free( font );
+}
+
+/* free the least recently used unused fonts until we are back within budget */
+/* must be called with the font cache lock held */
+static void trim_font_cache(void)
+{
+    struct cached_font *font, *prev;
+
+    LIST_FOR_EACH_ENTRY_SAFE_REV( font, prev, &font_cache, struct cached_font, entry )
+    {
+        if (font_cache_count <= FONT_CACHE_MIN_FONTS) break;
+        if (font_cache_count <= FONT_CACHE_MAX_FONTS && font_cache_unused_size <= FONT_CACHE_BUDGET) break;
+        if (!font->ref) free_cached_font( font );
+    }
+
+    TRACE( "%u fonts, %s bytes, %s unused, %s hits, %s misses, %s evicted\n", font_cache_count,
+           wine_dbgstr_longlong( font_cache_stats.size ), wine_dbgstr_longlong( font_cache_unused_size ),
+           wine_dbgstr_longlong( font_cache_stats.hits ),
+           wine_dbgstr_longlong( font_cache_stats.misses ), wine_dbgstr_longlong( font_cache_stats.evicted ));
+}
+
 static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
 {
-    struct cached_font font, *ptr, *last_unused = NULL;
-    UINT i = 0, j, k;
+    struct cached_font font, *ptr;
+    struct list *bucket;
+    UINT i;
 
     NtGdiExtGetObjectW( hfont, sizeof(font.lf), &font.lf );
     font.xform = dc->xformWorld2Vport;
@@ -650,45 +740,39 @@ static struct cached_font *add_cached_font( DC *dc, HFONT hfont, UINT aa_flags )
     font.hash = font_cache_hash( &font );
 
     pthread_mutex_lock( &font_cache_lock );
-    LIST_FOR_EACH_ENTRY( ptr, &font_cache, struct cached_font, entry )
+    if (!font_cache_hash_table[0].next)
+        for (i = 0; i < ARRAY_SIZE(font_cache_hash_table); i++) list_init( &font_cache_hash_table[i] );
+
+    bucket = &font_cache_hash_table[(font.hash * 0x9e3779b1) >> (32 - FONT_CACHE_HASH_BITS)];
+    LIST_FOR_EACH_ENTRY( ptr, bucket, struct cached_font, hash_entry )
     {
         if (!font_cache_cmp( &font, ptr ))
         {
-            InterlockedIncrement( &ptr->ref );
+            if (!ptr->ref++) font_cache_unused_size -= ptr->size;
             list_remove( &ptr->entry );
             goto done;
         }
-        if (!ptr->ref)
-        {
-            i++;
-            last_unused = ptr;
-        }
     }
 
-    if (i > 5)  /* keep at least 5 of the most-recently used fonts around */
-    {
-        ptr = last_unused;
-        for (i = 0; i < GLYPH_NBTYPES; i++)
-        {
-            for (j = 0; j < GLYPH_CACHE_PAGES; j++)
-            {
-                if (!ptr->glyphs[i][j]) continue;
-                for (k = 0; k < GLYPH_CACHE_PAGE_SIZE; k++)
-                    free( ptr->glyphs[i][j][k] );
-                free( ptr->glyphs[i][j] );
-            }
-        }
-        list_remove( &ptr->entry );
-    }
-    else if (!(ptr = malloc( sizeof(*ptr) )))
+    if (!(ptr = malloc( sizeof(*ptr) )))
     {
         pthread_mutex_unlock( &font_cache_lock );
         return NULL;
     }
 
-    *ptr = font;
-    ptr->ref = 1;
-    memset( ptr->glyphs, 0, sizeof(ptr->glyphs) );
+    ptr->ref      = 1;
+    ptr->hash     = font.hash;
+    ptr->lf       = font.lf;
+    ptr->xform    = font.xform;
+    ptr->aa_flags = font.aa_flags;
+    ptr->glyphs   = NULL;
+    ptr->blocks   = NULL;
+    ptr->size     = sizeof(*ptr);
+    pthread_mutex_init( &ptr->glyph_lock, NULL );
+    list_add_head( bucket, &ptr->hash_entry );
+    InterlockedExchangeAdd64( &font_cache_stats.size, ptr->size );
+    font_cache_count++;
+    trim_font_cache();
 done:
     list_add_head( &font_cache, &ptr->entry );
     pthread_mutex_unlock( &font_cache_lock );
@@ -698,43 +782,126 @@ done:
 
 void release_cached_font( struct cached_font *font )
 {
-    if (font) InterlockedDecrement( &font->ref );
+    if (!font) return;
+
+    pthread_mutex_lock( &font_cache_lock );
+    if (!--font->ref)
+    {
+        /* the font can't grow anymore until it is used again */
+        font_cache_unused_size += font->size;
+        trim_font_cache();
+    }
+    pthread_mutex_unlock( &font_cache_lock );
+}
+
+static inline UINT glyph_key( UINT index, UINT flags )
+{
+    enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
+    return index * GLYPH_NBTYPES + type;
+}
+
+static inline UINT glyph_slot( const struct glyph_table *table, UINT key )
+{
+    return (key * 0x9e3779b1) >> (32 - table->bits);
+}
+
+static struct cached_glyph *find_glyph( const struct glyph_table *table, UINT key )
+{
+    struct cached_glyph *glyph;
+    UINT i = glyph_slot( table, key ), mask = (1 << table->bits) - 1;
+
+    while ((glyph = table->glyphs[i]))
+    {
+        if (glyph->key == key) return glyph;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void insert_glyph( struct glyph_table *table, struct cached_glyph *glyph )
+{
+    UINT i = glyph_slot( table, glyph->key ), mask = (1 << table->bits) - 1;
+
+    while (table->glyphs[i]) i = (i + 1) & mask;
+    InterlockedExchangePointer( (void **)&table->glyphs[i], glyph );
+    table->count++;
+}
+
+/* must be called with the glyph lock held */
+static struct glyph_table *grow_glyph_table( struct cached_font *font )
+{
+    struct glyph_table *table, *prev = font->glyphs;
+    UINT i, bits = prev ? prev->bits + 1 : GLYPH_TABLE_MIN_BITS;
+    SIZE_T size = FIELD_OFFSET( struct glyph_table, glyphs[1 << bits] );
+
+    if (!(table = calloc( 1, size ))) return NULL;
+    table->prev = prev;
+    table->bits = bits;
+    if (prev)
+        for (i = 0; i < 1 << prev->bits; i++)
+            if (prev->glyphs[i]) insert_glyph( table, prev->glyphs[i] );
+
+    font->size += size;
+    InterlockedExchangeAdd64( &font_cache_stats.size, size );
+    InterlockedExchangePointer( (void **)&font->glyphs, table );
+    return table;
+}
+
+/* must be called with the glyph lock held */
+static struct cached_glyph *alloc_glyph( struct cached_font *font, UINT size )
+{
+    struct glyph_block *block = font->blocks;
+    struct cached_glyph *glyph;
+
+    size = (size + 3) & ~3;
+    if (!block || block->size - block->used < size)
+    {
+        UINT block_size = block ? min( block->size * 2, GLYPH_BLOCK_MAX_SIZE ) : GLYPH_BLOCK_MIN_SIZE;
+
+        block_size = max( block_size, size );
+        if (!(block = malloc( FIELD_OFFSET( struct glyph_block, data[block_size] )))) return NULL;
+        block->next = font->blocks;
+        block->size = block_size;
+        block->used = 0;
+        font->blocks = block;
+        font->size += block_size;
+        InterlockedExchangeAdd64( &font_cache_stats.size, block_size );
+    }
+    glyph = (struct cached_glyph *)(block->data + block->used);
+    block->used += size;
+    return glyph;
 }
 
 static struct cached_glyph *add_cached_glyph( struct cached_font *font, UINT index, UINT flags,
-                                              struct cached_glyph *glyph )
+                                              const struct cached_glyph *glyph, DWORD size )
 {
     struct cached_glyph *ret;
-    enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
-    UINT page = index / GLYPH_CACHE_PAGE_SIZE;
-    UINT entry = index % GLYPH_CACHE_PAGE_SIZE;
+    struct glyph_table *table;
+    UINT key = glyph_key( index, flags );
 
-    if (!font->glyphs[type][page])
-    {
-        struct cached_glyph **ptr;
+    pthread_mutex_lock( &font->glyph_lock );
+    table = font->glyphs;
+    if (table && (ret = find_glyph( table, key ))) goto done;  /* another thread was faster */
 
-        ptr = calloc( 1, GLYPH_CACHE_PAGE_SIZE * sizeof(*ptr) );
-        if (!ptr)
-        {
-            free( glyph );
-            return NULL;
-        }
-        if (InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page], ptr, NULL ))
-            free( ptr );
+    if ((!table || table->count >= (3 << table->bits) / 4) && !(table = grow_glyph_table( font )))
+        ret = NULL;
+    else if ((ret = alloc_glyph( font, FIELD_OFFSET( struct cached_glyph, bits[size] ))))
+    {
+        memcpy( ret, glyph, FIELD_OFFSET( struct cached_glyph, bits[size] ));
+        ret->key = key;
+        insert_glyph( table, ret );
     }
-    ret = InterlockedCompareExchangePointer( (void **)&font->glyphs[type][page][entry], glyph, NULL );
-    if (!ret) ret = glyph;
-    else free( glyph );
+done:
+    pthread_mutex_unlock( &font->glyph_lock );
     return ret;
 }
 
 static struct cached_glyph *get_cached_glyph( struct cached_font *font, UINT index, UINT flags )
 {
-    enum glyph_type type = (flags & ETO_GLYPH_INDEX) ? GLYPH_INDEX : GLYPH_WCHAR;
-    UINT page = index / GLYPH_CACHE_PAGE_SIZE;
+    struct glyph_table *table = font->glyphs;
 
-    if (!font->glyphs[type][page]) return NULL;
-    return font->glyphs[type][page][index % GLYPH_CACHE_PAGE_SIZE];
+    if (!table) return NULL;
+    return find_glyph( table, glyph_key( index, flags ));
 }
 
 /**********************************************************************
@@ -832,7 +999,7 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
     BYTE *dst, *src;
     int pad = 0, stride, bit_count;
     GLYPHMETRICS metrics;
-    struct cached_glyph *glyph;
+    struct cached_glyph *glyph, *ret_glyph;
 
     if (flags & ETO_GLYPH_INDEX) ggo_flags |= GGO_GLYPH_INDEX;
     indices[0] = index;
@@ -884,14 +1051,16 @@ static struct cached_glyph *cache_glyph_bitmap( DC *dc, struct cached_font *font
 
 done:
     glyph->metrics = metrics;
-    return add_cached_glyph( font, index, flags, glyph );
+    ret_glyph = add_cached_glyph( font, index, flags, glyph, size );
+    free( glyph );
+    return ret_glyph;
 }
 
 static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT x, INT y,
                            UINT flags, const WCHAR *str, UINT count, const INT *dx,
                            const struct clipped_rects *clipped_rects, RECT *bounds )
 {
-    UINT i;
+    UINT i, misses = 0;
     struct cached_glyph *glyph;
     dib_info glyph_dib;
     DWORD text_color;
@@ -912,8 +1081,11 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
 
     for (i = 0; i < count; i++)
     {
-        if (!(glyph = get_cached_glyph( font, str[i], flags )) &&
-            !(glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) continue;
+        if (!(glyph = get_cached_glyph( font, str[i], flags )))
+        {
+            misses++;
+            if (!(glyph = cache_glyph_bitmap( dc, font, str[i], flags ))) continue;
+        }
 
         glyph_dib.width       = glyph->metrics.gmBlackBoxX;
         glyph_dib.height      = glyph->metrics.gmBlackBoxY;
@@ -940,6 +1112,9 @@ static void render_string( DC *dc, dib_info *dib, struct cached_font *font, INT
             y += glyph->metrics.gmCellIncY;
         }
     }
+
+    InterlockedExchangeAdd64( &font_cache_stats.hits, count - misses );
+    if (misses) InterlockedExchangeAdd64( &font_cache_stats.misses, misses );
 }
 
 BOOL render_aa_text_bitmapinfo( DC *dc, BITMAPINFO *info, struct gdi_image_bits *bits,
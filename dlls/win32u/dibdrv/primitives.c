@@ -108,6 +108,110 @@ static inline BYTE *get_pixel_ptr_1(const dib_info *dib, int x, int y)
     return (BYTE*)dib->bits.ptr + (dib->rect.top + y) * dib->stride + (dib->rect.left + x) / 8;
 }
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector) && __has_builtin(__builtin_cpu_supports)
+
+#define SIMD_NAME(x) sse2_##x
+#define SIMD_TARGET __attribute__((target("sse2")))
+#define SIMD_SIZE 16
+#include "primitives_simd.h"
+#undef SIMD_NAME
+#undef SIMD_TARGET
+#undef SIMD_SIZE
+
+#define SIMD_NAME(x) avx2_##x
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define SIMD_SIZE 32
+#include "primitives_simd.h"
+#undef SIMD_NAME
+#undef SIMD_TARGET
+#undef SIMD_SIZE
+
+#define HAVE_SIMD_PRIMITIVES
+
+#endif
+#endif
+
+/* The row helpers return the number of pixels they handled, the rest of the
+ * row is left to the scalar code. */
+
+#ifdef HAVE_SIMD_PRIMITIVES
+#define SIMD_ROW(func, args) \
+    if (__builtin_cpu_supports( "avx2" )) return avx2_##func args; \
+    if (__builtin_cpu_supports( "sse2" )) return sse2_##func args;
+#else
+#define SIMD_ROW(func, args)
+#endif
+
+static inline int blend_argb_row( DWORD *dst, const DWORD *src, int len )
+{
+    SIMD_ROW( blend_argb_row, (dst, src, len) )
+    return 0;
+}
+
+static inline int blend_argb_alpha_row( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    SIMD_ROW( blend_argb_alpha_row, (dst, src, len, alpha) )
+    return 0;
+}
+
+static inline int blend_constant_alpha_row( DWORD *dst, const DWORD *src, int len, DWORD alpha, DWORD src_alpha )
+{
+    SIMD_ROW( blend_constant_alpha_row, (dst, src, len, alpha, src_alpha) )
+    return 0;
+}
+
+static inline int convert_555_to_8888_row( DWORD *dst, const WORD *src, int len )
+{
+    SIMD_ROW( convert_555_to_8888_row, (dst, src, len) )
+    return 0;
+}
+
+static inline int convert_shifts_to_8888_row( DWORD *dst, const DWORD *src, int len,
+                                              int red_shift, int green_shift, int blue_shift )
+{
+    SIMD_ROW( convert_shifts_to_8888_row, (dst, src, len, red_shift, green_shift, blue_shift) )
+    return 0;
+}
+
+static inline int convert_8888_to_555_row( WORD *dst, const DWORD *src, int len )
+{
+    SIMD_ROW( convert_8888_to_555_row, (dst, src, len) )
+    return 0;
+}
+
+/* 24-bpp rows are done four pixels, i.e. three dwords, at a time */
+static inline int convert_24_to_8888_row( DWORD *dst, const BYTE *src, int len )
+{
+    DWORD in[3];
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4, src += 12)
+    {
+        memcpy( in, src, sizeof(in) );
+        dst[x]     = in[0] & 0xffffff;
+        dst[x + 1] = (in[0] >> 24) | (in[1] & 0xffff) << 8;
+        dst[x + 2] = (in[1] >> 16) | (in[2] & 0xff) << 16;
+        dst[x + 3] = in[2] >> 8;
+    }
+    return x;
+}
+
+static inline int convert_8888_to_24_row( BYTE *dst, const DWORD *src, int len )
+{
+    DWORD out[3];
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4, dst += 12)
+    {
+        out[0] = (src[x] & 0xffffff)            | src[x + 1] << 24;
+        out[1] = ((src[x + 1] >> 8) & 0xffff)   | src[x + 2] << 16;
+        out[2] = ((src[x + 2] >> 16) & 0xff)    | src[x + 3] << 8;
+        memcpy( dst, out, sizeof(out) );
+    }
+    return x;
+}
+
 static const BYTE pixel_masks_4[2] = {0xf0, 0x0f};
 static const BYTE pixel_masks_1[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
 static const BYTE edge_masks_1[8] = {0xff, 0x7f, 0x3f, 0x1f, 0x0f, 0x07, 0x03, 0x01};
@@ -2248,9 +2352,11 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_shifts_to_8888_row(dst_start, src_start, src_rect->right - src_rect->left,
+                                               src->red_shift, src->green_shift, src->blue_shift);
+                dst_pixel = dst_start + x;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = (((src_val >> src->red_shift)   & 0xff) << 16) |
@@ -2289,9 +2395,10 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
 
         for(y = src_rect->top; y < src_rect->bottom; y++)
         {
-            dst_pixel = dst_start;
-            src_pixel = src_start;
-            for(x = src_rect->left; x < src_rect->right; x++)
+            x = convert_24_to_8888_row(dst_start, src_start, src_rect->right - src_rect->left);
+            dst_pixel = dst_start + x;
+            src_pixel = src_start + x * 3;
+            for(x += src_rect->left; x < src_rect->right; x++)
             {
                 RGBQUAD rgb;
                 rgb.rgbBlue  = *src_pixel++;
@@ -2314,9 +2421,10 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_555_to_8888_row(dst_start, src_start, src_rect->right - src_rect->left);
+                dst_pixel = dst_start + x;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
@@ -2749,9 +2857,10 @@ static void convert_to_24(dib_info *dst, const dib_info *src, const RECT *src_re
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_8888_to_24_row(dst_start, src_start, src_rect->right - src_rect->left);
+                dst_pixel = dst_start + x * 3;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ =  src_val        & 0xff;
@@ -2994,9 +3103,10 @@ static void convert_to_555(dib_info *dst, const dib_info *src, const RECT *src_r
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
+                x = convert_8888_to_555_row(dst_start, src_start, src_rect->right - src_rect->left);
+                dst_pixel = dst_start + x;
+                src_pixel = src_start + x;
+                for(x += src_rect->left; x < src_rect->right; x++)
                 {
                     src_val = *src_pixel++;
                     *dst_pixel++ = ((src_val >> 9) & 0x7c00) |
@@ -4691,25 +4801,36 @@ static void blend_rects_8888(const dib_info *dst, int num, const RECT *rc,
     {
         DWORD *src_ptr = get_pixel_ptr_32( src, rc->left + offset->x, rc->top + offset->y );
         DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
+        int width = rc->right - rc->left;
 
+        /* the row helpers stop early on pixels they can't handle, so resume
+         * them after each scalar pixel */
         if (blend.AlphaFormat & AC_SRC_ALPHA)
         {
             if (blend.SourceConstantAlpha == 255)
                 for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+                    for (x = 0; x < width; x++)
+                    {
+                        x += blend_argb_row( dst_ptr + x, src_ptr + x, width - x );
+                        if (x < width) dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+                    }
             else
                 for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                    for (x = 0; x < rc->right - rc->left; x++)
-                        dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+                    for (x = 0; x < width; x++)
+                    {
+                        x += blend_argb_alpha_row( dst_ptr + x, src_ptr + x, width - x, blend.SourceConstantAlpha );
+                        if (x < width) dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+                    }
         }
         else if (src->compression == BI_RGB)
             for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
+                for (x = blend_constant_alpha_row( dst_ptr, src_ptr, width, blend.SourceConstantAlpha, 0 );
+                     x < width; x++)
                     dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
         else
             for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-                for (x = 0; x < rc->right - rc->left; x++)
+                for (x = blend_constant_alpha_row( dst_ptr, src_ptr, width, blend.SourceConstantAlpha, 0xff000000 );
+                     x < width; x++)
                     dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
     }
 }
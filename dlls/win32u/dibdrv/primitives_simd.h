@@ -0,0 +1,179 @@
+/*
+ * DIB driver vectorized primitives
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* This file is included by primitives.c once for each instruction set, with
+ * SIMD_NAME(), SIMD_TARGET and SIMD_SIZE defined. It only uses generic vector
+ * types, the compiler generates the instructions allowed by the target.
+ *
+ * Each row function returns the number of pixels it handled, the caller
+ * does the rest with the scalar code. The results are identical to the
+ * scalar code. */
+
+typedef BYTE      SIMD_NAME(v8)  __attribute__((vector_size(SIMD_SIZE)));
+typedef WORD      SIMD_NAME(v16) __attribute__((vector_size(SIMD_SIZE * 2)));
+typedef DWORD     SIMD_NAME(v32) __attribute__((vector_size(SIMD_SIZE)));
+typedef ULONGLONG SIMD_NAME(v64) __attribute__((vector_size(SIMD_SIZE)));
+typedef WORD      SIMD_NAME(h16) __attribute__((vector_size(SIMD_SIZE / 2)));
+
+#define SIMD_PIXELS (SIMD_SIZE / 4)
+
+static inline SIMD_TARGET SIMD_NAME(v32) SIMD_NAME(load)( const DWORD *ptr )
+{
+    SIMD_NAME(v32) v;
+    memcpy( &v, ptr, sizeof(v) );
+    return v;
+}
+
+static inline SIMD_TARGET void SIMD_NAME(store)( DWORD *ptr, SIMD_NAME(v32) v )
+{
+    memcpy( ptr, &v, sizeof(v) );
+}
+
+/* one 16-bit lane per channel, the wide vectors only live in registers */
+#define SIMD_WIDEN(v)   __builtin_convertvector( (SIMD_NAME(v8))(v), SIMD_NAME(v16) )
+#define SIMD_NARROW(v)  ((SIMD_NAME(v32))__builtin_convertvector( (v), SIMD_NAME(v8) ))
+
+/* (x + 127) / 255, exact for x < 65153 */
+#define SIMD_DIV255(x)  ((((x) + 128) + (((x) + 127) >> 8)) >> 8)
+
+/* alpha of each pixel in all four of its channels */
+static inline SIMD_TARGET SIMD_NAME(v32) SIMD_NAME(alpha)( SIMD_NAME(v32) v )
+{
+    return (v >> 24) * 0x01010101;
+}
+
+static inline SIMD_TARGET BOOL SIMD_NAME(is_zero)( SIMD_NAME(v32) v )
+{
+    SIMD_NAME(v64) q = (SIMD_NAME(v64))v;
+    ULONGLONG ret = 0;
+    int i;
+
+    for (i = 0; i < SIMD_SIZE / 8; i++) ret |= q[i];
+    return !ret;
+}
+
+/* The scalar code lets channels carry into each other if the source isn't
+ * properly premultiplied, so stop and let it handle those pixels. */
+static inline SIMD_TARGET BOOL SIMD_NAME(blend_premultiplied)( DWORD *dst, SIMD_NAME(v32) src,
+                                                               SIMD_NAME(v32) alpha )
+{
+    SIMD_NAME(v16) res = SIMD_WIDEN( SIMD_NAME(load)( dst )) * (255 - SIMD_WIDEN( alpha ));
+
+    res = SIMD_WIDEN( src ) + SIMD_DIV255( res );
+    if (!SIMD_NAME(is_zero)( SIMD_NARROW( res >> 8 ))) return FALSE;
+    SIMD_NAME(store)( dst, SIMD_NARROW( res ));
+    return TRUE;
+}
+
+static SIMD_TARGET int SIMD_NAME(blend_argb_row)( DWORD *dst, const DWORD *src, int len )
+{
+    SIMD_NAME(v32) s;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        s = SIMD_NAME(load)( src + x );
+        if (!SIMD_NAME(blend_premultiplied)( dst + x, s, SIMD_NAME(alpha)( s ))) break;
+    }
+    return x;
+}
+
+static SIMD_TARGET int SIMD_NAME(blend_argb_alpha_row)( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    const WORD const_alpha = alpha;
+    SIMD_NAME(v32) s;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        s = SIMD_NARROW( SIMD_DIV255( SIMD_WIDEN( SIMD_NAME(load)( src + x )) * const_alpha ));
+        if (!SIMD_NAME(blend_premultiplied)( dst + x, s, SIMD_NAME(alpha)( s ))) break;
+    }
+    return x;
+}
+
+/* blend_argb_constant_alpha, or blend_argb_no_src_alpha if src_alpha is 0xff000000 */
+static SIMD_TARGET int SIMD_NAME(blend_constant_alpha_row)( DWORD *dst, const DWORD *src, int len,
+                                                            DWORD alpha, DWORD src_alpha )
+{
+    const WORD const_alpha = alpha, inv_alpha = 255 - alpha;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        SIMD_NAME(v16) s = SIMD_WIDEN( SIMD_NAME(load)( src + x ) | src_alpha );
+        SIMD_NAME(v16) d = SIMD_WIDEN( SIMD_NAME(load)( dst + x ));
+
+        SIMD_NAME(store)( dst + x, SIMD_NARROW( SIMD_DIV255( s * const_alpha + d * inv_alpha )));
+    }
+    return x;
+}
+
+static SIMD_TARGET int SIMD_NAME(convert_555_to_8888_row)( DWORD *dst, const WORD *src, int len )
+{
+    SIMD_NAME(h16) h;
+    SIMD_NAME(v32) v;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        memcpy( &h, src + x, sizeof(h) );
+        v = __builtin_convertvector( h, SIMD_NAME(v32) );
+        SIMD_NAME(store)( dst + x, ((v << 9) & 0xf80000) | ((v << 4) & 0x070000) |
+                                   ((v << 6) & 0x00f800) | ((v << 1) & 0x000700) |
+                                   ((v << 3) & 0x0000f8) | ((v >> 2) & 0x000007) );
+    }
+    return x;
+}
+
+static SIMD_TARGET int SIMD_NAME(convert_shifts_to_8888_row)( DWORD *dst, const DWORD *src, int len,
+                                                              int red_shift, int green_shift, int blue_shift )
+{
+    SIMD_NAME(v32) v;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        v = SIMD_NAME(load)( src + x );
+        SIMD_NAME(store)( dst + x, ((v >> red_shift)   & 0xff) << 16 |
+                                   ((v >> green_shift) & 0xff) <<  8 |
+                                    ((v >> blue_shift) & 0xff) );
+    }
+    return x;
+}
+
+static SIMD_TARGET int SIMD_NAME(convert_8888_to_555_row)( WORD *dst, const DWORD *src, int len )
+{
+    SIMD_NAME(h16) h;
+    SIMD_NAME(v32) v;
+    int x;
+
+    for (x = 0; x + SIMD_PIXELS <= len; x += SIMD_PIXELS)
+    {
+        v = SIMD_NAME(load)( src + x );
+        h = __builtin_convertvector( ((v >> 9) & 0x7c00) | ((v >> 6) & 0x03e0) | ((v >> 3) & 0x001f),
+                                     SIMD_NAME(h16) );
+        memcpy( dst + x, &h, sizeof(h) );
+    }
+    return x;
+}
+
+#undef SIMD_PIXELS
+#undef SIMD_WIDEN
+#undef SIMD_NARROW
+#undef SIMD_DIV255
@@ -1008,7 +1008,7 @@ static inline void get_fontsig( FT_Face ft_face, FONTSIGNATURE *fs )
 }
 
 static FT_Face new_ft_face( const char *file, void *font_data_ptr, UINT font_data_size,
-                            FT_Long face_index, BOOL allow_bitmap )
+                            FT_Long face_index, BOOL allow_bitmap, BOOL *invalid )
 {
     FT_Error err;
     TT_OS2 *pOS2;
@@ -1028,6 +1028,8 @@ static FT_Face new_ft_face( const char *file, void *font_data_ptr, UINT font_dat
     if (err != 0)
     {
         WARN("Unable to load font %s/%p err = %x\n", debugstr_a(file), font_data_ptr, err);
+        /* failing to open or allocate doesn't mean that the file is bad */
+        *invalid = err != FT_Err_Cannot_Open_Resource && err != FT_Err_Out_Of_Memory;
         return NULL;
     }
 
@@ -1080,6 +1082,7 @@ static FT_Face new_ft_face( const char *file, void *font_data_ptr, UINT font_dat
     return ft_face;
 fail:
     pFT_Done_Face( ft_face );
+    *invalid = TRUE;
     return NULL;
 }
 
@@ -1174,8 +1177,9 @@ struct unix_face
     struct bitmap_font_size size;
 };
 
+/* invalid is set if the face can't be used, as opposed to a temporary failure */
 static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr, UINT data_size,
-                                           UINT face_index, UINT flags )
+                                           UINT face_index, UINT flags, BOOL *invalid )
 {
     static const WCHAR space_w[] = {' ',0};
 
@@ -1191,6 +1195,8 @@ static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr
     TRACE( "unix_name %s, face_index %u, data_ptr %p, data_size %u, flags %#x\n",
            unix_name, face_index, data_ptr, data_size, flags );
 
+    *invalid = FALSE;
+
     if (unix_name)
     {
         if ((fd = open( unix_name, O_RDONLY )) == -1) return NULL;
@@ -1252,7 +1258,8 @@ static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr
             WARN( "full name not found, using %s instead\n", debugstr_w(This->full_name) );
         }
     }
-    else if ((This->ft_face = new_ft_face( unix_name, data_ptr, data_size, face_index, flags & ADDFONT_ALLOW_BITMAP )))
+    else if ((This->ft_face = new_ft_face( unix_name, data_ptr, data_size, face_index,
+                                           flags & ADDFONT_ALLOW_BITMAP, invalid )))
     {
         TT_OS2 *os2;
 
@@ -1293,6 +1300,7 @@ static struct unix_face *unix_face_create( const char *unix_name, void *data_ptr
                 pFT_Done_Face( This->ft_face );
                 free( This );
                 This = NULL;
+                *invalid = TRUE;
                 goto done;
             }
             get_bitmap_size( This->ft_face, &This->size );
@@ -1320,16 +1328,466 @@ static void unix_face_destroy( struct unix_face *This )
     free( This );
 }
 
+/* face cache
+ *
+ * Parsing every font file on each process start is slow with large font
+ * collections, so the results are kept in a file in the prefix. Later
+ * processes map it and only need to stat() the font files to check that
+ * the entries are still valid. The file is never modified in place, it is
+ * replaced as a whole when some entries were missing or stale. */
+
+#define FACE_CACHE_MAGIC    0x43464657  /* "WFFC" */
+#define FACE_CACHE_VERSION  1
+
+struct face_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD lcid;        /* used to select the names */
+    DWORD ft_version;
+    DWORD count;
+    DWORD size;
+};
+
+#define FACE_CACHE_FAMILY_NAME  0x01
+#define FACE_CACHE_SECOND_NAME  0x02
+#define FACE_CACHE_STYLE_NAME   0x04
+#define FACE_CACHE_FULL_NAME    0x08
+#define FACE_CACHE_INVALID      0x80  /* the face couldn't be loaded */
+
+struct face_cache_entry
+{
+    DWORD                   size;  /* of the whole entry */
+    DWORD                   face_index;
+    DWORD                   flags;
+    DWORD                   names;
+    ULONGLONG               file_id;
+    ULONGLONG               file_size;
+    ULONGLONG               file_time;
+    DWORD                   scalable;
+    DWORD                   num_faces;
+    DWORD                   ntm_flags;
+    DWORD                   weight;
+    DWORD                   font_version;
+    FONTSIGNATURE           fs;
+    struct bitmap_font_size bitmap_size;
+    WCHAR                   data[1];  /* names, followed by the unix file name */
+};
+
+static const struct face_cache_header *face_cache;
+static SIZE_T face_cache_size;
+static UINT *face_cache_offsets;
+static UINT *face_cache_table;  /* entry numbers + 1, 0 if unused */
+static UINT face_cache_mask;
+static BYTE *face_cache_used;
+static UINT face_cache_used_count;
+static BOOL face_cache_stale;
+static BYTE *face_cache_new;    /* entries that weren't in the file */
+static UINT face_cache_new_count;
+static UINT face_cache_new_size;
+static UINT face_cache_new_capacity;
+static BOOL face_cache_loaded;
+static BOOL face_cache_saved;
+
+static char *get_unix_file_name( LPCWSTR path );
+
+static char *get_face_cache_file_name(void)
+{
+    WCHAR path[MAX_PATH];
+
+    asciiz_to_unicode( path, "\\??\\C:\\windows\\winefontcache.dat" );
+    return get_unix_file_name( path );
+}
+
+static UINT face_cache_hash( const char *unix_name, UINT face_index )
+{
+    UINT hash = face_index * 0x9e3779b1;
+
+    while (*unix_name) hash = (hash ^ (BYTE)*unix_name++) * 0x01000193;
+    return hash;
+}
+
+static const char *face_cache_entry_unix_name( const struct face_cache_entry *entry )
+{
+    const WCHAR *ptr = entry->data;
+    UINT i;
+
+    for (i = 0; i < 4; i++)
+        if (entry->names & (1 << i)) ptr += lstrlenW( ptr ) + 1;
+    return (const char *)ptr;
+}
+
+static void set_face_cache_file_info( struct face_cache_entry *entry, const struct stat *st )
+{
+    entry->file_id   = st->st_ino;
+    entry->file_size = st->st_size;
+    entry->file_time = (ULONGLONG)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    entry->file_time += st->st_mtim.tv_nsec;
+#endif
+}
+
+static BOOL check_face_cache_entry( const struct face_cache_entry *entry, UINT size )
+{
+    const WCHAR *ptr = entry->data;
+    const char *end;
+    UINT i;
+
+    if (size < sizeof(*entry) || entry->size < sizeof(*entry) || entry->size > size || entry->size % 8)
+        return FALSE;
+    end = (const char *)entry + entry->size;
+    for (i = 0; i < 4; i++)
+    {
+        if (!(entry->names & (1 << i))) continue;
+        while ((const char *)ptr < end && *ptr) ptr++;
+        if ((const char *)ptr++ >= end) return FALSE;
+    }
+    return memchr( ptr, 0, end - (const char *)ptr ) != NULL;
+}
+
+static inline const struct face_cache_entry *get_face_cache_entry( UINT i )
+{
+    return (const struct face_cache_entry *)((const char *)face_cache + face_cache_offsets[i]);
+}
+
+/* find the entry for the same face, or the free slot to insert it */
+static BOOL find_face_cache_slot( const struct face_cache_entry *key, UINT *slot )
+{
+    const char *unix_name = face_cache_entry_unix_name( key );
+    const struct face_cache_entry *entry;
+    UINT i;
+
+    *slot = face_cache_hash( unix_name, key->face_index ) & face_cache_mask;
+    for (; (i = face_cache_table[*slot]); *slot = (*slot + 1) & face_cache_mask)
+    {
+        entry = get_face_cache_entry( i - 1 );
+        if (entry->face_index == key->face_index && entry->flags == key->flags &&
+            !strcmp( face_cache_entry_unix_name( entry ), unix_name ))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void load_face_cache(void)
+{
+    const struct face_cache_header *header;
+    const struct face_cache_entry *entry;
+    struct stat st;
+    char *name;
+    UINT i, pos, slot;
+    int fd;
+
+    face_cache_loaded = TRUE;
+    if (!(name = get_face_cache_file_name())) return;
+    fd = open( name, O_RDONLY );
+    free( name );
+    if (fd == -1) return;
+
+    if (!fstat( fd, &st ) && st.st_size >= sizeof(*header) && st.st_size < 0x10000000)
+    {
+        header = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if (header != MAP_FAILED)
+        {
+            face_cache = header;
+            face_cache_size = st.st_size;
+        }
+    }
+    close( fd );
+    if (!face_cache) return;
+
+    header = face_cache;
+    if (header->magic != FACE_CACHE_MAGIC || header->version != FACE_CACHE_VERSION ||
+        header->lcid != system_lcid || header->ft_version != FT_SimpleVersion ||
+        header->size != face_cache_size || header->count > face_cache_size / sizeof(*entry))
+    {
+        TRACE( "ignoring outdated cache\n" );
+        munmap( (void *)face_cache, face_cache_size );
+        face_cache = NULL;
+        return;
+    }
+
+    for (face_cache_mask = 15; face_cache_mask < header->count * 2; face_cache_mask = face_cache_mask * 2 + 1)
+        ;
+    face_cache_table = calloc( face_cache_mask + 1, sizeof(*face_cache_table) );
+    face_cache_offsets = malloc( header->count * sizeof(*face_cache_offsets) );
+    face_cache_used = calloc( header->count, 1 );
+    if (!face_cache_table || !face_cache_offsets || !face_cache_used)
+    {
+        free( face_cache_table );
+        face_cache_table = NULL;
+        face_cache_stale = TRUE;
+        return;
+    }
+
+    for (i = 0, pos = sizeof(*header); i < header->count; i++, pos += entry->size)
+    {
+        entry = (const struct face_cache_entry *)((const char *)face_cache + pos);
+        if (!check_face_cache_entry( entry, face_cache_size - pos ))
+        {
+            WARN( "corrupted cache\n" );
+            free( face_cache_table );
+            face_cache_table = NULL;
+            face_cache_stale = TRUE;
+            return;
+        }
+        face_cache_offsets[i] = pos;
+        if (find_face_cache_slot( entry, &slot ))
+        {
+            face_cache_stale = TRUE;  /* duplicate, drop it */
+            continue;
+        }
+        face_cache_table[slot] = i + 1;
+    }
+    TRACE( "loaded %u entries\n", header->count );
+}
+
+static const struct face_cache_entry *find_face_cache_entry( const char *unix_name, UINT face_index,
+                                                             UINT flags, const struct stat *st, UINT *number )
+{
+    const struct face_cache_entry *entry;
+    struct face_cache_entry file_info;
+    UINT slot, i;
+
+    if (!face_cache_loaded) load_face_cache();
+    if (!face_cache_table) return NULL;
+
+    set_face_cache_file_info( &file_info, st );
+    slot = face_cache_hash( unix_name, face_index ) & face_cache_mask;
+    for (; (i = face_cache_table[slot]); slot = (slot + 1) & face_cache_mask)
+    {
+        entry = get_face_cache_entry( i - 1 );
+        if (entry->face_index != face_index || entry->flags != (flags & ADDFONT_ALLOW_BITMAP)) continue;
+        if (strcmp( face_cache_entry_unix_name( entry ), unix_name )) continue;
+        if (entry->file_id != file_info.file_id || entry->file_size != file_info.file_size ||
+            entry->file_time != file_info.file_time)
+            return NULL;
+        *number = i - 1;
+        return entry;
+    }
+    return NULL;
+}
+
+static WCHAR *get_face_cache_name( const struct face_cache_entry *entry, UINT name, const WCHAR **ptr )
+{
+    const WCHAR *str = *ptr;
+
+    if (!(entry->names & name)) return NULL;
+    *ptr += lstrlenW( str ) + 1;
+    return wcsdup( str );
+}
+
+/***********************************************************************
+ *           load_cached_unix_face
+ *
+ * Returns TRUE if the cache knows about the face, face is set to NULL if
+ * it couldn't be loaded.
+ */
+static BOOL load_cached_unix_face( const char *unix_name, UINT face_index, UINT flags,
+                                   const struct stat *st, struct unix_face **face )
+{
+    const struct face_cache_entry *entry;
+    struct unix_face *This;
+    const WCHAR *ptr;
+    UINT number;
+
+    if (!(entry = find_face_cache_entry( unix_name, face_index, flags, st, &number ))) return FALSE;
+    if (!face_cache_used[number])
+    {
+        face_cache_used[number] = 1;
+        face_cache_used_count++;
+    }
+
+    *face = NULL;
+    if (entry->names & FACE_CACHE_INVALID) return TRUE;
+    if (!(This = calloc( 1, sizeof(*This) ))) return FALSE;
+
+    ptr = entry->data;
+    This->family_name  = get_face_cache_name( entry, FACE_CACHE_FAMILY_NAME, &ptr );
+    This->second_name  = get_face_cache_name( entry, FACE_CACHE_SECOND_NAME, &ptr );
+    This->style_name   = get_face_cache_name( entry, FACE_CACHE_STYLE_NAME, &ptr );
+    This->full_name    = get_face_cache_name( entry, FACE_CACHE_FULL_NAME, &ptr );
+    This->scalable     = entry->scalable;
+    This->num_faces    = entry->num_faces;
+    This->ntm_flags    = entry->ntm_flags;
+    This->weight       = entry->weight;
+    This->font_version = entry->font_version;
+    This->fs           = entry->fs;
+    This->size         = entry->bitmap_size;
+    *face = This;
+    return TRUE;
+}
+
+static void add_face_cache_entry( const char *unix_name, UINT face_index, UINT flags,
+                                  const struct stat *st, const struct unix_face *face )
+{
+    const WCHAR *names[4] = { NULL };
+    struct face_cache_entry *entry;
+    UINT i, len, size = FIELD_OFFSET( struct face_cache_entry, data );
+    WCHAR *ptr;
+
+    if (face_cache_saved) return;
+
+    if (face)
+    {
+        names[0] = face->family_name;
+        names[1] = face->second_name;
+        names[2] = face->style_name;
+        names[3] = face->full_name;
+    }
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+        if (names[i]) size += (lstrlenW( names[i] ) + 1) * sizeof(WCHAR);
+    size = (size + strlen( unix_name ) + 1 + 7) & ~7;
+
+    if (face_cache_new_size + size > face_cache_new_capacity)
+    {
+        UINT capacity = max( face_cache_new_capacity * 2, face_cache_new_size + size );
+        BYTE *new;
+
+        if (!(new = realloc( face_cache_new, max( capacity, 0x10000 )))) return;
+        face_cache_new = new;
+        face_cache_new_capacity = max( capacity, 0x10000 );
+    }
+
+    entry = (struct face_cache_entry *)(face_cache_new + face_cache_new_size);
+    memset( entry, 0, size );
+    entry->size       = size;
+    entry->face_index = face_index;
+    entry->flags      = flags & ADDFONT_ALLOW_BITMAP;
+    set_face_cache_file_info( entry, st );
+    if (face)
+    {
+        entry->scalable     = face->scalable;
+        entry->num_faces    = face->num_faces;
+        entry->ntm_flags    = face->ntm_flags;
+        entry->weight       = face->weight;
+        entry->font_version = face->font_version;
+        entry->fs           = face->fs;
+        entry->bitmap_size  = face->size;
+    }
+    else entry->names = FACE_CACHE_INVALID;
+
+    for (i = 0, ptr = entry->data; i < ARRAY_SIZE(names); i++)
+    {
+        if (!names[i]) continue;
+        entry->names |= 1 << i;
+        len = lstrlenW( names[i] ) + 1;
+        memcpy( ptr, names[i], len * sizeof(WCHAR) );
+        ptr += len;
+    }
+    strcpy( (char *)ptr, unix_name );
+
+    face_cache_new_size += size;
+    face_cache_new_count++;
+}
+
+static BOOL write_face_cache_data( int fd, const void *data, SIZE_T size )
+{
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write( fd, data, size )) <= 0) return FALSE;
+        data = (const char *)data + ret;
+        size -= ret;
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *           save_face_cache
+ *
+ * Write the faces that were loaded to the cache file if it was out of
+ * date. Faces that are added later aren't recorded anymore.
+ */
+static void save_face_cache(void)
+{
+    const struct face_cache_entry *entry;
+    struct face_cache_header header;
+    UINT i, j, count = face_cache_table ? face_cache->count : 0;
+    char *name, *tmp_name;
+    BOOL ret;
+    int fd;
+
+    if (face_cache_saved) return;
+    face_cache_saved = TRUE;
+
+    if (face_cache_table && !face_cache_stale && !face_cache_new_count && face_cache_used_count == count)
+        goto done;
+
+    header.magic      = FACE_CACHE_MAGIC;
+    header.version    = FACE_CACHE_VERSION;
+    header.lcid       = system_lcid;
+    header.ft_version = FT_SimpleVersion;
+    header.count      = face_cache_used_count + face_cache_new_count;
+    header.size       = sizeof(header) + face_cache_new_size;
+    for (i = 0; i < count; i++)
+        if (face_cache_used[i]) header.size += get_face_cache_entry( i )->size;
+
+    if (!(name = get_face_cache_file_name())) goto done;
+    if (!(tmp_name = malloc( strlen( name ) + 16 )))
+    {
+        free( name );
+        goto done;
+    }
+    sprintf( tmp_name, "%s.%d", name, (int)getpid() );
+
+    if ((fd = open( tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) != -1)
+    {
+        ret = write_face_cache_data( fd, &header, sizeof(header) );
+        /* copy the runs of entries that are still used */
+        for (i = 0; ret && i < count; i = j)
+        {
+            for (j = i; j < count && face_cache_used[j]; j++) ;
+            if (j > i)
+            {
+                entry = get_face_cache_entry( j - 1 );
+                ret = write_face_cache_data( fd, get_face_cache_entry( i ),
+                                             face_cache_offsets[j - 1] + entry->size - face_cache_offsets[i] );
+            }
+            else j++;
+        }
+        if (ret) ret = write_face_cache_data( fd, face_cache_new, face_cache_new_size );
+        close( fd );
+
+        if (ret && !rename( tmp_name, name ))
+            TRACE( "saved %u faces to %s\n", header.count, debugstr_a(name) );
+        else
+        {
+            WARN( "failed to save %s\n", debugstr_a(name) );
+            unlink( tmp_name );
+        }
+    }
+    free( tmp_name );
+    free( name );
+
+done:
+    free( face_cache_new );
+    face_cache_new = NULL;
+    face_cache_new_count = face_cache_new_size = face_cache_new_capacity = 0;
+}
+
 static int add_unix_face( const char *unix_name, const WCHAR *file, void *data_ptr, SIZE_T data_size,
                           DWORD face_index, DWORD flags, DWORD *num_faces )
 {
     struct unix_face *unix_face;
+    struct stat st;
+    BOOL invalid;
     int ret;
 
     if (num_faces) *num_faces = 0;
 
-    if (!(unix_face = unix_face_create( unix_name, data_ptr, data_size, face_index, flags )))
-        return 0;
+    if (unix_name && !stat( unix_name, &st ))
+    {
+        if (!load_cached_unix_face( unix_name, face_index, flags, &st, &unix_face ))
+        {
+            unix_face = unix_face_create( unix_name, data_ptr, data_size, face_index, flags, &invalid );
+            /* don't remember temporary failures */
+            if (unix_face || invalid) add_face_cache_entry( unix_name, face_index, flags, &st, unix_face );
+        }
+    }
+    else unix_face = unix_face_create( unix_name, data_ptr, data_size, face_index, flags, &invalid );
+
+    if (!unix_face) return 0;
 
     if (unix_face->family_name[0] == '.') /* Ignore fonts with names beginning with a dot */
     {
@@ -1918,6 +2376,7 @@ static void freetype_load_fonts(void)
 #elif defined(__ANDROID__)
     ReadFontDir("/system/fonts", TRUE);
 #endif
+    save_face_cache();
 }
 
 /* Some fonts have large usWinDescent values, as a result of storing signed short
@@ -1674,6 +1674,52 @@ NTSTATUS WINAPI wow64_NtWaitForSingleObject( UINT *args )
 }
 
 
+/**********************************************************************
+ *           wow64___wine_futex_wait
+ */
+NTSTATUS WINAPI wow64___wine_futex_wait( UINT *args )
+{
+    const LONG *addr = get_ptr( &args );
+    LONG cmp = get_ulong( &args );
+    ULONG mask = get_ulong( &args );
+    const LARGE_INTEGER *timeout = get_ptr( &args );
+
+    return __wine_futex_wait( addr, cmp, mask, timeout );
+}
+
+
+/**********************************************************************
+ *           wow64___wine_futex_wake
+ */
+NTSTATUS WINAPI wow64___wine_futex_wake( UINT *args )
+{
+    const LONG *addr = get_ptr( &args );
+    ULONG count = get_ulong( &args );
+    ULONG mask = get_ulong( &args );
+    ULONG *woken = get_ptr( &args );
+
+    return __wine_futex_wake( addr, count, mask, woken );
+}
+
+
+/**********************************************************************
+ *           wow64___wine_wait_for_any_object
+ */
+NTSTATUS WINAPI wow64___wine_wait_for_any_object( UINT *args )
+{
+    ULONG count = get_ulong( &args );
+    LONG *handles_ptr = get_ptr( &args );
+    BOOLEAN alertable = get_ulong( &args );
+    const LARGE_INTEGER *timeout = get_ptr( &args );
+
+    HANDLE handles[WINE_MAXIMUM_WAIT_ANY_OBJECTS];
+    ULONG i;
+
+    for (i = 0; i < count && i < WINE_MAXIMUM_WAIT_ANY_OBJECTS; i++) handles[i] = LongToHandle( handles_ptr[i] );
+    return __wine_wait_for_any_object( count, handles, alertable, timeout );
+}
+
+
 /**********************************************************************
  *           wow64_NtYieldExecution
  */
@@ -954,6 +954,30 @@ struct input_shared_memory
 typedef volatile struct input_shared_memory input_shm_t;
 
 
+struct registry_cache_value
+{
+    unsigned int         type;
+    data_size_t          namelen;
+    data_size_t          len;
+
+
+
+};
+
+#define REGISTRY_CACHE_SLOTS     256
+#define REGISTRY_CACHE_DATA_SIZE (4096 - 4 * sizeof(unsigned int))
+
+struct registry_cache_slot
+{
+    unsigned int         seq;
+    unsigned int         serial;
+    unsigned int         count;
+    data_size_t          size;
+    char                 data[REGISTRY_CACHE_DATA_SIZE];
+};
+typedef volatile struct registry_cache_slot registry_cache_slot_t;
+
+
 
 
 
@@ -2542,6 +2566,8 @@ struct get_key_value_reply
     struct reply_header __header;
     int          type;
     data_size_t  total;
+    int          cache_slot;
+    unsigned int cache_serial;
     /* VARARG(data,bytes); */
 };
 
@@ -6050,6 +6076,21 @@ struct fsync_free_shm_idx_reply
 };
 
 
+struct batch_requests_request
+{
+    struct request_header __header;
+    /* VARARG(requests,bytes); */
+    char __pad_12[4];
+};
+struct batch_requests_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    /* VARARG(replies,bytes); */
+    char __pad_12[4];
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -6352,6 +6393,7 @@ enum request
     REQ_fsync_msgwait,
     REQ_get_fsync_apc_idx,
     REQ_fsync_free_shm_idx,
+    REQ_batch_requests,
     REQ_NB_REQUESTS
 };
 
@@ -6659,6 +6701,7 @@ union generic_request
     struct fsync_msgwait_request fsync_msgwait_request;
     struct get_fsync_apc_idx_request get_fsync_apc_idx_request;
     struct fsync_free_shm_idx_request fsync_free_shm_idx_request;
+    struct batch_requests_request batch_requests_request;
 };
 union generic_reply
 {
@@ -6964,11 +7007,12 @@ union generic_reply
     struct fsync_msgwait_reply fsync_msgwait_reply;
     struct get_fsync_apc_idx_reply get_fsync_apc_idx_reply;
     struct fsync_free_shm_idx_reply fsync_free_shm_idx_reply;
+    struct batch_requests_reply batch_requests_reply;
 };
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 787
+#define SERVER_PROTOCOL_VERSION 789
 
 /* ### protocol_version end ### */
 
@@ -0,0 +1,278 @@
+/*
+ * Vectorized string and memory scanning helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_SIMDSTR_H
+#define __WINE_WINE_SIMDSTR_H
+
+/* The string functions scan aligned blocks, which may extend before the
+ * start and after the end of the string, but never cross a page boundary
+ * that the string itself doesn't cross. Callers are expected to check at
+ * runtime that the instruction set is available. */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+#define WINE_SIMD_STRINGS
+
+typedef char __wine_v16qi __attribute__((vector_size(16), may_alias));
+typedef char __wine_v16qi_u __attribute__((vector_size(16), may_alias, aligned(1)));
+typedef short __wine_v8hi __attribute__((vector_size(16), may_alias));
+typedef char __wine_v32qi __attribute__((vector_size(32), may_alias));
+typedef char __wine_v32qi_u __attribute__((vector_size(32), may_alias, aligned(1)));
+typedef short __wine_v16hi __attribute__((vector_size(32), may_alias));
+
+#define __WINE_SPLAT16(x) { x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x }
+#define __WINE_SPLAT32(x) { x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, \
+                            x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x }
+
+#define __WINE_MASK16(v) ((unsigned int)__builtin_ia32_pmovmskb128( (__wine_v16qi)(v) ))
+#define __WINE_MASK32(v) ((unsigned int)__builtin_ia32_pmovmskb256( (__wine_v32qi)(v) ))
+
+static inline BOOL __wine_cpu_has_avx2(void)
+{
+    unsigned int eax, ebx, ecx, edx, xcr0;
+
+    __asm__( "cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0) );
+    if (eax < 7) return FALSE;
+    __asm__( "cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0) );
+    if ((ecx & 0x18000000) != 0x18000000) return FALSE;  /* OSXSAVE and AVX */
+    __asm__( ".byte 0x0f,0x01,0xd0" : "=a"(xcr0), "=d"(edx) : "c"(0) );  /* xgetbv */
+    if ((xcr0 & 6) != 6) return FALSE;  /* XMM and YMM state enabled */
+    __asm__( "cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0) );
+    return (ebx >> 5) & 1;
+}
+
+/* byte functions */
+
+static inline __attribute__((target("sse2"))) const char *__wine_sse2_memchr( const char *str, char c, size_t len )
+{
+    const __wine_v16qi vc = __WINE_SPLAT16( c );
+    const char *ptr = (const char *)((ULONG_PTR)str & ~15);
+    unsigned int mask;
+    size_t avail = 16 - (str - ptr);
+
+    if (!len) return NULL;
+    mask = __WINE_MASK16( *(const __wine_v16qi *)ptr == vc ) >> (str - ptr);
+
+    for (;;)
+    {
+        if (mask) return __builtin_ctz( mask ) < len ? str + __builtin_ctz( mask ) : NULL;
+        if (len <= avail) return NULL;
+        len -= avail;
+        str += avail;
+        ptr += 16;
+        avail = 16;
+        mask = __WINE_MASK16( *(const __wine_v16qi *)ptr == vc );
+    }
+}
+
+static inline __attribute__((target("sse2"))) size_t __wine_sse2_strlen( const char *str )
+{
+    const __wine_v16qi zero = { 0 };
+    const char *ptr = (const char *)((ULONG_PTR)str & ~15);
+    unsigned int mask = __WINE_MASK16( *(const __wine_v16qi *)ptr == zero ) >> (str - ptr);
+
+    if (mask) return __builtin_ctz( mask );
+    for (;;)
+    {
+        ptr += 16;
+        if ((mask = __WINE_MASK16( *(const __wine_v16qi *)ptr == zero )))
+            return ptr + __builtin_ctz( mask ) - str;
+    }
+}
+
+static inline __attribute__((target("sse2"))) size_t __wine_sse2_strnlen( const char *str, size_t len )
+{
+    const char *end = __wine_sse2_memchr( str, 0, len );
+    return end ? end - str : len;
+}
+
+static inline __attribute__((target("sse2"))) const char *__wine_sse2_strchr( const char *str, char c )
+{
+    const __wine_v16qi vc = __WINE_SPLAT16( c ), zero = { 0 };
+    const char *ptr = (const char *)((ULONG_PTR)str & ~15);
+    __wine_v16qi block = *(const __wine_v16qi *)ptr;
+    unsigned int mask = __WINE_MASK16( (block == vc) | (block == zero) ) >> (str - ptr);
+
+    if (!mask)
+    {
+        do
+        {
+            ptr += 16;
+            block = *(const __wine_v16qi *)ptr;
+        } while (!(mask = __WINE_MASK16( (block == vc) | (block == zero) )));
+        str = ptr;
+    }
+    str += __builtin_ctz( mask );
+    return *str == c ? str : NULL;
+}
+
+static inline __attribute__((target("sse2"))) int __wine_sse2_memcmp( const unsigned char *p1, const unsigned char *p2,
+                                                                     size_t len )
+{
+    unsigned int mask;
+
+    for (; len >= 16; len -= 16, p1 += 16, p2 += 16)
+    {
+        mask = __WINE_MASK16( *(const __wine_v16qi_u *)p1 == *(const __wine_v16qi_u *)p2 ) ^ 0xffff;
+        if (mask)
+        {
+            mask = __builtin_ctz( mask );
+            return p1[mask] > p2[mask] ? 1 : -1;
+        }
+    }
+    for (; len; len--, p1++, p2++) if (*p1 != *p2) return *p1 > *p2 ? 1 : -1;
+    return 0;
+}
+
+static inline __attribute__((target("avx2"))) const char *__wine_avx2_memchr( const char *str, char c, size_t len )
+{
+    const __wine_v32qi vc = __WINE_SPLAT32( c );
+    const char *ptr = (const char *)((ULONG_PTR)str & ~31);
+    unsigned int mask;
+    size_t avail = 32 - (str - ptr);
+
+    if (!len) return NULL;
+    mask = __WINE_MASK32( *(const __wine_v32qi *)ptr == vc ) >> (str - ptr);
+
+    for (;;)
+    {
+        if (mask) return __builtin_ctz( mask ) < len ? str + __builtin_ctz( mask ) : NULL;
+        if (len <= avail) return NULL;
+        len -= avail;
+        str += avail;
+        ptr += 32;
+        avail = 32;
+        mask = __WINE_MASK32( *(const __wine_v32qi *)ptr == vc );
+    }
+}
+
+static inline __attribute__((target("avx2"))) size_t __wine_avx2_strlen( const char *str )
+{
+    const __wine_v32qi zero = { 0 };
+    const char *ptr = (const char *)((ULONG_PTR)str & ~31);
+    unsigned int mask = __WINE_MASK32( *(const __wine_v32qi *)ptr == zero ) >> (str - ptr);
+
+    if (mask) return __builtin_ctz( mask );
+    for (;;)
+    {
+        ptr += 32;
+        if ((mask = __WINE_MASK32( *(const __wine_v32qi *)ptr == zero )))
+            return ptr + __builtin_ctz( mask ) - str;
+    }
+}
+
+static inline __attribute__((target("avx2"))) int __wine_avx2_memcmp( const unsigned char *p1, const unsigned char *p2,
+                                                                     size_t len )
+{
+    unsigned int mask;
+
+    for (; len >= 32; len -= 32, p1 += 32, p2 += 32)
+    {
+        mask = ~__WINE_MASK32( *(const __wine_v32qi_u *)p1 == *(const __wine_v32qi_u *)p2 );
+        if (mask)
+        {
+            mask = __builtin_ctz( mask );
+            return p1[mask] > p2[mask] ? 1 : -1;
+        }
+    }
+    return __wine_sse2_memcmp( p1, p2, len );
+}
+
+/* wide char functions, the string must be aligned on a WCHAR boundary */
+
+static inline __attribute__((target("sse2"))) const WCHAR *__wine_sse2_wmemchr( const WCHAR *str, WCHAR c, size_t len )
+{
+    const __wine_v8hi vc = { c, c, c, c, c, c, c, c };
+    const WCHAR *ptr = (const WCHAR *)((ULONG_PTR)str & ~15);
+    unsigned int mask;
+    size_t avail = 8 - (str - ptr);
+
+    if (!len) return NULL;
+    mask = __WINE_MASK16( *(const __wine_v8hi *)ptr == vc ) >> ((str - ptr) * 2);
+
+    for (;;)
+    {
+        if (mask) return __builtin_ctz( mask ) / 2 < len ? str + __builtin_ctz( mask ) / 2 : NULL;
+        if (len <= avail) return NULL;
+        len -= avail;
+        str += avail;
+        ptr += 8;
+        avail = 8;
+        mask = __WINE_MASK16( *(const __wine_v8hi *)ptr == vc );
+    }
+}
+
+static inline __attribute__((target("sse2"))) size_t __wine_sse2_wcslen( const WCHAR *str )
+{
+    const __wine_v8hi zero = { 0 };
+    const WCHAR *ptr = (const WCHAR *)((ULONG_PTR)str & ~15);
+    unsigned int mask = __WINE_MASK16( *(const __wine_v8hi *)ptr == zero ) >> ((str - ptr) * 2);
+
+    if (mask) return __builtin_ctz( mask ) / 2;
+    for (;;)
+    {
+        ptr += 8;
+        if ((mask = __WINE_MASK16( *(const __wine_v8hi *)ptr == zero )))
+            return ptr + __builtin_ctz( mask ) / 2 - str;
+    }
+}
+
+static inline __attribute__((target("sse2"))) size_t __wine_sse2_wcsnlen( const WCHAR *str, size_t len )
+{
+    const WCHAR *end = __wine_sse2_wmemchr( str, 0, len );
+    return end ? end - str : len;
+}
+
+static inline __attribute__((target("sse2"))) const WCHAR *__wine_sse2_wcschr( const WCHAR *str, WCHAR c )
+{
+    const __wine_v8hi vc = { c, c, c, c, c, c, c, c }, zero = { 0 };
+    const WCHAR *ptr = (const WCHAR *)((ULONG_PTR)str & ~15);
+    __wine_v8hi block = *(const __wine_v8hi *)ptr;
+    unsigned int mask = __WINE_MASK16( (block == vc) | (block == zero) ) >> ((str - ptr) * 2);
+
+    if (!mask)
+    {
+        do
+        {
+            ptr += 8;
+            block = *(const __wine_v8hi *)ptr;
+        } while (!(mask = __WINE_MASK16( (block == vc) | (block == zero) )));
+        str = ptr;
+    }
+    str += __builtin_ctz( mask ) / 2;
+    return *str == c ? str : NULL;
+}
+
+static inline __attribute__((target("avx2"))) size_t __wine_avx2_wcslen( const WCHAR *str )
+{
+    const __wine_v16hi zero = { 0 };
+    const WCHAR *ptr = (const WCHAR *)((ULONG_PTR)str & ~31);
+    unsigned int mask = __WINE_MASK32( *(const __wine_v16hi *)ptr == zero ) >> ((str - ptr) * 2);
+
+    if (mask) return __builtin_ctz( mask ) / 2;
+    for (;;)
+    {
+        ptr += 16;
+        if ((mask = __WINE_MASK32( *(const __wine_v16hi *)ptr == zero )))
+            return ptr + __builtin_ctz( mask ) / 2 - str;
+    }
+}
+
+#endif  /* __GNUC__ && (__i386__ || __x86_64__) */
+
+#endif  /* __WINE_WINE_SIMDSTR_H */
@@ -1078,6 +1078,10 @@ NTSYSAPI WORD         WINAPI RtlQueryDepthSList(PSLIST_HEADER);
 
 typedef enum _HEAP_INFORMATION_CLASS {
     HeapCompatibilityInformation,
+#ifdef __WINESRC__
+    HeapWineStatistics = 1000,
+    HeapWineAllocationSites,
+#endif
 } HEAP_INFORMATION_CLASS;
 
 /* Processor feature flags.  */
@@ -2618,6 +2618,54 @@ typedef struct _RTL_HEAP_DEFINITION {
     ULONG Unknown[11];
 } RTL_HEAP_DEFINITION, *PRTL_HEAP_DEFINITION;
 
+#ifdef __WINESRC__
+
+/* HeapWineStatistics */
+typedef struct _HEAP_WINE_BIN_STATISTICS
+{
+    SIZE_T    BlockSize;        /* largest block size in the bin, ~0 for large blocks */
+    ULONGLONG Allocations;
+    ULONGLONG Frees;
+    SIZE_T    LiveBlocks;
+    SIZE_T    LiveBytes;
+    BOOLEAN   LowFragmentation; /* LFH enabled for the bin */
+} HEAP_WINE_BIN_STATISTICS, *PHEAP_WINE_BIN_STATISTICS;
+
+typedef struct _HEAP_WINE_STATISTICS
+{
+    BOOLEAN   Instrumented;     /* per-bin counters are only maintained with WINE_HEAP_STATS */
+    ULONG     SubheapCount;
+    SIZE_T    ReservedSize;
+    SIZE_T    CommittedSize;
+    SIZE_T    FreeSize;         /* free space in the subheaps, LFH groups are counted as used */
+    SIZE_T    FreeBlocks;
+    SIZE_T    LargestFreeBlock;
+    SIZE_T    LargeBlocks;
+    SIZE_T    LargeSize;
+    ULONG     BinCount;
+    HEAP_WINE_BIN_STATISTICS Bins[ANYSIZE_ARRAY];
+} HEAP_WINE_STATISTICS, *PHEAP_WINE_STATISTICS;
+
+/* HeapWineAllocationSites */
+#define HEAP_WINE_SITE_FRAMES 8
+
+typedef struct _HEAP_WINE_ALLOCATION_SITE
+{
+    ULONGLONG Samples;
+    ULONGLONG Bytes;
+    PVOID     Frames[HEAP_WINE_SITE_FRAMES];
+} HEAP_WINE_ALLOCATION_SITE, *PHEAP_WINE_ALLOCATION_SITE;
+
+typedef struct _HEAP_WINE_ALLOCATION_SITES
+{
+    ULONG     SampleRate;       /* one allocation out of SampleRate in each bin is sampled */
+    ULONG     Count;
+    ULONGLONG Dropped;          /* samples dropped because the site table was full */
+    HEAP_WINE_ALLOCATION_SITE Sites[ANYSIZE_ARRAY];
+} HEAP_WINE_ALLOCATION_SITES, *PHEAP_WINE_ALLOCATION_SITES;
+
+#endif /* __WINESRC__ */
+
 typedef struct _RTL_RWLOCK {
     RTL_CRITICAL_SECTION rtlCS;
 
@@ -5142,7 +5190,13 @@ NTSYSAPI NTSTATUS  WINAPI RtlLargeIntegerToChar(const ULONGLONG *,ULONG,ULONG,PC
 
 /* Wine internal functions */
 
+#define WINE_MAXIMUM_WAIT_ANY_OBJECTS 127  /* futex_waitv limit, including the APC futex */
+
+NTSYSAPI NTSTATUS WINAPI __wine_futex_wait( const LONG *addr, LONG cmp, ULONG mask, const LARGE_INTEGER *timeout );
+NTSYSAPI NTSTATUS WINAPI __wine_futex_wake( const LONG *addr, ULONG count, ULONG mask, ULONG *woken );
 NTSYSAPI NTSTATUS WINAPI __wine_set_unix_env( const char *var, const char *val );
+NTSYSAPI NTSTATUS WINAPI __wine_wait_for_any_object( ULONG count, const HANDLE *handles, BOOLEAN alertable,
+                                                     const LARGE_INTEGER *timeout );
 NTSYSAPI NTSTATUS WINAPI wine_nt_to_unix_file_name( const OBJECT_ATTRIBUTES *attr, char *nameA, ULONG *size,
                                                     UINT disposition );
 NTSYSAPI NTSTATUS WINAPI wine_unix_to_nt_file_name( const char *name, WCHAR *buffer, ULONG *size );
@@ -35,6 +35,9 @@
 #ifdef HAVE_LINUX_MAJOR_H
 #include <linux/major.h>
 #endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 #ifdef HAVE_SYS_STATVFS_H
 #include <sys/statvfs.h>
 #endif
@@ -113,6 +116,12 @@
 # define USE_EVENT_PORTS
 #endif /* HAVE_PORT_H && HAVE_PORT_CREATE */
 
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(IORING_FEAT_CQE_SKIP)
+# include <sys/mman.h>
+# include <sys/uio.h>
+# define USE_IO_URING
+#endif /* HAVE_LINUX_IO_URING_H */
+
 /* Because of the stupid Posix locking semantics, we need to keep
  * track of all file descriptors referencing a given file, and not
  * close a single one until all the locks are gone (sigh).
@@ -340,14 +349,23 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired list */
+    int                   index;      /* index in timeout heap, -1 once expired */
     abstime_t             when;       /* timeout expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+/* binary min-heap of timeouts, ordered by expiry time */
+struct timeout_heap
+{
+    struct timeout_user **users;      /* heap array */
+    int                   count;      /* number of timeouts in the heap */
+    int                   size;       /* allocated size of the array */
+};
+
+static struct timeout_heap abs_timeouts;  /* absolute timeouts, when > 0 */
+static struct timeout_heap rel_timeouts;  /* relative timeouts, -when is the monotonic expiry */
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -424,43 +442,110 @@ void set_current_time(void)
     if (user_shared_data) set_user_shared_data_time();
 }
 
+/* expiry of a timeout, in the time base of its heap */
+static inline abstime_t timeout_expiry( const struct timeout_user *user )
+{
+    return user->when > 0 ? user->when : -user->when;
+}
+
+static inline struct timeout_heap *get_timeout_heap( const struct timeout_user *user )
+{
+    return user->when > 0 ? &abs_timeouts : &rel_timeouts;
+}
+
+static inline void set_heap_entry( struct timeout_heap *heap, int index, struct timeout_user *user )
+{
+    heap->users[index] = user;
+    user->index = index;
+}
+
+/* move a timeout up the heap until its parent expires before it */
+static void timeout_heap_up( struct timeout_heap *heap, int index, struct timeout_user *user )
+{
+    abstime_t expiry = timeout_expiry( user );
+
+    while (index)
+    {
+        int parent = (index - 1) / 2;
+        if (timeout_expiry( heap->users[parent] ) <= expiry) break;
+        set_heap_entry( heap, index, heap->users[parent] );
+        index = parent;
+    }
+    set_heap_entry( heap, index, user );
+}
+
+/* move a timeout down the heap until its children expire after it */
+static void timeout_heap_down( struct timeout_heap *heap, int index, struct timeout_user *user )
+{
+    abstime_t expiry = timeout_expiry( user );
+    int child;
+
+    while ((child = 2 * index + 1) < heap->count)
+    {
+        if (child + 1 < heap->count &&
+            timeout_expiry( heap->users[child + 1] ) < timeout_expiry( heap->users[child] ))
+            child++;
+        if (expiry <= timeout_expiry( heap->users[child] )) break;
+        set_heap_entry( heap, index, heap->users[child] );
+        index = child;
+    }
+    set_heap_entry( heap, index, user );
+}
+
+static void timeout_heap_remove( struct timeout_heap *heap, struct timeout_user *user )
+{
+    struct timeout_user *last = heap->users[--heap->count];
+    int index = user->index;
+
+    user->index = -1;
+    if (last == user) return;
+    if (index && timeout_expiry( heap->users[(index - 1) / 2] ) > timeout_expiry( last ))
+        timeout_heap_up( heap, index, last );
+    else
+        timeout_heap_down( heap, index, last );
+}
+
+/* return the timeout of a heap expiring first */
+static inline struct timeout_user *timeout_heap_head( const struct timeout_heap *heap )
+{
+    return heap->count ? heap->users[0] : NULL;
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
+    struct timeout_heap *heap;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
+    heap = get_timeout_heap( user );
+    if (heap->count == heap->size)
     {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
-    {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
+        int new_size = max( 64, heap->size * 2 );
+        struct timeout_user **new_users = realloc( heap->users, new_size * sizeof(*new_users) );
+
+        if (!new_users)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
+            free( user );
+            set_error( STATUS_NO_MEMORY );
+            return NULL;
         }
+        heap->users = new_users;
+        heap->size  = new_size;
     }
-    list_add_before( ptr, &user->entry );
+    timeout_heap_up( heap, heap->count++, user );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index != -1) timeout_heap_remove( get_timeout_heap( user ), user );
+    else list_remove( &user->entry );  /* expired but callback not called yet */
     free( user );
 }
 
@@ -834,6 +919,494 @@ static inline void main_loop_epoll(void) { }
 
 #endif /* USE_EPOLL */
 
+#ifdef USE_IO_URING
+
+/* The io_uring main loop submits poll requests, reads of request pipes and
+ * writes of replies as a single batch together with the wait for the next
+ * completions, so that a typical request costs one system call. */
+
+enum uring_op
+{
+    URING_OP_IGNORE,    /* completion is ignored (cancellations, link heads) */
+    URING_OP_POLL,      /* poll on a user fd, with the user index and arm sequence */
+    URING_OP_READ,      /* read ahead on a user fd, points to a struct uring_read */
+    URING_OP_WRITE      /* queued write, points to a struct uring_write */
+};
+#define URING_OP_MASK 3
+
+struct uring_read
+{
+    int                user;       /* poll user owning this buffer, -1 once detached */
+    int                error;      /* errno of the failed read, 0 if none */
+    int                eof;        /* end of file has been reached */
+    unsigned int       pos;        /* position of the next byte to return */
+    unsigned int       len;        /* length of the data in the buffer */
+    char               data[4096];
+};
+
+struct uring_write
+{
+    struct fd         *fd;         /* fd being written to */
+    struct object     *user;       /* fd user, notified if the write fails */
+    void             (*error)( struct object *user, int err );  /* failure callback */
+    struct iovec       iov[2];     /* data remaining to write */
+    void              *data;       /* variable-size data, freed once written */
+    char               header[1];  /* copy of the fixed-size header */
+};
+
+struct uring_user
+{
+    unsigned int       seq;        /* arm sequence of the current poll */
+    int                events;     /* events currently armed, -1 if none */
+    int                dirty;      /* needs to be re-armed before waiting */
+    int                reading;    /* the read ahead request is in flight */
+    struct uring_read *read;       /* read ahead buffer, NULL if not used */
+};
+
+static int uring_fd = -1;
+static unsigned int *uring_sq_head, *uring_sq_tail, *uring_sq_mask, *uring_sq_array;
+static unsigned int *uring_cq_head, *uring_cq_tail, *uring_cq_mask;
+static unsigned int uring_sq_entries, uring_sq_local_tail;
+static struct io_uring_sqe *uring_sqes;
+static struct io_uring_cqe *uring_cqes;
+static struct uring_user *uring_users;  /* per-user state, same indices as pollfd */
+static int *uring_dirty;                /* users whose state must be updated before waiting */
+static int *uring_ready;                /* users with events to process */
+static int uring_nb_dirty;
+static int uring_allocated;
+static struct io_uring_cqe *uring_pending;  /* completions reaped but not processed yet */
+static unsigned int uring_nb_pending, uring_pending_size;
+static unsigned int uring_nb_writes;        /* queued writes that haven't completed */
+
+static inline int init_uring(void)
+{
+    struct io_uring_params params;
+    const char *env = getenv( "WINESERVER_IO_URING" );
+    const unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                                  IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    size_t sq_size, cq_size;
+    char *ring;
+    int fd;
+
+    if (!env || !atoi( env )) return 0;
+
+    memset( &params, 0, sizeof(params) );
+    params.flags = IORING_SETUP_CQSIZE;
+#ifdef IORING_SETUP_SUBMIT_ALL
+    params.flags |= IORING_SETUP_SUBMIT_ALL;
+#endif
+    params.cq_entries = 4096;
+    if ((fd = syscall( __NR_io_uring_setup, 256, &params )) == -1) return 0;
+    if ((params.features & required) != required) goto failed;
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > sq_size) sq_size = cq_size;
+    ring = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (ring == MAP_FAILED) goto failed;
+    uring_sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (uring_sqes == MAP_FAILED)
+    {
+        munmap( ring, sq_size );
+        goto failed;
+    }
+
+    uring_sq_head  = (unsigned int *)(ring + params.sq_off.head);
+    uring_sq_tail  = (unsigned int *)(ring + params.sq_off.tail);
+    uring_sq_mask  = (unsigned int *)(ring + params.sq_off.ring_mask);
+    uring_sq_array = (unsigned int *)(ring + params.sq_off.array);
+    uring_cq_head  = (unsigned int *)(ring + params.cq_off.head);
+    uring_cq_tail  = (unsigned int *)(ring + params.cq_off.tail);
+    uring_cq_mask  = (unsigned int *)(ring + params.cq_off.ring_mask);
+    uring_cqes     = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    uring_sq_entries = params.sq_entries;
+    uring_sq_local_tail = *uring_sq_tail;
+    uring_fd = fd;
+    return 1;
+
+failed:
+    close( fd );
+    return 0;
+}
+
+/* grow the per-user state to the size of the poll array */
+static int grow_uring_users( int count )
+{
+    struct uring_user *users;
+    int *dirty, *ready;
+
+    if (uring_fd == -1 || count <= uring_allocated) return 1;
+    if (!(users = realloc( uring_users, count * sizeof(*users) ))) return 0;
+    uring_users = users;
+    if (!(dirty = realloc( uring_dirty, count * sizeof(*dirty) ))) return 0;
+    uring_dirty = dirty;
+    if (!(ready = realloc( uring_ready, count * sizeof(*ready) ))) return 0;
+    uring_ready = ready;
+    memset( uring_users + uring_allocated, 0, (count - uring_allocated) * sizeof(*users) );
+    while (uring_allocated < count) uring_users[uring_allocated++].events = -1;
+    return 1;
+}
+
+/* submit the queued entries, and wait for completions if timeout is not 0 */
+static int uring_enter( int timeout )
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int flags = IORING_ENTER_EXT_ARG | IORING_ENTER_GETEVENTS, to_submit;
+    int ret;
+
+    __atomic_store_n( uring_sq_tail, uring_sq_local_tail, __ATOMIC_RELEASE );
+    to_submit = uring_sq_local_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE );
+
+    /* GETEVENTS without waiting still moves overflowed completions back to the ring */
+    memset( &arg, 0, sizeof(arg) );
+    if (timeout > 0)
+    {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000;
+        arg.ts = (UINT_PTR)&ts;
+    }
+    if (!timeout && !to_submit) return 0;
+
+    ret = syscall( __NR_io_uring_enter, uring_fd, to_submit, timeout ? 1 : 0, flags, &arg, sizeof(arg) );
+    if (ret == -1 && errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+        perror( "io_uring_enter" );  /* should not happen */
+    return ret;
+}
+
+/* move the completions from the ring to the pending list, to be processed by the main loop */
+static void uring_reap_cqes(void)
+{
+    unsigned int head = *uring_cq_head, tail = __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE );
+
+    if (uring_nb_pending + (tail - head) > uring_pending_size)
+    {
+        unsigned int size = max( uring_pending_size * 2, uring_nb_pending + (tail - head) );
+        struct io_uring_cqe *pending;
+
+        if (!(pending = realloc( uring_pending, size * sizeof(*pending) ))) fatal_error( "out of memory\n" );
+        uring_pending = pending;
+        uring_pending_size = size;
+    }
+    for ( ; head != tail; head++) uring_pending[uring_nb_pending++] = uring_cqes[head & *uring_cq_mask];
+    __atomic_store_n( uring_cq_head, head, __ATOMIC_RELEASE );
+}
+
+/* get a free submission queue entry */
+static struct io_uring_sqe *uring_get_sqe( UINT64 user_data )
+{
+    struct io_uring_sqe *sqe;
+
+    /* the kernel stops consuming entries while completions are stuck in its overflow
+     * list, so the completion ring has to be emptied before submitting again */
+    while (uring_sq_local_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE ) >= uring_sq_entries)
+    {
+        uring_reap_cqes();
+        uring_enter( 0 );
+    }
+
+    sqe = &uring_sqes[uring_sq_local_tail & *uring_sq_mask];
+    uring_sq_array[uring_sq_local_tail & *uring_sq_mask] = uring_sq_local_tail & *uring_sq_mask;
+    uring_sq_local_tail++;
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+static void uring_queue_poll( int unix_fd, int events, UINT64 user_data, unsigned char flags )
+{
+    struct io_uring_sqe *sqe = uring_get_sqe( user_data );
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = unix_fd;
+    sqe->flags = flags;
+#ifdef WORDS_BIGENDIAN
+    sqe->poll32_events = (events << 16) | ((unsigned int)events >> 16);
+#else
+    sqe->poll32_events = events;
+#endif
+}
+
+static void uring_queue_cancel( UINT64 user_data )
+{
+    struct io_uring_sqe *sqe = uring_get_sqe( URING_OP_IGNORE );
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = user_data;
+}
+
+/* queue a read behind a poll, so that it only runs once data is available */
+static void uring_queue_read( struct fd *fd, struct uring_read *read )
+{
+    struct io_uring_sqe *sqe;
+
+    uring_queue_poll( fd->unix_fd, POLLIN, (UINT_PTR)read | URING_OP_IGNORE,
+                      IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS );
+    sqe = uring_get_sqe( (UINT_PTR)read | URING_OP_READ );
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd->unix_fd;
+    sqe->addr = (UINT_PTR)read->data;
+    sqe->len = sizeof(read->data);
+    read->pos = read->len = 0;
+}
+
+/* queue a write, behind a poll if the previous attempt would have blocked */
+static void uring_queue_write( struct uring_write *write, int wait )
+{
+    struct io_uring_sqe *sqe;
+
+    if (wait) uring_queue_poll( write->fd->unix_fd, POLLOUT, URING_OP_IGNORE,
+                                IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS );
+    sqe = uring_get_sqe( (UINT_PTR)write | URING_OP_WRITE );
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = write->fd->unix_fd;
+    if (write->iov[0].iov_len)
+    {
+        sqe->addr = (UINT_PTR)write->iov;
+        sqe->len = write->iov[1].iov_len ? 2 : 1;
+    }
+    else
+    {
+        sqe->addr = (UINT_PTR)&write->iov[1];
+        sqe->len = 1;
+    }
+}
+
+static void uring_write_done( struct uring_write *write, int res )
+{
+    if (res == -EAGAIN)
+    {
+        uring_queue_write( write, 1 );
+        return;
+    }
+    if (res > 0)
+    {
+        size_t len = min( (size_t)res, write->iov[0].iov_len );
+
+        write->iov[0].iov_base = (char *)write->iov[0].iov_base + len;
+        write->iov[0].iov_len -= len;
+        write->iov[1].iov_base = (char *)write->iov[1].iov_base + (res - len);
+        write->iov[1].iov_len -= res - len;
+        if (write->iov[0].iov_len || write->iov[1].iov_len)
+        {
+            uring_queue_write( write, 0 );
+            return;
+        }
+    }
+    else write->error( write->user, -res );  /* 0 if nothing could be written */
+    release_object( write->fd );
+    release_object( write->user );
+    free( write->data );
+    free( write );
+    uring_nb_writes--;
+}
+
+static inline void mark_uring_user_dirty( int user )
+{
+    if (uring_users[user].dirty) return;
+    uring_users[user].dirty = 1;
+    uring_dirty[uring_nb_dirty++] = user;
+}
+
+/* stop waiting on this fd completely */
+static inline void remove_uring_user( struct fd *fd, int user )
+{
+    struct uring_user *state;
+
+    if (uring_fd == -1) return;
+
+    state = &uring_users[user];
+
+    if (state->events != -1) uring_queue_cancel( ((UINT64)state->seq << 32) | (user << 2) | URING_OP_POLL );
+    state->seq++;
+    state->events = -1;
+    if (state->read)
+    {
+        if (state->reading)
+        {
+            uring_queue_cancel( (UINT_PTR)state->read | URING_OP_IGNORE );
+            state->read->user = -1;  /* freed when the read completes */
+        }
+        else free( state->read );
+        state->read = NULL;
+        state->reading = 0;
+    }
+}
+
+/* set the events that io_uring waits for on this fd; helper for set_fd_events */
+static inline void set_fd_uring_events( struct fd *fd, int user, int events )
+{
+    if (uring_fd == -1) return;
+
+    if (events == -1) remove_uring_user( fd, user );
+    else mark_uring_user_dirty( user );
+}
+
+/* arm polls and reads for the users whose state changed, and return the number
+ * of users that already have data to process */
+static int arm_uring_users(void)
+{
+    int i, user, ready = 0;
+
+    for (i = 0; i < uring_nb_dirty; i++)
+    {
+        struct uring_user *state = &uring_users[(user = uring_dirty[i])];
+        int events = pollfd[user].fd != -1 ? pollfd[user].events : -1;
+
+        state->dirty = 0;
+        if (state->read)
+        {
+            struct uring_read *read = state->read;
+
+            if (events == -1 || !(events & POLLIN) || state->reading) continue;
+            if (read->pos < read->len || read->eof || read->error)
+            {
+                pollfd[user].revents = POLLIN;
+                uring_ready[ready++] = user;
+            }
+            else
+            {
+                uring_queue_read( poll_users[user], read );
+                state->reading = 1;
+            }
+            continue;
+        }
+        if (events == state->events) continue;
+        if (state->events != -1) uring_queue_cancel( ((UINT64)state->seq << 32) | (user << 2) | URING_OP_POLL );
+        state->seq++;
+        state->events = events;
+        if (events != -1)
+            uring_queue_poll( poll_users[user]->unix_fd, events,
+                              ((UINT64)state->seq << 32) | (user << 2) | URING_OP_POLL, 0 );
+    }
+    uring_nb_dirty = 0;
+    return ready;
+}
+
+/* process a completion, and return the user that has an event to process or -1 */
+static int uring_completion( const struct io_uring_cqe *cqe )
+{
+    struct uring_read *read;
+    struct uring_user *state;
+    int user;
+
+    switch (cqe->user_data & URING_OP_MASK)
+    {
+    case URING_OP_POLL:
+        user = (cqe->user_data & 0xffffffff) >> 2;
+        state = &uring_users[user];
+        if (state->seq != cqe->user_data >> 32) return -1;  /* stale */
+        state->events = -1;
+        mark_uring_user_dirty( user );
+        if (cqe->res == -ECANCELED) return -1;
+        pollfd[user].revents |= cqe->res > 0 ? cqe->res : POLLERR;
+        return user;
+
+    case URING_OP_READ:
+        read = (struct uring_read *)(UINT_PTR)(cqe->user_data & ~(UINT64)URING_OP_MASK);
+        if ((user = read->user) == -1)
+        {
+            free( read );
+            return -1;
+        }
+        uring_users[user].reading = 0;
+        mark_uring_user_dirty( user );
+        if (cqe->res > 0) read->len = cqe->res;
+        else if (!cqe->res) read->eof = 1;
+        else if (cqe->res != -EAGAIN && cqe->res != -ECANCELED) read->error = -cqe->res;
+        else return -1;
+        if (!(pollfd[user].events & POLLIN)) return -1;
+        pollfd[user].revents |= POLLIN;
+        return user;
+
+    case URING_OP_WRITE:
+        uring_write_done( (struct uring_write *)(UINT_PTR)(cqe->user_data & ~(UINT64)URING_OP_MASK), cqe->res );
+        return -1;
+    }
+    return -1;
+}
+
+/* process the pending completions, and add the users with events to the ready list */
+static int uring_process_completions( int count )
+{
+    unsigned int i;
+    int user;
+
+    for (i = 0; i < uring_nb_pending; i++)
+    {
+        struct io_uring_cqe cqe = uring_pending[i];  /* processing may reap more completions */
+        if ((user = uring_completion( &cqe )) != -1) uring_ready[count++] = user;
+    }
+    uring_nb_pending = 0;
+    return count;
+}
+
+/* wait for the queued writes to complete, giving up after a second */
+static void uring_flush_writes(void)
+{
+    timeout_t end;
+
+    if (uring_fd == -1) return;
+
+    set_current_time();
+    end = monotonic_time + TICKS_PER_SEC;
+    while (uring_nb_writes && monotonic_time < end)
+    {
+        uring_enter( 100 );
+        set_current_time();
+        uring_reap_cqes();
+        uring_process_completions( 0 );
+    }
+}
+
+static inline void main_loop_uring(void)
+{
+    int i, count, user, timeout;
+
+    if (uring_fd == -1) return;
+
+    while (active_users)
+    {
+        timeout = get_next_timeout();
+
+        if (!active_users) break;  /* last user removed by a timeout */
+
+        /* users with data left over from the previous read are ready right away */
+        if ((count = arm_uring_users()) || uring_nb_pending) timeout = 0;
+
+        uring_enter( timeout );
+        set_current_time();
+        uring_reap_cqes();
+
+        /* put the events into the pollfd array first, like poll does */
+        count = uring_process_completions( count );
+
+        /* read events from the pollfd array, as set_fd_events may modify them */
+        for (i = 0; i < count; i++)
+        {
+            int revents = pollfd[(user = uring_ready[i])].revents;
+
+            if (!revents) continue;
+            pollfd[user].revents = 0;
+            fd_poll_event( poll_users[user], revents );
+            mark_uring_user_dirty( user );  /* read ahead data may have been consumed */
+        }
+    }
+    uring_flush_writes();
+}
+
+#else /* USE_IO_URING */
+
+static inline int init_uring(void) { return 0; }
+static inline int grow_uring_users( int count ) { return 1; }
+static inline void set_fd_uring_events( struct fd *fd, int user, int events ) { }
+static inline void remove_uring_user( struct fd *fd, int user ) { }
+static inline void main_loop_uring(void) { }
+static inline void uring_flush_writes(void) { }
+
+#endif /* USE_IO_URING */
+
 
 /* add a user in the poll array and return its index, or -1 on failure */
 static int add_poll_user( struct fd *fd )
@@ -862,9 +1435,10 @@ static int add_poll_user( struct fd *fd )
             }
             poll_users = newusers;
             pollfd = newpoll;
-            if (!allocated_users) init_epoll();
+            if (!allocated_users && !init_uring()) init_epoll();
             allocated_users = new_count;
         }
+        if (!grow_uring_users( allocated_users )) return -1;
         ret = nb_users++;
     }
     pollfd[ret].fd = -1;
@@ -881,6 +1455,7 @@ static void remove_poll_user( struct fd *fd, int user )
     assert( user >= 0 );
     assert( poll_users[user] == fd );
 
+    remove_uring_user( fd, user );
     remove_epoll_user( fd, user );
     pollfd[user].fd = -1;
     pollfd[user].events = 0;
@@ -895,58 +1470,45 @@ static int get_next_timeout(void)
 {
     int ret = user_shared_data ? user_shared_data_timeout : -1;
 
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeouts.count || rel_timeouts.count)
     {
+        struct timeout_user *timeout;
         struct list expired_list, *ptr;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heaps */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
+        while ((timeout = timeout_heap_head( &abs_timeouts )) && timeout->when <= current_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &abs_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
+        while ((timeout = timeout_heap_head( &rel_timeouts )) && -timeout->when <= monotonic_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (-timeout->when <= monotonic_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &rel_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
 
         /* now call the callback for all the removed timers */
 
         while ((ptr = list_head( &expired_list )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             list_remove( &timeout->entry );
             timeout->callback( timeout->private );
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if ((timeout = timeout_heap_head( &abs_timeouts )))
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             timeout_t diff = (timeout->when - current_time + 9999) / 10000;
             if (diff > INT_MAX) diff = INT_MAX;
             else if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if ((timeout = timeout_heap_head( &rel_timeouts )))
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             timeout_t diff = (-timeout->when - monotonic_time + 9999) / 10000;
             if (diff > INT_MAX) diff = INT_MAX;
             else if (diff < 0) diff = 0;
@@ -964,6 +1526,7 @@ void main_loop(void)
     set_current_time();
     server_start_time = current_time;
 
+    main_loop_uring();
     main_loop_epoll();
     /* fall through to normal poll loop */
 
@@ -1637,6 +2200,7 @@ void set_fd_events( struct fd *fd, int events )
     int user = fd->poll_index;
     assert( poll_users[user] == fd );
 
+    set_fd_uring_events( fd, user, events );
     set_fd_epoll_events( fd, user, events );
 
     if (events == -1)  /* stop waiting on this fd completely */
@@ -1652,6 +2216,99 @@ void set_fd_events( struct fd *fd, int events )
     }
 }
 
+/* let the main loop read ahead the data of an fd that is only read with read_fd_data */
+void enable_fd_read_ahead( struct fd *fd )
+{
+#ifdef USE_IO_URING
+    struct uring_user *state;
+    struct uring_read *ahead;
+
+    if (uring_fd == -1 || fd->poll_index == -1) return;
+    state = &uring_users[fd->poll_index];
+    if (state->read || !(ahead = malloc( sizeof(*ahead) ))) return;
+
+    memset( ahead, 0, offsetof( struct uring_read, data ));
+    ahead->user = fd->poll_index;
+    if (state->events != -1)
+        uring_queue_cancel( ((UINT64)state->seq << 32) | (fd->poll_index << 2) | URING_OP_POLL );
+    state->seq++;
+    state->events = -1;
+    state->read = ahead;
+    mark_uring_user_dirty( fd->poll_index );
+#endif
+}
+
+/* read data from an fd, starting with the data read ahead by the main loop */
+int read_fd_data( struct fd *fd, void *buffer, size_t size )
+{
+#ifdef USE_IO_URING
+    struct uring_read *ahead;
+
+    if (uring_fd != -1 && fd->poll_index != -1 && (ahead = uring_users[fd->poll_index].read))
+    {
+        size_t len = min( size, ahead->len - ahead->pos );
+        int ret;
+
+        if (uring_users[fd->poll_index].reading)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (!len && ahead->error)
+        {
+            errno = ahead->error;
+            ahead->error = 0;
+            return -1;
+        }
+        if (!len && ahead->eof) return 0;
+        if (len)
+        {
+            memcpy( buffer, ahead->data + ahead->pos, len );
+            ahead->pos += len;
+            if (len == size || ahead->eof) return len;
+            if ((ret = read( fd->unix_fd, (char *)buffer + len, size - len )) > 0) len += ret;
+            return len;
+        }
+    }
+#endif
+    return read( fd->unix_fd, buffer, size );
+}
+
+/* queue a write of a header and data through the main loop, taking ownership of the data */
+/* error is called with the errno, or 0 if the fd accepted no data, if the write fails */
+/* returns 0 if the caller has to write them itself */
+int queue_fd_write( struct fd *fd, const void *header, data_size_t header_size, void *data, data_size_t size,
+                    void (*error)( struct object *user, int err ) )
+{
+#ifdef USE_IO_URING
+    struct uring_write *write;
+
+    if (uring_fd == -1 || fd->unix_fd == -1) return 0;
+    if (!(write = malloc( offsetof( struct uring_write, header[header_size] )))) return 0;
+
+    write->fd = (struct fd *)grab_object( fd );
+    write->user = grab_object( fd->user );
+    write->error = error;
+    write->data = data;
+    memcpy( write->header, header, header_size );
+    write->iov[0].iov_base = write->header;
+    write->iov[0].iov_len  = header_size;
+    write->iov[1].iov_base = data;
+    write->iov[1].iov_len  = size;
+    uring_queue_write( write, 0 );
+    uring_nb_writes++;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* write out the queued replies before the server exits */
+void flush_fd_writes(void)
+{
+    uring_flush_writes();
+}
+
 /* prepare an fd for unmounting its corresponding device */
 static inline void unmount_fd( struct fd *fd )
 {
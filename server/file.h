@@ -102,6 +102,11 @@ extern int is_same_file_fd( struct fd *fd1, struct fd *fd2 );
 extern int is_fd_removable( struct fd *fd );
 extern int check_fd_events( struct fd *fd, int events );
 extern void set_fd_events( struct fd *fd, int events );
+extern void enable_fd_read_ahead( struct fd *fd );
+extern int read_fd_data( struct fd *fd, void *buffer, size_t size );
+extern int queue_fd_write( struct fd *fd, const void *header, data_size_t header_size,
+                           void *data, data_size_t size, void (*error)( struct object *user, int err ) );
+extern void flush_fd_writes(void);
 extern obj_handle_t lock_fd( struct fd *fd, file_pos_t offset, file_pos_t count, int shared, int wait );
 extern void unlock_fd( struct fd *fd, file_pos_t offset, file_pos_t count );
 extern void allow_fd_caching( struct fd *fd );
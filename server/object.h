@@ -247,6 +247,8 @@ extern unsigned short supported_machines[8];
 extern unsigned short native_machine;
 extern void init_registry(void);
 extern void flush_registry(void);
+extern struct object *create_registry_cache_mapping( struct object *root, const struct unicode_str *name,
+                                                     unsigned int attr, const struct security_descriptor *sd );
 
 static inline int is_machine_32bit( unsigned short machine )
 {
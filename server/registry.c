@@ -74,6 +74,16 @@ struct type_descr key_type =
     },
 };
 
+/* hash index over the subkeys or values of a large key */
+struct name_index
+{
+    int              *buckets;     /* first entry of each hash bucket, -1 if empty */
+    int              *next;        /* next entry in the same bucket, indexed like the array */
+    unsigned int      hash_size;   /* number of hash buckets */
+    int               nb_next;     /* count of allocated entries in the next array */
+    int               sorted;      /* number of entries at the start of the array that are sorted */
+};
+
 /* a registry key */
 struct key
 {
@@ -83,14 +93,18 @@ struct key
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    struct name_index *subkey_index; /* hash index of the subkeys, NULL if not indexed */
     struct key       *wow6432node; /* Wow6432Node subkey */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
+    struct name_index *value_index; /* hash index of the values, NULL if not indexed */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
     abstime_t         timestamp_counter; /* timestamp counter at last change */
+    int               cache_slot;  /* slot in the shared registry cache, -1 if not cached */
+    unsigned int      query_count; /* number of value queries since last change */
 };
 
 /* key flags */
@@ -101,6 +115,7 @@ struct key
 #define KEY_WOWREFLECT 0x0010  /* key is a Wow64 shared and reflected key (used for Software\Classes) */
 #define KEY_PREDEF   0x0020  /* key is marked as predefined */
 #define KEY_WOWSHARE 0x0040  /* key is Wow64 shared */
+#define KEY_CHANGED  0x0080  /* key itself has been modified since it was last saved */
 
 #define OBJ_KEY_WOW64 0x100000 /* magic flag added to attributes for WoW64 redirection */
 
@@ -116,12 +131,23 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_HASH_INDEX 256  /* default min. number of subkeys or values before a key gets a hash index */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
 
+#define CACHE_QUERY_THRESHOLD 16  /* number of value queries before a key is published in the cache */
+
+static int min_hash_index = MIN_HASH_INDEX;  /* can be overridden with WINESERVER_REGISTRY_INDEX */
+
 static abstime_t change_timestamp_counter;
 
+/* shared memory cache of frequently queried keys */
+static struct registry_cache_slot *registry_cache;
+static struct key *cache_keys[REGISTRY_CACHE_SLOTS];
+static unsigned int cache_next_slot;
+static unsigned int cache_serial;
+
 /* the root of the registry tree */
 static struct key *root_key;
 
@@ -139,9 +165,13 @@ struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    int          full_save;  /* keys have been deleted or renamed, the journal can't be used */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
+
+/* marks the end of each complete set of journal entries */
+#define JOURNAL_COMMIT ";; commit\n"
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
 
@@ -159,6 +189,7 @@ struct file_load_info
     int         line;     /* current input line */
     WCHAR      *tmp;      /* temp buffer to use while parsing input */
     size_t      tmplen;   /* length of temp buffer */
+    long        end;      /* end of the complete journal entries, -1 if not a journal */
 };
 
 
@@ -288,12 +319,262 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
+/* type-specific accessors for the entries of an array covered by a hash index */
+struct index_type
+{
+    size_t entry_size;
+    void (*get_name)( const void *entry, struct unicode_str *name );
+    int  (*compare)( const void *entry1, const void *entry2 );
+};
+
+#define INDEX_ENTRY(type,array,i) ((char *)(array) + (i) * (type)->entry_size)
+
+static int compare_names( const struct unicode_str *name1, const struct unicode_str *name2 )
+{
+    int res = memicmp_strW( name1->str, name2->str, min( name1->len, name2->len ));
+    if (!res) res = name1->len - name2->len;
+    return res;
+}
+
+static void get_subkey_entry_name( const void *entry, struct unicode_str *name )
+{
+    const struct key *key = *(struct key * const *)entry;
+
+    name->str = key->obj.name->name;
+    name->len = key->obj.name->len;
+}
+
+static int compare_subkey_entries( const void *entry1, const void *entry2 )
+{
+    struct unicode_str name1, name2;
+
+    get_subkey_entry_name( entry1, &name1 );
+    get_subkey_entry_name( entry2, &name2 );
+    return compare_names( &name1, &name2 );
+}
+
+static void get_value_entry_name( const void *entry, struct unicode_str *name )
+{
+    const struct key_value *value = entry;
+
+    name->str = value->name;
+    name->len = value->namelen;
+}
+
+static int compare_value_entries( const void *entry1, const void *entry2 )
+{
+    struct unicode_str name1, name2;
+
+    get_value_entry_name( entry1, &name1 );
+    get_value_entry_name( entry2, &name2 );
+    return compare_names( &name1, &name2 );
+}
+
+static const struct index_type subkey_index_type =
+{
+    sizeof(struct key *),
+    get_subkey_entry_name,
+    compare_subkey_entries
+};
+
+static const struct index_type value_index_type =
+{
+    sizeof(struct key_value),
+    get_value_entry_name,
+    compare_value_entries
+};
+
+/* add an array entry to the hash table of an index */
+static void link_index_entry( struct name_index *index, const struct index_type *type, const void *array, int i )
+{
+    struct unicode_str name;
+    unsigned int hash;
+
+    type->get_name( INDEX_ENTRY( type, array, i ), &name );
+    hash = hash_strW( name.str, name.len, index->hash_size );
+    index->next[i] = index->buckets[hash];
+    index->buckets[hash] = i;
+}
+
+/* rebuild the hash table of an index after the array entries have moved, growing it if possible */
+static void rebuild_name_index( struct name_index *index, const struct index_type *type,
+                                const void *array, int count )
+{
+    unsigned int i, hash_size;
+    int *buckets;
+
+    if (count > index->hash_size)
+    {
+        hash_size = 2 * count;
+        if ((buckets = realloc( index->buckets, hash_size * sizeof(*buckets) )))
+        {
+            index->buckets   = buckets;
+            index->hash_size = hash_size;
+        }
+    }
+    for (i = 0; i < index->hash_size; i++) index->buckets[i] = -1;
+    for (i = 0; i < count; i++) link_index_entry( index, type, array, i );
+}
+
+/* create a hash index over a sorted array */
+static struct name_index *create_name_index( const struct index_type *type, const void *array,
+                                             int count, int nb_entries )
+{
+    struct name_index *index;
+
+    if (!(index = malloc( sizeof(*index) ))) return NULL;
+    index->hash_size = 2 * count;
+    index->nb_next   = nb_entries;
+    index->sorted    = count;
+    index->buckets   = malloc( index->hash_size * sizeof(*index->buckets) );
+    index->next      = malloc( index->nb_next * sizeof(*index->next) );
+    if (!index->buckets || !index->next)
+    {
+        free( index->buckets );
+        free( index->next );
+        free( index );
+        return NULL;
+    }
+    rebuild_name_index( index, type, array, count );
+    return index;
+}
+
+static void free_name_index( struct name_index *index )
+{
+    if (!index) return;
+    free( index->buckets );
+    free( index->next );
+    free( index );
+}
+
+/* make room in an index for the given number of array entries */
+static int grow_name_index( struct name_index *index, int nb_entries )
+{
+    int *next;
+
+    if (!(next = realloc( index->next, nb_entries * sizeof(*next) )))
+    {
+        set_error( STATUS_NO_MEMORY );
+        return 0;
+    }
+    index->next    = next;
+    index->nb_next = nb_entries;
+    return 1;
+}
+
+/* find an entry by name in an index; return its position in the array or -1 */
+static int find_index_entry( const struct name_index *index, const struct index_type *type,
+                             const void *array, const struct unicode_str *name )
+{
+    struct unicode_str entry_name;
+    int i;
+
+    for (i = index->buckets[hash_strW( name->str, name->len, index->hash_size )]; i != -1; i = index->next[i])
+    {
+        type->get_name( INDEX_ENTRY( type, array, i ), &entry_name );
+        if (entry_name.len == name->len && !memicmp_strW( entry_name.str, name->str, name->len )) return i;
+    }
+    return -1;
+}
+
+/* add the entry that has just been appended to an indexed array */
+static void add_index_entry( struct name_index *index, const struct index_type *type, const void *array, int count )
+{
+    int i = count - 1;
+
+    if (count > 2 * index->hash_size) rebuild_name_index( index, type, array, count );
+    else link_index_entry( index, type, array, i );
+
+    /* the array stays sorted as long as entries are appended in order, e.g. when loading a file */
+    if (index->sorted == i &&
+        (!i || type->compare( INDEX_ENTRY( type, array, i - 1 ), INDEX_ENTRY( type, array, i )) < 0))
+        index->sorted++;
+}
+
+/* update an index after the entry at position i has been removed from the array */
+static void remove_index_entry( struct name_index *index, const struct index_type *type, const void *array,
+                                int count, int i, const struct unicode_str *name )
+{
+    unsigned int j;
+    int *ptr;
+
+    if (i < index->sorted) index->sorted--;
+    ptr = &index->buckets[hash_strW( name->str, name->len, index->hash_size )];
+    while (*ptr != i) ptr = &index->next[*ptr];
+    *ptr = index->next[i];
+    if (i == count) return;
+
+    /* the following entries have moved down like the array itself, renumber them without rehashing */
+    memmove( index->next + i, index->next + i + 1, (count - i) * sizeof(*index->next) );
+    for (j = 0; j < index->hash_size; j++) if (index->buckets[j] > i) index->buckets[j]--;
+    for (j = 0; j < count; j++) if (index->next[j] > i) index->next[j]--;
+}
+
+/* sort the entries that have been appended to an indexed array since it was last sorted */
+static void sort_index_entries( struct name_index *index, const struct index_type *type, void *array, int count )
+{
+    size_t size = type->entry_size;
+    int i, j, k, sorted = index->sorted;
+    char *tail;
+
+    if (sorted >= count) return;
+
+    qsort( INDEX_ENTRY( type, array, sorted ), count - sorted, size, type->compare );
+    if (sorted && type->compare( INDEX_ENTRY( type, array, sorted - 1 ), INDEX_ENTRY( type, array, sorted )) > 0)
+    {
+        if ((tail = malloc( (count - sorted) * size )))
+        {
+            /* merge the tail into the sorted part, starting from the end */
+            memcpy( tail, INDEX_ENTRY( type, array, sorted ), (count - sorted) * size );
+            i = sorted - 1;
+            j = count - sorted - 1;
+            k = count - 1;
+            while (j >= 0)
+            {
+                if (i >= 0 && type->compare( INDEX_ENTRY( type, array, i ), tail + j * size ) > 0)
+                    memcpy( INDEX_ENTRY( type, array, k-- ), INDEX_ENTRY( type, array, i-- ), size );
+                else
+                    memcpy( INDEX_ENTRY( type, array, k-- ), tail + j-- * size, size );
+            }
+            free( tail );
+        }
+        else qsort( array, count, size, type->compare );
+    }
+    index->sorted = count;
+    rebuild_name_index( index, type, array, count );
+}
+
+/* make sure the subkeys of a key are in sorted order */
+static void sort_subkeys( struct key *key )
+{
+    if (key->subkey_index)
+        sort_index_entries( key->subkey_index, &subkey_index_type, key->subkeys, key->last_subkey + 1 );
+}
+
+/* make sure the values of a key are in sorted order */
+static void sort_values( struct key *key )
+{
+    if (key->value_index)
+        sort_index_entries( key->value_index, &value_index_type, key->values, key->last_value + 1 );
+}
+
 /* find the named child of a given key and return its index */
 static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    if (key->subkey_index)
+    {
+        if ((i = find_index_entry( key->subkey_index, &subkey_index_type, key->subkeys, name )) == -1)
+        {
+            *index = key->last_subkey + 1;  /* indexed arrays are sorted lazily, append it */
+            return NULL;
+        }
+        *index = i;
+        return key->subkeys[i];
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -323,6 +604,7 @@ static int grow_subkeys( struct key *key )
     if (key->nb_subkeys)
     {
         nb_subkeys = key->nb_subkeys + (key->nb_subkeys / 2);  /* grow by 50% */
+        if (key->subkey_index && !grow_name_index( key->subkey_index, nb_subkeys )) return 0;
         if (!(new_subkeys = realloc( key->subkeys, nb_subkeys * sizeof(*new_subkeys) )))
         {
             set_error( STATUS_NO_MEMORY );
@@ -339,8 +621,108 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* remove a key from the shared registry cache */
+static void invalidate_cached_key( struct key *key )
+{
+    struct registry_cache_slot *slot;
+
+    key->query_count = 0;
+    if (key->cache_slot == -1) return;
+
+    slot = &registry_cache[key->cache_slot];
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+    slot->serial = 0;
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+
+    cache_keys[key->cache_slot] = NULL;
+    key->cache_slot = -1;
+}
+
+/* give a cached key a new serial number, so that clients stop using their cached handles to it */
+static void renew_cached_key_serial( struct key *key )
+{
+    struct registry_cache_slot *slot;
+
+    if (key->cache_slot == -1) return;
+    if (!++cache_serial) ++cache_serial;
+
+    slot = &registry_cache[key->cache_slot];
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+    slot->serial = cache_serial;
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+}
+
+/* publish the values of a frequently queried key in the shared registry cache */
+static void publish_cached_key( struct key *key )
+{
+    struct registry_cache_slot *slot;
+    struct registry_cache_value *cached;
+    data_size_t size = 0;
+    int i, index;
+    char *ptr;
+
+    sort_values( key );
+    for (i = 0; i <= key->last_value; i++)
+    {
+        size += (sizeof(*cached) + key->values[i].namelen + key->values[i].len + 3) & ~3;
+        if (size > REGISTRY_CACHE_DATA_SIZE)
+        {
+            key->query_count = 0;  /* too large, try again later */
+            return;
+        }
+    }
+
+    index = cache_next_slot++ % REGISTRY_CACHE_SLOTS;
+    if (cache_keys[index]) invalidate_cached_key( cache_keys[index] );
+    if (!++cache_serial) ++cache_serial;
+
+    slot = &registry_cache[index];
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+    for (i = 0, ptr = slot->data; i <= key->last_value; i++)
+    {
+        const struct key_value *value = &key->values[i];
+
+        cached = (struct registry_cache_value *)ptr;
+        cached->type    = value->type;
+        cached->namelen = value->namelen;
+        cached->len     = value->len;
+        ptr = (char *)(cached + 1);
+        memcpy( ptr, value->name, value->namelen );
+        memcpy( ptr + value->namelen, value->data, value->len );
+        ptr += (value->namelen + value->len + 3) & ~3;
+    }
+    slot->count  = key->last_value + 1;
+    slot->size   = size;
+    slot->serial = cache_serial;
+    __atomic_add_fetch( &slot->seq, 1, __ATOMIC_SEQ_CST );
+
+    cache_keys[index] = key;
+    key->cache_slot = index;
+}
+
+/* save a single key with its values to a text file */
+static void save_key( struct key *key, const struct key *base, FILE *f, int replace )
+{
+    int i;
+
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+    if (replace) fputs( "#replace\n", f );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen, f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+    sort_values( key );
+    for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+}
+
 /* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
@@ -348,21 +730,39 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+        save_key( key, base, f, 0 );
+    sort_subkeys( key );
+    for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
+}
+
+/* save the keys modified since the last save to a journal file */
+static void save_changed_subkeys( struct key *key, const struct key *base, FILE *f )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    if (!(key->flags & KEY_DIRTY)) return;
+    if (key->flags & KEY_CHANGED) save_key( key, base, f, 1 );
+    sort_subkeys( key );
+    for (i = 0; i <= key->last_subkey; i++) save_changed_subkeys( key->subkeys[i], base, f );
+}
+
+/* estimate the size of the journal entries for the keys modified since the last save */
+static size_t get_changed_subkeys_size( const struct key *key )
+{
+    size_t size = 0;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return 0;
+    if (!(key->flags & KEY_DIRTY)) return 0;
+    if (key->flags & KEY_CHANGED)
     {
-        fprintf( f, "\n[" );
-        if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen, f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+        size += 64 + MAX_NAME_LEN + key->classlen;
+        for (i = 0; i <= key->last_value; i++)
+            size += 16 + key->values[i].namelen + 3 * key->values[i].len;
     }
-    for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
+    for (i = 0; i <= key->last_subkey; i++) size += get_changed_subkeys_size( key->subkeys[i] );
+    return size;
 }
 
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
@@ -607,6 +1007,14 @@ static int key_link_name( struct object *obj, struct object_name *name, struct o
     for (i = ++parent_key->last_subkey; i > index; i--)
         parent_key->subkeys[i] = parent_key->subkeys[i - 1];
     parent_key->subkeys[index] = (struct key *)grab_object( key );
+    key->obj.name = name;  /* needed by the index, it would be set by our caller anyway */
+    name->obj = obj;
+    if (parent_key->subkey_index)
+        add_index_entry( parent_key->subkey_index, &subkey_index_type, parent_key->subkeys,
+                         parent_key->last_subkey + 1 );
+    else if (parent_key->last_subkey + 1 >= min_hash_index)
+        parent_key->subkey_index = create_name_index( &subkey_index_type, parent_key->subkeys,
+                                                      parent_key->last_subkey + 1, parent_key->nb_subkeys );
     if (!(parent_key->flags & KEY_WOWSHARE) && is_wow6432node( name->name, name->len ) &&
         !is_wow6432node( parent_key->obj.name->name, parent_key->obj.name->len ))
         parent_key->wow6432node = key;
@@ -618,7 +1026,8 @@ static void key_unlink_name( struct object *obj, struct object_name *name )
 {
     struct key *key = (struct key *)obj;
     struct key *parent = (struct key *)name->parent;
-    int i, nb_subkeys;
+    struct unicode_str tmp;
+    int i, index, nb_subkeys;
 
     if (!parent) return;
 
@@ -628,10 +1037,16 @@ static void key_unlink_name( struct object *obj, struct object_name *name )
         return;
     }
 
-    for (i = 0; i <= parent->last_subkey; i++) if (parent->subkeys[i] == key) break;
-    assert( i <= parent->last_subkey );
-    for ( ; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+    tmp.str = name->name;
+    tmp.len = name->len;
+    if (parent->subkey_index) find_subkey( parent, &tmp, &index );
+    else for (index = 0; index <= parent->last_subkey; index++) if (parent->subkeys[index] == key) break;
+    assert( index <= parent->last_subkey && parent->subkeys[index] == key );
+    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
     parent->last_subkey--;
+    if (parent->subkey_index)
+        remove_index_entry( parent->subkey_index, &subkey_index_type, parent->subkeys,
+                            parent->last_subkey + 1, index, &tmp );
     name->parent = NULL;
     if (parent->wow6432node == key) parent->wow6432node = NULL;
     release_object( key );
@@ -655,6 +1070,8 @@ static int key_close_handle( struct object *obj, struct process *process, obj_ha
     struct key * key = (struct key *) obj;
     struct notify *notify = find_notify( key, process, handle );
     if (notify) do_notification( key, notify, 1 );
+    /* the handle value may be reused for another object, whichever way it was closed */
+    renew_cached_key_serial( key );
     return 1;  /* ok to close */
 }
 
@@ -665,6 +1082,7 @@ static void key_destroy( struct object *obj )
     struct key *key = (struct key *)obj;
     assert( obj->ops == &key_ops );
 
+    invalidate_cached_key( key );
     free( key->class );
     for (i = 0; i <= key->last_value; i++)
     {
@@ -672,12 +1090,14 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    free_name_index( key->value_index );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->obj.name->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free_name_index( key->subkey_index );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -706,12 +1126,16 @@ static struct key *create_key_object( struct object *parent, const struct unicod
             key->last_subkey = -1;
             key->nb_subkeys  = 0;
             key->subkeys     = NULL;
+            key->subkey_index = NULL;
             key->wow6432node = NULL;
             key->nb_values   = 0;
             key->last_value  = -1;
             key->values      = NULL;
+            key->value_index = NULL;
             key->modif       = modif;
             key->timestamp_counter = 0;
+            key->cache_slot  = -1;
+            key->query_count = 0;
             list_init( &key->notify_list );
 
             if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
@@ -723,7 +1147,7 @@ static struct key *create_key_object( struct object *parent, const struct unicod
                 release_object( key );
                 return NULL;
             }
-            else key->flags |= KEY_DIRTY;
+            else key->flags |= KEY_DIRTY | KEY_CHANGED;
         }
     }
     return key;
@@ -749,10 +1173,19 @@ static void make_clean( struct key *key, abstime_t timestamp_counter )
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    if (key->timestamp_counter <= timestamp_counter) key->flags &= ~KEY_DIRTY;
+    if (key->timestamp_counter <= timestamp_counter) key->flags &= ~(KEY_DIRTY | KEY_CHANGED);
     for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i], timestamp_counter );
 }
 
+/* keys have been removed from the tree, which can't be recorded in a journal */
+static void require_full_save( const struct key *key )
+{
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    for (i = 0; i < save_branch_count; i++) save_branch_info[i].full_save = 1;
+}
+
 /* go through all the notifications and send them if necessary */
 static void check_notify( struct key *key, unsigned int change, int not_subtree )
 {
@@ -770,6 +1203,7 @@ static void check_notify( struct key *key, unsigned int change, int not_subtree
 static void touch_key( struct key *key, unsigned int change )
 {
     key->modif = current_time;
+    if (!(key->flags & KEY_VOLATILE)) key->flags |= KEY_CHANGED;
     make_dirty( key );
 
     /* do notifications */
@@ -929,6 +1363,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
@@ -1040,24 +1475,40 @@ static void rename_key( struct key *key, const struct unicode_str *new_name )
     new_name_ptr->parent = &parent->obj;
     memcpy( new_name_ptr->name, new_name->str, new_name->len );
 
-    for (cur_index = 0; cur_index <= parent->last_subkey; cur_index++)
-        if (parent->subkeys[cur_index] == key) break;
-
-    if (cur_index < index && (index - cur_index) > 1)
+    if (parent->subkey_index)
     {
-        --index;
+        /* move it to the unsorted part of the array */
+        struct unicode_str old_name = { key->obj.name->name, key->obj.name->len };
+
+        find_subkey( parent, &old_name, &cur_index );
+        index = parent->last_subkey;
         for (i = cur_index; i < index; ++i) parent->subkeys[i] = parent->subkeys[i+1];
+        parent->subkey_index->sorted = min( parent->subkey_index->sorted, cur_index );
     }
-    else if (cur_index > index)
+    else
     {
-        for (i = cur_index; i > index; --i) parent->subkeys[i] = parent->subkeys[i-1];
+        for (cur_index = 0; cur_index <= parent->last_subkey; cur_index++)
+            if (parent->subkeys[cur_index] == key) break;
+
+        if (cur_index < index && (index - cur_index) > 1)
+        {
+            --index;
+            for (i = cur_index; i < index; ++i) parent->subkeys[i] = parent->subkeys[i+1];
+        }
+        else if (cur_index > index)
+        {
+            for (i = cur_index; i > index; --i) parent->subkeys[i] = parent->subkeys[i-1];
+        }
     }
     parent->subkeys[index] = key;
 
     free( key->obj.name );
     key->obj.name = new_name_ptr;
+    if (parent->subkey_index)
+        rebuild_name_index( parent->subkey_index, &subkey_index_type, parent->subkeys, parent->last_subkey + 1 );
 
     if (debug_level > 1) dump_operation( key, NULL, "Rename" );
+    require_full_save( key );
     touch_key( key, REG_NOTIFY_CHANGE_NAME );
 }
 
@@ -1091,6 +1542,8 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    invalidate_cached_key( key );
+    require_full_save( key );
     key->flags |= KEY_DELETED;
     unlink_named_object( &key->obj );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
@@ -1106,6 +1559,7 @@ static int grow_values( struct key *key )
     if (key->nb_values)
     {
         nb_values = key->nb_values + (key->nb_values / 2);  /* grow by 50% */
+        if (key->value_index && !grow_name_index( key->value_index, nb_values )) return 0;
         if (!(new_val = realloc( key->values, nb_values * sizeof(*new_val) )))
         {
             set_error( STATUS_NO_MEMORY );
@@ -1128,6 +1582,17 @@ static struct key_value *find_value( const struct key *key, const struct unicode
     int i, min, max, res;
     data_size_t len;
 
+    if (key->value_index)
+    {
+        if ((i = find_index_entry( key->value_index, &value_index_type, key->values, name )) == -1)
+        {
+            *index = key->last_value + 1;  /* indexed arrays are sorted lazily, append it */
+            return NULL;
+        }
+        *index = i;
+        return &key->values[i];
+    }
+
     min = 0;
     max = key->last_value;
     while (min <= max)
@@ -1171,6 +1636,11 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     value->namelen = name->len;
     value->len     = 0;
     value->data    = NULL;
+    if (key->value_index)
+        add_index_entry( key->value_index, &value_index_type, key->values, key->last_value + 1 );
+    else if (key->last_value + 1 >= min_hash_index)
+        key->value_index = create_name_index( &value_index_type, key->values,
+                                              key->last_value + 1, key->nb_values );
     return value;
 }
 
@@ -1224,6 +1694,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->type  = type;
     value->len   = len;
     value->data  = ptr;
+    invalidate_cached_key( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
@@ -1271,6 +1742,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         void *data;
         data_size_t namelen, maxlen;
 
+        sort_values( key );
         value = &key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
@@ -1333,6 +1805,9 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     free( value->data );
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
+    if (key->value_index)
+        remove_index_entry( key->value_index, &value_index_type, key->values, key->last_value + 1, index, name );
+    invalidate_cached_key( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
     /* try to shrink the array */
@@ -1504,6 +1979,29 @@ static void update_key_time( struct key *key, timeout_t modif )
 }
 
 /* load a global option from the input file */
+/* find the end of the last complete entry of a journal, starting from the current position */
+static long get_journal_end( FILE *f )
+{
+    long pos = ftell( f ), end = pos;
+    int c, len = 0;  /* matched length of the commit marker, -1 if the line doesn't match */
+
+    while ((c = getc( f )) != EOF)
+    {
+        if (len != -1 && c == JOURNAL_COMMIT[len])
+        {
+            if (c != '\n') len++;
+            else
+            {
+                end = ftell( f );
+                len = 0;
+            }
+        }
+        else len = (c == '\n') ? 0 : -1;
+    }
+    fseek( f, pos, SEEK_SET );
+    return end;
+}
+
 static int load_global_option( const char *buffer, struct file_load_info *info )
 {
     const char *p;
@@ -1528,6 +2026,8 @@ static int load_global_option( const char *buffer, struct file_load_info *info )
             return 0;
         }
     }
+    /* journal file, ignore the last entry if it was only partially written */
+    if (!strncmp( buffer, "#base=", 6 )) info->end = get_journal_end( info->file );
     /* ignore unknown options */
     return 1;
 }
@@ -1562,6 +2062,20 @@ static int load_key_option( struct key *key, const char *buffer, struct file_loa
         key->classlen = len;
     }
     if (!strncmp( buffer, "#link", 5 )) key->flags |= KEY_SYMLINK;
+    if (!strncmp( buffer, "#replace", 8 ))  /* journal entry, the values that follow replace all existing ones */
+    {
+        int i;
+
+        invalidate_cached_key( key );
+        for (i = 0; i <= key->last_value; i++)
+        {
+            free( key->values[i].name );
+            free( key->values[i].data );
+        }
+        key->last_value = -1;
+        free_name_index( key->value_index );
+        key->value_index = NULL;
+    }
     /* ignore unknown options */
     return 1;
 }
@@ -1615,6 +2129,7 @@ static struct key_value *parse_value_name( struct key *key, const char *buffer,
     if (buffer[*len] != '=') goto error;
     (*len)++;
     while (isspace(buffer[*len])) (*len)++;
+    invalidate_cached_key( key );
     if (!(value = find_value( key, &name, &index ))) value = insert_value( key, &name, index );
     return value;
 
@@ -1732,6 +2247,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
     info.len    = 4;
     info.tmplen = 4;
     info.line   = 0;
+    info.end    = -1;
     if (!(info.buffer = mem_alloc( info.len ))) return;
     if (!(info.tmp = mem_alloc( info.tmplen )))
     {
@@ -1746,7 +2262,7 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
         goto done;
     }
 
-    while (read_next_line( &info ) == 1)
+    while ((info.end == -1 || ftell( f ) < info.end) && read_next_line( &info ) == 1)
     {
         p = info.buffer;
         while (*p && isspace(*p)) p++;
@@ -1811,6 +2327,161 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* get the name of the journal file of a registry branch, or of its previous generation */
+static char *get_journal_name( const char *path, int old )
+{
+    char *ret = mem_alloc( strlen( path ) + sizeof(".log.old") );
+
+    if (ret) sprintf( ret, old ? "%s.log.old" : "%s.log", path );
+    return ret;
+}
+
+/* format the identity of a registry file, used to check that a journal applies to it */
+static int get_file_identity( const char *path, char *buffer, size_t size, off_t *file_size )
+{
+    struct stat st;
+    unsigned long nsec = 0;
+
+    if (stat( path, &st )) return 0;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    nsec = st.st_mtim.tv_nsec;
+#endif
+    snprintf( buffer, size, "#base=%lx:%lx:%lx:%lx.%lx", (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+              (unsigned long)st.st_size, (unsigned long)st.st_mtime, nsec );
+    if (file_size) *file_size = st.st_size;
+    return 1;
+}
+
+/* open a journal and read the identity of the registry file it was written for */
+static FILE *read_journal_header( const char *journal, const char *mode, char *identity, size_t size )
+{
+    char buffer[128];
+    size_t len;
+    FILE *f;
+
+    if (!(f = fopen( journal, mode ))) return NULL;
+
+    if (fgets( buffer, sizeof(buffer), f ) && !strcmp( buffer, "WINE REGISTRY Version 2\n" ) &&
+        fgets( identity, size, f ) && (len = strlen( identity )) && identity[len - 1] == '\n')
+    {
+        identity[len - 1] = 0;
+        return f;
+    }
+
+    fclose( f );
+    return NULL;
+}
+
+/* open the journal of a registry file, if it applies to the current version of that file */
+static FILE *open_journal( const char *path, const char *journal, const char *mode )
+{
+    char identity[128], buffer[128];
+    FILE *f;
+
+    if (!get_file_identity( path, identity, sizeof(identity), NULL )) return NULL;
+    if (!(f = read_journal_header( journal, mode, buffer, sizeof(buffer) ))) return NULL;
+    if (!strcmp( buffer, identity )) return f;
+
+    fclose( f );
+    return NULL;
+}
+
+/* append the entries of a journal, from the current position up to end, to another file */
+static int copy_journal_entries( FILE *src, FILE *dst, long end )
+{
+    char buffer[4096];
+    long pos = ftell( src );
+    size_t len;
+
+    while (pos < end)
+    {
+        len = min( sizeof(buffer), end - pos );
+        if (fread( buffer, 1, len, src ) != len) return 0;
+        if (fwrite( buffer, 1, len, dst ) != len) return 0;
+        pos += len;
+    }
+    return 1;
+}
+
+/* rewrite a journal so that it applies to the current version of the registry file,
+ * after the file has been rewritten from a snapshot that doesn't contain its entries */
+static int restamp_journal( const char *path, const char *journal )
+{
+    char identity[128], buffer[128], *tmp;
+    FILE *f, *new_f;
+    int ret = 0;
+
+    if (!(f = read_journal_header( journal, "r", buffer, sizeof(buffer) )))
+        return access( journal, F_OK ) != 0;  /* nothing to do without a journal */
+    if (!get_file_identity( path, identity, sizeof(identity), NULL )) goto done;
+    if (!(tmp = mem_alloc( strlen( journal ) + sizeof(".tmp") ))) goto done;
+    sprintf( tmp, "%s.tmp", journal );
+
+    if ((new_f = fopen( tmp, "w" )))
+    {
+        fprintf( new_f, "WINE REGISTRY Version 2\n%s\n", identity );
+        ret = copy_journal_entries( f, new_f, get_journal_end( f ));
+        if (fclose( new_f )) ret = 0;
+        if (ret) ret = !rename( tmp, journal );
+        if (!ret) unlink( tmp );
+    }
+    free( tmp );
+
+done:
+    fclose( f );
+    return ret;
+}
+
+/* replay a journal opened with open_journal, and drop a partially written last entry */
+static void replay_journal( const char *journal, FILE *f, struct key *key )
+{
+    long end = get_journal_end( f );
+
+    rewind( f );
+    load_keys( key, journal, f, 0 );
+    if (!fseek( f, 0, SEEK_END ) && ftell( f ) > end) ftruncate( fileno( f ), end );
+}
+
+/* replay the journals of a registry file on top of the keys loaded from it */
+static void load_journal( const char *filename, struct key *key )
+{
+    char *journal, *old_journal, buffer[128];
+    int rotated = 0;
+    FILE *f;
+
+    if (!(journal = get_journal_name( filename, 0 ))) return;
+    if (!(old_journal = get_journal_name( filename, 1 )))
+    {
+        free( journal );
+        return;
+    }
+
+    /* the previous generation is still there if the file was being written out by a client */
+    if ((f = open_journal( filename, old_journal, "r+" )))
+    {
+        replay_journal( old_journal, f, key );
+        fclose( f );
+    }
+    else if (!access( old_journal, F_OK ))
+    {
+        /* the file has been rewritten from the snapshot, but the newer journal wasn't updated for it */
+        rotated = 1;
+    }
+
+    if ((f = open_journal( filename, journal, "r+" )) ||
+        (rotated && (f = read_journal_header( journal, "r+", buffer, sizeof(buffer) ))))
+    {
+        replay_journal( journal, f, key );
+        fclose( f );
+        if (rotated && !restamp_journal( filename, journal )) unlink( journal );
+    }
+    else unlink( journal );  /* stale journal, the file has been rewritten since */
+
+    if (rotated) unlink( old_journal );
+    free( old_journal );
+    free( journal );
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
@@ -1825,11 +2496,13 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        load_journal( filename, key );
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
     save_branch_info[save_branch_count].path = filename;
+    save_branch_info[save_branch_count].full_save = 0;
     save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
     make_object_permanent( &key->obj );
     return (f != NULL);
@@ -1910,6 +2583,13 @@ void init_registry(void)
     unsigned int i;
     char *p;
 
+    /* a threshold of 0 disables the hash index */
+    if ((p = getenv( "WINESERVER_REGISTRY_INDEX" )))
+    {
+        min_hash_index = atoi( p );
+        if (min_hash_index <= 0) min_hash_index = INT_MAX;
+    }
+
     /* switch to the config dir */
 
     if (fchdir( config_dir_fd ) == -1) fatal_error( "chdir to config dir: %s\n", strerror( errno ));
@@ -2008,6 +2688,14 @@ void init_registry(void)
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
 
+/* create the shared memory mapping used for the registry cache */
+struct object *create_registry_cache_mapping( struct object *root, const struct unicode_str *name,
+                                              unsigned int attr, const struct security_descriptor *sd )
+{
+    return create_shared_mapping( root, name, REGISTRY_CACHE_SLOTS * sizeof(*registry_cache),
+                                  attr, sd, (void **)&registry_cache );
+}
+
 /* save a registry branch to a file */
 static void save_all_subkeys( struct key *key, FILE *f )
 {
@@ -2053,13 +2741,15 @@ static data_size_t serialize_value( const struct key_value *value, char *buf )
 }
 
 /* save a registry key with subkeys to a buffer */
-static data_size_t serialize_key( const struct key *key, char *buf )
+static data_size_t serialize_key( struct key *key, char *buf )
 {
     data_size_t size;
     int subkey_count, i;
 
     if (key->flags & KEY_VOLATILE) return 0;
 
+    sort_values( key );
+    sort_subkeys( key );
     size = sizeof(data_size_t) + key->obj.name->len + sizeof(data_size_t) + key->classlen + sizeof(int) + sizeof(int)
            + sizeof(unsigned int) + sizeof(timeout_t);
     for (i = 0; i <= key->last_value; i++)
@@ -2098,7 +2788,7 @@ static data_size_t serialize_key( const struct key *key, char *buf )
 }
 
 /* save registry branch to buffer */
-static data_size_t save_registry( const struct key *key, char *buf )
+static data_size_t save_registry( struct key *key, char *buf )
 {
     int *parent_count = NULL;
     const struct key *parent;
@@ -2130,9 +2820,143 @@ static data_size_t save_registry( const struct key *key, char *buf )
     return size;
 }
 
+/* check whether the journal of a branch has been rotated for a client flush that isn't done yet;
+ * the newer generation may then apply to the file being written by the client */
+static int is_journal_rotated( const struct save_branch_info *info )
+{
+    char *old_journal;
+    int ret;
+
+    if (!(old_journal = get_journal_name( info->path, 1 ))) return 0;
+    ret = !access( old_journal, F_OK );
+    free( old_journal );
+    return ret;
+}
+
+/* append the keys modified since the last save of a branch to its journal */
+static int save_branch_journal( struct save_branch_info *info )
+{
+    char identity[128], buffer[128], *journal;
+    off_t file_size, journal_size = 0;
+    size_t size;
+    FILE *f;
+    int ret = 0;
+
+    if (info->full_save) return 0;
+    if (!get_file_identity( info->path, identity, sizeof(identity), &file_size )) return 0;
+    if (!(journal = get_journal_name( info->path, 0 ))) return 0;
+
+    size = get_changed_subkeys_size( info->key );
+    if ((f = open_journal( info->path, journal, "r+" )) ||
+        (is_journal_rotated( info ) && (f = read_journal_header( journal, "r+", buffer, sizeof(buffer) ))))
+    {
+        /* append after the last complete entry */
+        journal_size = get_journal_end( f );
+        fseek( f, journal_size, SEEK_SET );
+        ftruncate( fileno( f ), journal_size );
+    }
+    /* rewrite the whole branch instead once the journal gets too large */
+    if (journal_size + size > file_size / 4) goto done;
+
+    if (!f && (f = fopen( journal, "w" ))) fprintf( f, "WINE REGISTRY Version 2\n%s\n", identity );
+    if (!f) goto done;
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", journal );
+        dump_operation( info->key, NULL, "journaling" );
+    }
+
+    save_changed_subkeys( info->key, info->key, f );
+    fputs( JOURNAL_COMMIT, f );
+    ret = !fclose( f );
+    f = NULL;
+    if (ret) make_clean( info->key, change_timestamp_counter );
+
+done:
+    if (f) fclose( f );
+    free( journal );
+    return ret;
+}
+
+/* remove the journals of a branch after the whole branch has been saved by the server */
+static void remove_branch_journal( struct save_branch_info *info )
+{
+    char *journal;
+
+    info->full_save = 0;
+    if ((journal = get_journal_name( info->path, 1 )))
+    {
+        unlink( journal );
+        free( journal );
+    }
+    if ((journal = get_journal_name( info->path, 0 )))
+    {
+        unlink( journal );
+        free( journal );
+    }
+}
+
+/* start a new journal generation for a branch that is about to be written out by a client;
+ * changes journaled from now on are not part of its snapshot and must be kept */
+static void rotate_branch_journal( struct save_branch_info *info )
+{
+    char *journal, *old_journal, buffer[128];
+    FILE *f, *old_f;
+
+    if (!(journal = get_journal_name( info->path, 0 ))) return;
+    if (!(old_journal = get_journal_name( info->path, 1 )))
+    {
+        free( journal );
+        return;
+    }
+
+    if (access( old_journal, F_OK ))
+    {
+        rename( journal, old_journal );
+    }
+    else if ((f = read_journal_header( journal, "r", buffer, sizeof(buffer) )))
+    {
+        /* a previous client flush didn't finish, merge both generations */
+        if ((old_f = fopen( old_journal, "a" )))
+        {
+            if (copy_journal_entries( f, old_f, get_journal_end( f )) && !fclose( old_f )) unlink( journal );
+            else fclose( old_f );
+        }
+        fclose( f );
+    }
+    free( old_journal );
+    free( journal );
+}
+
+/* the branch has been written out by a client, remove the journal generation contained
+ * in its snapshot and make the newer one apply to the new file */
+static void finish_branch_journal( struct save_branch_info *info )
+{
+    char *journal, *old_journal;
+
+    info->full_save = 0;
+    if (!(journal = get_journal_name( info->path, 0 ))) return;
+    if ((old_journal = get_journal_name( info->path, 1 )))
+    {
+        unlink( old_journal );
+        free( old_journal );
+    }
+    if (!restamp_journal( info->path, journal ))
+    {
+        /* the newer changes are only in memory now */
+        unlink( journal );
+        info->full_save = 1;
+        make_dirty( info->key );
+    }
+    free( journal );
+}
+
 /* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+static int save_branch( struct save_branch_info *info )
 {
+    struct key *key = info->key;
+    const char *path = info->path;
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
@@ -2144,6 +2968,8 @@ static int save_branch( struct key *key, const char *path )
         return 1;
     }
 
+    if (save_branch_journal( info )) return 1;
+
     /* test the file type */
 
     if ((fd = open( path, O_WRONLY )) != -1)
@@ -2200,7 +3026,11 @@ static int save_branch( struct key *key, const char *path )
 
 done:
     free( tmp );
-    if (ret) make_clean( key, key->timestamp_counter );
+    if (ret)
+    {
+        make_clean( key, key->timestamp_counter );
+        remove_branch_journal( info );
+    }
     return ret;
 }
 
@@ -2212,7 +3042,7 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        if (!save_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -2337,6 +3167,17 @@ DECL_HANDLER(flush_key)
         find_branches_for_key( key, branches, &branch_count );
     release_object( key );
 
+    /* save small changes to the journal directly, the remaining branches are written by the client */
+    if (branch_count && fchdir( config_dir_fd ) != -1)
+    {
+        for (i = 0; i < branch_count; ++i)
+        {
+            if (!(save_branch_info[branches[i]].key->flags & KEY_DIRTY)) continue;
+            save_branch_journal( &save_branch_info[branches[i]] );
+        }
+        if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    }
+
     reply->timestamp_counter = change_timestamp_counter;
     for (i = 0; i < branch_count; ++i)
     {
@@ -2365,13 +3206,29 @@ DECL_HANDLER(flush_key)
         data += path_len;
         data += save_registry( save_branch_info[branches[i]].key, data );
     }
+
+    /* the journals are part of the snapshot now, newer changes go to a new generation */
+    if (fchdir( config_dir_fd ) == -1) return;
+    for (i = 0; i < branch_count; ++i)
+    {
+        if (!(save_branch_info[branches[i]].key->flags & KEY_DIRTY)) continue;
+        rotate_branch_journal( &save_branch_info[branches[i]] );
+    }
+    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
 
 /* clear dirty state after successful registry branch flush */
 DECL_HANDLER(flush_key_done)
 {
-    if (req->branch < save_branch_count) make_clean( save_branch_info[req->branch].key, req->timestamp_counter );
-    else set_error( STATUS_INVALID_PARAMETER );
+    if (req->branch >= save_branch_count)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    make_clean( save_branch_info[req->branch].key, req->timestamp_counter );
+    if (fchdir( config_dir_fd ) == -1) return;
+    finish_branch_journal( &save_branch_info[req->branch] );
+    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
 
 /* enumerate registry subkeys */
@@ -2417,9 +3274,20 @@ DECL_HANDLER(get_key_value)
     struct unicode_str name = get_req_unicode_str();
 
     reply->total = 0;
+    reply->cache_slot = -1;
     if ((key = get_hkey_obj( req->hkey, KEY_QUERY_VALUE )))
     {
         get_value( key, &name, &reply->type, &reply->total );
+        if (registry_cache && !(key->flags & KEY_PREDEF))
+        {
+            if (key->cache_slot == -1 && ++key->query_count >= CACHE_QUERY_THRESHOLD)
+                publish_cached_key( key );
+            if (key->cache_slot != -1)
+            {
+                reply->cache_slot   = key->cache_slot;
+                reply->cache_serial = registry_cache[key->cache_slot].serial;
+            }
+        }
         release_object( key );
     }
 }
@@ -248,11 +248,32 @@ void write_reply( struct thread *thread )
         fatal_protocol_error( thread, "reply write: %s\n", strerror( errno ));
 }
 
+/* a reply queued through the main loop couldn't be written, fail like send_reply does */
+static void queued_reply_error( struct object *obj, int err )
+{
+    struct thread *thread = (struct thread *)obj;
+
+    if (thread->state == TERMINATED) return;
+    if (!err)
+        fatal_protocol_error( thread, "partial write 0\n" );
+    else if (err == EPIPE)
+        kill_thread( thread, 0 );  /* normal death */
+    else
+        fatal_protocol_error( thread, "reply write: %s\n", strerror( err ));
+}
+
 /* send a reply to the current thread */
 static void send_reply( union generic_reply *reply )
 {
     int ret;
 
+    if (queue_fd_write( current->reply_fd, reply, sizeof(*reply), current->reply_data, current->reply_size,
+                        queued_reply_error ))
+    {
+        current->reply_data = NULL;
+        return;
+    }
+
     if (!current->reply_size)
     {
         if ((ret = write( get_unix_fd( current->reply_fd ),
@@ -290,23 +311,31 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
-/* call a request handler */
-static void call_req_handler( struct thread *thread )
+/* run the handler for the current request */
+static void invoke_req_handler( union generic_reply *reply )
 {
-    union generic_reply reply;
-    enum request req = thread->req.request_header.req;
+    enum request req = current->req.request_header.req;
 
-    current = thread;
     current->reply_size = 0;
     clear_error();
-    memset( &reply, 0, sizeof(reply) );
+    memset( reply, 0, sizeof(*reply) );
 
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
-        req_handlers[req]( &current->req, &reply );
+        req_handlers[req]( &current->req, reply );
     else
         set_error( STATUS_NOT_IMPLEMENTED );
+}
+
+/* call a request handler */
+static void call_req_handler( struct thread *thread )
+{
+    union generic_reply reply;
+    enum request req = thread->req.request_header.req;
+
+    current = thread;
+    invoke_req_handler( &reply );
 
     if (current)
     {
@@ -333,8 +362,8 @@ void read_request( struct thread *thread )
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
+        if ((ret = read_fd_data( thread->request_fd, &thread->req,
+                                 sizeof(thread->req) )) != sizeof(thread->req)) goto error;
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
@@ -352,10 +381,10 @@ void read_request( struct thread *thread )
     /* read the variable sized data */
     for (;;)
     {
-        ret = read( get_unix_fd( thread->request_fd ),
-                    (char *)thread->req_data + thread->req.request_header.request_size
-                      - thread->req_toread,
-                    thread->req_toread );
+        ret = read_fd_data( thread->request_fd,
+                            (char *)thread->req_data + thread->req.request_header.request_size
+                              - thread->req_toread,
+                            thread->req_toread );
         if (ret <= 0) break;
         if (!(thread->req_toread -= ret))
         {
@@ -375,6 +404,92 @@ error:
         fatal_protocol_error( thread, "read: %s\n", strerror( errno ));
 }
 
+/* size of a batched request or reply entry, padded to keep the headers aligned */
+static inline data_size_t batch_entry_size( data_size_t header, data_size_t size )
+{
+    return header + ((size + 7) & ~7);
+}
+
+/* process a batch of independent requests, replying to all of them at once */
+DECL_HANDLER(batch_requests)
+{
+    struct thread *thread = current;
+    union generic_request saved_req = thread->req;
+    void *saved_data = thread->req_data;
+    const char *ptr = get_req_data(), *end = ptr + get_req_data_size();
+    data_size_t out_size = 0, max_size = get_reply_max_size(), pos = 0;
+    union generic_request sub;
+    union generic_reply sub_reply;
+    char *out;
+
+    /* validate the whole batch first so that nothing runs on malformed input */
+    while (ptr < end)
+    {
+        if (end - ptr < sizeof(sub)) goto invalid;
+        memcpy( &sub, ptr, sizeof(sub) );
+        if (sub.request_header.request_size > end - ptr - sizeof(sub)) goto invalid;
+        /* only independent requests that don't wait and don't take a file descriptor from
+         * the client can be batched; file descriptors travel outside of the request data,
+         * get_esync_fd sends one only on success and the client receives these fds in
+         * request order. */
+        switch (sub.request_header.req)
+        {
+        case REQ_close_handle:
+        case REQ_open_key:
+        case REQ_get_key_value:
+        case REQ_enum_key:
+        case REQ_enum_key_value:
+        case REQ_get_object_info:
+        case REQ_get_object_name:
+        case REQ_get_object_type:
+        case REQ_get_esync_fd:
+        case REQ_get_fsync_idx:
+            break;
+        default:
+            goto invalid;  /* these need their own round trip */
+        }
+        if (sub.request_header.reply_size > max_size) goto invalid;
+        out_size += batch_entry_size( sizeof(sub_reply), sub.request_header.reply_size );
+        if (out_size > max_size) goto invalid;
+        ptr += min( batch_entry_size( sizeof(sub), sub.request_header.request_size ), end - ptr );
+    }
+    if (!(out = mem_alloc( out_size ))) return;
+
+    for (ptr = get_req_data(); ptr < end; reply->count++)
+    {
+        memcpy( &thread->req, ptr, sizeof(thread->req) );
+        thread->req_data = (void *)(ptr + sizeof(thread->req));
+        ptr += min( batch_entry_size( sizeof(sub), thread->req.request_header.request_size ), end - ptr );
+
+        invoke_req_handler( &sub_reply );
+        if (!current) break;  /* the thread has been killed */
+
+        sub_reply.reply_header.error = current->error;
+        sub_reply.reply_header.reply_size = current->reply_size;
+        if (debug_level) trace_reply( thread->req.request_header.req, &sub_reply );
+        memcpy( out + pos, &sub_reply, sizeof(sub_reply) );
+        if (current->reply_size) memcpy( out + pos + sizeof(sub_reply), current->reply_data, current->reply_size );
+        pos += batch_entry_size( sizeof(sub_reply), current->reply_size );
+        free( current->reply_data );
+        current->reply_data = NULL;
+        current->reply_size = 0;
+    }
+
+    thread->req = saved_req;
+    thread->req_data = saved_data;
+    if (!current)
+    {
+        free( out );
+        return;
+    }
+    clear_error();
+    set_reply_data_ptr( out, pos );
+    return;
+
+invalid:
+    set_error( STATUS_INVALID_PARAMETER );
+}
+
 /* receive a file descriptor on the process socket */
 int receive_fd( struct process *process )
 {
@@ -939,6 +1054,7 @@ static void close_socket_timeout( void *arg )
 {
     master_timeout = NULL;
     flush_registry();
+    flush_fd_writes();
     if (debug_level) fprintf( stderr, "wineserver: exiting (pid=%ld)\n", (long) getpid() );
 
 #ifdef DEBUG_OBJECTS
@@ -419,6 +419,7 @@ DECL_HANDLER(get_fsync_idx);
 DECL_HANDLER(fsync_msgwait);
 DECL_HANDLER(get_fsync_apc_idx);
 DECL_HANDLER(fsync_free_shm_idx);
+DECL_HANDLER(batch_requests);
 
 #ifdef WANT_REQUEST_HANDLERS
 
@@ -725,6 +726,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_fsync_msgwait,
     (req_handler)req_get_fsync_apc_idx,
     (req_handler)req_fsync_free_shm_idx,
+    (req_handler)req_batch_requests,
 };
 
 C_ASSERT( sizeof(abstime_t) == 8 );
@@ -1316,7 +1318,9 @@ C_ASSERT( FIELD_OFFSET(struct get_key_value_request, hkey) == 12 );
 C_ASSERT( sizeof(struct get_key_value_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, type) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, total) == 12 );
-C_ASSERT( sizeof(struct get_key_value_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, cache_slot) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_key_value_reply, cache_serial) == 20 );
+C_ASSERT( sizeof(struct get_key_value_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, hkey) == 12 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, index) == 16 );
 C_ASSERT( FIELD_OFFSET(struct enum_key_value_request, info_class) == 20 );
@@ -2458,6 +2462,9 @@ C_ASSERT( sizeof(struct get_fsync_apc_idx_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct fsync_free_shm_idx_request, shm_idx) == 12 );
 C_ASSERT( sizeof(struct fsync_free_shm_idx_request) == 16 );
 C_ASSERT( sizeof(struct fsync_free_shm_idx_reply) == 8 );
+C_ASSERT( sizeof(struct batch_requests_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct batch_requests_reply, count) == 8 );
+C_ASSERT( sizeof(struct batch_requests_reply) == 16 );
 
 #endif  /* WANT_REQUEST_HANDLERS */
 
@@ -498,6 +498,7 @@ struct thread *create_thread( int fd, struct process *process, const struct secu
         thread->esync_apc_fd = esync_create_fd( 0, 0 );
     }
 
+    enable_fd_read_ahead( thread->request_fd );
     set_fd_events( thread->request_fd, POLLIN );  /* start listening to events */
     add_process_thread( thread->process, thread );
     return thread;
@@ -2632,6 +2632,8 @@ static void dump_get_key_value_reply( const struct get_key_value_reply *req )
 {
     fprintf( stderr, " type=%d", req->type );
     fprintf( stderr, ", total=%u", req->total );
+    fprintf( stderr, ", cache_slot=%d", req->cache_slot );
+    fprintf( stderr, ", cache_serial=%08x", req->cache_serial );
     dump_varargs_bytes( ", data=", cur_size );
 }
 
@@ -4941,6 +4943,17 @@ static void dump_fsync_free_shm_idx_request( const struct fsync_free_shm_idx_req
     fprintf( stderr, " shm_idx=%08x", req->shm_idx );
 }
 
+static void dump_batch_requests_request( const struct batch_requests_request *req )
+{
+    dump_varargs_bytes( " requests=", cur_size );
+}
+
+static void dump_batch_requests_reply( const struct batch_requests_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    dump_varargs_bytes( ", replies=", cur_size );
+}
+
 static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_new_process_request,
     (dump_func)dump_get_new_process_info_request,
@@ -5242,6 +5255,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_fsync_msgwait_request,
     (dump_func)dump_get_fsync_apc_idx_request,
     (dump_func)dump_fsync_free_shm_idx_request,
+    (dump_func)dump_batch_requests_request,
 };
 
 static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
@@ -5545,6 +5559,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     (dump_func)dump_get_fsync_apc_idx_reply,
     NULL,
+    (dump_func)dump_batch_requests_reply,
 };
 
 static const char * const req_names[REQ_NB_REQUESTS] = {
@@ -5848,6 +5863,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "fsync_msgwait",
     "get_fsync_apc_idx",
     "fsync_free_shm_idx",
+    "batch_requests",
 };
 
 static const struct